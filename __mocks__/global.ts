@@ -7,12 +7,16 @@ declare global {
 
 const MockMqttModule = {
   createMqtt: jest.fn(),
+  createNativeMqtt: jest.fn(),
   removeMqtt: jest.fn(),
   connectMqtt: jest.fn(),
   disconnectMqtt: jest.fn(),
   subscribeMqtt: jest.fn(),
   unsubscribeMqtt: jest.fn(),
   getConnectionStatusMqtt: jest.fn(() => 'connected'),
+  getConnectionStateMqtt: jest.fn(() => undefined),
+  publishMqtt: jest.fn(),
+  publishManyMqtt: jest.fn(),
 };
 
 global.__MqttModuleProxy = {
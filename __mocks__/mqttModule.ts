@@ -8,6 +8,8 @@ jest.mock('../src/Modules/mqttModule.ts', () => {
       subscribeMqtt: jest.fn(),
       unsubscribeMqtt: jest.fn(),
       getConnectionStatusMqtt: jest.fn(() => {}),
+      publishMqtt: jest.fn(),
+      publishManyMqtt: jest.fn(),
     },
   };
 });
@@ -0,0 +1,285 @@
+//
+//  JNIBinding.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jni.h>
+
+#include <cstddef>
+#include <type_traits>
+
+namespace mqtt {
+namespace jni {
+
+/**
+ * A string of fixed length built at compile time; JNI type signatures are concatenated from these.
+ */
+template <size_t N>
+struct FixedString {
+    char chars[N + 1] = {};
+
+    constexpr FixedString() = default;
+    constexpr FixedString(const char (&literal)[N + 1]) {
+        for (size_t i = 0; i < N; i++) {
+            chars[i] = literal[i];
+        }
+    }
+
+    constexpr const char *c_str() const { return chars; }
+    constexpr size_t size() const { return N; }
+
+    template <size_t M>
+    constexpr bool operator==(const char (&other)[M]) const {
+        if (M != N + 1) {
+            return false;
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (chars[i] != other[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <size_t N>
+FixedString(const char (&)[N]) -> FixedString<N - 1>;
+
+template <size_t A, size_t B>
+constexpr FixedString<A + B> operator+(const FixedString<A> &a, const FixedString<B> &b) {
+    FixedString<A + B> result;
+    for (size_t i = 0; i < A; i++) {
+        result.chars[i] = a.chars[i];
+    }
+    for (size_t i = 0; i < B; i++) {
+        result.chars[A + i] = b.chars[i];
+    }
+    return result;
+}
+
+/**
+ * A reference to an instance of the Java class named by ClassName::NAME (in JNI form, e.g. "java/nio/ByteBuffer").
+ * Plain jobjects carry no class, so object parameters other than String are declared with this wrapper to get their
+ * signature.
+ */
+template <typename ClassName>
+struct Object {
+    jobject ref;
+};
+
+/**
+ * A Java array of Element, for element types without a dedicated JNI array type (String[], Object[]).
+ */
+template <typename Element>
+struct Array {
+    jobjectArray ref;
+};
+
+struct ByteBufferClassName {
+    static constexpr char NAME[] = "java/nio/ByteBuffer";
+};
+using ByteBuffer = Object<ByteBufferClassName>;
+
+/**
+ * The JNI type signature of a C++ parameter or return type. Only the types below map to Java types; anything else
+ * fails to compile.
+ */
+template <typename T>
+struct JavaType {
+    static_assert(sizeof(T) == 0, "no Java type for this C++ type, use a j* type or jni::Object");
+};
+
+#define MQTT_JNI_JAVA_TYPE(type, signature)                        \
+    template <>                                                   \
+    struct JavaType<type> {                                       \
+        static constexpr auto SIGNATURE = FixedString(signature); \
+    }
+
+MQTT_JNI_JAVA_TYPE(void, "V");
+MQTT_JNI_JAVA_TYPE(jboolean, "Z");
+MQTT_JNI_JAVA_TYPE(jbyte, "B");
+MQTT_JNI_JAVA_TYPE(jchar, "C");
+MQTT_JNI_JAVA_TYPE(jshort, "S");
+MQTT_JNI_JAVA_TYPE(jint, "I");
+MQTT_JNI_JAVA_TYPE(jlong, "J");
+MQTT_JNI_JAVA_TYPE(jfloat, "F");
+MQTT_JNI_JAVA_TYPE(jdouble, "D");
+MQTT_JNI_JAVA_TYPE(jstring, "Ljava/lang/String;");
+MQTT_JNI_JAVA_TYPE(jbyteArray, "[B");
+MQTT_JNI_JAVA_TYPE(jintArray, "[I");
+
+#undef MQTT_JNI_JAVA_TYPE
+
+template <typename ClassName>
+struct JavaType<Object<ClassName>> {
+    static constexpr auto SIGNATURE = FixedString("L") + FixedString(ClassName::NAME) + FixedString(";");
+};
+
+template <typename Element>
+struct JavaType<Array<Element>> {
+    static constexpr auto SIGNATURE = FixedString("[") + JavaType<Element>::SIGNATURE;
+};
+
+/**
+ * "(<parameters>)<return>", the method descriptor GetMethodID expects.
+ */
+template <typename R, typename... Args>
+constexpr auto methodSignature() {
+    return (FixedString("(") + ... + JavaType<Args>::SIGNATURE) + FixedString(")") + JavaType<R>::SIGNATURE;
+}
+
+namespace detail {
+
+inline void setValue(jvalue &value, jboolean argument) { value.z = argument; }
+inline void setValue(jvalue &value, jbyte argument) { value.b = argument; }
+inline void setValue(jvalue &value, jchar argument) { value.c = argument; }
+inline void setValue(jvalue &value, jshort argument) { value.s = argument; }
+inline void setValue(jvalue &value, jint argument) { value.i = argument; }
+inline void setValue(jvalue &value, jlong argument) { value.j = argument; }
+inline void setValue(jvalue &value, jfloat argument) { value.f = argument; }
+inline void setValue(jvalue &value, jdouble argument) { value.d = argument; }
+inline void setValue(jvalue &value, jobject argument) { value.l = argument; }
+
+template <typename ClassName>
+void setValue(jvalue &value, Object<ClassName> argument) {
+    value.l = argument.ref;
+}
+
+template <typename Element>
+void setValue(jvalue &value, Array<Element> argument) {
+    value.l = argument.ref;
+}
+
+template <typename... Args>
+struct Arguments {
+    // One spare element, so a method without parameters does not declare an empty array.
+    jvalue values[sizeof...(Args) + 1];
+
+    template <typename... Actual>
+    explicit Arguments(Actual... arguments) {
+        size_t index = 0;
+        (setValue(values[index++], arguments), ...);
+        (void)index;
+    }
+};
+
+template <typename R>
+R fromObject(jobject object) {
+    if constexpr (std::is_pointer_v<R>) {
+        return static_cast<R>(object);
+    } else {
+        return R{object};
+    }
+}
+
+}
+
+/**
+ * An instance method of a Java class, declared by its C++ signature, e.g. Method<void(jstring, jint)> for a
+ * (String, int) -> void method. The JNI descriptor is derived from the declaration at compile time, arguments are
+ * passed unboxed through a jvalue array, and calling with argument types other than the declared ones fails to
+ * compile instead of being reinterpreted by the varargs Call*Method functions.
+ */
+template <typename Signature>
+class Method;
+
+template <typename R, typename... Args>
+class Method<R(Args...)> {
+public:
+    static constexpr auto SIGNATURE = methodSignature<R, Args...>();
+
+    /**
+     * Looks up the method; false (with a pending NoSuchMethodError) when the class has none with this signature.
+     */
+    bool resolve(JNIEnv *env, jclass clazz, const char *name) {
+        id_ = env->GetMethodID(clazz, name, SIGNATURE.c_str());
+        return id_ != nullptr;
+    }
+
+    explicit operator bool() const { return id_ != nullptr; }
+
+    template <typename... Actual>
+    R operator()(JNIEnv *env, jobject receiver, Actual... arguments) const {
+        static_assert(sizeof...(Actual) == sizeof...(Args), "wrong number of arguments for this Java method");
+        static_assert((std::is_same_v<Actual, Args> && ...), "argument types do not match the Java signature");
+        detail::Arguments<Args...> values{arguments...};
+        if constexpr (std::is_void_v<R>) {
+            env->CallVoidMethodA(receiver, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jboolean>) {
+            return env->CallBooleanMethodA(receiver, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jint>) {
+            return env->CallIntMethodA(receiver, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jlong>) {
+            return env->CallLongMethodA(receiver, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jdouble>) {
+            return env->CallDoubleMethodA(receiver, id_, values.values);
+        } else {
+            return detail::fromObject<R>(env->CallObjectMethodA(receiver, id_, values.values));
+        }
+    }
+
+private:
+    jmethodID id_ = nullptr;
+};
+
+/**
+ * A static method, declared and called like Method.
+ */
+template <typename Signature>
+class StaticMethod;
+
+template <typename R, typename... Args>
+class StaticMethod<R(Args...)> {
+public:
+    static constexpr auto SIGNATURE = methodSignature<R, Args...>();
+
+    bool resolve(JNIEnv *env, jclass clazz, const char *name) {
+        clazz_ = clazz;
+        id_ = env->GetStaticMethodID(clazz, name, SIGNATURE.c_str());
+        return id_ != nullptr;
+    }
+
+    explicit operator bool() const { return id_ != nullptr; }
+
+    /**
+     * clazz passed to resolve() must still be valid, i.e. a global reference.
+     */
+    template <typename... Actual>
+    R operator()(JNIEnv *env, Actual... arguments) const {
+        static_assert(sizeof...(Actual) == sizeof...(Args), "wrong number of arguments for this Java method");
+        static_assert((std::is_same_v<Actual, Args> && ...), "argument types do not match the Java signature");
+        detail::Arguments<Args...> values{arguments...};
+        if constexpr (std::is_void_v<R>) {
+            env->CallStaticVoidMethodA(clazz_, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jboolean>) {
+            return env->CallStaticBooleanMethodA(clazz_, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jint>) {
+            return env->CallStaticIntMethodA(clazz_, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jlong>) {
+            return env->CallStaticLongMethodA(clazz_, id_, values.values);
+        } else if constexpr (std::is_same_v<R, jdouble>) {
+            return env->CallStaticDoubleMethodA(clazz_, id_, values.values);
+        } else {
+            return detail::fromObject<R>(env->CallStaticObjectMethodA(clazz_, id_, values.values));
+        }
+    }
+
+private:
+    jclass clazz_ = nullptr;
+    jmethodID id_ = nullptr;
+};
+
+inline jboolean toJBoolean(bool value) {
+    return value ? JNI_TRUE : JNI_FALSE;
+}
+
+static_assert(Method<void()>::SIGNATURE == "()V");
+static_assert(Method<void(jstring, ByteBuffer, jint, jboolean)>::SIGNATURE ==
+              "(Ljava/lang/String;Ljava/nio/ByteBuffer;IZ)V");
+static_assert(Method<void(Array<jstring>, jintArray)>::SIGNATURE == "([Ljava/lang/String;[I)V");
+static_assert(StaticMethod<ByteBuffer(jint)>::SIGNATURE == "(I)Ljava/nio/ByteBuffer;");
+
+}
+}
@@ -2,6 +2,24 @@
 #include <jsi/jsi.h>
 #include <pthread.h>
 #include <sys/types.h>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "JNIBinding.h"
+#include "MqttClientRegistry.h"
+#include "MqttEventDispatcher.h"
+#include "MqttJSIModule.h"
+#include "MqttMetrics.h"
+#include "MqttTrace.h"
+#include "MqttUtf16.h"
+
+#if MQTT_HERMES
+#include <hermes/hermes.h>
+#endif
 
 namespace jsi = facebook::jsi;
 
@@ -10,22 +28,40 @@ namespace jsi = facebook::jsi;
  * ******************************************************** JNI Methods ********************************************************
  */
 
-static jclass java_class;
-static jobject java_object;
-static jobject java_storage_object;
 static JavaVM *java_vm = nullptr;
 
-static jobject JSIArrayToJArray(JNIEnv *jniEnv, jsi::Object &object, jsi::Runtime &runtime, jclass doubleClass,
-                                jclass booleanClass, jclass integerClass, jclass longClass, jclass hashMapClass, jclass arrayListClass);
+/*
+ * Classes and method ids used on the hot path. They are resolved once in JNI_OnLoad and kept as global refs, so
+ * nothing calls FindClass/GetMethodID per call.
+ *
+ * Java methods are declared with their C++ signature (see JNIBinding.h): the JNI descriptors are generated from
+ * these declarations, and calls with other argument types do not compile.
+ */
+struct JNIClassCache {
+    jclass byteBufferClass;
+    jclass stringClass;
+
+    mqtt::jni::StaticMethod<mqtt::jni::ByteBuffer(jint)> byteBufferAllocateDirect;
+};
 
-static jobject JSIRecordToJHashMap(JNIEnv *jniEnv, jsi::Object &object, jsi::Runtime &runtime, jclass doubleClass,
-                                   jclass booleanClass, jclass integerClass, jclass longClass, jclass hashMapClass, jclass arrayListClass);
+/*
+ * Methods of MqttHelper, the HiveMQ backed transport. Resolved when the first client is registered.
+ */
+struct JNITransportMethods {
+    mqtt::jni::Method<void(jint, jboolean, jstring, jstring, jint)> connect;
+    mqtt::jni::Method<void()> disconnect;
+    mqtt::jni::Method<void(jstring, jint)> subscribe;
+    mqtt::jni::Method<void(mqtt::jni::Array<jstring>, jintArray)> subscribeMany;
+    mqtt::jni::Method<void(jstring)> unsubscribe;
+    mqtt::jni::Method<void(jstring, mqtt::jni::ByteBuffer, jint, jboolean)> publish;
+    mqtt::jni::Method<void(jlong)> acknowledge;
+    mqtt::jni::Method<void()> close;
+};
 
-static jsi::Value JNIHashMapToJSIRecord(jobject hashMap, JNIEnv *env, jsi::Runtime &runtime, jclass stringClass, jclass integerClass, jclass floatClass, jclass doubleClass,
-                                        jclass booleanClass, jclass arrayListClass, jclass hashMapClass);
+static JNIClassCache jni_cache;
+static JNITransportMethods jni_transport_methods;
 
-static jsi::Value JNIArrayToJSIArray(jobject arrayList, JNIEnv *env, jsi::Runtime &runtime, jclass stringClass, jclass integerClass, jclass floatClass, jclass doubleClass,
-                                     jclass booleanClass, jclass arrayListClass, jclass hashMapClass);
+static mqtt::jni::Method<void()> jni_schedule_js_queue_flush;
 
 
 void DeferThreadDetach(JNIEnv *env) {
@@ -65,445 +101,518 @@ JNIEnv *GetJniEnv() {
     return env;
 }
 
-static bool isInt(double d) {
-    return d == (int)d;
+/*
+ * Clears the exception a JNI call left pending, which would otherwise abort the next JNI call on this thread, and
+ * returns whether there was one. It is logged with its stack trace.
+ */
+static bool clearPendingException(JNIEnv *env) {
+    if (!env->ExceptionCheck()) {
+        return false;
+    }
+    env->ExceptionDescribe();
+    env->ExceptionClear();
+    return true;
 }
 
-static bool isLong(double d) {
-    double intPointer;
-    return modf(d, &intPointer) == 0.0;
+/*
+ * Throws an IllegalStateException into the calling Kotlin code, for natives that cannot do their job at all.
+ */
+static void throwIllegalState(JNIEnv *env, const char *message) {
+    jclass exceptionClass = env->FindClass("java/lang/IllegalStateException");
+    if (exceptionClass != nullptr) {
+        env->ThrowNew(exceptionClass, message);
+        env->DeleteLocalRef(exceptionClass);
+    }
 }
 
+static jclass findGlobalClass(JNIEnv *env, const char *name) {
+    jclass localClass = env->FindClass(name);
+    if (localClass == nullptr) {
+        return nullptr;
+    }
+    auto globalClass = (jclass)env->NewGlobalRef(localClass);
+    env->DeleteLocalRef(localClass);
+    return globalClass;
+}
 
+static bool initJNIClassCache(JNIEnv *env) {
+    JNIClassCache &c = jni_cache;
+    c.byteBufferClass = findGlobalClass(env, "java/nio/ByteBuffer");
+    if (c.byteBufferClass == nullptr) {
+        return false;
+    }
+    if (!c.byteBufferAllocateDirect.resolve(env, c.byteBufferClass, "allocateDirect")) {
+        clearPendingException(env);
+        return false;
+    }
+    c.stringClass = findGlobalClass(env, "java/lang/String");
+    return c.stringClass != nullptr;
+}
 
-static jsi::Value JNIValueToJSIValue(jobject result, JNIEnv *jniEnv,
-                                     jsi::Runtime &runtime, jclass stringClass, jclass integerClass, jclass floatClass, jclass doubleClass,
-                                     jclass booleanClass, jclass arrayListClass, jclass hashMapClass) {
-    jsi::Value retVal = jsi::Value::null();
-    if (result == nullptr) {
-        return retVal;
-    }
-
-    if (jniEnv->IsInstanceOf(result, stringClass)) {
-        jstring resultStr = (jstring)result;
-        const char *str = jniEnv->GetStringUTFChars(resultStr, nullptr);
-        retVal = jsi::String::createFromUtf8(runtime, str);
-        jniEnv->ReleaseStringUTFChars(resultStr, str);
-    } else if (jniEnv->IsInstanceOf(result, integerClass)) {
-        jmethodID getVal = jniEnv->GetMethodID(integerClass, "intValue", "()I");
-        int i = jniEnv->CallIntMethod(result, getVal);
-        retVal = jsi::Value(runtime, i);
-    } else if (jniEnv->IsInstanceOf(result, floatClass)) {
-        jmethodID getVal = jniEnv->GetMethodID(floatClass, "floatValue", "()F");
-        double d = jniEnv->CallFloatMethod(result, getVal);
-        retVal = jsi::Value(runtime, d);
-    } else if (jniEnv->IsInstanceOf(result, doubleClass)) {
-        jmethodID getVal = jniEnv->GetMethodID(doubleClass, "doubleValue", "()D");
-        double d = jniEnv->CallDoubleMethod(result, getVal);
-        retVal = jsi::Value(runtime, d);
-    } else if (jniEnv->IsInstanceOf(result, booleanClass)) {
-        jmethodID getVal = jniEnv->GetMethodID(booleanClass, "booleanValue", "()Z");
-        bool b = jniEnv->CallBooleanMethod(result, getVal);
-        retVal = jsi::Value(runtime, b);
-    } else if (jniEnv->IsInstanceOf(result, arrayListClass)) {
-        // ArrayList<E>
-        retVal = JNIArrayToJSIArray(result, jniEnv, runtime, stringClass, integerClass, floatClass, doubleClass, booleanClass, arrayListClass, hashMapClass);
-    } else if (jniEnv->IsInstanceOf(result, hashMapClass)) {
-        // HashMap<K, V>
-        retVal = JNIHashMapToJSIRecord(result, jniEnv, runtime, stringClass, integerClass, floatClass, doubleClass, booleanClass, arrayListClass, hashMapClass);
-    }
-    return retVal;
+/*
+ * Resolves every MqttHelper method, or returns false with the NoSuchMethodError of the first one that is missing
+ * (renamed in Kotlin or stripped by R8) logged and cleared; the transport must then not be used.
+ */
+static bool initJNITransportMethods(JNIEnv *env, jobject transport) {
+    jclass transportClass = env->GetObjectClass(transport);
+    JNITransportMethods &m = jni_transport_methods;
+    bool resolved = m.connect.resolve(env, transportClass, "connect") &&
+                    m.disconnect.resolve(env, transportClass, "disconnect") &&
+                    m.subscribe.resolve(env, transportClass, "subscribe") &&
+                    m.subscribeMany.resolve(env, transportClass, "subscribeMany") &&
+                    m.unsubscribe.resolve(env, transportClass, "unsubscribe") &&
+                    m.publish.resolve(env, transportClass, "publish") &&
+                    m.acknowledge.resolve(env, transportClass, "acknowledge") &&
+                    m.close.resolve(env, transportClass, "close");
+    if (!resolved) {
+        clearPendingException(env);
+    }
+    env->DeleteLocalRef(transportClass);
+    return resolved;
 }
 
-static jsi::Value JNIHashMapToJSIRecord(jobject hashMap, JNIEnv *env, jsi::Runtime &runtime, jclass stringClass, jclass integerClass, jclass floatClass, jclass doubleClass,
-                                        jclass booleanClass, jclass arrayListClass, jclass hashMapClass) {
-    // Get the Map's entry Set.
-    jsi::Value retVal = jsi::Value::null();
-    jclass mapClass = env->FindClass("java/util/Map");
-    if (mapClass == nullptr) {
-        return retVal;
-    }
-    jmethodID entrySet =
-            env->GetMethodID(mapClass, "entrySet", "()Ljava/util/Set;");
-    if (entrySet == nullptr) {
-        return retVal;
-    }
-    jobject set = env->CallObjectMethod(hashMap, entrySet);
-    if (set == nullptr) {
-        return retVal;
-    }
-    // Obtain an iterator over the Set
-    jclass setClass = env->FindClass("java/util/Set");
-    if (setClass == nullptr) {
-        return retVal;
-    }
-    jmethodID iterator =
-            env->GetMethodID(setClass, "iterator", "()Ljava/util/Iterator;");
-    if (iterator == nullptr) {
-        return retVal;
-    }
-    jobject iter = env->CallObjectMethod(set, iterator);
-    if (iter == nullptr) {
-        return retVal;
-    }
-    // Get the Iterator method IDs
-    jclass iteratorClass = env->FindClass("java/util/Iterator");
-    if (iteratorClass == nullptr) {
-        return retVal;
-    }
-    jmethodID hasNext = env->GetMethodID(iteratorClass, "hasNext", "()Z");
-    if (hasNext == nullptr) {
-        return retVal;
-    }
-    jmethodID next =
-            env->GetMethodID(iteratorClass, "next", "()Ljava/lang/Object;");
-    if (next == nullptr) {
-        return retVal;
-    }
-    // Get the Entry class method IDs
-    jclass entryClass = env->FindClass("java/util/Map$Entry");
-    if (entryClass == nullptr) {
-        return retVal;
-    }
-    jmethodID getKey =
-            env->GetMethodID(entryClass, "getKey", "()Ljava/lang/Object;");
-    if (getKey == nullptr) {
-        return retVal;
-    }
-    jmethodID getValue =
-            env->GetMethodID(entryClass, "getValue", "()Ljava/lang/Object;");
-    if (getValue == nullptr) {
-        return retVal;
-    }
-    // Iterate over the entry Set
-    auto jsiObj = jsi::Object(runtime);
-    while (env->CallBooleanMethod(iter, hasNext)) {
-        jobject entry = env->CallObjectMethod(iter, next);
-        jstring key = (jstring) env->CallObjectMethod(entry, getKey);
-        jobject value = env->CallObjectMethod(entry, getValue);
-        const char* keyStr = env->GetStringUTFChars(key, NULL);
-        if (!keyStr) {
-            return retVal;
-        }
-        auto jsiValue = JNIValueToJSIValue(value, env, runtime, stringClass, integerClass, floatClass, doubleClass, booleanClass, arrayListClass, hashMapClass);
-        jsiObj.setProperty(runtime, keyStr, jsiValue);
-        env->DeleteLocalRef(entry);
-        env->ReleaseStringUTFChars(key, keyStr);
-        env->DeleteLocalRef(key);
-        env->DeleteLocalRef(value);
-    }
-    env->DeleteLocalRef(mapClass);
-    env->DeleteLocalRef(set);
-    env->DeleteLocalRef(setClass);
-    env->DeleteLocalRef(iter);
-    env->DeleteLocalRef(iteratorClass);
-    env->DeleteLocalRef(entryClass);
-    return jsiObj;
+/*
+ * Standard UTF-8 of a Java string. GetStringUTFChars would return modified UTF-8, which MQTT rejects for strings with
+ * supplementary characters (emoji) or U+0000.
+ */
+static std::string JStringToStdString(JNIEnv *env, jstring value) {
+    if (value == nullptr) {
+        return std::string();
+    }
+    jsize length = env->GetStringLength(value);
+    const jchar *chars = env->GetStringCritical(value, nullptr);
+    if (chars == nullptr) {
+        clearPendingException(env);
+        return std::string();
+    }
+    std::string result = mqtt::utf16ToUtf8(reinterpret_cast<const char16_t *>(chars), static_cast<size_t>(length));
+    env->ReleaseStringCritical(value, chars);
+    return result;
 }
 
-static jsi::Value JNIArrayToJSIArray(jobject arrayList, JNIEnv *env, jsi::Runtime &runtime, jclass stringClass, jclass integerClass, jclass floatClass, jclass doubleClass,
-                                     jclass booleanClass, jclass arrayListClass, jclass hashMapClass) {
-    jsi::Value retVal = jsi::Value::null();
-    if (arrayListClass == nullptr) {
-        return retVal;
-    }
-    jmethodID iterator =
-            env->GetMethodID(arrayListClass, "iterator", "()Ljava/util/Iterator;");
-    if (iterator == nullptr) {
-        return retVal;
-    }
-    jobject iter = env->CallObjectMethod(arrayList, iterator);
-    if (iter == nullptr) {
-        return retVal;
-    }
-    jclass iteratorClass = env->FindClass("java/util/Iterator");
-    if (iteratorClass == nullptr) {
-        return retVal;
-    }
-    jmethodID hasNext = env->GetMethodID(iteratorClass, "hasNext", "()Z");
-    if (hasNext == nullptr) {
-        return retVal;
-    }
-    jmethodID next =
-            env->GetMethodID(iteratorClass, "next", "()Ljava/lang/Object;");
-    if (next == nullptr) {
-        return retVal;
-    }
-    jmethodID sizeMethod =
-            env->GetMethodID(arrayListClass, "size", "()I");
-    if (sizeMethod == nullptr) {
-        return retVal;
-    }
-    jint size = env->CallIntMethod(arrayList, sizeMethod);
-    size_t i = 0;
-    jsi::Array jsiArray = jsi::Array(runtime, size);
-    while (env->CallBooleanMethod(iter, hasNext)) {
-        jobject value = env->CallObjectMethod(iter, next);
-        auto jsiValue = JNIValueToJSIValue(value, env, runtime, stringClass, integerClass, floatClass, doubleClass, booleanClass, arrayListClass, hashMapClass);
-        jsiArray.setValueAtIndex(runtime, i, jsiValue);
-        env->DeleteLocalRef(value);
-        i++;
-    }
-    env->DeleteLocalRef(iter);
-    env->DeleteLocalRef(iteratorClass);
-    return jsiArray;
+/*
+ * Java string of UTF-8 text, the counterpart of JStringToStdString; NewStringUTF expects modified UTF-8.
+ */
+static jstring StdStringToJString(JNIEnv *env, const std::string &value) {
+    std::u16string chars = mqtt::utf8ToUtf16(value);
+    return env->NewString(reinterpret_cast<const jchar *>(chars.data()), static_cast<jsize>(chars.size()));
 }
 
-static jobject JSIValueToJNIValue(JNIEnv *jniEnv, const jsi::Value &jsiValue, jsi::Runtime &runtime, jclass doubleClass,
-                                  jclass booleanClass, jclass integerClass, jclass longClass, jclass hashMapClass, jclass arrayListClass) {
-    if (doubleClass == nullptr || booleanClass == nullptr || integerClass == nullptr || longClass == nullptr) {
-        return nullptr;
-    }
-    jobject jniValue = nullptr;
-    if (!jsiValue.isNull() && !jsiValue.isUndefined()) {
-        if (jsiValue.isString()) {
-            jsi::String val = jsiValue.getString(runtime);
-            std::string cxxVal = val.utf8(runtime);
-            jniValue = jniEnv->NewStringUTF(cxxVal.c_str());
-        } else if (jsiValue.isBool()) {
-            bool b = jsiValue.getBool();
-            jmethodID booleanConstructID = jniEnv->GetMethodID(booleanClass, "<init>", "(Z)V");
-            jniValue = jniEnv->NewObject(booleanClass, booleanConstructID, b);
-        } else if (jsiValue.isNumber()) {
-            double d = jsiValue.getNumber();
-            if (isinf(d) || isnan(d)) {
-                jniValue = nullptr;
-            } else {
-                if (isInt(d)) {
-                    jmethodID integerConstructID = jniEnv->GetMethodID(integerClass, "<init>", "(I)V");
-                    jniValue = jniEnv->NewObject(integerClass, integerConstructID, (int)d);
-                } else if(isLong(d)) {
-                    jmethodID longConstructID = jniEnv->GetMethodID(longClass, "<init>", "(J)V");
-                    jniValue = jniEnv->NewObject(longClass, longConstructID, (long)d);
-                } else {
-                    jmethodID doubleConstructID = jniEnv->GetMethodID(doubleClass, "<init>", "(D)V");
-                    jniValue = jniEnv->NewObject(doubleClass, doubleConstructID, d);
-                }
-            }
-        } else if (jsiValue.isObject()) {
-            jsi::Object o = jsiValue.getObject(runtime);
-            if (!o.isFunction(runtime)) {
-                if (o.isArray(runtime)) {
-                    jniValue = JSIArrayToJArray(jniEnv, o, runtime, doubleClass, booleanClass, integerClass, longClass, hashMapClass, arrayListClass);
-                } else {
-                    jniValue = JSIRecordToJHashMap(jniEnv, o, runtime, doubleClass, booleanClass, integerClass, longClass, hashMapClass, arrayListClass);
-                }
+
+/*
+ * ******************************************************** Transport ********************************************************
+ */
+
+/*
+ * mqtt::Transport backed by a Kotlin MqttHelper. Every call only hands the operation to the helper, which runs it on
+ * its executor and reports the outcome back through the MqttCore natives below. An exception thrown by a call is
+ * cleared; a publish that did not reach the helper is reported to the client as failed.
+ */
+class JNITransport : public mqtt::Transport {
+public:
+    JNITransport(JNIEnv *env, std::string clientId, jobject helper)
+    : clientId_(std::move(clientId)), helper_(env->NewGlobalRef(helper)) {}
+
+    ~JNITransport() override {
+        GetJniEnv()->DeleteGlobalRef(helper_);
+    }
+
+    void connect(const mqtt::ConnectOptions &options) override {
+        JNIEnv *env = GetJniEnv();
+        jstring username = StdStringToJString(env, options.username);
+        jstring password = StdStringToJString(env, options.password);
+        jni_transport_methods.connect(env, helper_, (jint)options.keepAlive, mqtt::jni::toJBoolean(options.cleanSession),
+                                      username, password, (jint)options.receiveMaximum);
+        clearPendingException(env);
+        env->DeleteLocalRef(username);
+        env->DeleteLocalRef(password);
+    }
+
+    void disconnect() override {
+        JNIEnv *env = GetJniEnv();
+        jni_transport_methods.disconnect(env, helper_);
+        clearPendingException(env);
+    }
+
+    void subscribe(const std::string &topic, int qos) override {
+        JNIEnv *env = GetJniEnv();
+        jstring jTopic = StdStringToJString(env, topic);
+        jni_transport_methods.subscribe(env, helper_, jTopic, (jint)qos);
+        clearPendingException(env);
+        env->DeleteLocalRef(jTopic);
+    }
+
+    /*
+     * One HiveMQ SUBSCRIBE with every filter, used to restore the subscriptions after a connect.
+     */
+    void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) override {
+        JNIEnv *env = GetJniEnv();
+        auto size = (jsize)filters.size();
+        jobjectArray topics = env->NewObjectArray(size, jni_cache.stringClass, nullptr);
+        jintArray qos = env->NewIntArray(size);
+        if (topics != nullptr && qos != nullptr) {
+            std::vector<jint> qosValues(filters.size());
+            for (jsize i = 0; i < size; i++) {
+                jstring jTopic = StdStringToJString(env, filters[i].first);
+                env->SetObjectArrayElement(topics, i, jTopic);
+                env->DeleteLocalRef(jTopic);
+                qosValues[i] = (jint)filters[i].second;
             }
+            env->SetIntArrayRegion(qos, 0, size, qosValues.data());
+            jni_transport_methods.subscribeMany(env, helper_, mqtt::jni::Array<jstring>{topics}, qos);
+            clearPendingException(env);
+        }
+        env->DeleteLocalRef(topics);
+        env->DeleteLocalRef(qos);
+    }
+
+    void unsubscribe(const std::string &topic) override {
+        JNIEnv *env = GetJniEnv();
+        jstring jTopic = StdStringToJString(env, topic);
+        jni_transport_methods.unsubscribe(env, helper_, jTopic);
+        clearPendingException(env);
+        env->DeleteLocalRef(jTopic);
+    }
+
+    /*
+     * Copies the payload straight into a direct ByteBuffer, which HiveMQ keeps instead of copying again. This is
+     * the only copy on the publish path.
+     */
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) override {
+        MQTT_TRACE_SECTION("mqtt::JNITransport::publish");
+        JNIEnv *env = GetJniEnv();
+        mqtt::jni::ByteBuffer byteBuffer = jni_cache.byteBufferAllocateDirect(env, (jint)size);
+        if (byteBuffer.ref == nullptr) {
+            // allocateDirect threw, typically an OutOfMemoryError.
+            clearPendingException(env);
+            publishFailed(topic, "payload buffer could not be allocated");
+            return;
+        }
+        if (size > 0) {
+            memcpy(env->GetDirectBufferAddress(byteBuffer.ref), payload, size);
+        }
+        jstring jTopic = StdStringToJString(env, topic);
+        bool failed = jTopic == nullptr;
+        if (!failed) {
+            jni_transport_methods.publish(env, helper_, jTopic, byteBuffer, (jint)qos, mqtt::jni::toJBoolean(retain));
+            env->DeleteLocalRef(jTopic);
+        }
+        failed = clearPendingException(env) || failed;
+        env->DeleteLocalRef(byteBuffer.ref);
+        if (failed) {
+            publishFailed(topic, "MqttHelper.publish threw");
         }
     }
-    return jniValue;
-}
 
-static jobject JSIRecordToJHashMap(JNIEnv *jniEnv, jsi::Object &object, jsi::Runtime &runtime, jclass doubleClass,
-                                   jclass booleanClass, jclass integerClass, jclass longClass, jclass hashMapClass, jclass arrayListClass) {
-    if (object.isArray(runtime) || object.isFunction(runtime)) {
-        return nullptr;
+    /*
+     * MqttHelper holds on to received QoS 1/2 publishes under the acknowledgement it passed to nativeOnMessage.
+     */
+    void acknowledge(uint64_t acknowledgement) override {
+        JNIEnv *env = GetJniEnv();
+        jni_transport_methods.acknowledge(env, helper_, (jlong)acknowledgement);
+        clearPendingException(env);
     }
-    if (hashMapClass == nullptr)
-        return nullptr;
-    jsi::Array propertyNames = object.getPropertyNames(runtime);
-    size_t size = propertyNames.size(runtime);
-    jmethodID init = jniEnv->GetMethodID(hashMapClass, "<init>", "()V");
-    jobject hashMap = jniEnv->NewObject(hashMapClass, init);
-    jmethodID put = jniEnv->GetMethodID(hashMapClass, "put", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
-
-    for (size_t i = 0; i < size; i++) {
-        jsi::String jsiKey = propertyNames.getValueAtIndex(runtime, i).getString(runtime);
-        std::string cxxKey = jsiKey.utf8(runtime);
-        jstring jKey = jniEnv->NewStringUTF(cxxKey.c_str());
-        jsi::Value jsiValue = object.getProperty(runtime, jsiKey);
-        jobject jniValue = JSIValueToJNIValue(jniEnv, jsiValue, runtime, doubleClass, booleanClass, integerClass, longClass, hashMapClass, arrayListClass);
-        if (jniValue != nullptr) {
-            jniEnv->CallObjectMethod(hashMap, put, jKey, jniValue);
-        } else {
-            if (jsiValue.isNull()) {
-                jniEnv->CallObjectMethod(hashMap, put, jKey, jniValue);
-            }
-        }
-        jniEnv->DeleteLocalRef(jniValue);
-        jniEnv->DeleteLocalRef(jKey);
+
+    void close() override {
+        JNIEnv *env = GetJniEnv();
+        jni_transport_methods.close(env, helper_);
+        clearPendingException(env);
     }
-    return hashMap;
-}
 
-static jobject JSIArrayToJArray(JNIEnv *jniEnv, jsi::Object &object, jsi::Runtime &runtime, jclass doubleClass,
-                                jclass booleanClass, jclass integerClass, jclass longClass, jclass hashMapClass, jclass arrayListClass) {
-    if (object.isArray(runtime)) {
-        if (arrayListClass == nullptr) {
-            return nullptr;
+private:
+    void publishFailed(const std::string &topic, const char *reason) {
+        if (auto client = mqtt::ClientRegistry::shared().find(clientId_)) {
+            client->onPublishFailed(topic, "Failed to publish message on topic: " + topic + " (" + reason + ")");
         }
-        jsi::Array jsiArray = object.getArray(runtime);
-        size_t size = jsiArray.size(runtime);
-        jmethodID init = jniEnv->GetMethodID(arrayListClass, "<init>", "(I)V");
-        jobject array = jniEnv->NewObject(arrayListClass, init, (int)size);
-        jmethodID add = jniEnv->GetMethodID(arrayListClass, "add", "(Ljava/lang/Object;)Z");
-        for (size_t i = 0; i < size; i++) {
-            jsi::Value jsiValue = jsiArray.getValueAtIndex(runtime, i);
-            jobject jniValue = JSIValueToJNIValue(jniEnv, jsiValue, runtime, doubleClass, booleanClass, integerClass, longClass, hashMapClass, arrayListClass);
-            jniEnv->CallBooleanMethod(array, add, jniValue);
-            jniEnv->DeleteLocalRef(jniValue);
-        }
-        return array;
-    } else {
-        return nullptr;
     }
-}
-
 
+    std::string clientId_;
+    jobject helper_;
+};
 
 
 /*
- * ******************************************************** Utility Methods ********************************************************
+ * ******************************************************** MQTT Module ********************************************************
+ * Native Module: MqttModule
  */
 
+static jobject java_mqtt_object;
 
-static inline void addGlobalHostFunction(
-        jsi::Runtime &runtime, jsi::Object &object, const char *name, unsigned int argc, jsi::HostFunctionType function)
-{
-    auto jsiFunction =
-            jsi::Function::createFromHostFunction(runtime, jsi::PropNameID::forAscii(runtime, name), argc, function);
-    object.setProperty(runtime, name, std::move(jsiFunction));
-}
+/*
+ * Work that has to run on the JS thread. MqttModuleImpl.scheduleJSQueueFlush posts a single runnable on the JS
+ * message queue which drains everything queued up to that point via nativeFlushJSQueue.
+ */
+static std::mutex js_queue_mutex;
+static std::vector<std::function<void()>> js_queue;
 
-static jsi::Value executeJNIFunction(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, std::size_t count, const char* functionName, const char* functionSig, bool isVoid, jobject java_instance = java_object) {
-    // Step-1 : Convert all JSI values received from JS to JNI Values and store in params array
-    JNIEnv *jniEnv = GetJniEnv();
-    java_class = jniEnv->GetObjectClass(java_instance);
-    jvalue params[count];
-
-    jclass doubleClass = jniEnv->FindClass("java/lang/Double");
-    jclass booleanClass = jniEnv->FindClass("java/lang/Boolean");
-    jclass integerClass = jniEnv->FindClass("java/lang/Integer");
-    jclass longClass = jniEnv->FindClass("java/lang/Long");
-    jclass hashMapClass = jniEnv->FindClass("java/util/HashMap");
-    jclass arrayListClass = jniEnv->FindClass("java/util/ArrayList");
-    jclass stringClass = jniEnv->FindClass("java/lang/String");
-    jclass floatClass = jniEnv->FindClass("java/lang/Float");
-
-    for (size_t i = 0; i < count; i++) {
-        params[i].l = JSIValueToJNIValue(jniEnv, arguments[i], runtime, doubleClass, booleanClass, integerClass, longClass, hashMapClass, arrayListClass);
-    }
-
-    // Step-2 : Create method Id for java/kotlin function, execute method via jni and store jni result
-    jmethodID methodId = jniEnv->GetMethodID(java_class, functionName, functionSig);
-    jobject result = nullptr;
-    if (isVoid && count == 0) {
-        jniEnv->CallVoidMethod(java_instance, methodId);
-    } else if (!isVoid && count == 0) {
-        result = jniEnv->CallObjectMethod(java_instance, methodId);
-    } else if (isVoid && count > 0) {
-        jniEnv->CallVoidMethodA(java_instance, methodId, params);
-    } else if (!isVoid && count > 0) {
-        result = jniEnv->CallObjectMethodA(java_instance, methodId, params);
-    }
-
-    // Step-3 : Convert jni result value to JSI value and send back to JS
-
-    auto jsiValue = isVoid ? jsi::Value() : JNIValueToJSIValue(result, jniEnv, runtime, stringClass, integerClass, floatClass, doubleClass, booleanClass, arrayListClass, hashMapClass);
-    jniEnv->DeleteLocalRef(java_class);
-    for (size_t i = 0; i < count; i++) {
-        jniEnv->DeleteLocalRef(params[i].l);
-    }
-    jniEnv->DeleteLocalRef(result);
-    jniEnv->DeleteLocalRef(doubleClass);
-    jniEnv->DeleteLocalRef(booleanClass);
-    jniEnv->DeleteLocalRef(integerClass);
-    jniEnv->DeleteLocalRef(floatClass);
-    jniEnv->DeleteLocalRef(stringClass);
-    jniEnv->DeleteLocalRef(arrayListClass);
-    jniEnv->DeleteLocalRef(hashMapClass);
-    jniEnv->DeleteLocalRef(longClass);
-    return jsiValue;
+static void invokeOnJSQueue(std::function<void()> &&task) {
+    bool shouldSchedule;
+    {
+        std::lock_guard<std::mutex> lock(js_queue_mutex);
+        shouldSchedule = js_queue.empty();
+        js_queue.push_back(std::move(task));
+    }
+    if (shouldSchedule && jni_schedule_js_queue_flush) {
+        jni_schedule_js_queue_flush(GetJniEnv(), java_mqtt_object);
+    }
 }
 
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttModuleImpl_nativeInstallJSIBindings(JNIEnv *env, jobject thiz, jlong jsi,
+                                                              jstring storageDirectory) {
+    if (java_mqtt_object != nullptr) {
+        env->DeleteGlobalRef(java_mqtt_object);
+    }
+    java_mqtt_object = env->NewGlobalRef(thiz);
+    env->GetJavaVM(&java_vm);
+
+    jclass moduleClass = env->GetObjectClass(thiz);
+    bool resolved = jni_schedule_js_queue_flush.resolve(env, moduleClass, "scheduleJSQueueFlush");
+    env->DeleteLocalRef(moduleClass);
+    if (!resolved) {
+        // Without it no event would ever reach JS.
+        clearPendingException(env);
+        throwIllegalState(env, "MqttModuleImpl.scheduleJSQueueFlush is missing");
+        return;
+    }
+
+    auto runtime = reinterpret_cast<jsi::Runtime *>(jsi);
+    if (runtime) {
+        std::string directoryPath = JStringToStdString(env, storageDirectory);
+        mqtt::BackgroundRuntime::RuntimeFactory createBackgroundRuntime;
+#if MQTT_HERMES
+        createBackgroundRuntime = []() -> std::unique_ptr<jsi::Runtime> { return facebook::hermes::makeHermesRuntime(); };
+#endif
+        mqtt::installJSIModule(*runtime, invokeOnJSQueue, std::move(directoryPath), std::move(createBackgroundRuntime));
+    }
+}
 
 /*
- * ******************************************************** MQTT Module ********************************************************
- * Native Module: MqttModule
+ * Called on the thread MqttWarmStart.start runs it on; credentials, a MqttWarmStart.CredentialsProvider or null, is
+ * asked for the username and password of every recorded client that needs them, before nativeWarmStart returns.
  */
+extern "C"
+JNIEXPORT jint JNICALL
+Java_com_d11_rn_mqtt_MqttWarmStart_nativeWarmStart(JNIEnv *env, jclass clazz, jstring storageDirectory,
+                                                   jobject credentials) {
+    std::string directoryPath = JStringToStdString(env, storageDirectory);
+    mqtt::WarmStart::CredentialsProvider provider;
+    mqtt::jni::Method<mqtt::jni::Array<jstring>(jstring)> credentialsOf;
+    if (credentials != nullptr) {
+        jclass providerClass = env->GetObjectClass(credentials);
+        bool resolved = credentialsOf.resolve(env, providerClass, "credentials");
+        env->DeleteLocalRef(providerClass);
+        if (!resolved) {
+            clearPendingException(env);
+            throwIllegalState(env, "MqttWarmStart.CredentialsProvider.credentials is missing");
+            return 0;
+        }
+        provider = [env, credentials, &credentialsOf](const std::string &clientId, std::string &username,
+                                                      std::string &password) {
+            jstring jClientId = StdStringToJString(env, clientId);
+            jobjectArray pair = credentialsOf(env, credentials, jClientId).ref;
+            env->DeleteLocalRef(jClientId);
+            // A provider that throws skips the client, like one returning null.
+            if (clearPendingException(env) || pair == nullptr) {
+                return false;
+            }
+            bool supplied = env->GetArrayLength(pair) == 2;
+            if (supplied) {
+                auto jUsername = static_cast<jstring>(env->GetObjectArrayElement(pair, 0));
+                auto jPassword = static_cast<jstring>(env->GetObjectArrayElement(pair, 1));
+                username = JStringToStdString(env, jUsername);
+                password = JStringToStdString(env, jPassword);
+                env->DeleteLocalRef(jUsername);
+                env->DeleteLocalRef(jPassword);
+            }
+            env->DeleteLocalRef(pair);
+            return supplied;
+        };
+    }
+    return static_cast<jint>(mqtt::warmStartClients(std::move(directoryPath), provider));
+}
 
-static jobject java_mqtt_object;
+extern "C"
+JNIEXPORT jint JNICALL
+JNI_OnLoad(JavaVM *vm, void *reserved) {
+    java_vm = vm;
+    JNIEnv *env = nullptr;
+    if (vm->GetEnv((void **)&env, JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+    if (!initJNIClassCache(env)) {
+        return JNI_ERR;
+    }
+    return JNI_VERSION_1_6;
+}
 
-static jsi::Value createMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                             const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "createMqtt", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/Integer;Ljava/lang/Boolean;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttModuleImpl_nativeReleaseJSIBindings(JNIEnv *env, jobject thiz) {
+    mqtt::releaseJSIModule();
 }
 
-static jsi::Value removeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                             const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "removeMqtt", "(Ljava/lang/String;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttModuleImpl_nativeFlushJSQueue(JNIEnv *env, jobject thiz) {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(js_queue_mutex);
+        tasks.swap(js_queue);
+    }
+    for (auto &task : tasks) {
+        task();
+    }
 }
 
-static jsi::Value connectMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                              const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "connectMqtt", "(Ljava/lang/String;Ljava/util/HashMap;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+
+/*
+ * ******************************************************** MQTT Core ********************************************************
+ * Kotlin object: MqttCore. Registers MqttHelper transports and forwards their outcomes to the shared C++ client.
+ */
+
+static std::shared_ptr<mqtt::Client> findClient(JNIEnv *env, jstring clientId) {
+    return mqtt::ClientRegistry::shared().find(JStringToStdString(env, clientId));
 }
 
-static jsi::Value disconnectMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                                 const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "disconnectMqtt", "(Ljava/lang/String;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeRegisterClient(JNIEnv *env, jclass clazz, jstring clientId, jobject transport) {
+    // Resolved once; a missing method will not appear later, so the failure is kept and reported to every caller.
+    static const bool transportMethodsResolved = initJNITransportMethods(env, transport);
+    if (!transportMethodsResolved) {
+        throwIllegalState(env, "MqttHelper does not have the methods the native core calls");
+        return JNI_FALSE;
+    }
+    std::string id = JStringToStdString(env, clientId);
+    auto client = mqtt::ClientRegistry::shared().create(id, std::make_shared<JNITransport>(env, id, transport),
+                                                        mqtt::dispatcherEventSink());
+    return client ? JNI_TRUE : JNI_FALSE;
 }
 
-static jsi::Value subscribeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                                const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "subscribeMqtt", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/Integer;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnInitialized(JNIEnv *env, jclass clazz, jstring clientId, jboolean success,
+                                                  jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        if (success) {
+            client->onInitialized();
+        } else {
+            client->onInitializationFailed(JStringToStdString(env, errorMessage));
+        }
+    }
 }
 
-static jsi::Value unsubscribeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                                  const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "unsubscribeMqtt", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)V",
-                                           true, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnConnected(JNIEnv *env, jclass clazz, jstring clientId, jint reasonCode) {
+    if (auto client = findClient(env, clientId)) {
+        client->onConnected(reasonCode);
+    }
 }
 
-static jsi::Value getConnectionStatusMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue,
-                                          const jsi::Value *arguments, std::size_t count) {
-    jsi::Value retVal = executeJNIFunction(runtime, thisValue, arguments, count,
-                                           "getConnectionStatusMqtt", "(Ljava/lang/String;)Ljava/lang/String;",
-                                           false, java_mqtt_object);
-    return retVal;
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnConnectionFailed(JNIEnv *env, jclass clazz, jstring clientId, jint reasonCode,
+                                                       jstring errorMessage, jstring errorCause) {
+    if (auto client = findClient(env, clientId)) {
+        client->onConnectionFailed(reasonCode, JStringToStdString(env, errorMessage), JStringToStdString(env, errorCause));
+    }
 }
 
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnDisconnected(JNIEnv *env, jclass clazz, jstring clientId, jint reasonCode,
+                                                   jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        client->onDisconnected(reasonCode, JStringToStdString(env, errorMessage));
+    }
+}
 
-static void installMqttJSIModule(jsi::Runtime &jsiRuntime){
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnDisconnectFailed(JNIEnv *env, jclass clazz, jstring clientId,
+                                                       jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        client->onDisconnectFailed(JStringToStdString(env, errorMessage));
+    }
+}
 
-    jsi::Object module = jsi::Object(jsiRuntime);
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnSubscribed(JNIEnv *env, jclass clazz, jstring clientId, jstring topic, jint qos,
+                                                 jstring message) {
+    if (auto client = findClient(env, clientId)) {
+        client->onSubscribed(JStringToStdString(env, topic), qos, JStringToStdString(env, message));
+    }
+}
 
-    addGlobalHostFunction(jsiRuntime, module, "createMqtt", 4, createMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "removeMqtt", 1, removeMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "connectMqtt", 2, connectMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "disconnectMqtt", 1, disconnectMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "subscribeMqtt", 4, subscribeMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "unsubscribeMqtt", 3, unsubscribeMqtt);
-    addGlobalHostFunction(jsiRuntime, module, "getConnectionStatusMqtt", 1, getConnectionStatusMqtt);
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnSubscribeFailed(JNIEnv *env, jclass clazz, jstring clientId, jstring topic,
+                                                      jint reasonCode, jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        client->onSubscribeFailed(JStringToStdString(env, topic), reasonCode, JStringToStdString(env, errorMessage));
+    }
+}
 
-    jsiRuntime.global().setProperty(jsiRuntime, "__MqttModuleProxy", std::move(module));
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnUnsubscribeFailed(JNIEnv *env, jclass clazz, jstring clientId, jstring topic,
+                                                        jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        client->onUnsubscribeFailed(JStringToStdString(env, topic), JStringToStdString(env, errorMessage));
+    }
 }
 
 extern "C"
 JNIEXPORT void JNICALL
-Java_com_d11_rn_mqtt_MqttModuleImpl_nativeInstallJSIBindings(JNIEnv *env, jobject thiz, jlong jsi) {
-    java_mqtt_object = env->NewGlobalRef(thiz);
-    env->GetJavaVM(&java_vm);
-    auto runtime = reinterpret_cast<jsi::Runtime *>(jsi);
-    if (runtime) {
-        installMqttJSIModule(*runtime);
+Java_com_d11_rn_mqtt_MqttCore_nativeOnPublishFailed(JNIEnv *env, jclass clazz, jstring clientId, jstring topic,
+                                                    jstring errorMessage) {
+    if (auto client = findClient(env, clientId)) {
+        client->onPublishFailed(JStringToStdString(env, topic), JStringToStdString(env, errorMessage));
     }
 }
 
+/*
+ * Fast path for PUBLISH packets: the payload bytes go straight into the event without a per-message HashMap.
+ * receivedAtNanos is the System.nanoTime() at which HiveMQ handed the message over, on the same clock as
+ * monotonicNanos(); the time until here is recorded as the conversion time of the message. A non-zero
+ * acknowledgement identifies a QoS 1/2 publish that HiveMQ acknowledges once the core calls back. userProperties
+ * holds the MQTT 5 user properties as alternating names and values, null when there are none.
+ */
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_d11_rn_mqtt_MqttCore_nativeOnMessage(JNIEnv *env, jclass clazz, jstring clientId, jstring topic,
+                                              jbyteArray payload, jint qos, jlong receivedAtNanos,
+                                              jlong acknowledgement, jobjectArray userProperties) {
+    MQTT_TRACE_SECTION("mqtt::nativeOnMessage");
+    auto client = findClient(env, clientId);
+    if (!client) {
+        return;
+    }
+    jsize size = env->GetArrayLength(payload);
+    std::string payloadStr(size, '\0');
+    if (size > 0) {
+        env->GetByteArrayRegion(payload, 0, size, reinterpret_cast<jbyte *>(&payloadStr[0]));
+    }
+    std::string topicStr = JStringToStdString(env, topic);
+    client->metrics().recordConversion(mqtt::monotonicNanos() - receivedAtNanos);
+    std::vector<std::string> propertyStrings;
+    if (userProperties) {
+        jsize length = env->GetArrayLength(userProperties);
+        propertyStrings.reserve(length);
+        for (jsize i = 0; i < length; i++) {
+            auto value = static_cast<jstring>(env->GetObjectArrayElement(userProperties, i));
+            propertyStrings.push_back(JStringToStdString(env, value));
+            env->DeleteLocalRef(value);
+        }
+    }
+    mqtt::UserProperties properties;
+    for (size_t i = 0; i + 1 < propertyStrings.size(); i += 2) {
+        properties.emplace_back(propertyStrings[i], propertyStrings[i + 1]);
+    }
+    client->onMessage(topicStr, std::move(payloadStr), qos, receivedAtNanos, (uint64_t)acknowledgement,
+                      properties);
+}
@@ -0,0 +1,45 @@
+package com.d11.rn.mqtt
+
+import com.facebook.proguard.annotations.DoNotStrip
+
+/**
+ * Entry points of the shared C++ core (cpp/MqttClient.h). MqttHelper registers itself as the transport of a client
+ * and reports every outcome of the HiveMQ client here; the core owns connection state, subscriptions and events.
+ */
+@DoNotStrip
+object MqttCore {
+  @JvmStatic
+  external fun nativeRegisterClient(clientId: String, transport: MqttHelper): Boolean
+
+  @JvmStatic
+  external fun nativeOnInitialized(clientId: String, success: Boolean, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnConnected(clientId: String, reasonCode: Int)
+
+  @JvmStatic
+  external fun nativeOnConnectionFailed(clientId: String, reasonCode: Int, errorMessage: String, errorCause: String)
+
+  @JvmStatic
+  external fun nativeOnDisconnected(clientId: String, reasonCode: Int, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnDisconnectFailed(clientId: String, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnSubscribed(clientId: String, topic: String, qos: Int, message: String)
+
+  @JvmStatic
+  external fun nativeOnSubscribeFailed(clientId: String, topic: String, reasonCode: Int, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnUnsubscribeFailed(clientId: String, topic: String, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnPublishFailed(clientId: String, topic: String, errorMessage: String)
+
+  @JvmStatic
+  external fun nativeOnMessage(
+    clientId: String, topic: String, payload: ByteArray, qos: Int, receivedAtNanos: Long, acknowledgement: Long,
+    userProperties: Array<String>?)
+}
@@ -1,48 +1,56 @@
 package com.d11.rn.mqtt
 
+import android.os.Trace
 import android.util.Log
-import com.hivemq.client.mqtt.MqttClientState
+import com.facebook.proguard.annotations.DoNotStrip
+import com.hivemq.client.mqtt.MqttGlobalPublishFilter
 import com.hivemq.client.mqtt.datatypes.MqttQos
 import com.hivemq.client.mqtt.mqtt5.Mqtt5Client
 import com.hivemq.client.mqtt.mqtt5.Mqtt5RxClient
 import com.hivemq.client.mqtt.mqtt5.exceptions.Mqtt5ConnAckException
 import com.hivemq.client.mqtt.mqtt5.exceptions.Mqtt5DisconnectException
-import io.reactivex.Observer
+import com.hivemq.client.mqtt.mqtt5.exceptions.Mqtt5SubAckException
+import com.hivemq.client.mqtt.mqtt5.message.publish.Mqtt5Publish
+import com.hivemq.client.mqtt.mqtt5.message.subscribe.Mqtt5Subscribe
+import com.hivemq.client.mqtt.mqtt5.message.subscribe.Mqtt5Subscription
+import io.reactivex.Flowable
 import io.reactivex.disposables.Disposable
+import java.nio.ByteBuffer
+import java.util.concurrent.ConcurrentHashMap
+import java.util.concurrent.atomic.AtomicLong
 
+/**
+ * HiveMQ backed transport of one client. The shared C++ core (cpp/MqttClient.h) decides what to connect, subscribe
+ * and publish and calls the methods below through JNI; every outcome is reported back through [MqttCore].
+ * Connection state, subscription bookkeeping and event payloads live in the core.
+ */
+@DoNotStrip
 class MqttHelper(
   private val clientId: String,
-  host: String,
-  port: Int,
-  enableSslConfig: Boolean,
-  private val emitJsiEvent: (eventId: String, payload: HashMap<String, Any>) -> Unit
+  private val host: String,
+  private val port: Int,
+  private val enableSslConfig: Boolean,
+  // Serializes the calls of this client, see MqttManager.laneFor.
+  private val lane: SerialLane
 ) {
   private lateinit var mqtt: Mqtt5RxClient
-  private val subscriptionMap: HashMap<String, HashMap<String, Subscription>> = HashMap()
+  private var publishes: Disposable? = null
+  // Received QoS 1/2 publishes whose PUBACK/PUBREC waits for the core, by the acknowledgement passed with them.
+  private val unacknowledged = ConcurrentHashMap<Long, Mqtt5Publish>()
+  private val nextAcknowledgement = AtomicLong()
 
   companion object {
-    const val CLIENT_INITIALIZE_EVENT = "client_initialize"
-    const val CONNECTED_EVENT = "connected"
-    const val DISCONNECTED_EVENT = "disconnected"
-    const val SUBSCRIBE_SUCCESS = "subscribe_success"
-    const val SUBSCRIBE_FAILED = "subscribe_failed"
-    const val ERROR_EVENT = "mqtt_error"
-
-    const val CONNECTED = "connected"
-    const val CONNECTING = "connecting"
-    const val DISCONNECTED = "disconnected"
-
-    // Error Reason Codes
-    const val DEFAULT_ERROR = -1
+    // Error Reason Codes, see ErrorCode in cpp/MqttConstants.h
     const val CONNECTION_ERROR = -2
     const val DISCONNECTION_ERROR = -3
     const val SUBSCRIPTION_ERROR = -4
-    const val UNSUBSCRIPTION_ERROR = -5
-    const val INITIALIZATION_ERROR = -6
-    const val RX_CHAIN_ERROR = -7
   }
 
-  init {
+  /**
+   * Builds the HiveMQ client. Called after the client is registered with the core so the initialize event has a
+   * receiver.
+   */
+  fun initialize() {
     Log.d("MQTT init", "clientid " + clientId + "host " + host + "port " + port)
     try {
       val client = Mqtt5Client.builder()
@@ -60,23 +68,17 @@ class MqttHelper(
             null
           }
 
-          var errorMessage = ""
-          val params = HashMap<String, Any>().apply {
-            put("reasonCode", connPayload ?: disconnectPayload ?: DISCONNECTION_ERROR)
-            errorMessage = try {
-              disconnectedContext.cause.message ?: "Unknown error"
-            } catch (e: Exception) {
-              e.message.toString();
-            }
-            put("errorMessage", errorMessage)
+          val errorMessage = try {
+            disconnectedContext.cause.message ?: "Unknown error"
+          } catch (e: Exception) {
+            e.message.toString()
           }
-          emitJsiEvent(clientId + DISCONNECTED_EVENT, params)
+          // HiveMQ drops acknowledgements of a lost connection; the broker sends those messages again.
+          unacknowledged.clear()
+          MqttCore.nativeOnDisconnected(clientId, connPayload ?: disconnectPayload ?: DISCONNECTION_ERROR, errorMessage)
         }
         .addConnectedListener {
-          val params = HashMap<String, Any>().apply {
-            put("reasonCode", 0)
-          }
-          emitJsiEvent(clientId + CONNECTED_EVENT, params)
+          MqttCore.nativeOnConnected(clientId, 0)
         }
         .serverHost(host)
         .serverPort(port)
@@ -90,174 +92,211 @@ class MqttHelper(
           .buildRx()
       }
 
-      if (this::mqtt.isInitialized) {
-        val params = HashMap<String, Any>().apply {
-          put("clientInit", true)
-        }
-        emitJsiEvent(clientId + CLIENT_INITIALIZE_EVENT, params)
-      }
+      // One global flow for every subscription; the core routes each message to the matching JS subscriptions.
+      // Acknowledged manually: QoS 1/2 publishes are acknowledged once the core's flow control delivered them.
+      publishes = mqtt.publishes(MqttGlobalPublishFilter.ALL, true)
+        .subscribe(
+          { publish ->
+            // Stamped before the payload is copied out, so the core's conversion time covers the whole handover.
+            val receivedAt = System.nanoTime()
+            Trace.beginSection("MqttHelper.onMessage")
+            try {
+              var acknowledgement = 0L
+              if (publish.qos == MqttQos.AT_MOST_ONCE) {
+                publish.acknowledge()
+              } else {
+                acknowledgement = nextAcknowledgement.incrementAndGet()
+                unacknowledged[acknowledgement] = publish
+              }
+              // The core decompresses the payload (content-encoding) and runs the subscription filters with them.
+              val properties = publish.userProperties.asList()
+              val userProperties = if (properties.isEmpty()) null else Array(properties.size * 2) {
+                val property = properties[it / 2]
+                (if (it % 2 == 0) property.name else property.value).toString()
+              }
+              MqttCore.nativeOnMessage(
+                clientId, publish.topic.toString(), publish.payloadAsBytes, publish.qos.code, receivedAt,
+                acknowledgement, userProperties)
+            } finally {
+              Trace.endSection()
+            }
+          },
+          { throwable ->
+            Log.e("RxJava", "Error occurred in publishes: ${throwable.message}")
+          })
+
+      MqttCore.nativeOnInitialized(clientId, true, "")
     } catch (e: Exception) {
       Log.e("MQTT init", "Initialization failed: ${e.message}")
-      val params = HashMap<String, Any>().apply {
-        put("clientInit", false)
-        put("errorMessage", e.message.toString())
-        put("errorType", "INITIALIZATION")
-        put("reasonCode", INITIALIZATION_ERROR)
-      }
-      emitJsiEvent(clientId + ERROR_EVENT, params)
+      MqttCore.nativeOnInitialized(clientId, false, e.message.toString())
     }
   }
 
-  fun connect(options: MqttConnectOptions) {
-    Log.d("MQTT Connect called", "username " + options.username)
-    val disposable: Disposable = mqtt.connectWith()
-      .keepAlive(options.keepAlive)
-      .cleanStart(options.cleanSession)
-      .simpleAuth()
-      .username(options.username)
-      .password(options.password)
-      .applySimpleAuth()
-      .applyConnect()
-      .doOnSuccess { ack ->
-        Log.d("MQTT Connect", " onSuccess " + ack.reasonString)
-        for ((topic, eventIdMap) in subscriptionMap) {
-          for ((eventId, subscription) in eventIdMap) {
-            subscription.disposable.dispose()
-            subscribeMqtt(eventId, topic, subscription.qos)
-          }
-        }
+  /**
+   * receiveMaximum > 0 limits the QoS 1/2 messages the broker sends before they are acknowledged.
+   */
+  @DoNotStrip
+  fun connect(keepAlive: Int, cleanSession: Boolean, username: String, password: String, receiveMaximum: Int) {
+    lane.execute {
+      Log.d("MQTT Connect called", "username $username")
+      val connect = mqtt.connectWith()
+        .keepAlive(keepAlive)
+        .cleanStart(cleanSession)
+        .simpleAuth()
+        .username(username)
+        .password(password.toByteArray())
+        .applySimpleAuth()
+      val restricted = if (receiveMaximum > 0) {
+        connect.restrictions().receiveMaximum(receiveMaximum).applyRestrictions()
+      } else {
+        connect
       }
-      .doOnError { error ->
-        Log.e("MQTT Connect", " onError " + error.message + ":" + error.cause)
-        val params = HashMap<String, Any>().apply {
-          put("clientConnected", false)
-          put("errorMessage", error.message.toString())
-          put("errorCause", error.cause.toString())
-          put("errorType", "CONNECTION")
-          put("reasonCode", CONNECTION_ERROR)
+      val disposable: Disposable = restricted
+        .applyConnect()
+        .doOnSuccess { ack ->
+          Log.d("MQTT Connect", " onSuccess " + ack.reasonString)
         }
-        emitJsiEvent(clientId + ERROR_EVENT, params)
-      }
-      .subscribe(
-        {},
-        { throwable ->
-          // This is the error handler in the subscribe method.
-          // It will be called if an error occurs in the observable chain.
-          Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
-        })
-
+        .doOnError { error ->
+          Log.e("MQTT Connect", " onError " + error.message + ":" + error.cause)
+          val reasonCode = (error as? Mqtt5ConnAckException)?.mqttMessage?.reasonCode?.code ?: CONNECTION_ERROR
+          MqttCore.nativeOnConnectionFailed(clientId, reasonCode, error.message.toString(), error.cause.toString())
+        }
+        .subscribe(
+          {},
+          { throwable ->
+            // This is the error handler in the subscribe method.
+            // It will be called if an error occurs in the observable chain.
+            Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
+          })
+    }
   }
 
-  fun disconnectMqtt() {
-    val disposable: Disposable = mqtt.disconnect()
-      .doOnComplete {
-        Log.d(
-          "MQTT Disconnect",
-          "doOnComplete"
-        ) // TODO: Replace with LogWrapper when available on bridge
-      }
-      .doOnError { error ->
-        Log.e(
-          "MQTT Disconnect",
-          "" + error.message
-        ) // TODO: Replace with LogWrapper when available on bridge
+  @DoNotStrip
+  fun disconnect() {
+    lane.execute {
+      val disposable: Disposable = mqtt.disconnect()
+        .doOnComplete {
+          Log.d(
+            "MQTT Disconnect",
+            "doOnComplete"
+          ) // TODO: Replace with LogWrapper when available on bridge
+        }
+        .doOnError { error ->
+          Log.e(
+            "MQTT Disconnect",
+            "" + error.message
+          ) // TODO: Replace with LogWrapper when available on bridge
 
-        /**
-         * Will be triggered when disconnection failed. Ideally this can happen when connection is already disconnected.
-         */
-        val params = HashMap<String, Any>().apply {
-          put("clientDisconnected", false)
-          put("errorMessage", error.message.toString())
-          put("reasonCode", DISCONNECTION_ERROR)
+          /**
+           * Will be triggered when disconnection failed. Ideally this can happen when connection is already disconnected.
+           */
+          MqttCore.nativeOnDisconnectFailed(clientId, error.message.toString())
         }
-        emitJsiEvent(clientId + DISCONNECTED_EVENT, params)
-      }
-      .subscribe(
-        {},
-        { throwable ->
-          // This is the error handler in the subscribe method.
-          // It will be called if an error occurs in the observable chain.
-          Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
-        })
+        .subscribe(
+          {},
+          { throwable ->
+            // This is the error handler in the subscribe method.
+            // It will be called if an error occurs in the observable chain.
+            Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
+          })
+    }
   }
 
-  fun subscribeMqtt(eventId: String, topic: String, qos: Int) {
-    val disposable: Disposable = mqtt.subscribePublishesWith()
-      .topicFilter(topic)
-      .qos(MqttQos.fromCode(qos) ?: MqttQos.AT_MOST_ONCE)
-      .applySubscribe()
-      .doOnSingle { subAck ->
-        Log.e("MQTT Subscribe", "" + subAck.reasonString)
-
-        val params = HashMap<String, Any>().apply {
-          put("message", subAck.reasonString.toString())
-          put("topic", topic)
-          put("qos", (MqttQos.fromCode(qos) ?: MqttQos.AT_MOST_ONCE).code)
+  @DoNotStrip
+  fun subscribe(topic: String, qos: Int) {
+    lane.execute {
+      val disposable: Disposable = mqtt.subscribeWith()
+        .topicFilter(topic)
+        .qos(MqttQos.fromCode(qos) ?: MqttQos.AT_MOST_ONCE)
+        .applySubscribe()
+        .doOnSuccess { subAck ->
+          Log.d("MQTT Subscribe", "" + subAck.reasonString)
+          val reasonCode = subAck.reasonCodes.firstOrNull()
+          if (reasonCode == null || reasonCode.isError) {
+            MqttCore.nativeOnSubscribeFailed(
+              clientId, topic, reasonCode?.code ?: SUBSCRIPTION_ERROR, "Failed to subscribe to topic: $topic"
+            )
+          } else {
+            MqttCore.nativeOnSubscribed(clientId, topic, reasonCode.code, subAck.reasonString.toString())
+          }
         }
-        emitJsiEvent(eventId + SUBSCRIBE_SUCCESS, params)
-      }
-      .doOnNext { publish ->
-        val params = HashMap<String, Any>().apply {
-          put("payload", String(publish.payloadAsBytes))
-          put("topic", publish.topic.toString())
-          put("qos", publish.qos.code)
+        .doOnError { error ->
+          Log.e(
+            "MQTT Subscribe",
+            "" + error.message
+          ) // TODO: Replace with LogWrapper when available on bridge
+          val reasonCode = (error as? Mqtt5SubAckException)?.mqttMessage?.reasonCodes?.firstOrNull()?.code
+          MqttCore.nativeOnSubscribeFailed(clientId, topic, reasonCode ?: SUBSCRIPTION_ERROR, error.message.toString())
         }
-        emitJsiEvent(eventId, params)
+        .subscribe(
+          {},
+          { throwable ->
+            // This is the error handler in the subscribe method.
+            // It will be called if an error occurs in the observable chain.
+            Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
+          })
+    }
+  }
+
+  /**
+   * Sends every filter in one SUBSCRIBE; the core uses it to restore the subscriptions after a connect.
+   * [qos] holds the QoS of each entry of [topics].
+   */
+  @DoNotStrip
+  fun subscribeMany(topics: Array<String>, qos: IntArray) {
+    lane.execute {
+      val subscriptions = topics.mapIndexed { index, topic ->
+        Mqtt5Subscription.builder()
+          .topicFilter(topic)
+          .qos(MqttQos.fromCode(qos[index]) ?: MqttQos.AT_MOST_ONCE)
+          .build()
       }
-      .doOnError { error ->
-        Log.e(
-          "MQTT Subscribe",
-          "" + error.message
-        ) // TODO: Replace with LogWrapper when available on bridge
-        val params = HashMap<String, Any>().apply {
-          put("clientSubscribed", false)
-          put("errorMessage", error.message.toString())
-          put("reasonCode", SUBSCRIPTION_ERROR)
+      val disposable: Disposable = mqtt.subscribe(Mqtt5Subscribe.builder().addSubscriptions(subscriptions).build())
+        .doOnSuccess { subAck ->
+          Log.d("MQTT Subscribe", "" + subAck.reasonString)
+          topics.forEachIndexed { index, topic ->
+            val reasonCode = subAck.reasonCodes.getOrNull(index)
+            if (reasonCode == null || reasonCode.isError) {
+              MqttCore.nativeOnSubscribeFailed(
+                clientId, topic, reasonCode?.code ?: SUBSCRIPTION_ERROR, "Failed to subscribe to topic: $topic"
+              )
+            } else {
+              MqttCore.nativeOnSubscribed(clientId, topic, reasonCode.code, subAck.reasonString.toString())
+            }
+          }
         }
-        emitJsiEvent(eventId + SUBSCRIBE_FAILED, params)
-      }
-      .subscribe(
-        {},
-        { throwable ->
-          // This is the error handler in the subscribe method.
-          // It will be called if an error occurs in the observable chain.
-          Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
-        })
-
-    if (!subscriptionMap.containsKey(topic)) {
-      subscriptionMap[topic] = HashMap()
+        .doOnError { error ->
+          Log.e("MQTT Subscribe", "" + error.message)
+          val reasonCodes = (error as? Mqtt5SubAckException)?.mqttMessage?.reasonCodes
+          topics.forEachIndexed { index, topic ->
+            val reasonCode = reasonCodes?.getOrNull(index)?.code ?: SUBSCRIPTION_ERROR
+            MqttCore.nativeOnSubscribeFailed(clientId, topic, reasonCode, error.message.toString())
+          }
+        }
+        .subscribe(
+          {},
+          { throwable ->
+            // This is the error handler in the subscribe method.
+            // It will be called if an error occurs in the observable chain.
+            Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
+          })
     }
-    subscriptionMap[topic]?.set(eventId, Subscription(disposable, qos))
   }
 
-  fun unsubscribeMqtt(eventId: String, topic: String) {
-    val allSubscriptions = subscriptionMap[topic]
-    if (allSubscriptions == null) {
-      Log.e("MQTT Unsubscribe", "unable to unsubscribe topic: $topic")
-      return
-    }
-    allSubscriptions[eventId]?.disposable?.dispose()
-    if (allSubscriptions.size > 1) {
-      allSubscriptions.remove(eventId)
-    } else {
+  @DoNotStrip
+  fun unsubscribe(topic: String) {
+    lane.execute {
       val disposable: Disposable = mqtt.unsubscribeWith()
         .addTopicFilter(topic)
         .applyUnsubscribe()
         .doOnSuccess { unsubAck ->
           // TODO: Replace with LogWrapper when available on bridge
-          Log.e("MQTT Unsubscribe", "" + unsubAck.reasonString)
+          Log.d("MQTT Unsubscribe", "" + unsubAck.reasonString)
         }
         .doOnError { error ->
           // TODO: Replace with LogWrapper when available on bridge
           Log.e("MQTT Unsubscribe", "" + error.message)
-          val params = HashMap<String, Any>().apply {
-            put("clientUnsubscribed", false)
-            put("errorMessage", error.message.toString())
-            put("errorType", "UNSUBSCRIPTION")
-            put("topic", topic)
-            put("reasonCode", UNSUBSCRIPTION_ERROR)
-          }
-          emitJsiEvent(clientId + ERROR_EVENT, params)
+          MqttCore.nativeOnUnsubscribeFailed(clientId, topic, error.message.toString())
         }
         .subscribe(
           {},
@@ -266,38 +305,74 @@ class MqttHelper(
             // It will be called if an error occurs in the observable chain.
             Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
           })
-      subscriptionMap.remove(topic)
     }
   }
 
-  fun getConnectionStatusMqtt(): String {
-    return when (mqtt.state) {
-      MqttClientState.CONNECTED -> {
-        CONNECTED
-      }
-
-      MqttClientState.DISCONNECTED -> {
-        DISCONNECTED
+  /**
+   * The payload is a direct ByteBuffer filled by the JSI layer; HiveMQ keeps a reference to it instead of copying.
+   */
+  @DoNotStrip
+  fun publish(topic: String, payload: ByteBuffer, qos: Int, retain: Boolean) {
+    lane.execute {
+      // Covers building the PUBLISH and handing it to HiveMQ; the network write happens on its own threads.
+      Trace.beginSection("MqttHelper.publish")
+      try {
+        val publish = Mqtt5Publish.builder()
+          .topic(topic)
+          .qos(MqttQos.fromCode(qos) ?: MqttQos.AT_MOST_ONCE)
+          .retain(retain)
+          .payload(payload)
+          .build()
+        val disposable: Disposable = mqtt.publish(Flowable.just(publish))
+          .doOnNext { result ->
+            result.error.ifPresent { error ->
+              Log.e("MQTT Publish", "" + error.message)
+              MqttCore.nativeOnPublishFailed(clientId, topic, error.message.toString())
+            }
+          }
+          .subscribe(
+            {},
+            { throwable ->
+              // This is the error handler in the subscribe method.
+              // It will be called if an error occurs in the observable chain.
+              Log.e("RxJava", "Error occurred in subscribe: ${throwable.message}")
+              publishFailed(topic, throwable)
+            })
+      } catch (e: Exception) {
+        // An invalid topic makes the builder throw; SerialLane would only log it.
+        Log.e("MQTT Publish", "" + e.message)
+        publishFailed(topic, e)
+      } finally {
+        Trace.endSection()
       }
+    }
+  }
 
-      MqttClientState.CONNECTING -> {
-        CONNECTING
-      }
+  private fun publishFailed(topic: String, cause: Throwable) {
+    MqttCore.nativeOnPublishFailed(clientId, topic, "Failed to publish message on topic: $topic (${cause.message})")
+  }
 
-      MqttClientState.DISCONNECTED_RECONNECT -> {
-        DISCONNECTED
-      }
+  /**
+   * Sends the PUBACK/PUBREC of a publish passed to the core with this acknowledgement. Called from any thread.
+   */
+  @DoNotStrip
+  fun acknowledge(acknowledgement: Long) {
+    unacknowledged.remove(acknowledgement)?.acknowledge()
+  }
 
-      MqttClientState.CONNECTING_RECONNECT -> {
-        CONNECTING
+  /**
+   * Called by the core when the client is removed.
+   */
+  @DoNotStrip
+  fun close() {
+    lane.execute {
+      publishes?.dispose()
+      publishes = null
+      unacknowledged.clear()
+      if (this::mqtt.isInitialized && mqtt.state.isConnectedOrReconnect) {
+        mqtt.disconnect().onErrorComplete().subscribe()
       }
+      MqttManager.releaseLane(clientId, lane)
     }
   }
 }
-
-data class Subscription(
-  val disposable: Disposable,
-  val qos: Int
-)
-
-
@@ -1,91 +1,59 @@
 package com.d11.rn.mqtt
 
 import android.util.Log
-import java.util.concurrent.Callable
+import java.util.concurrent.ConcurrentHashMap
 import java.util.concurrent.ExecutorService
 import java.util.concurrent.Executors
+import java.util.concurrent.atomic.AtomicInteger
 
 object MqttManager {
 
-    private val clientMap: HashMap<String, MqttHelper> = HashMap()
-    private val executor: ExecutorService = Executors.newSingleThreadExecutor()
+    private val threadCount = AtomicInteger()
 
-    fun createMqtt(
-        clientId: String,
-        host: String,
-        port: Int,
-        enableSslConfig:Boolean,
-        emitJsiEvent: (eventId: String, payload: HashMap<String, Any>) -> Unit
-    ) {
-        executor.submit {
-            if (!clientMap.containsKey(clientId)) {
-                clientMap[clientId] = MqttHelper(clientId, host, port, enableSslConfig, emitJsiEvent)
-            } else {
-                Log.w("MqttManager", "client already exists for clientId: $clientId with host: $host, port: $port")
-            }
+    private val pool: ExecutorService =
+        Executors.newFixedThreadPool(maxOf(2, Runtime.getRuntime().availableProcessors())) { runnable ->
+            Thread(runnable, "mqtt-worker-${threadCount.incrementAndGet()}").apply { isDaemon = true }
         }
-    }
 
-    fun removeMqtt(clientId: String) {
-        executor.submit {
-            clientMap.remove(clientId)
-        }
-    }
+    private val lanes = ConcurrentHashMap<String, SerialLane>()
 
-    fun connectMqtt(
+    /**
+     * Creates the HiveMQ transport of a client and registers it with the shared C++ core, which owns the client from
+     * then on. JSI calls (connect, subscribe, ...) go straight to the core. onRegistered runs on the client's lane once
+     * the core has the client (or already had one with that id), with the exception when creating it failed.
+     */
+    fun createMqtt(
         clientId: String,
-        options: MqttConnectOptions,
+        host: String,
+        port: Int,
+        enableSslConfig: Boolean,
+        onRegistered: (Exception?) -> Unit = {}
     ) {
-        executor.submit {
-            val client = clientMap[clientId]
-            if (client != null) {
-                client.connect(options)
-            } else {
-                Log.w("MqttManager", "unable to connect as the client for clientId: $clientId does not exist")
+        val lane = laneFor(clientId)
+        lane.execute {
+            try {
+                val helper = MqttHelper(clientId, host, port, enableSslConfig, lane)
+                if (MqttCore.nativeRegisterClient(clientId, helper)) {
+                    helper.initialize()
+                } else {
+                    Log.w("MqttManager", "client already exists for clientId: $clientId with host: $host, port: $port")
+                }
+                onRegistered(null)
+            } catch (e: Exception) {
+                onRegistered(e)
             }
         }
     }
 
-    fun disconnectMqtt(clientId: String) {
-        executor.submit {
-            val client = clientMap[clientId]
-            if (client != null) {
-                client.disconnectMqtt()
-            } else {
-                Log.w("MqttManager", "unable to disconnect as the client for clientId: $clientId does not exist")
-            }
-        }
-    }
-
-    fun subscribeMqtt(id: String, clientId: String, topic: String, qos: Int) {
-        executor.submit {
-            val client = clientMap[clientId]
-            if (client != null) {
-                client.subscribeMqtt(id, topic, qos)
-            } else {
-                Log.w("MqttManager", "unable to subscribe as the client for clientId: $clientId does not exist")
-            }
-        }
-    }
-
-    fun unsubscribeMqtt(eventId: String, clientId: String, topic: String) {
-        executor.submit {
-            val client = clientMap[clientId]
-            if (client != null) {
-                client.unsubscribeMqtt(eventId, topic)
-            } else {
-                Log.w("MqttManager", "unable to unsubscribe as the client for clientId: $clientId does not exist")
-            }
-        }
-    }
+    /**
+     * Lane that runs the HiveMQ calls of one client in the order the core issued them, on the shared worker pool.
+     */
+    internal fun laneFor(clientId: String): SerialLane = lanes.getOrPut(clientId) { SerialLane(pool) }
 
-    fun getConnectionStatusMqtt(clientId: String): String {
-        return try {
-            executor.submit(Callable {
-                clientMap[clientId]?.getConnectionStatusMqtt() ?: "disconnected"
-            }).get()
-        } catch (e: Exception) {
-            "disconnected"
-        }
+    /**
+     * Forgets the lane of a closed client; a client created later with the same id gets a new one.
+     */
+    internal fun releaseLane(clientId: String, lane: SerialLane) {
+        lanes.remove(clientId, lane)
     }
 }
@@ -1,19 +1,16 @@
 package com.d11.rn.mqtt
 
 import android.util.Log
-import com.d11.rn.mqtt.helpers.MapUtils
 import com.facebook.react.bridge.Promise
 import com.facebook.react.bridge.ReactApplicationContext
 import com.facebook.react.bridge.ReactContextBaseJavaModule
 import com.facebook.react.bridge.ReactMethod
-import com.facebook.react.bridge.WritableMap
+import com.facebook.proguard.annotations.DoNotStrip
 import com.facebook.react.module.annotations.ReactModule
-import com.facebook.react.modules.core.DeviceEventManagerModule
-import java.io.Serializable
 
 @ReactModule(name = MqttModuleImpl.NAME)
 class MqttModuleImpl(reactContext: ReactApplicationContext?) :
-    ReactContextBaseJavaModule(reactContext), MqttModule {
+    ReactContextBaseJavaModule(reactContext) {
     companion object {
         const val NAME = "MqttModule"
       init {
@@ -30,10 +27,30 @@ class MqttModuleImpl(reactContext: ReactApplicationContext?) :
       return NAME
     }
 
-    private external fun nativeInstallJSIBindings(runtimePtr: Long)
+    private external fun nativeInstallJSIBindings(runtimePtr: Long, storageDirectory: String)
 
     private external fun nativeMultiply(a: Int, b: Int): Int
 
+    private external fun nativeFlushJSQueue()
+
+    private external fun nativeReleaseJSIBindings()
+
+    /**
+     * The React instance is torn down (reload or teardown) while its runtime still exists: release the JS listeners.
+     */
+    override fun invalidate() {
+      nativeReleaseJSIBindings()
+      super.invalidate()
+    }
+
+    /**
+     * Called from cpp-adapter.cpp when JS-thread work (event delivery) is queued on the native side.
+     */
+    @DoNotStrip
+    private fun scheduleJSQueueFlush() {
+      reactApplicationContext.runOnJSQueueThread { nativeFlushJSQueue() }
+    }
+
     @ReactMethod(isBlockingSynchronousMethod = true)
     fun installJSIModule(): Boolean {
       val context = reactApplicationContext ?: return false
@@ -41,7 +58,8 @@ class MqttModuleImpl(reactContext: ReactApplicationContext?) :
       val reactContextValue = reactContext?.get() ?: 0L
 
       return if (reactContextValue != 0L) {
-        nativeInstallJSIBindings(reactContextValue)
+        // App private storage for the native engine's outbound stores.
+        nativeInstallJSIBindings(reactContextValue, context.filesDir.absolutePath)
         true
       } else {
         false
@@ -53,52 +71,26 @@ class MqttModuleImpl(reactContext: ReactApplicationContext?) :
     promise.resolve(nativeMultiply(a, b))
   }
 
+  /**
+   * Creates the client's transport and hands it to the shared C++ core. Every other call (connect, subscribe,
+   * publish, ...) is a JSI host function implemented by the core, see cpp/MqttJSIModule.cpp. The promise resolves
+   * once the core has the client, so JS calls made after awaiting it (setLastValueCache, ...) find it.
+   */
   @ReactMethod
   fun createMqtt(clientId: String, host: String, port: Int, enableSslConfig: Boolean, promise: Promise) {
         try {
-            MqttManager.createMqtt(clientId, host, port, enableSslConfig, this::emitJsiEvent)
-            promise.resolve(null)
+            MqttManager.createMqtt(clientId, host, port, enableSslConfig) { error ->
+                if (error == null) {
+                    promise.resolve(null)
+                } else {
+                    promise.reject("Error", "Failed to create MQTT connection", error)
+                    Log.e("MQTT", "Error in createMqtt", error)
+                }
+            }
             Log.d("MQTT", "connect called via React Native bridge")
         } catch (e: Exception) {
             promise.reject("Error", "Failed to create MQTT connection", e)
             Log.e("MQTT", "Error in createMqtt", e)
         }
   }
-
-    private fun emitJsiEvent(eventId: String, payload: HashMap<String, Any>) {
-        reactApplicationContext
-            .getJSModule(DeviceEventManagerModule.RCTDeviceEventEmitter::class.java)
-            .emit(eventId, MapUtils.toWritableMap(payload))
-    }
-
-    override fun removeMqtt(clientId: String) {
-        MqttManager.removeMqtt(clientId)
-      Log.d("::::D11MQTT",":::: removeMqtt called via jsi bridge")
-    }
-
-    override fun connectMqtt(clientId: String, options: HashMap<String, Serializable>) {
-        MqttManager.connectMqtt(clientId, MqttConnectOptions(options))
-      Log.d("::::D11MQTT",":::: connectMqtt called via jsi bridge")
-
-    }
-
-    override fun disconnectMqtt(clientId: String) {
-        MqttManager.disconnectMqtt(clientId)
-      Log.d("::::D11MQTT",":::: disconnectMqtt called via jsi bridge")
-    }
-
-    override fun subscribeMqtt(eventId: String, clientId: String, topic: String, qos: Integer) {
-        MqttManager.subscribeMqtt(eventId, clientId, topic, qos.toInt())
-      Log.d("::::D11MQTT",":::: subscribeMqtt called via jsi bridge")
-    }
-
-    override fun unsubscribeMqtt(eventId: String, clientId: String, topic: String) {
-        MqttManager.unsubscribeMqtt(eventId, clientId, topic)
-      Log.d("::::D11MQTT",":::: unsubscribeMqtt called via jsi bridge")
-    }
-
-    override fun getConnectionStatusMqtt(clientId: String): String {
-        return MqttManager.getConnectionStatusMqtt(clientId)
-      Log.d("::::D11MQTT",":::: getConnectionStatusMqtt called via jsi bridge")
-    }
 }
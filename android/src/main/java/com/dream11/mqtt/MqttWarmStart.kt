@@ -0,0 +1,52 @@
+package com.d11.rn.mqtt
+
+import android.content.Context
+import android.util.Log
+import com.facebook.proguard.annotations.DoNotStrip
+import kotlin.concurrent.thread
+
+/**
+ * Warm start of the native engine: call MqttWarmStart.start(this) from Application.onCreate. The clients JS created
+ * with warmStart: true at the last launch connect and subscribe again while the JS bundle loads, and hold what they
+ * receive until JS creates them; see cpp/MqttWarmStart.h.
+ */
+@DoNotStrip
+object MqttWarmStart {
+  init {
+    try {
+      System.loadLibrary("mqtt")
+    } catch (ignored: Exception) {
+      Log.d("mqtt", "lib load failed")
+    }
+  }
+
+  /**
+   * Supplies the credentials of a recorded client whose connect had a username or password. Sessions do not record
+   * them, so keep them where the app keeps its secrets (the Android Keystore, EncryptedSharedPreferences).
+   */
+  fun interface CredentialsProvider {
+    /**
+     * Returns arrayOf(username, password) for clientId, or null to leave the client to JS.
+     */
+    @DoNotStrip
+    fun credentials(clientId: String): Array<String>?
+  }
+
+  @JvmStatic
+  private external fun nativeWarmStart(storageDirectory: String, credentials: CredentialsProvider?): Int
+
+  /**
+   * Starts the recorded clients on a background thread, so reading their sessions does not delay the launch.
+   * Clients that connected with credentials are only started when credentials supplies them.
+   */
+  @JvmStatic
+  @JvmOverloads
+  fun start(context: Context, credentials: CredentialsProvider? = null) {
+    // Same directory MqttModuleImpl passes to nativeInstallJSIBindings.
+    val storageDirectory = context.applicationContext.filesDir.absolutePath
+    thread(name = "mqtt-warm-start") {
+      val started = nativeWarmStart(storageDirectory, credentials)
+      Log.d("mqtt", "warm started $started clients")
+    }
+  }
+}
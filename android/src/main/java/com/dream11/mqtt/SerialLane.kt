@@ -0,0 +1,47 @@
+package com.d11.rn.mqtt
+
+import android.util.Log
+import java.util.ArrayDeque
+import java.util.concurrent.Executor
+
+/**
+ * Runs tasks one at a time, in submission order, on a shared pool. Each client gets its own lane, so the calls of
+ * one client stay ordered while different clients proceed in parallel.
+ */
+internal class SerialLane(private val pool: Executor) : Executor {
+  private val tasks = ArrayDeque<Runnable>()
+  private var scheduled = false
+
+  override fun execute(task: Runnable) {
+    synchronized(this) {
+      tasks.add(task)
+      if (scheduled) {
+        return
+      }
+      scheduled = true
+    }
+    pool.execute { drain() }
+  }
+
+  private fun drain() {
+    // A bounded batch per turn keeps a busy client from holding a pool thread while other lanes wait.
+    repeat(MAX_TASKS_PER_TURN) {
+      val task = synchronized(this) {
+        tasks.poll() ?: run {
+          scheduled = false
+          return
+        }
+      }
+      try {
+        task.run()
+      } catch (e: Exception) {
+        Log.e("MqttManager", "Task failed: ${e.message}")
+      }
+    }
+    pool.execute { drain() }
+  }
+
+  companion object {
+    private const val MAX_TASKS_PER_TURN = 16
+  }
+}
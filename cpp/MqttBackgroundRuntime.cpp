@@ -0,0 +1,205 @@
+//
+//  MqttBackgroundRuntime.cpp
+//  d11-mqtt
+//
+
+#include "MqttBackgroundRuntime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <utility>
+
+#include "MqttConstants.h"
+#include "MqttEventDispatcher.h"
+#include "MqttJson.h"
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+static std::mutex current_background_runtime_mutex;
+static std::shared_ptr<BackgroundRuntime> current_background_runtime;
+
+BackgroundRuntime::BackgroundRuntime(RuntimeFactory createRuntime, Installer install, std::shared_ptr<EventSink> sink)
+    : createRuntime_(std::move(createRuntime)), install_(std::move(install)), sink_(std::move(sink)) {}
+
+BackgroundRuntime::~BackgroundRuntime() {
+    loop_.stop();
+    // The thread is gone, so the runtime can be torn down here; its functions go first.
+    handlers_.clear();
+    runtime_.reset();
+}
+
+std::shared_ptr<BackgroundRuntime> BackgroundRuntime::current() {
+    std::lock_guard<std::mutex> lock(current_background_runtime_mutex);
+    return current_background_runtime;
+}
+
+void BackgroundRuntime::setCurrent(std::shared_ptr<BackgroundRuntime> runtime) {
+    std::shared_ptr<BackgroundRuntime> previous;
+    {
+        std::lock_guard<std::mutex> lock(current_background_runtime_mutex);
+        previous = std::move(current_background_runtime);
+        current_background_runtime = std::move(runtime);
+    }
+    // previous, if this was the last reference, stops its thread outside the lock.
+}
+
+void BackgroundRuntime::addHandler(const std::string &eventId, std::string source, PayloadFormat format) {
+    {
+        std::lock_guard<std::mutex> lock(routesMutex_);
+        auto next = std::make_shared<RouteMap>(*std::atomic_load(&routes_));
+        (*next)[eventId] = format;
+        std::atomic_store(&routes_, std::shared_ptr<const RouteMap>(std::move(next)));
+    }
+    // Queued ahead of every message routed to it from now on.
+    loop_.post([this, eventId, source = std::move(source), format] { evaluateHandler(eventId, source, format); });
+}
+
+void BackgroundRuntime::removeHandler(const std::string &eventId) {
+    {
+        std::lock_guard<std::mutex> lock(routesMutex_);
+        auto next = std::make_shared<RouteMap>(*std::atomic_load(&routes_));
+        if (next->erase(eventId) == 0) {
+            return;
+        }
+        std::atomic_store(&routes_, std::shared_ptr<const RouteMap>(std::move(next)));
+    }
+    loop_.post([this, eventId] { handlers_.erase(eventId); });
+}
+
+bool BackgroundRuntime::deliver(const std::string &eventId, MqttMessage &message) {
+    auto routes = std::atomic_load(&routes_);
+    auto route = routes->find(eventId);
+    if (route == routes->end()) {
+        return false;
+    }
+    if (route->second != PayloadFormat::Json) {
+        message.json.reset();
+    } else if (!message.json) {
+        // Parsed here, on the network thread, as for the UI runtime.
+        message.json = parseJson(message.payload);
+    }
+    loop_.post([this, eventId, message = std::move(message)]() mutable { callHandler(eventId, message); });
+    return true;
+}
+
+bool BackgroundRuntime::ensureRuntime(std::string &error) {
+    if (runtime_) {
+        return true;
+    }
+    MQTT_TRACE_SECTION("mqtt::BackgroundRuntime::create");
+    try {
+        runtime_ = createRuntime_ ? createRuntime_() : nullptr;
+        if (!runtime_) {
+            error = "No background JS runtime available on this platform";
+            return false;
+        }
+        install_(*runtime_);
+        installTimers();
+        return true;
+    } catch (const std::exception &exception) {
+        error = std::string("Failed to create the background JS runtime: ") + exception.what();
+        runtime_.reset();
+        return false;
+    }
+}
+
+void BackgroundRuntime::installTimers() {
+    jsi::Runtime &runtime = *runtime_;
+    runtime.global().setProperty(
+        runtime, "setTimeout",
+        jsi::Function::createFromHostFunction(
+            runtime, jsi::PropNameID::forAscii(runtime, "setTimeout"), 2,
+            [this](jsi::Runtime &runtime, const jsi::Value &, const jsi::Value *arguments, size_t count) {
+                if (count < 1 || !arguments[0].isObject() || !arguments[0].getObject(runtime).isFunction(runtime)) {
+                    throw jsi::JSError(runtime, "setTimeout expects a function");
+                }
+                auto callback =
+                    std::make_shared<jsi::Function>(arguments[0].getObject(runtime).getFunction(runtime));
+                double delayMs = count > 1 && arguments[1].isNumber() ? std::max(0.0, arguments[1].getNumber()) : 0;
+                auto id = loop_.addTimer(std::chrono::milliseconds(static_cast<int64_t>(delayMs)), [this, callback] {
+                    try {
+                        callback->call(*runtime_);
+                    } catch (...) {
+                        // A timer belongs to no subscription to report to; it must not take the thread down.
+                    }
+                });
+                return jsi::Value(static_cast<double>(id));
+            }));
+    runtime.global().setProperty(
+        runtime, "clearTimeout",
+        jsi::Function::createFromHostFunction(
+            runtime, jsi::PropNameID::forAscii(runtime, "clearTimeout"), 1,
+            [this](jsi::Runtime &runtime, const jsi::Value &, const jsi::Value *arguments, size_t count) {
+                if (count > 0 && arguments[0].isNumber()) {
+                    loop_.cancelTimer(static_cast<EventLoop::TimerId>(arguments[0].getNumber()));
+                }
+                return jsi::Value::undefined();
+            }));
+}
+
+void BackgroundRuntime::evaluateHandler(const std::string &eventId, const std::string &source, PayloadFormat format) {
+    MQTT_TRACE_SECTION("mqtt::BackgroundRuntime::evaluateHandler");
+    std::string error;
+    if (!ensureRuntime(error)) {
+        emitError(eventId, error);
+        return;
+    }
+    jsi::Runtime &runtime = *runtime_;
+    try {
+        jsi::Value value = runtime.evaluateJavaScript(std::make_shared<jsi::StringBuffer>("(" + source + "\n)"),
+                                                      "mqtt-background-handler:" + eventId);
+        if (!value.isObject() || !value.getObject(runtime).isFunction(runtime)) {
+            emitError(eventId, "The background handler source does not evaluate to a function");
+            return;
+        }
+        auto post = std::make_shared<jsi::Function>(jsi::Function::createFromHostFunction(
+            runtime, jsi::PropNameID::forAscii(runtime, "post"), 1,
+            [this, eventId](jsi::Runtime &, const jsi::Value &, const jsi::Value *arguments, size_t count) {
+                if (count > 0) {
+                    emitResult(eventId, arguments[0]);
+                }
+                return jsi::Value::undefined();
+            }));
+        handlers_[eventId] =
+            Handler{std::make_shared<jsi::Function>(value.getObject(runtime).getFunction(runtime)), post, format};
+    } catch (const jsi::JSError &exception) {
+        emitError(eventId, exception.getMessage());
+    } catch (const std::exception &exception) {
+        emitError(eventId, exception.what());
+    }
+}
+
+void BackgroundRuntime::callHandler(const std::string &eventId, MqttMessage &message) {
+    auto it = handlers_.find(eventId);
+    if (it == handlers_.end()) {
+        return;
+    }
+    MQTT_TRACE_SECTION("mqtt::BackgroundRuntime::callHandler");
+    Handler handler = it->second;
+    jsi::Runtime &runtime = *runtime_;
+    try {
+        jsi::Value result = handler.function->call(
+            runtime, convertMqttMessageToJSIValue(runtime, message, handler.format), jsi::Value(runtime, *handler.post));
+        if (!result.isUndefined()) {
+            emitResult(eventId, result);
+        }
+    } catch (const jsi::JSError &exception) {
+        emitError(eventId, exception.getMessage());
+    } catch (const std::exception &exception) {
+        emitError(eventId, exception.what());
+    }
+}
+
+void BackgroundRuntime::emitResult(const std::string &eventId, const jsi::Value &result) {
+    sink_->emit(eventId + events::BACKGROUND_RESULT, convertJSIValueToEventValue(*runtime_, result));
+}
+
+void BackgroundRuntime::emitError(const std::string &eventId, const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("errorMessage", errorMessage);
+    sink_->emit(eventId + events::BACKGROUND_ERROR, EventValue(std::move(payload)));
+}
+
+}
@@ -0,0 +1,97 @@
+//
+//  MqttBackgroundRuntime.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jsi/jsi.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "MqttEventLoop.h"
+#include "MqttEventSink.h"
+#include "MqttMessage.h"
+
+namespace mqtt {
+
+namespace jsi = facebook::jsi;
+
+/**
+ * Second JS runtime owned by the library, on a thread of its own, for subscriptions whose messages should not reach
+ * the UI JS thread at all.
+ *
+ * A subscription registers the source of a handler function `(message, post) => result` for its eventId. Every
+ * message of that eventId is then passed to the handler on the background thread instead of being queued for the UI
+ * runtime; only what the handler returns (unless undefined) or passes to post() is emitted to the UI runtime as
+ * eventId + events::BACKGROUND_RESULT. Handlers that fail to evaluate or throw are reported as eventId +
+ * events::BACKGROUND_ERROR.
+ *
+ * The runtime is created on first use with the platform's factory. The installer gives it the __MqttModuleProxy host
+ * functions of the UI runtime, without the event listener ones; setTimeout and clearTimeout are added here so
+ * handlers can aggregate over time. Handler state lives in the handler's closure.
+ */
+class BackgroundRuntime {
+public:
+    using RuntimeFactory = std::function<std::unique_ptr<jsi::Runtime>()>;
+    using Installer = std::function<void(jsi::Runtime &runtime)>;
+
+    BackgroundRuntime(RuntimeFactory createRuntime, Installer install, std::shared_ptr<EventSink> sink);
+    ~BackgroundRuntime();
+
+    BackgroundRuntime(const BackgroundRuntime &) = delete;
+    BackgroundRuntime &operator=(const BackgroundRuntime &) = delete;
+
+    /**
+     * Background runtime of the currently installed UI runtime, or nullptr when the platform has none (JSC).
+     */
+    static std::shared_ptr<BackgroundRuntime> current();
+    static void setCurrent(std::shared_ptr<BackgroundRuntime> runtime);
+
+    /**
+     * Routes the messages of eventId to the handler evaluated from source, replacing a previous one. JS thread.
+     */
+    void addHandler(const std::string &eventId, std::string source, PayloadFormat format);
+    void removeHandler(const std::string &eventId);
+
+    /**
+     * Queues message for the handler of eventId and returns true, or returns false, leaving message untouched, when
+     * eventId has none. Any thread.
+     */
+    bool deliver(const std::string &eventId, MqttMessage &message);
+
+private:
+    struct Handler {
+        std::shared_ptr<jsi::Function> function;
+        std::shared_ptr<jsi::Function> post;
+        PayloadFormat format;
+    };
+    using RouteMap = std::unordered_map<std::string, PayloadFormat>;
+
+    // Loop thread only, like everything touching runtime_.
+    bool ensureRuntime(std::string &error);
+    void installTimers();
+    void evaluateHandler(const std::string &eventId, const std::string &source, PayloadFormat format);
+    void callHandler(const std::string &eventId, MqttMessage &message);
+    void emitResult(const std::string &eventId, const jsi::Value &result);
+    void emitError(const std::string &eventId, const std::string &errorMessage);
+
+    const RuntimeFactory createRuntime_;
+    const Installer install_;
+    const std::shared_ptr<EventSink> sink_;
+
+    // Copy-on-write, replaced on the JS thread and read with atomic_load by the network threads delivering messages.
+    std::shared_ptr<const RouteMap> routes_ = std::make_shared<const RouteMap>();
+    std::mutex routesMutex_;
+
+    // Destroyed after loop_, whose pending tasks and timers hold functions of the runtime.
+    std::unique_ptr<jsi::Runtime> runtime_;
+    std::unordered_map<std::string, Handler> handlers_;
+    EventLoop loop_;
+};
+
+}
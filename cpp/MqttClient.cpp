@@ -0,0 +1,748 @@
+//
+//  MqttClient.cpp
+//  d11-mqtt
+//
+
+#include "MqttClient.h"
+#include "MqttTopic.h"
+#include "MqttTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+
+namespace {
+
+// MQTT 5 reason codes of a CONNACK or DISCONNECT that new credentials may resolve.
+constexpr int REASON_BAD_USERNAME_OR_PASSWORD = 0x86;
+constexpr int REASON_NOT_AUTHORIZED = 0x87;
+constexpr int REASON_BAD_AUTHENTICATION_METHOD = 0x8C;
+// Sent by brokers that limit a connection to the lifetime of its token.
+constexpr int REASON_MAXIMUM_CONNECT_TIME = 0xA0;
+
+// Subscriber of the warm start filters in the SubscriptionTable; JS eventIds never start with a control character.
+constexpr const char *WARM_START_EVENT_ID = "\x01warm_start";
+
+bool isCredentialsReasonCode(int reasonCode) {
+    return reasonCode == REASON_BAD_USERNAME_OR_PASSWORD || reasonCode == REASON_NOT_AUTHORIZED ||
+           reasonCode == REASON_BAD_AUTHENTICATION_METHOD || reasonCode == REASON_MAXIMUM_CONNECT_TIME;
+}
+
+}
+
+Client::Client(std::string clientId, std::shared_ptr<Transport> transport, std::shared_ptr<EventSink> sink)
+: clientId_(std::move(clientId)), transport_(std::move(transport)), sink_(std::move(sink)),
+  pipeline_(std::make_shared<DeliveryPipeline>(
+      [this](InboundMessage &&message, std::shared_ptr<DeliveryTicket> ticket) {
+          route(std::move(message), std::move(ticket));
+      },
+      [this](uint64_t acknowledgement) { acknowledge(acknowledgement); })) {}
+
+Client::~Client() {
+    pipeline_->close();
+}
+
+void Client::connect(const ConnectOptions &options) {
+    std::shared_ptr<Transport> transport;
+    bool startedConnecting = false;
+    bool adopted = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        if (awaitingAdoption_) {
+            // JS takes the warm started client over: a connection that is up or on its way is kept.
+            awaitingAdoption_ = false;
+            adoptedAt_ = monotonicNanos();
+            adopted = state_ != ConnectionState::Disconnected;
+        }
+        if (state_ == ConnectionState::Disconnected) {
+            state_.store(ConnectionState::Connecting, std::memory_order_release);
+            startedConnecting = true;
+        }
+        lastOptions_ = options;
+        wantConnected_ = true;
+        reconnectDue_ = false;
+        credentialsRejected_ = false;
+        transport = transport_;
+    }
+    if (adopted) {
+        // Its connected event went out before JS listened; a CONNACK still to come is reported as usual.
+        if (connectionState() == ConnectionState::Connected) {
+            emitConnectionState(ConnectionState::Connected);
+            EventValue::Map payload;
+            payload.emplace_back("reasonCode", lastReasonCode());
+            emitClientEvent(events::CONNECTED, std::move(payload));
+        }
+        return;
+    }
+    if (startedConnecting) {
+        emitConnectionState(ConnectionState::Connecting);
+    }
+    transport->connect(options);
+}
+
+void Client::warmStart(const ConnectOptions &options, const std::vector<std::pair<std::string, int>> &filters,
+                       size_t capacity) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        for (const auto &filter : filters) {
+            subscriptions_.add(WARM_START_EVENT_ID, filter.first, filter.second);
+            warmFilters_.push_back(filter.first);
+        }
+        heldCapacity_ = capacity;
+    }
+    metrics_.markWarmStarted();
+    connect(options);
+    std::lock_guard<std::mutex> lock(mutex_);
+    awaitingAdoption_ = !closed_;
+}
+
+void Client::setSessionObserver(SessionObserver observer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sessionObserver_ = std::move(observer);
+    recordedFilters_.clear();
+}
+
+void Client::disconnect() {
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        wantConnected_ = false;
+        reconnectDue_ = false;
+        connectionLostAt_ = 0;
+        transport = transport_;
+    }
+    transport->disconnect();
+}
+
+void Client::subscribe(const std::string &eventId, const std::string &topic, int qos, bool replayLastValue,
+                       std::shared_ptr<MessageFilter> filter) {
+    std::shared_ptr<Transport> transport;
+    bool acknowledgeNow = false;
+    int grantedQos = qos;
+    std::vector<MqttMessage> replay;
+    bool warmStartDone = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        bool filterWasPending = subscriptions_.hasPendingAck(topic);
+        bool needsSubscribe = subscriptions_.add(eventId, topic, qos);
+        setMessageFilterLocked(eventId, filter);
+        if (!warmFilters_.empty()) {
+            claimWarmFilterLocked(topic, replay);
+            warmStartDone = warmFilters_.empty();
+        }
+        // Otherwise sent together with every other filter once the connection is up.
+        if (state_ == ConnectionState::Connected) {
+            if (needsSubscribe) {
+                transport = transport_;
+                grantedQos = subscriptions_.maxQos(topic);
+            } else if (!filterWasPending) {
+                // The broker already has this filter at a sufficient QoS, so there is no SUBACK to wait for.
+                subscriptions_.clearPending(eventId, topic);
+                acknowledgeNow = true;
+                grantedQos = subscriptions_.maxQos(topic);
+            }
+        }
+    }
+    if (transport) {
+        transport->subscribe(topic, grantedQos);
+    } else if (acknowledgeNow) {
+        EventValue::Map payload;
+        payload.emplace_back("message", "");
+        payload.emplace_back("topic", topic);
+        payload.emplace_back("qos", grantedQos);
+        sink_->emit(eventId + events::SUBSCRIBE_SUCCESS, EventValue(std::move(payload)));
+    }
+    // The cached last values go first, then the messages held since the warm start.
+    std::vector<MqttMessage> messages;
+    auto cache = replayLastValue ? lastValueCache() : nullptr;
+    if (cache) {
+        std::vector<LastValueCache::Value> values;
+        cache->collectMatches(topic, values);
+        int64_t now = monotonicNanos();
+        for (auto &value : values) {
+            MqttMessage message;
+            message.topic = std::move(value.topic);
+            message.payload = std::move(value.payload);
+            message.qos = value.qos;
+            message.receivedAt = now;
+            messages.push_back(std::move(message));
+        }
+    }
+    std::move(replay.begin(), replay.end(), std::back_inserter(messages));
+    const MessageProperties noProperties;
+    for (auto &message : messages) {
+        if (filter) {
+            FilterSubject subject(message.topic, message.payload, noProperties);
+            if (!filter->matches(subject)) {
+                continue;
+            }
+            message.json = subject.parsedJson();
+        }
+        sink_->emitMessage(eventId, std::move(message));
+    }
+    if (warmStartDone) {
+        recordSession(false);
+    }
+}
+
+void Client::unsubscribe(const std::string &eventId, const std::string &topic) {
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        setMessageFilterLocked(eventId, nullptr);
+        if (subscriptions_.remove(eventId, topic) && state_ == ConnectionState::Connected) {
+            transport = transport_;
+        }
+    }
+    if (transport) {
+        transport->unsubscribe(topic);
+        recordSession(false);
+    }
+}
+
+void Client::publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) {
+    // Reported here rather than left to the transports, which would put a packet the broker disconnects for on the
+    // wire (or truncate the topic).
+    const char *invalid = invalidTopicName(topic);
+    if (invalid == nullptr && size > MAX_REMAINING_LENGTH) {
+        invalid = "payload too large";
+    }
+    if (invalid != nullptr) {
+        onPublishFailed(topic, "Failed to publish message on topic: " + topic + " (" + invalid + ")");
+        return;
+    }
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        transport = transport_;
+    }
+    metrics_.recordSent(size);
+    transport->publish(topic, payload, size, qos, retain);
+}
+
+std::shared_ptr<MessageFilter> Client::messageFilter(const std::string &eventId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto filter = filters_.find(eventId);
+    return filter == filters_.end() ? nullptr : filter->second;
+}
+
+void Client::setMessageFilterLocked(const std::string &eventId, std::shared_ptr<MessageFilter> filter) {
+    auto previous = filters_.find(eventId);
+    if (previous != filters_.end()) {
+        if (previous->second->usesUserProperties()) {
+            userPropertyFilters_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        filters_.erase(previous);
+    }
+    if (filter) {
+        if (filter->usesUserProperties()) {
+            userPropertyFilters_.fetch_add(1, std::memory_order_relaxed);
+        }
+        filters_.emplace(eventId, std::move(filter));
+    }
+}
+
+void Client::setReconnectPolicy(const ReconnectPolicy &policy) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reconnectPolicy_ = policy;
+}
+
+std::chrono::milliseconds Client::reconnectDelay(const ReconnectPolicy &policy, int attempt, double random) {
+    double delay = static_cast<double>(policy.backoff.count()) * std::pow(2.0, attempt) +
+                   std::ceil(random * static_cast<double>(policy.jitter.count()));
+    delay = std::min(delay, static_cast<double>(policy.maxBackoff.count()));
+    return std::chrono::milliseconds(static_cast<int64_t>(delay));
+}
+
+const char *Client::statusOf(ConnectionState state) {
+    switch (state) {
+        case ConnectionState::Connected:
+            return status::CONNECTED;
+        case ConnectionState::Connecting:
+            return status::CONNECTING;
+        case ConnectionState::Disconnected:
+            return status::DISCONNECTED;
+    }
+    return status::DISCONNECTED;
+}
+
+void Client::close() {
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        state_.store(ConnectionState::Disconnected, std::memory_order_release);
+        transport = std::move(transport_);
+    }
+    reconnectTimer_.stop();
+    pipeline_->close();
+    transport->close();
+}
+
+void Client::setFlowControl(const FlowControl &flowControl) {
+    pipeline_->configure(flowControl);
+}
+
+void Client::onInitialized() {
+    metrics_.recordJsAttached(monotonicNanos());
+    EventValue::Map payload;
+    payload.emplace_back("clientInit", true);
+    emitClientEvent(events::CLIENT_INITIALIZE, std::move(payload));
+}
+
+void Client::onInitializationFailed(const std::string &errorMessage) {
+    emitClientEvent(events::MQTT_ERROR, initializationError(errorMessage));
+}
+
+EventValue::Map Client::initializationError(const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("clientInit", false);
+    payload.emplace_back("errorMessage", errorMessage);
+    payload.emplace_back("errorType", errorType::INITIALIZATION);
+    payload.emplace_back("reasonCode", INITIALIZATION_ERROR);
+    return payload;
+}
+
+void Client::onConnected(int reasonCode) {
+    std::shared_ptr<Transport> transport;
+    std::vector<std::pair<std::string, int>> filters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        state_.store(ConnectionState::Connected, std::memory_order_release);
+        lastReasonCode_.store(reasonCode, std::memory_order_relaxed);
+        retryCount_.store(0, std::memory_order_relaxed);
+        reconnectDue_ = false;
+        credentialsRejected_ = false;
+        if (connectionLostAt_ != 0) {
+            metrics_.recordReconnect((monotonicNanos() - connectionLostAt_) / 1000000);
+            connectionLostAt_ = 0;
+        }
+        lastConnectedAt_.store(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                   std::chrono::system_clock::now().time_since_epoch())
+                                   .count(),
+                               std::memory_order_relaxed);
+        // Every subscription is (re)sent on connect, so each of them gets a fresh success or failure event.
+        subscriptions_.markAllPending();
+        filters = subscriptions_.filters();
+        transport = transport_;
+    }
+
+    metrics_.recordFirstConnect(monotonicNanos());
+    emitConnectionState(ConnectionState::Connected);
+    EventValue::Map payload;
+    payload.emplace_back("reasonCode", reasonCode);
+    emitClientEvent(events::CONNECTED, std::move(payload));
+
+    // One SUBSCRIBE for all of them where the transport supports it, instead of a round trip per filter.
+    if (!filters.empty()) {
+        transport->subscribeMany(filters);
+    }
+    recordSession(true);
+}
+
+void Client::onConnectionFailed(int reasonCode, const std::string &errorMessage, const std::string &errorCause) {
+    bool wasDisconnected;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        wasDisconnected = state_ == ConnectionState::Disconnected;
+        state_.store(ConnectionState::Disconnected, std::memory_order_release);
+        lastReasonCode_.store(reasonCode, std::memory_order_relaxed);
+        int failures = retryCount_.fetch_add(1, std::memory_order_relaxed) + 1;
+        scheduleReconnectLocked(reasonCode, failures);
+    }
+    emitConnectionState(ConnectionState::Disconnected);
+
+    EventValue::Map payload;
+    payload.emplace_back("clientConnected", false);
+    payload.emplace_back("errorMessage", errorMessage);
+    payload.emplace_back("errorCause", errorCause);
+    payload.emplace_back("errorType", errorType::CONNECTION);
+    payload.emplace_back("reasonCode", CONNECTION_ERROR);
+    emitClientEvent(events::MQTT_ERROR, std::move(payload));
+
+    // The platform may also report the failed attempt as a disconnect; JS only sees one of them.
+    if (!wasDisconnected) {
+        emitDisconnected(reasonCode, errorMessage);
+    }
+}
+
+void Client::onDisconnected(int reasonCode, const std::string &errorMessage) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || state_ == ConnectionState::Disconnected) {
+            return;
+        }
+        // A failed attempt may be reported only as a disconnect; it is counted once onConnectionFailed follows.
+        int attempt = state_ == ConnectionState::Connected ? 0 : retryCount_.load(std::memory_order_relaxed) + 1;
+        if (attempt == 0 && wantConnected_) {
+            connectionLostAt_ = monotonicNanos();
+        }
+        state_.store(ConnectionState::Disconnected, std::memory_order_release);
+        lastReasonCode_.store(reasonCode, std::memory_order_relaxed);
+        scheduleReconnectLocked(reasonCode, attempt);
+    }
+    emitConnectionState(ConnectionState::Disconnected);
+    emitDisconnected(reasonCode, errorMessage);
+}
+
+void Client::onDisconnectFailed(const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("clientDisconnected", false);
+    payload.emplace_back("errorMessage", errorMessage);
+    payload.emplace_back("reasonCode", DISCONNECTION_ERROR);
+    emitClientEvent(events::DISCONNECTED, std::move(payload));
+}
+
+void Client::onSubscribed(const std::string &topic, int qos, const std::string &message) {
+    std::vector<std::string> eventIds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        eventIds = subscriptions_.takePendingAcks(topic);
+    }
+    recordSession(false);
+    for (const auto &eventId : eventIds) {
+        EventValue::Map payload;
+        payload.emplace_back("message", message);
+        payload.emplace_back("topic", topic);
+        payload.emplace_back("qos", qos);
+        sink_->emit(eventId + events::SUBSCRIBE_SUCCESS, EventValue(std::move(payload)));
+    }
+}
+
+void Client::onSubscribeFailed(const std::string &topic, int reasonCode, const std::string &errorMessage) {
+    std::vector<std::string> eventIds;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        // Failed filters stay in the table and are retried on the next connect.
+        eventIds = subscriptions_.takePendingAcks(topic);
+    }
+    for (const auto &eventId : eventIds) {
+        EventValue::Map payload;
+        payload.emplace_back("clientSubscribed", false);
+        payload.emplace_back("errorMessage", errorMessage);
+        payload.emplace_back("topic", topic);
+        payload.emplace_back("reasonCode", reasonCode);
+        sink_->emit(eventId + events::SUBSCRIBE_FAILED, EventValue(std::move(payload)));
+    }
+}
+
+void Client::onUnsubscribeFailed(const std::string &topic, const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("clientUnsubscribed", false);
+    payload.emplace_back("errorMessage", errorMessage);
+    payload.emplace_back("errorType", errorType::UNSUBSCRIPTION);
+    payload.emplace_back("topic", topic);
+    payload.emplace_back("reasonCode", UNSUBSCRIPTION_ERROR);
+    emitClientEvent(events::MQTT_ERROR, std::move(payload));
+}
+
+void Client::onPublishFailed(const std::string &topic, const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("errorMessage", errorMessage);
+    payload.emplace_back("errorType", errorType::PUBLISH);
+    payload.emplace_back("topic", topic);
+    payload.emplace_back("reasonCode", PUBLISH_ERROR);
+    emitClientEvent(events::MQTT_ERROR, std::move(payload));
+}
+
+void Client::onMessage(const std::string &topic, std::string payload, int qos, int64_t receivedAt,
+                       uint64_t acknowledgement, const UserProperties &userProperties) {
+    MQTT_TRACE_SECTION("mqtt::Client::onMessage");
+    if (receivedAt == 0) {
+        receivedAt = monotonicNanos();
+    }
+    // Counts the bytes that came over the network.
+    metrics_.recordReceived(topic, payload.size());
+    metrics_.recordFirstMessage(receivedAt);
+    std::vector<std::string> unsubscribe;
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!warmFilters_.empty() && adoptedAt_ != 0 &&
+            receivedAt - adoptedAt_ > std::chrono::nanoseconds(WARM_START_CLAIM_TIMEOUT).count()) {
+            expireWarmFiltersLocked(unsubscribe);
+            transport = transport_;
+        }
+    }
+    if (transport) {
+        for (const auto &filter : unsubscribe) {
+            transport->unsubscribe(filter);
+        }
+        recordSession(false);
+    }
+    std::string_view contentEncoding;
+    for (const auto &property : userProperties) {
+        if (property.first == CONTENT_ENCODING_PROPERTY) {
+            contentEncoding = property.second;
+            break;
+        }
+    }
+    std::string error;
+    if (!contentEncoding.empty() && !decompressor_.decompress(contentEncoding, payload, error)) {
+        EventValue::Map event;
+        event.emplace_back("errorMessage", error);
+        event.emplace_back("errorType", errorType::DECOMPRESSION);
+        event.emplace_back("topic", topic);
+        event.emplace_back("reasonCode", DECOMPRESSION_ERROR);
+        emitClientEvent(events::MQTT_ERROR, std::move(event));
+        // Redelivery would fail the same way.
+        if (acknowledgement != 0) {
+            acknowledge(acknowledgement);
+        }
+        return;
+    }
+    if (auto cache = lastValueCache()) {
+        cache->put(topic, payload, qos);
+    }
+    InboundMessage message{topic, std::move(payload), qos, receivedAt, acknowledgement, MessageProperties()};
+    if (userPropertyFilters_.load(std::memory_order_relaxed) > 0) {
+        message.userProperties.assign(userProperties.begin(), userProperties.end());
+    }
+    if (pipeline_->enabled()) {
+        pipeline_->push(std::move(message));
+        return;
+    }
+    route(std::move(message), nullptr);
+    if (acknowledgement != 0) {
+        acknowledge(acknowledgement);
+    }
+}
+
+void Client::route(InboundMessage &&inbound, std::shared_ptr<DeliveryTicket> ticket) {
+    std::vector<std::string> eventIds;
+    std::vector<std::shared_ptr<MessageFilter>> filters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        subscriptions_.collectMatches(inbound.topic, eventIds);
+        auto warm = std::remove(eventIds.begin(), eventIds.end(), WARM_START_EVENT_ID);
+        if (warm != eventIds.end()) {
+            eventIds.erase(warm, eventIds.end());
+            if (heldCapacity_ > 0) {
+                if (held_.size() == heldCapacity_) {
+                    held_.pop_front();
+                }
+                MqttMessage held;
+                held.topic = inbound.topic;
+                held.payload = inbound.payload;
+                held.qos = inbound.qos;
+                held.receivedAt = inbound.receivedAt;
+                held_.push_back(std::move(held));
+            }
+        }
+        if (!filters_.empty()) {
+            filters.reserve(eventIds.size());
+            for (const auto &eventId : eventIds) {
+                auto filter = filters_.find(eventId);
+                filters.push_back(filter == filters_.end() ? nullptr : filter->second);
+            }
+        }
+    }
+    std::shared_ptr<const JsonDocument> json;
+    if (!filters.empty()) {
+        // Decided before anything is copied for the subscriptions: a dropped message costs no more than this.
+        FilterSubject subject(inbound.topic, inbound.payload, inbound.userProperties);
+        size_t kept = 0;
+        for (size_t i = 0; i < eventIds.size(); i++) {
+            if (filters[i] && !filters[i]->matches(subject)) {
+                continue;
+            }
+            if (kept != i) {
+                eventIds[kept] = std::move(eventIds[i]);
+            }
+            kept++;
+        }
+        eventIds.resize(kept);
+        json = subject.parsedJson();
+    }
+    for (size_t i = 0; i < eventIds.size(); i++) {
+        bool last = i + 1 == eventIds.size();
+        MqttMessage message;
+        // Only overlapping filters pay for a copy; the last subscriber takes the topic and payload.
+        message.topic = last ? std::move(inbound.topic) : inbound.topic;
+        message.payload = last ? std::move(inbound.payload) : inbound.payload;
+        message.qos = inbound.qos;
+        message.receivedAt = inbound.receivedAt;
+        message.json = json;
+        message.ticket = last ? std::move(ticket) : ticket;
+        sink_->emitMessage(std::move(eventIds[i]), std::move(message));
+    }
+}
+
+void Client::acknowledge(uint64_t acknowledgement) {
+    std::shared_ptr<Transport> transport;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        transport = transport_;
+    }
+    transport->acknowledge(acknowledgement);
+}
+
+void Client::claimWarmFilterLocked(const std::string &filter, std::vector<MqttMessage> &replay) {
+    for (const auto &held : held_) {
+        if (topicMatchesFilter(held.topic, filter)) {
+            replay.push_back(held);
+        }
+    }
+    auto warm = std::find(warmFilters_.begin(), warmFilters_.end(), filter);
+    if (warm != warmFilters_.end()) {
+        warmFilters_.erase(warm);
+        // The JS subscriber was added first, so the broker keeps the filter.
+        subscriptions_.remove(WARM_START_EVENT_ID, filter);
+    }
+    if (warmFilters_.empty()) {
+        held_.clear();
+    }
+}
+
+void Client::expireWarmFiltersLocked(std::vector<std::string> &unsubscribe) {
+    for (const auto &filter : warmFilters_) {
+        if (subscriptions_.remove(WARM_START_EVENT_ID, filter) && state_ == ConnectionState::Connected) {
+            unsubscribe.push_back(filter);
+        }
+    }
+    warmFilters_.clear();
+    held_.clear();
+}
+
+void Client::recordSession(bool force) {
+    SessionObserver observer;
+    ConnectOptions options;
+    std::vector<std::pair<std::string, int>> filters;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || !sessionObserver_ || state_ != ConnectionState::Connected || !warmFilters_.empty()) {
+            return;
+        }
+        filters = subscriptions_.filters();
+        std::sort(filters.begin(), filters.end());
+        if (!force && filters == recordedFilters_) {
+            return;
+        }
+        recordedFilters_ = filters;
+        observer = sessionObserver_;
+        options = lastOptions_;
+    }
+    observer(options, filters);
+}
+
+void Client::emitClientEvent(const char *suffix, EventValue::Map payload) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+    }
+    sink_->emit(clientId_ + suffix, EventValue(std::move(payload)));
+}
+
+void Client::emitDisconnected(int reasonCode, const std::string &errorMessage) {
+    EventValue::Map payload;
+    payload.emplace_back("reasonCode", reasonCode);
+    payload.emplace_back("errorMessage", errorMessage);
+    emitClientEvent(events::DISCONNECTED, std::move(payload));
+}
+
+void Client::scheduleReconnectLocked(int reasonCode, int attempt) {
+    if (!reconnectPolicy_.enabled || !wantConnected_ || closed_) {
+        return;
+    }
+    if (attempt > reconnectPolicy_.maxRetries) {
+        wantConnected_ = false;
+        reconnectDue_ = false;
+        connectionLostAt_ = 0;
+        return;
+    }
+    if (reconnectPolicy_.refreshCredentials && isCredentialsReasonCode(reasonCode)) {
+        credentialsRejected_ = true;
+    }
+    auto delay = std::chrono::milliseconds(0);
+    if (attempt > 0) {
+        delay = reconnectDelay(reconnectPolicy_, attempt, std::uniform_real_distribution<double>()(random_));
+    }
+    reconnectDue_ = true;
+    // An earlier pending deadline, e.g. from the disconnect reported for the same attempt, wins.
+    reconnectTimer_.arm(FlushTimer::Clock::now() + delay);
+}
+
+void Client::onReconnectTimer() {
+    std::shared_ptr<Transport> transport;
+    ConnectOptions options;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_ || !reconnectDue_ || !wantConnected_ || state_ != ConnectionState::Disconnected) {
+            return;
+        }
+        reconnectDue_ = false;
+        if (!credentialsRejected_) {
+            state_.store(ConnectionState::Connecting, std::memory_order_release);
+            transport = transport_;
+            options = lastOptions_;
+        }
+        credentialsRejected_ = false;
+    }
+    if (!transport) {
+        // JS answers with a connect() carrying fresh credentials.
+        EventValue::Map payload;
+        payload.emplace_back("reasonCode", lastReasonCode());
+        payload.emplace_back("retryCount", retryCount());
+        emitClientEvent(events::CREDENTIALS_REQUIRED, std::move(payload));
+        return;
+    }
+    emitConnectionState(ConnectionState::Connecting);
+    transport->connect(options);
+}
+
+void Client::emitConnectionState(ConnectionState state) {
+    EventValue::Map payload;
+    payload.emplace_back("state", statusOf(state));
+    payload.emplace_back("lastReasonCode", lastReasonCode());
+    payload.emplace_back("retryCount", retryCount());
+    payload.emplace_back("lastConnectedAt", static_cast<double>(lastConnectedAt()));
+    emitClientEvent(events::CONNECTION_STATE, std::move(payload));
+}
+
+}
@@ -0,0 +1,299 @@
+//
+//  MqttClient.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MqttConstants.h"
+#include "MqttDeliveryPipeline.h"
+#include "MqttEventSink.h"
+#include "MqttFlushTimer.h"
+#include "MqttLastValueCache.h"
+#include "MqttMessageFilter.h"
+#include "MqttMetrics.h"
+#include "MqttPayloadDecompressor.h"
+#include "MqttSubscriptionTable.h"
+#include "MqttTransport.h"
+
+namespace mqtt {
+
+// Messages a warm started client holds for the JS subscriptions still to come.
+constexpr size_t WARM_START_HELD_MESSAGES = 256;
+// Filters of a warm started client that JS has not subscribed to this long after taking it over are dropped.
+constexpr std::chrono::seconds WARM_START_CLAIM_TIMEOUT{10};
+
+/**
+ * Automatic reconnect of a Client, set from the JS reconnect options.
+ */
+struct ReconnectPolicy {
+    bool enabled = false;
+    // Failed attempts in a row that are retried before the client gives up; a dropped connection is always retried
+    // once right away.
+    int maxRetries = 0;
+    std::chrono::milliseconds backoff{2000};
+    std::chrono::milliseconds maxBackoff{60000};
+    std::chrono::milliseconds jitter{1};
+    // A listener refreshes the credentials: attempts rejected for them emit CREDENTIALS_REQUIRED instead of retrying
+    // with the cached ones.
+    bool refreshCredentials = false;
+};
+
+/**
+ * Platform independent state of one MQTT client: connection state, subscription bookkeeping, resubscribe on
+ * connect and the mapping of transport outcomes to the events and reason codes JS expects.
+ *
+ * Commands (connect, subscribe, ...) come from the JS thread, transport callbacks (on*) from the platform client's
+ * threads. Both are serialized by one mutex that is never held while calling into the transport or the sink. The
+ * connection state is also published through an atomic, so status reads from the JS thread never wait for it.
+ */
+class Client : public TransportListener {
+public:
+    enum class ConnectionState { Disconnected, Connecting, Connected };
+
+    Client(std::string clientId, std::shared_ptr<Transport> transport, std::shared_ptr<EventSink> sink);
+    ~Client() override;
+
+    const std::string &clientId() const { return clientId_; }
+
+    void connect(const ConnectOptions &options);
+    void disconnect();
+    /**
+     * With replayLastValue, the values of the last value cache matching topic are emitted to eventId right away,
+     * ahead of what the broker sends. With a filter, only the messages passing it are emitted to eventId, replayed
+     * ones included, which carry no user properties.
+     */
+    void subscribe(const std::string &eventId, const std::string &topic, int qos, bool replayLastValue = false,
+                   std::shared_ptr<MessageFilter> filter = nullptr);
+    void unsubscribe(const std::string &eventId, const std::string &topic);
+
+    /**
+     * A topic that is not a valid topic name or a payload that cannot fit in a packet is reported through
+     * onPublishFailed without reaching the transport.
+     */
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain);
+
+    /**
+     * After a dropped connection or a failed attempt following connect(), the client reconnects by itself with the
+     * options of the last connect(), after a backoff computed by reconnectDelay(), until disconnect() is called.
+     */
+    void setReconnectPolicy(const ReconnectPolicy &policy);
+
+    /**
+     * Bounds the received messages waiting for JS, see DeliveryPipeline. Disabled (unbounded) unless set.
+     */
+    void setFlowControl(const FlowControl &flowControl);
+
+    /**
+     * Snapshot of the delivery pipeline, see DeliveryPipeline::snapshot().
+     */
+    EventValue deliveryState() const { return pipeline_->snapshot(); }
+
+    /**
+     * Warm start, before JS created the client: connects with options and subscribes filters. Messages received on
+     * them are held, the last capacity of them, and replayed to every JS subscription of a matching filter. The
+     * first connect() from JS takes the connection over as it is. Once JS subscribed every filter, or
+     * WARM_START_CLAIM_TIMEOUT after it took over, the client is an ordinary one again.
+     */
+    void warmStart(const ConnectOptions &options, const std::vector<std::pair<std::string, int>> &filters,
+                   size_t capacity = WARM_START_HELD_MESSAGES);
+
+    /**
+     * Receives the connect options and subscribed filters to warm start with next time: after every successful
+     * connect, and whenever the filters change while connected. Called on the transport's or the JS thread.
+     */
+    using SessionObserver =
+        std::function<void(const ConnectOptions &options, const std::vector<std::pair<std::string, int>> &filters)>;
+    void setSessionObserver(SessionObserver observer);
+
+    /**
+     * Registers a preset dictionary for the deflate payloads this client receives, see PayloadDecompressor.
+     */
+    void addCompressionDictionary(std::string dictionary) { decompressor_.addDictionary(std::move(dictionary)); }
+
+    /**
+     * Records the last payload of every topic received from now on in cache, replacing a previous cache; nullptr
+     * stops recording. Any thread.
+     */
+    void setLastValueCache(std::shared_ptr<LastValueCache> cache) { std::atomic_store(&lastValues_, std::move(cache)); }
+    std::shared_ptr<LastValueCache> lastValueCache() const { return std::atomic_load(&lastValues_); }
+
+    /**
+     * The filter eventId subscribed with, for its counters; nullptr without one.
+     */
+    std::shared_ptr<MessageFilter> messageFilter(const std::string &eventId) const;
+
+    /**
+     * Delay before reconnect attempt number attempt (1 after the first failure): backoff * 2^attempt plus up to
+     * jitter, capped at maxBackoff. random is uniform in [0, 1).
+     */
+    static std::chrono::milliseconds reconnectDelay(const ReconnectPolicy &policy, int attempt, double random);
+
+    /**
+     * Lock free; safe to call from any thread, including while a command of this client is in progress.
+     */
+    ConnectionState connectionState() const { return state_.load(std::memory_order_acquire); }
+    const char *connectionStatus() const { return statusOf(connectionState()); }
+
+    /**
+     * The status string of a state, one of the status:: constants.
+     */
+    static const char *statusOf(ConnectionState state);
+
+    /**
+     * Reason code of the last connect, connection failure or disconnect. Lock free like connectionState().
+     */
+    int lastReasonCode() const { return lastReasonCode_.load(std::memory_order_relaxed); }
+
+    /**
+     * Failed connection attempts since the last successful connect.
+     */
+    int retryCount() const { return retryCount_.load(std::memory_order_relaxed); }
+
+    /**
+     * Milliseconds since the Unix epoch of the last successful connect, 0 if the client never connected.
+     */
+    int64_t lastConnectedAt() const { return lastConnectedAt_.load(std::memory_order_relaxed); }
+
+    /**
+     * Traffic counters and latencies of this client, for getMetrics(clientId).
+     */
+    ClientMetrics &metrics() { return metrics_; }
+
+    /**
+     * Releases the transport. Later transport callbacks are ignored.
+     */
+    void close();
+
+    void onInitialized();
+    void onInitializationFailed(const std::string &errorMessage);
+
+    /**
+     * Payload of the MQTT_ERROR event onInitializationFailed emits, for a client that could not even be created.
+     */
+    static EventValue::Map initializationError(const std::string &errorMessage);
+    void onConnected(int reasonCode) override;
+    void onConnectionFailed(int reasonCode, const std::string &errorMessage, const std::string &errorCause) override;
+    void onDisconnected(int reasonCode, const std::string &errorMessage) override;
+    void onDisconnectFailed(const std::string &errorMessage);
+    void onSubscribed(const std::string &topic, int qos, const std::string &message) override;
+    void onSubscribeFailed(const std::string &topic, int reasonCode, const std::string &errorMessage) override;
+    void onUnsubscribeFailed(const std::string &topic, const std::string &errorMessage) override;
+    void onPublishFailed(const std::string &topic, const std::string &errorMessage) override;
+    /**
+     * receivedAt is the monotonicNanos() at which the platform client handed the message over, 0 for now. A non-zero
+     * acknowledgement is passed back to Transport::acknowledge once the message may be acknowledged. A payload with
+     * a content-encoding user property is decompressed before it is routed; one that fails to decompress is reported
+     * as an MQTT_ERROR and dropped.
+     */
+    void onMessage(const std::string &topic, std::string payload, int qos, int64_t receivedAt = 0,
+                   uint64_t acknowledgement = 0, const UserProperties &userProperties = {}) override;
+
+private:
+    /**
+     * Hands a received message to every matching subscription whose filter it passes; they share ticket, which may
+     * be null.
+     */
+    void route(InboundMessage &&message, std::shared_ptr<DeliveryTicket> ticket);
+
+    /**
+     * Replaces the filter of eventId; nullptr removes it.
+     */
+    void setMessageFilterLocked(const std::string &eventId, std::shared_ptr<MessageFilter> filter);
+
+    /**
+     * A JS subscription to filter: copies the held messages it matches to replay, and releases the warm start
+     * subscription of the same filter.
+     */
+    void claimWarmFilterLocked(const std::string &filter, std::vector<MqttMessage> &replay);
+
+    /**
+     * Drops the warm start filters JS did not subscribe to in time; appends those nobody else holds to unsubscribe.
+     */
+    void expireWarmFiltersLocked(std::vector<std::string> &unsubscribe);
+
+    /**
+     * Passes the session to the SessionObserver. Unless force, only when the filters differ from the last ones
+     * passed. Not while warm start filters are pending, which JS may no longer want.
+     */
+    void recordSession(bool force);
+    void acknowledge(uint64_t acknowledgement);
+
+    void emitClientEvent(const char *suffix, EventValue::Map payload);
+    void emitDisconnected(int reasonCode, const std::string &errorMessage);
+
+    /**
+     * Emits the connection_state event with a snapshot of the fields above, after every state transition.
+     */
+    void emitConnectionState(ConnectionState state);
+
+    /**
+     * Arms the reconnect timer after the connection went down with reasonCode. attempt is 0 when an established
+     * connection dropped, which is retried right away, else the number of failed attempts in a row.
+     */
+    void scheduleReconnectLocked(int reasonCode, int attempt);
+    void onReconnectTimer();
+
+    const std::string clientId_;
+    std::shared_ptr<Transport> transport_;
+    const std::shared_ptr<EventSink> sink_;
+
+    mutable std::mutex mutex_;
+    // Written under mutex_, read without it.
+    std::atomic<ConnectionState> state_{ConnectionState::Disconnected};
+    std::atomic<int> lastReasonCode_{NORMAL_DISCONNECTION};
+    std::atomic<int> retryCount_{0};
+    std::atomic<int64_t> lastConnectedAt_{0};
+    SubscriptionTable subscriptions_;
+    // Filters of the JS subscriptions that have one, by eventId.
+    std::unordered_map<std::string, std::shared_ptr<MessageFilter>> filters_;
+    // Filters in filters_ reading user properties: received messages only keep theirs while there are any. Read
+    // without mutex_.
+    std::atomic<size_t> userPropertyFilters_{0};
+    bool closed_ = false;
+
+    ReconnectPolicy reconnectPolicy_;
+    ConnectOptions lastOptions_;
+    // Between connect() and disconnect(): the reconnect timer may connect again.
+    bool wantConnected_ = false;
+    bool reconnectDue_ = false;
+    bool credentialsRejected_ = false;
+    std::minstd_rand random_{std::random_device{}()};
+    // monotonicNanos() when an established connection dropped unintentionally, 0 unless reconnecting after one.
+    int64_t connectionLostAt_ = 0;
+
+    // Warm start: filters JS has not subscribed to yet and the messages received on them.
+    std::vector<std::string> warmFilters_;
+    std::deque<MqttMessage> held_;
+    size_t heldCapacity_ = 0;
+    // Warm started, and connect() was not called by JS yet.
+    bool awaitingAdoption_ = false;
+    int64_t adoptedAt_ = 0;
+    SessionObserver sessionObserver_;
+    std::vector<std::pair<std::string, int>> recordedFilters_;
+
+    ClientMetrics metrics_;
+    PayloadDecompressor decompressor_;
+    // Replaced with atomic_store, read with atomic_load on the receive path.
+    std::shared_ptr<LastValueCache> lastValues_;
+    // Closed by the destructor: its callbacks point back at this client.
+    std::shared_ptr<DeliveryPipeline> pipeline_;
+    // Declared last: its thread calls back into the members above and is joined first on destruction.
+    FlushTimer reconnectTimer_{[this] { onReconnectTimer(); }};
+};
+
+}
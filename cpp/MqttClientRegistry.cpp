@@ -0,0 +1,60 @@
+//
+//  MqttClientRegistry.cpp
+//  d11-mqtt
+//
+
+#include "MqttClientRegistry.h"
+
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+
+ClientRegistry &ClientRegistry::shared() {
+    static ClientRegistry *registry = new ClientRegistry();
+    return *registry;
+}
+
+std::shared_ptr<Client> ClientRegistry::create(const std::string &clientId, std::shared_ptr<Transport> transport,
+                                               std::shared_ptr<EventSink> sink) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (clients_.find(clientId) != clients_.end()) {
+        return nullptr;
+    }
+    auto client = std::make_shared<Client>(clientId, std::move(transport), std::move(sink));
+    clients_.emplace(clientId, client);
+    return client;
+}
+
+std::shared_ptr<Client> ClientRegistry::find(const std::string &clientId) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = clients_.find(clientId);
+    return it == clients_.end() ? nullptr : it->second;
+}
+
+void ClientRegistry::remove(const std::string &clientId) {
+    std::shared_ptr<Client> client;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = clients_.find(clientId);
+        if (it == clients_.end()) {
+            return;
+        }
+        client = std::move(it->second);
+        clients_.erase(it);
+    }
+    client->close();
+}
+
+void ClientRegistry::clear() {
+    std::unordered_map<std::string, std::shared_ptr<Client>> clients;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clients.swap(clients_);
+    }
+    for (auto &entry : clients) {
+        entry.second->close();
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+//
+//  MqttClientRegistry.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "MqttClient.h"
+
+namespace mqtt {
+
+/**
+ * Process wide map of clientId to Client, shared by the JSI bindings (commands) and the platform transports
+ * (callbacks). Lookups hand out shared_ptrs so a client removed concurrently stays valid for the running call.
+ */
+class ClientRegistry {
+public:
+    static ClientRegistry &shared();
+
+    /**
+     * Registers a new client. Returns nullptr and leaves the existing client untouched when clientId is taken.
+     */
+    std::shared_ptr<Client> create(const std::string &clientId, std::shared_ptr<Transport> transport,
+                                   std::shared_ptr<EventSink> sink);
+
+    std::shared_ptr<Client> find(const std::string &clientId) const;
+
+    /**
+     * Unregisters the client and closes its transport.
+     */
+    void remove(const std::string &clientId);
+
+    /**
+     * Closes and drops every client.
+     */
+    void clear();
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Client>> clients_;
+};
+
+}
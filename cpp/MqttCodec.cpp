@@ -0,0 +1,703 @@
+//
+//  MqttCodec.cpp
+//  d11-mqtt
+//
+
+#include "MqttCodec.h"
+#include "MqttConstants.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mqtt {
+
+namespace {
+
+// Property identifiers (section 2.2.2.2).
+constexpr uint8_t PAYLOAD_FORMAT_INDICATOR = 0x01;
+constexpr uint8_t MESSAGE_EXPIRY_INTERVAL = 0x02;
+constexpr uint8_t CONTENT_TYPE = 0x03;
+constexpr uint8_t RESPONSE_TOPIC = 0x08;
+constexpr uint8_t CORRELATION_DATA = 0x09;
+constexpr uint8_t SUBSCRIPTION_IDENTIFIER = 0x0B;
+constexpr uint8_t SESSION_EXPIRY_INTERVAL = 0x11;
+constexpr uint8_t ASSIGNED_CLIENT_IDENTIFIER = 0x12;
+constexpr uint8_t SERVER_KEEP_ALIVE = 0x13;
+constexpr uint8_t AUTHENTICATION_METHOD = 0x15;
+constexpr uint8_t AUTHENTICATION_DATA = 0x16;
+constexpr uint8_t REQUEST_PROBLEM_INFORMATION = 0x17;
+constexpr uint8_t WILL_DELAY_INTERVAL = 0x18;
+constexpr uint8_t REQUEST_RESPONSE_INFORMATION = 0x19;
+constexpr uint8_t RESPONSE_INFORMATION = 0x1A;
+constexpr uint8_t SERVER_REFERENCE = 0x1C;
+constexpr uint8_t REASON_STRING = 0x1F;
+constexpr uint8_t RECEIVE_MAXIMUM = 0x21;
+constexpr uint8_t TOPIC_ALIAS_MAXIMUM = 0x22;
+constexpr uint8_t TOPIC_ALIAS = 0x23;
+constexpr uint8_t MAXIMUM_QOS = 0x24;
+constexpr uint8_t RETAIN_AVAILABLE = 0x25;
+constexpr uint8_t USER_PROPERTY = 0x26;
+constexpr uint8_t MAXIMUM_PACKET_SIZE = 0x27;
+constexpr uint8_t WILDCARD_SUBSCRIPTION_AVAILABLE = 0x28;
+constexpr uint8_t SUBSCRIPTION_IDENTIFIER_AVAILABLE = 0x29;
+constexpr uint8_t SHARED_SUBSCRIPTION_AVAILABLE = 0x2A;
+
+constexpr uint8_t CONNECT_FLAG_USERNAME = 0x80;
+constexpr uint8_t CONNECT_FLAG_PASSWORD = 0x40;
+constexpr uint8_t CONNECT_FLAG_WILL = 0x04;
+constexpr uint8_t CONNECT_FLAG_CLEAN_START = 0x02;
+
+constexpr uint8_t PROTOCOL_LEVEL = 5;
+
+size_t stringSize(std::string_view value) {
+    return 2 + value.size();
+}
+
+size_t publishRemainingLength(const PublishPacket &packet) {
+    size_t propertiesLength = packet.topicAlias ? 3 : 0;
+    return stringSize(packet.topic) + (packet.qos > 0 ? 2 : 0) + varintSize(static_cast<uint32_t>(propertiesLength)) +
+           propertiesLength + packet.payloadSize;
+}
+
+/**
+ * Bounds checked reader over the body of one packet. The first failed read marks the cursor as failed and every
+ * later read returns zero values, so decoders check ok() once at the end.
+ */
+class Cursor {
+public:
+    Cursor(const uint8_t *data, size_t size) : data_(data), end_(data + size) {}
+
+    bool ok() const { return ok_; }
+    bool atEnd() const { return data_ == end_; }
+    size_t remaining() const { return static_cast<size_t>(end_ - data_); }
+    const uint8_t *position() const { return data_; }
+
+    uint8_t u8() {
+        if (!require(1)) {
+            return 0;
+        }
+        return *data_++;
+    }
+
+    uint16_t u16() {
+        if (!require(2)) {
+            return 0;
+        }
+        uint16_t value = static_cast<uint16_t>((data_[0] << 8) | data_[1]);
+        data_ += 2;
+        return value;
+    }
+
+    uint32_t u32() {
+        if (!require(4)) {
+            return 0;
+        }
+        uint32_t value = (static_cast<uint32_t>(data_[0]) << 24) | (static_cast<uint32_t>(data_[1]) << 16) |
+                         (static_cast<uint32_t>(data_[2]) << 8) | data_[3];
+        data_ += 4;
+        return value;
+    }
+
+    uint32_t varint() {
+        uint32_t value = 0;
+        int read = decodeVarint(data_, remaining(), value);
+        if (read <= 0) {
+            ok_ = false;
+            return 0;
+        }
+        data_ += read;
+        return value;
+    }
+
+    std::string_view string() {
+        uint16_t size = u16();
+        if (!require(size)) {
+            return std::string_view();
+        }
+        std::string_view value(reinterpret_cast<const char *>(data_), size);
+        data_ += size;
+        return value;
+    }
+
+    void skip(size_t size) {
+        if (require(size)) {
+            data_ += size;
+        }
+    }
+
+    /**
+     * Narrows the cursor to the next size bytes and returns a cursor over them.
+     */
+    Cursor take(size_t size) {
+        if (!require(size)) {
+            return Cursor(data_, 0);
+        }
+        Cursor section(data_, size);
+        data_ += size;
+        return section;
+    }
+
+    void fail() { ok_ = false; }
+
+private:
+    bool require(size_t size) {
+        if (!ok_ || remaining() < size) {
+            ok_ = false;
+            data_ = end_;
+            return false;
+        }
+        return true;
+    }
+
+    const uint8_t *data_;
+    const uint8_t *end_;
+    bool ok_ = true;
+};
+
+bool decodeProperties(Cursor &cursor, Properties &properties) {
+    properties.clear();
+    uint32_t length = cursor.varint();
+    Cursor section = cursor.take(length);
+    while (section.ok() && !section.atEnd()) {
+        switch (section.u8()) {
+            case PAYLOAD_FORMAT_INDICATOR:
+                properties.payloadFormatIndicator = section.u8();
+                break;
+            case MESSAGE_EXPIRY_INTERVAL:
+                properties.messageExpiryInterval = section.u32();
+                break;
+            case CONTENT_TYPE:
+                properties.contentType = section.string();
+                break;
+            case SESSION_EXPIRY_INTERVAL:
+                properties.sessionExpiryInterval = section.u32();
+                break;
+            case ASSIGNED_CLIENT_IDENTIFIER:
+                properties.assignedClientIdentifier = section.string();
+                break;
+            case SERVER_KEEP_ALIVE:
+                properties.serverKeepAlive = section.u16();
+                break;
+            case REASON_STRING:
+                properties.reasonString = section.string();
+                break;
+            case RECEIVE_MAXIMUM:
+                properties.receiveMaximum = section.u16();
+                break;
+            case TOPIC_ALIAS_MAXIMUM:
+                properties.topicAliasMaximum = section.u16();
+                break;
+            case TOPIC_ALIAS:
+                properties.topicAlias = section.u16();
+                break;
+            case MAXIMUM_PACKET_SIZE:
+                properties.maximumPacketSize = section.u32();
+                break;
+            case USER_PROPERTY: {
+                std::string_view key = section.string();
+                std::string_view value = section.string();
+                properties.userProperties.emplace_back(key, value);
+                break;
+            }
+            case REQUEST_PROBLEM_INFORMATION:
+            case REQUEST_RESPONSE_INFORMATION:
+            case MAXIMUM_QOS:
+            case RETAIN_AVAILABLE:
+            case WILDCARD_SUBSCRIPTION_AVAILABLE:
+            case SUBSCRIPTION_IDENTIFIER_AVAILABLE:
+            case SHARED_SUBSCRIPTION_AVAILABLE:
+                section.skip(1);
+                break;
+            case WILL_DELAY_INTERVAL:
+                section.skip(4);
+                break;
+            case SUBSCRIPTION_IDENTIFIER:
+                section.varint();
+                break;
+            case RESPONSE_TOPIC:
+            case AUTHENTICATION_METHOD:
+            case RESPONSE_INFORMATION:
+            case SERVER_REFERENCE:
+            case CORRELATION_DATA:
+            case AUTHENTICATION_DATA:
+                section.string();
+                break;
+            default:
+                // The length of an unknown property cannot be known.
+                section.fail();
+                break;
+        }
+    }
+    return cursor.ok() && section.ok();
+}
+
+bool decodeConnect(Cursor &cursor, Packet &packet) {
+    std::string_view protocolName = cursor.string();
+    uint8_t level = cursor.u8();
+    uint8_t flags = cursor.u8();
+    if (protocolName != "MQTT" || level != PROTOCOL_LEVEL || (flags & 0x01) != 0) {
+        return false;
+    }
+    ConnectPacket &connect = packet.connect;
+    connect.keepAlive = cursor.u16();
+    connect.cleanStart = (flags & CONNECT_FLAG_CLEAN_START) != 0;
+    if (!decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    connect.sessionExpiryInterval = packet.properties.sessionExpiryInterval.value_or(0);
+    connect.receiveMaximum = packet.properties.receiveMaximum.value_or(0);
+    connect.maximumPacketSize = packet.properties.maximumPacketSize.value_or(0);
+    connect.topicAliasMaximum = packet.properties.topicAliasMaximum.value_or(0);
+    connect.clientId = cursor.string();
+    if (flags & CONNECT_FLAG_WILL) {
+        // Will messages are not supported, skip them.
+        cursor.skip(cursor.varint());
+        cursor.string();
+        cursor.string();
+    }
+    connect.username = (flags & CONNECT_FLAG_USERNAME) ? cursor.string() : std::string_view();
+    connect.password = (flags & CONNECT_FLAG_PASSWORD) ? cursor.string() : std::string_view();
+    return cursor.ok() && cursor.atEnd();
+}
+
+bool decodePublish(Cursor &cursor, Packet &packet) {
+    packet.qos = (packet.flags >> 1) & 0x03;
+    packet.retain = (packet.flags & 0x01) != 0;
+    packet.dup = (packet.flags & 0x08) != 0;
+    if (packet.qos == 3) {
+        return false;
+    }
+    packet.topic = cursor.string();
+    packet.packetId = packet.qos > 0 ? cursor.u16() : 0;
+    if (!decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    packet.payload = cursor.position();
+    packet.payloadSize = cursor.remaining();
+    return cursor.ok();
+}
+
+bool decodeAck(Cursor &cursor, Packet &packet) {
+    packet.packetId = cursor.u16();
+    packet.reasonCode = cursor.atEnd() ? 0 : cursor.u8();
+    if (!cursor.atEnd() && !decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    return cursor.ok() && cursor.atEnd();
+}
+
+bool decodeSubscribe(Cursor &cursor, Packet &packet, bool withOptions) {
+    packet.packetId = cursor.u16();
+    if (!decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    while (cursor.ok() && !cursor.atEnd()) {
+        TopicFilter filter;
+        filter.filter = cursor.string();
+        filter.qos = withOptions ? (cursor.u8() & 0x03) : 0;
+        packet.topicFilters.push_back(filter);
+    }
+    return cursor.ok() && !packet.topicFilters.empty();
+}
+
+bool decodeSubscribeAck(Cursor &cursor, Packet &packet) {
+    packet.packetId = cursor.u16();
+    if (!decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    packet.reasonCodes = cursor.position();
+    packet.reasonCodeCount = cursor.remaining();
+    return cursor.ok();
+}
+
+bool decodeReasonAndProperties(Cursor &cursor, Packet &packet) {
+    packet.reasonCode = cursor.atEnd() ? 0 : cursor.u8();
+    if (!cursor.atEnd() && !decodeProperties(cursor, packet.properties)) {
+        return false;
+    }
+    return cursor.ok() && cursor.atEnd();
+}
+
+}
+
+void Properties::clear() {
+    payloadFormatIndicator.reset();
+    messageExpiryInterval.reset();
+    sessionExpiryInterval.reset();
+    serverKeepAlive.reset();
+    receiveMaximum.reset();
+    topicAliasMaximum.reset();
+    topicAlias.reset();
+    maximumPacketSize.reset();
+    contentType = std::string_view();
+    assignedClientIdentifier = std::string_view();
+    reasonString = std::string_view();
+    userProperties.clear();
+}
+
+size_t varintSize(uint32_t value) {
+    if (value < 128) {
+        return 1;
+    } else if (value < 16384) {
+        return 2;
+    } else if (value < 2097152) {
+        return 3;
+    }
+    return 4;
+}
+
+int decodeVarint(const uint8_t *data, size_t size, uint32_t &value) {
+    value = 0;
+    uint32_t multiplier = 1;
+    for (size_t i = 0; i < 4; i++) {
+        if (i >= size) {
+            return 0;
+        }
+        value += (data[i] & 0x7F) * multiplier;
+        if ((data[i] & 0x80) == 0) {
+            return static_cast<int>(i + 1);
+        }
+        multiplier *= 128;
+    }
+    return -1;
+}
+
+void PacketWriter::fixedHeader(PacketType type, uint8_t flags, size_t remainingLength) {
+    buffer_.reserve(buffer_.size() + 1 + varintSize(static_cast<uint32_t>(remainingLength)) + remainingLength);
+    byte(static_cast<uint8_t>((static_cast<uint8_t>(type) << 4) | flags));
+    varint(static_cast<uint32_t>(remainingLength));
+}
+
+void PacketWriter::u16(uint16_t value) {
+    buffer_.push_back(static_cast<uint8_t>(value >> 8));
+    buffer_.push_back(static_cast<uint8_t>(value));
+}
+
+void PacketWriter::u32(uint32_t value) {
+    buffer_.push_back(static_cast<uint8_t>(value >> 24));
+    buffer_.push_back(static_cast<uint8_t>(value >> 16));
+    buffer_.push_back(static_cast<uint8_t>(value >> 8));
+    buffer_.push_back(static_cast<uint8_t>(value));
+}
+
+void PacketWriter::varint(uint32_t value) {
+    do {
+        uint8_t encoded = value % 128;
+        value /= 128;
+        if (value > 0) {
+            encoded |= 0x80;
+        }
+        buffer_.push_back(encoded);
+    } while (value > 0);
+}
+
+void PacketWriter::string(std::string_view value) {
+    u16(static_cast<uint16_t>(value.size()));
+    bytes(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+}
+
+void PacketWriter::bytes(const uint8_t *data, size_t size) {
+    if (size > 0) {
+        buffer_.insert(buffer_.end(), data, data + size);
+    }
+}
+
+void PacketWriter::connect(const ConnectPacket &packet) {
+    size_t propertiesLength = 0;
+    propertiesLength += packet.sessionExpiryInterval ? 5 : 0;
+    propertiesLength += packet.receiveMaximum ? 3 : 0;
+    propertiesLength += packet.maximumPacketSize ? 5 : 0;
+    propertiesLength += packet.topicAliasMaximum ? 3 : 0;
+
+    uint8_t flags = packet.cleanStart ? CONNECT_FLAG_CLEAN_START : 0;
+    size_t remaining = stringSize("MQTT") + 1 + 1 + 2 + varintSize(static_cast<uint32_t>(propertiesLength)) +
+                       propertiesLength + stringSize(packet.clientId);
+    if (!packet.username.empty()) {
+        flags |= CONNECT_FLAG_USERNAME;
+        remaining += stringSize(packet.username);
+    }
+    if (!packet.password.empty()) {
+        flags |= CONNECT_FLAG_PASSWORD;
+        remaining += stringSize(packet.password);
+    }
+
+    fixedHeader(PacketType::Connect, 0, remaining);
+    string("MQTT");
+    byte(PROTOCOL_LEVEL);
+    byte(flags);
+    u16(packet.keepAlive);
+    varint(static_cast<uint32_t>(propertiesLength));
+    if (packet.sessionExpiryInterval) {
+        byte(SESSION_EXPIRY_INTERVAL);
+        u32(packet.sessionExpiryInterval);
+    }
+    if (packet.receiveMaximum) {
+        byte(RECEIVE_MAXIMUM);
+        u16(packet.receiveMaximum);
+    }
+    if (packet.maximumPacketSize) {
+        byte(MAXIMUM_PACKET_SIZE);
+        u32(packet.maximumPacketSize);
+    }
+    if (packet.topicAliasMaximum) {
+        byte(TOPIC_ALIAS_MAXIMUM);
+        u16(packet.topicAliasMaximum);
+    }
+    string(packet.clientId);
+    if (flags & CONNECT_FLAG_USERNAME) {
+        string(packet.username);
+    }
+    if (flags & CONNECT_FLAG_PASSWORD) {
+        string(packet.password);
+    }
+}
+
+void PacketWriter::connack(bool sessionPresent, uint8_t reasonCode, const Properties *properties) {
+    size_t propertiesLength = 0;
+    if (properties != nullptr) {
+        propertiesLength += properties->receiveMaximum ? 3 : 0;
+        propertiesLength += properties->topicAliasMaximum ? 3 : 0;
+        propertiesLength += properties->serverKeepAlive ? 3 : 0;
+        propertiesLength += properties->maximumPacketSize ? 5 : 0;
+        propertiesLength += properties->assignedClientIdentifier.empty()
+                                ? 0
+                                : 1 + stringSize(properties->assignedClientIdentifier);
+        propertiesLength += properties->reasonString.empty() ? 0 : 1 + stringSize(properties->reasonString);
+    }
+    fixedHeader(PacketType::Connack, 0, 2 + varintSize(static_cast<uint32_t>(propertiesLength)) + propertiesLength);
+    byte(sessionPresent ? 1 : 0);
+    byte(reasonCode);
+    varint(static_cast<uint32_t>(propertiesLength));
+    if (properties == nullptr) {
+        return;
+    }
+    if (properties->receiveMaximum) {
+        byte(RECEIVE_MAXIMUM);
+        u16(*properties->receiveMaximum);
+    }
+    if (properties->topicAliasMaximum) {
+        byte(TOPIC_ALIAS_MAXIMUM);
+        u16(*properties->topicAliasMaximum);
+    }
+    if (properties->serverKeepAlive) {
+        byte(SERVER_KEEP_ALIVE);
+        u16(*properties->serverKeepAlive);
+    }
+    if (properties->maximumPacketSize) {
+        byte(MAXIMUM_PACKET_SIZE);
+        u32(*properties->maximumPacketSize);
+    }
+    if (!properties->assignedClientIdentifier.empty()) {
+        byte(ASSIGNED_CLIENT_IDENTIFIER);
+        string(properties->assignedClientIdentifier);
+    }
+    if (!properties->reasonString.empty()) {
+        byte(REASON_STRING);
+        string(properties->reasonString);
+    }
+}
+
+size_t PacketWriter::publishSize(const PublishPacket &packet) {
+    size_t remaining = publishRemainingLength(packet);
+    return 1 + varintSize(static_cast<uint32_t>(std::min(remaining, MAX_REMAINING_LENGTH))) + remaining;
+}
+
+bool PacketWriter::encodable(const PublishPacket &packet) {
+    return packet.topic.size() <= 0xFFFF && publishRemainingLength(packet) <= MAX_REMAINING_LENGTH;
+}
+
+bool PacketWriter::publish(const PublishPacket &packet) {
+    if (!encodable(packet)) {
+        return false;
+    }
+    size_t propertiesLength = packet.topicAlias ? 3 : 0;
+    size_t remaining = publishRemainingLength(packet);
+    uint8_t flags = static_cast<uint8_t>((packet.dup ? 0x08 : 0) | ((packet.qos & 0x03) << 1) |
+                                         (packet.retain ? 0x01 : 0));
+    fixedHeader(PacketType::Publish, flags, remaining);
+    string(packet.topic);
+    if (packet.qos > 0) {
+        u16(packet.packetId);
+    }
+    varint(static_cast<uint32_t>(propertiesLength));
+    if (packet.topicAlias) {
+        byte(TOPIC_ALIAS);
+        u16(packet.topicAlias);
+    }
+    bytes(packet.payload, packet.payloadSize);
+    return true;
+}
+
+void PacketWriter::subscribe(uint16_t packetId, const TopicFilter *filters, size_t count) {
+    size_t remaining = 2 + 1;
+    for (size_t i = 0; i < count; i++) {
+        remaining += stringSize(filters[i].filter) + 1;
+    }
+    fixedHeader(PacketType::Subscribe, 0x02, remaining);
+    u16(packetId);
+    varint(0);
+    for (size_t i = 0; i < count; i++) {
+        string(filters[i].filter);
+        // Retain handling 0: retained messages are sent on every subscribe, as on the platform clients.
+        byte(filters[i].qos & 0x03);
+    }
+}
+
+void PacketWriter::suback(uint16_t packetId, const uint8_t *reasonCodes, size_t count) {
+    fixedHeader(PacketType::Suback, 0, 2 + 1 + count);
+    u16(packetId);
+    varint(0);
+    bytes(reasonCodes, count);
+}
+
+void PacketWriter::unsubscribe(uint16_t packetId, const std::string_view *filters, size_t count) {
+    size_t remaining = 2 + 1;
+    for (size_t i = 0; i < count; i++) {
+        remaining += stringSize(filters[i]);
+    }
+    fixedHeader(PacketType::Unsubscribe, 0x02, remaining);
+    u16(packetId);
+    varint(0);
+    for (size_t i = 0; i < count; i++) {
+        string(filters[i]);
+    }
+}
+
+void PacketWriter::unsuback(uint16_t packetId, const uint8_t *reasonCodes, size_t count) {
+    fixedHeader(PacketType::Unsuback, 0, 2 + 1 + count);
+    u16(packetId);
+    varint(0);
+    bytes(reasonCodes, count);
+}
+
+void PacketWriter::ack(PacketType type, uint16_t packetId, uint8_t reasonCode) {
+    fixedHeader(type, type == PacketType::Pubrel ? 0x02 : 0, reasonCode ? 3 : 2);
+    u16(packetId);
+    if (reasonCode) {
+        byte(reasonCode);
+    }
+}
+
+void PacketWriter::pingreq() {
+    fixedHeader(PacketType::Pingreq, 0, 0);
+}
+
+void PacketWriter::pingresp() {
+    fixedHeader(PacketType::Pingresp, 0, 0);
+}
+
+void PacketWriter::disconnect(uint8_t reasonCode) {
+    fixedHeader(PacketType::Disconnect, 0, reasonCode ? 1 : 0);
+    if (reasonCode) {
+        byte(reasonCode);
+    }
+}
+
+uint8_t *PacketReader::prepare(size_t minimumSize) {
+    if (begin_ == end_) {
+        begin_ = end_ = 0;
+    }
+    if (buffer_.size() - end_ < minimumSize) {
+        compact();
+        if (buffer_.size() - end_ < minimumSize) {
+            buffer_.resize(end_ + minimumSize);
+        }
+    }
+    return buffer_.data() + end_;
+}
+
+void PacketReader::append(const uint8_t *data, size_t size) {
+    std::memcpy(prepare(size), data, size);
+    commit(size);
+}
+
+void PacketReader::compact() {
+    if (begin_ == 0) {
+        return;
+    }
+    if (begin_ != end_) {
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    }
+    end_ -= begin_;
+    begin_ = 0;
+}
+
+DecodeStatus PacketReader::next(Packet &packet) {
+    const uint8_t *data = buffer_.data() + begin_;
+    size_t available = end_ - begin_;
+    if (available < 2) {
+        return DecodeStatus::Incomplete;
+    }
+    uint32_t remainingLength = 0;
+    int lengthBytes = decodeVarint(data + 1, available - 1, remainingLength);
+    if (lengthBytes < 0 || remainingLength > MAX_REMAINING_LENGTH) {
+        return DecodeStatus::Malformed;
+    }
+    if (lengthBytes == 0) {
+        return DecodeStatus::Incomplete;
+    }
+    size_t packetSize = 1 + static_cast<size_t>(lengthBytes) + remainingLength;
+    if (packetSize > maximumPacketSize_) {
+        return DecodeStatus::TooLarge;
+    }
+    if (available < packetSize) {
+        return DecodeStatus::Incomplete;
+    }
+
+    packet.type = static_cast<PacketType>(data[0] >> 4);
+    packet.flags = data[0] & 0x0F;
+    packet.packetId = 0;
+    packet.reasonCode = 0;
+    packet.properties.clear();
+    packet.topicFilters.clear();
+    packet.reasonCodes = nullptr;
+    packet.reasonCodeCount = 0;
+
+    Cursor cursor(data + 1 + lengthBytes, remainingLength);
+    bool valid = false;
+    switch (packet.type) {
+        case PacketType::Connect:
+            valid = packet.flags == 0 && decodeConnect(cursor, packet);
+            break;
+        case PacketType::Connack:
+            packet.sessionPresent = (cursor.u8() & 0x01) != 0;
+            valid = packet.flags == 0 && decodeReasonAndProperties(cursor, packet);
+            break;
+        case PacketType::Publish:
+            valid = decodePublish(cursor, packet);
+            break;
+        case PacketType::Puback:
+        case PacketType::Pubrec:
+        case PacketType::Pubcomp:
+            valid = packet.flags == 0 && decodeAck(cursor, packet);
+            break;
+        case PacketType::Pubrel:
+            valid = packet.flags == 0x02 && decodeAck(cursor, packet);
+            break;
+        case PacketType::Subscribe:
+            valid = packet.flags == 0x02 && decodeSubscribe(cursor, packet, true);
+            break;
+        case PacketType::Unsubscribe:
+            valid = packet.flags == 0x02 && decodeSubscribe(cursor, packet, false);
+            break;
+        case PacketType::Suback:
+        case PacketType::Unsuback:
+            valid = packet.flags == 0 && decodeSubscribeAck(cursor, packet);
+            break;
+        case PacketType::Pingreq:
+        case PacketType::Pingresp:
+            valid = packet.flags == 0 && remainingLength == 0;
+            break;
+        case PacketType::Disconnect:
+        case PacketType::Auth:
+            valid = packet.flags == 0 && decodeReasonAndProperties(cursor, packet);
+            break;
+    }
+    if (!valid) {
+        return DecodeStatus::Malformed;
+    }
+    begin_ += packetSize;
+    return DecodeStatus::Ok;
+}
+
+}
@@ -0,0 +1,222 @@
+//
+//  MqttCodec.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+
+/**
+ * MQTT 5 control packet types (section 2.1.2).
+ */
+enum class PacketType : uint8_t {
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Pubrec = 5,
+    Pubrel = 6,
+    Pubcomp = 7,
+    Subscribe = 8,
+    Suback = 9,
+    Unsubscribe = 10,
+    Unsuback = 11,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14,
+    Auth = 15,
+};
+
+/**
+ * Properties understood by the engine. Decoded string values point into the PacketReader buffer and are only
+ * valid until the next PacketReader::next() call; unknown but well formed properties are skipped.
+ */
+struct Properties {
+    std::optional<uint8_t> payloadFormatIndicator;
+    std::optional<uint32_t> messageExpiryInterval;
+    std::optional<uint32_t> sessionExpiryInterval;
+    std::optional<uint16_t> serverKeepAlive;
+    std::optional<uint16_t> receiveMaximum;
+    std::optional<uint16_t> topicAliasMaximum;
+    std::optional<uint16_t> topicAlias;
+    std::optional<uint32_t> maximumPacketSize;
+    std::string_view contentType;
+    std::string_view assignedClientIdentifier;
+    std::string_view reasonString;
+    std::vector<std::pair<std::string_view, std::string_view>> userProperties;
+
+    void clear();
+};
+
+struct ConnectPacket {
+    std::string_view clientId;
+    std::string_view username;
+    std::string_view password;
+    uint16_t keepAlive = 60;
+    bool cleanStart = true;
+    uint32_t sessionExpiryInterval = 0;
+    // 0 leaves the property out, i.e. the protocol default applies.
+    uint16_t receiveMaximum = 0;
+    uint32_t maximumPacketSize = 0;
+    uint16_t topicAliasMaximum = 0;
+};
+
+struct PublishPacket {
+    std::string_view topic;
+    const uint8_t *payload = nullptr;
+    size_t payloadSize = 0;
+    uint8_t qos = 0;
+    bool retain = false;
+    bool dup = false;
+    uint16_t packetId = 0;
+    // 0 leaves the property out.
+    uint16_t topicAlias = 0;
+};
+
+struct TopicFilter {
+    std::string_view filter;
+    uint8_t qos = 0;
+};
+
+/**
+ * A decoded packet. Only the fields of its type are meaningful; views point into the PacketReader buffer.
+ * Reusing one Packet across next() calls keeps the capacity of its vectors.
+ */
+struct Packet {
+    PacketType type = PacketType::Connect;
+    uint8_t flags = 0;
+    uint16_t packetId = 0;
+    uint8_t reasonCode = 0;
+    bool sessionPresent = false;
+    Properties properties;
+
+    // CONNECT
+    ConnectPacket connect;
+
+    // PUBLISH
+    std::string_view topic;
+    const uint8_t *payload = nullptr;
+    size_t payloadSize = 0;
+    uint8_t qos = 0;
+    bool retain = false;
+    bool dup = false;
+
+    // SUBSCRIBE, UNSUBSCRIBE (qos unused)
+    std::vector<TopicFilter> topicFilters;
+
+    // SUBACK, UNSUBACK
+    const uint8_t *reasonCodes = nullptr;
+    size_t reasonCodeCount = 0;
+};
+
+enum class DecodeStatus {
+    Ok,
+    // More bytes are needed for the next packet.
+    Incomplete,
+    Malformed,
+    TooLarge,
+};
+
+/**
+ * Appends encoded packets to a caller owned buffer. The buffer is meant to be reused: encoding only grows it, so
+ * after warm-up a steady stream of packets does not allocate.
+ */
+class PacketWriter {
+public:
+    explicit PacketWriter(std::vector<uint8_t> &buffer) : buffer_(buffer) {}
+
+    void connect(const ConnectPacket &packet);
+    void connack(bool sessionPresent, uint8_t reasonCode, const Properties *properties = nullptr);
+
+    /**
+     * Returns false, leaving the buffer as it was, when the packet is not encodable().
+     */
+    bool publish(const PublishPacket &packet);
+
+    /**
+     * Whether the topic fits in 65535 bytes and the packet in MAX_REMAINING_LENGTH.
+     */
+    static bool encodable(const PublishPacket &packet);
+
+    /**
+     * Bytes publish() appends for packet, fixed header included.
+     */
+    static size_t publishSize(const PublishPacket &packet);
+    void subscribe(uint16_t packetId, const TopicFilter *filters, size_t count);
+    void suback(uint16_t packetId, const uint8_t *reasonCodes, size_t count);
+    void unsubscribe(uint16_t packetId, const std::string_view *filters, size_t count);
+    void unsuback(uint16_t packetId, const uint8_t *reasonCodes, size_t count);
+
+    /**
+     * PUBACK, PUBREC, PUBREL or PUBCOMP. The reason code is left out when it is 0 (success).
+     */
+    void ack(PacketType type, uint16_t packetId, uint8_t reasonCode = 0);
+    void pingreq();
+    void pingresp();
+    void disconnect(uint8_t reasonCode = 0);
+
+private:
+    void fixedHeader(PacketType type, uint8_t flags, size_t remainingLength);
+    void byte(uint8_t value) { buffer_.push_back(value); }
+    void u16(uint16_t value);
+    void u32(uint32_t value);
+    void varint(uint32_t value);
+    void string(std::string_view value);
+    void bytes(const uint8_t *data, size_t size);
+
+    std::vector<uint8_t> &buffer_;
+};
+
+/**
+ * Incremental decoder for a byte stream. Network reads go straight into prepare()/commit(); next() then yields
+ * every complete packet without copying payloads. compact() drops consumed bytes once the caller is done with the
+ * decoded views.
+ */
+class PacketReader {
+public:
+    explicit PacketReader(size_t maximumPacketSize = 256 * 1024 * 1024) : maximumPacketSize_(maximumPacketSize) {}
+
+    /**
+     * Returns space for at least minimumSize more bytes.
+     */
+    uint8_t *prepare(size_t minimumSize);
+    void commit(size_t size) { end_ += size; }
+    void append(const uint8_t *data, size_t size);
+
+    DecodeStatus next(Packet &packet);
+    void compact();
+
+    /**
+     * Drops every buffered byte, e.g. when the connection is closed.
+     */
+    void reset() { begin_ = end_ = 0; }
+
+    size_t buffered() const { return end_ - begin_; }
+
+private:
+    std::vector<uint8_t> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+    const size_t maximumPacketSize_;
+};
+
+/**
+ * Number of bytes of the variable byte integer encoding of value (1-4).
+ */
+size_t varintSize(uint32_t value);
+
+/**
+ * Decodes a variable byte integer. Returns the number of bytes read, 0 if more bytes are needed, or -1 when the
+ * encoding is longer than 4 bytes.
+ */
+int decodeVarint(const uint8_t *data, size_t size, uint32_t &value);
+
+}
@@ -0,0 +1,32 @@
+//
+//  MqttConflationSlots.cpp
+//  d11-mqtt
+//
+
+#include "MqttConflationSlots.h"
+
+#include <utility>
+
+namespace mqtt {
+
+bool ConflationSlots::push(MqttMessage &&message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = slotByTopic_.try_emplace(message.topic, slots_.size());
+    if (!inserted.second) {
+        slots_[inserted.first->second] = std::move(message);
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    slots_.push_back(std::move(message));
+    return slots_.size() == 1;
+}
+
+std::vector<MqttMessage> ConflationSlots::drain() {
+    std::vector<MqttMessage> messages;
+    std::lock_guard<std::mutex> lock(mutex_);
+    messages.swap(slots_);
+    slotByTopic_.clear();
+    return messages;
+}
+
+}
@@ -0,0 +1,52 @@
+//
+//  MqttConflationSlots.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MqttMessage.h"
+
+namespace mqtt {
+
+/**
+ * Last-value slots of one conflated subscription: holds only the latest undelivered message per exact topic.
+ *
+ * While the JS thread is busy, a newer message on a topic replaces the one waiting in its slot instead of queueing
+ * behind it, and the replaced message is counted as dropped. push() is called from network threads, drain() from
+ * the JS thread.
+ */
+class ConflationSlots {
+public:
+    /**
+     * Stores message in the slot of its topic.
+     * @return true when the slots were empty, i.e. the caller has to request a flush.
+     */
+    bool push(MqttMessage &&message);
+
+    /**
+     * Takes the waiting messages, one per topic, ordered by when each topic first got a message since the last
+     * drain. JS thread only.
+     */
+    std::vector<MqttMessage> drain();
+
+    /**
+     * Messages replaced by a newer one before they were delivered, since the slots were created.
+     */
+    uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex_;
+    std::vector<MqttMessage> slots_;
+    std::unordered_map<std::string, size_t> slotByTopic_;
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}
@@ -0,0 +1,50 @@
+//
+//  MqttConnectionStateHostObject.cpp
+//  d11-mqtt
+//
+
+#include "MqttConnectionStateHostObject.h"
+
+#include <string>
+
+#include "MqttConstants.h"
+
+namespace mqtt {
+
+namespace {
+
+constexpr const char *PROPERTY_NAMES[] = {"state", "lastReasonCode", "retryCount", "lastConnectedAt"};
+
+}
+
+jsi::Value ConnectionStateHostObject::get(jsi::Runtime &runtime, const jsi::PropNameID &name) {
+    std::string property = name.utf8(runtime);
+    std::shared_ptr<Client> client = client_.lock();
+    if (property == "state") {
+        return jsi::String::createFromAscii(runtime, client ? client->connectionStatus() : status::DISCONNECTED);
+    }
+    if (property == "lastReasonCode") {
+        return jsi::Value(client ? client->lastReasonCode() : static_cast<int>(NORMAL_DISCONNECTION));
+    }
+    if (property == "retryCount") {
+        return jsi::Value(client ? client->retryCount() : 0);
+    }
+    if (property == "lastConnectedAt") {
+        return jsi::Value(client ? static_cast<double>(client->lastConnectedAt()) : 0.0);
+    }
+    return jsi::Value::undefined();
+}
+
+void ConnectionStateHostObject::set(jsi::Runtime &runtime, const jsi::PropNameID &name, const jsi::Value &) {
+    throw jsi::JSError(runtime, "Connection state is read-only, cannot set " + name.utf8(runtime));
+}
+
+std::vector<jsi::PropNameID> ConnectionStateHostObject::getPropertyNames(jsi::Runtime &runtime) {
+    std::vector<jsi::PropNameID> names;
+    for (const char *property : PROPERTY_NAMES) {
+        names.push_back(jsi::PropNameID::forAscii(runtime, property));
+    }
+    return names;
+}
+
+}
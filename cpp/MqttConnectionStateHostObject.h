@@ -0,0 +1,36 @@
+//
+//  MqttConnectionStateHostObject.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jsi/jsi.h>
+
+#include <memory>
+#include <vector>
+
+#include "MqttClient.h"
+
+namespace mqtt {
+
+namespace jsi = facebook::jsi;
+
+/**
+ * Read-only view of a client's connection state, returned by getConnectionStateMqtt. Every property read loads the
+ * Client's atomics directly, so JS can poll state, lastReasonCode, retryCount and lastConnectedAt at property access
+ * cost without a call into the platform. Once the client is removed it reads as disconnected.
+ */
+class ConnectionStateHostObject : public jsi::HostObject {
+public:
+    explicit ConnectionStateHostObject(std::weak_ptr<Client> client) : client_(std::move(client)) {}
+
+    jsi::Value get(jsi::Runtime &runtime, const jsi::PropNameID &name) override;
+    void set(jsi::Runtime &runtime, const jsi::PropNameID &name, const jsi::Value &value) override;
+    std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &runtime) override;
+
+private:
+    const std::weak_ptr<Client> client_;
+};
+
+}
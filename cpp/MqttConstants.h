@@ -0,0 +1,78 @@
+//
+//  MqttConstants.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+
+namespace mqtt {
+
+/**
+ * Event suffixes appended to the clientId (client events) or to the subscription eventId (subscription events).
+ * They must stay in sync with MQTT_EVENTS in src/Mqtt/MqttClient.constants.ts.
+ */
+namespace events {
+constexpr const char *CLIENT_INITIALIZE = "client_initialize";
+constexpr const char *CONNECTED = "connected";
+constexpr const char *DISCONNECTED = "disconnected";
+constexpr const char *SUBSCRIBE_SUCCESS = "subscribe_success";
+constexpr const char *SUBSCRIBE_FAILED = "subscribe_failed";
+constexpr const char *MQTT_ERROR = "mqtt_error";
+constexpr const char *CONNECTION_STATE = "connection_state";
+constexpr const char *CREDENTIALS_REQUIRED = "credentials_required";
+constexpr const char *BACKGROUND_RESULT = "background_result";
+constexpr const char *BACKGROUND_ERROR = "background_error";
+}
+
+/**
+ * Values returned by getConnectionStatusMqtt, matching CONNECTION_STATE on the JS side.
+ */
+namespace status {
+constexpr const char *CONNECTED = "connected";
+constexpr const char *CONNECTING = "connecting";
+constexpr const char *DISCONNECTED = "disconnected";
+}
+
+/**
+ * Library specific reason codes reported next to the MQTT 5 reason codes, see Mqtt5ReasonCode on the JS side.
+ */
+enum ErrorCode : int {
+    NORMAL_DISCONNECTION = 0,
+    DEFAULT_ERROR = -1,
+    CONNECTION_ERROR = -2,
+    DISCONNECTION_ERROR = -3,
+    SUBSCRIPTION_ERROR = -4,
+    UNSUBSCRIPTION_ERROR = -5,
+    INITIALIZATION_ERROR = -6,
+    RX_CHAIN_ERROR = -7,
+    PUBLISH_ERROR = -8,
+    DECOMPRESSION_ERROR = -9,
+};
+
+/**
+ * errorType values of ERROR events, matching MqttErrorType on the JS side.
+ */
+namespace errorType {
+constexpr const char *INITIALIZATION = "INITIALIZATION";
+constexpr const char *CONNECTION = "CONNECTION";
+constexpr const char *SUBSCRIPTION = "SUBSCRIPTION";
+constexpr const char *UNSUBSCRIPTION = "UNSUBSCRIPTION";
+constexpr const char *DISCONNECTION = "DISCONNECTION";
+constexpr const char *PUBLISH = "PUBLISH";
+constexpr const char *DECOMPRESSION = "DECOMPRESSION";
+}
+
+/**
+ * Largest remaining length an MQTT packet can have (section 2.1.4): a PUBLISH carries its topic, packet identifier
+ * and properties besides the payload within it.
+ */
+constexpr size_t MAX_REMAINING_LENGTH = 268435455;
+
+/**
+ * MQTT 5 user property a publisher sets to "deflate" (a zlib stream) or "gzip" to mark a compressed payload.
+ */
+constexpr const char *CONTENT_ENCODING_PROPERTY = "content-encoding";
+
+}
@@ -0,0 +1,151 @@
+//
+//  MqttDeliveryPipeline.cpp
+//  d11-mqtt
+//
+
+#include "MqttDeliveryPipeline.h"
+
+#include <limits>
+#include <utility>
+
+namespace mqtt {
+
+DeliveryTicket::~DeliveryTicket() {
+    if (auto pipeline = pipeline_.lock()) {
+        pipeline->release(acknowledgement_);
+    }
+}
+
+DeliveryPipeline::DeliveryPipeline(Deliver deliver, Acknowledge acknowledge)
+: deliver_(std::move(deliver)), acknowledge_(std::move(acknowledge)), drainTimer_([this] {
+      // Tickets released by the drain must not destroy the pipeline under it.
+      if (auto self = weak_from_this().lock()) {
+          std::unique_lock<std::mutex> lock(mutex_);
+          drain(lock);
+      }
+  }) {}
+
+DeliveryPipeline::~DeliveryPipeline() {
+    close();
+}
+
+void DeliveryPipeline::configure(const FlowControl &flowControl) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    flowControl_ = flowControl;
+    enabled_.store(flowControl.highWaterMark > 0, std::memory_order_release);
+    drain(lock);
+}
+
+void DeliveryPipeline::push(InboundMessage &&message) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    if (message.qos == 0 && queue_.size() + inFlight_ >= flowControl_.highWaterMark) {
+        dropped_++;
+        if (flowControl_.dropPolicy == DropPolicy::DropNewest) {
+            return;
+        }
+        auto oldest = queue_.begin();
+        while (oldest != queue_.end() && oldest->qos != 0) {
+            ++oldest;
+        }
+        if (oldest == queue_.end()) {
+            // Only QoS 1/2 messages wait, and those are never dropped.
+            return;
+        }
+        queue_.erase(oldest);
+    }
+    if (message.acknowledgement != 0) {
+        unacknowledged_++;
+    }
+    queue_.push_back(std::move(message));
+    drain(lock);
+}
+
+void DeliveryPipeline::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        queue_.clear();
+        pendingAcknowledgements_.clear();
+    }
+    drainTimer_.stop();
+}
+
+void DeliveryPipeline::release(uint64_t acknowledgement) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    if (inFlight_ > 0) {
+        inFlight_--;
+    }
+    if (acknowledgement != 0) {
+        unacknowledged_--;
+        pendingAcknowledgements_.push_back(acknowledgement);
+    }
+    // The thread that drains right now picks the work up itself.
+    if (!draining_ && hasWorkLocked()) {
+        drainTimer_.arm(FlushTimer::Clock::now());
+    }
+}
+
+size_t DeliveryPipeline::windowLocked() const {
+    if (flowControl_.highWaterMark == 0) {
+        return std::numeric_limits<size_t>::max();
+    }
+    return (flowControl_.highWaterMark + 1) / 2;
+}
+
+bool DeliveryPipeline::hasWorkLocked() const {
+    return !pendingAcknowledgements_.empty() || (!queue_.empty() && inFlight_ < windowLocked());
+}
+
+void DeliveryPipeline::drain(std::unique_lock<std::mutex> &lock) {
+    // One thread at a time, so entries reach the subscriptions in the order they were received.
+    if (draining_ || closed_) {
+        return;
+    }
+    draining_ = true;
+    std::vector<uint64_t> acknowledgements;
+    std::vector<InboundMessage> messages;
+    while (!closed_ && hasWorkLocked()) {
+        acknowledgements.swap(pendingAcknowledgements_);
+        size_t window = windowLocked();
+        while (!queue_.empty() && inFlight_ < window) {
+            messages.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+            inFlight_++;
+        }
+        lock.unlock();
+        for (uint64_t acknowledgement : acknowledgements) {
+            acknowledge_(acknowledgement);
+        }
+        for (auto &message : messages) {
+            auto ticket = std::make_shared<DeliveryTicket>(weak_from_this(), message.acknowledgement);
+            deliver_(std::move(message), std::move(ticket));
+        }
+        acknowledgements.clear();
+        messages.clear();
+        lock.lock();
+    }
+    draining_ = false;
+}
+
+EventValue DeliveryPipeline::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    EventValue::Map fields;
+    fields.emplace_back("highWaterMark", static_cast<double>(flowControl_.highWaterMark));
+    fields.emplace_back("dropPolicy", flowControl_.dropPolicy == DropPolicy::DropOldest ? "oldest" : "newest");
+    fields.emplace_back("queued", static_cast<double>(queue_.size()));
+    fields.emplace_back("inFlight", static_cast<double>(inFlight_));
+    fields.emplace_back("unacknowledged", static_cast<double>(unacknowledged_));
+    fields.emplace_back("dropped", static_cast<double>(dropped_));
+    return EventValue(std::move(fields));
+}
+
+}
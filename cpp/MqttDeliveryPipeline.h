@@ -0,0 +1,149 @@
+//
+//  MqttDeliveryPipeline.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "MqttEventValue.h"
+#include "MqttFlushTimer.h"
+#include "MqttMessage.h"
+
+namespace mqtt {
+
+/**
+ * The QoS 0 message a full DeliveryPipeline gives up: the oldest one still waiting in it, or the one just received.
+ */
+enum class DropPolicy { DropOldest, DropNewest };
+
+/**
+ * Flow control of received messages, set from the JS flowControl options.
+ */
+struct FlowControl {
+    // Received messages that may wait for JS before QoS 0 ones are dropped; 0 disables the pipeline.
+    size_t highWaterMark = 0;
+    DropPolicy dropPolicy = DropPolicy::DropOldest;
+};
+
+/**
+ * A received PUBLISH waiting in the pipeline, before it is routed to the subscriptions.
+ */
+struct InboundMessage {
+    std::string topic;
+    std::string payload;
+    int qos = 0;
+    int64_t receivedAt = 0;
+    // Handle of the deferred PUBACK/PUBREC for Transport::acknowledge, 0 when the transport acknowledged on receipt.
+    uint64_t acknowledgement = 0;
+    // Only kept while a message filter of the client reads them.
+    MessageProperties userProperties;
+};
+
+class DeliveryPipeline;
+
+/**
+ * Shared by the MqttMessages routed from one pipeline entry. The entry leaves the delivery window once the last of
+ * them is destroyed: delivered to JS, replaced by conflation or discarded with the dispatcher.
+ */
+class DeliveryTicket {
+public:
+    DeliveryTicket(std::weak_ptr<DeliveryPipeline> pipeline, uint64_t acknowledgement)
+    : pipeline_(std::move(pipeline)), acknowledgement_(acknowledgement) {}
+    ~DeliveryTicket();
+
+    DeliveryTicket(const DeliveryTicket &) = delete;
+    DeliveryTicket &operator=(const DeliveryTicket &) = delete;
+
+private:
+    std::weak_ptr<DeliveryPipeline> pipeline_;
+    const uint64_t acknowledgement_;
+};
+
+/**
+ * Bounded path of received messages from the network to JS, one per client.
+ *
+ * At most highWaterMark messages wait for JS: up to half of them are handed to the dispatcher (the delivery
+ * window), the rest queue here in arrival order. Once the pipeline is full, a received QoS 0 message either
+ * replaces the oldest QoS 0 message still queued or is dropped, as the drop policy says. QoS 1/2 messages are never
+ * dropped; their PUBACK/PUBREC is held back until JS got them instead, so a transport that announced a Receive
+ * Maximum makes the broker stop sending once that many are unacknowledged.
+ *
+ * push() is called from the transport's thread. Entries are routed to the subscriptions in order by whichever thread
+ * drains: the pushing one, or the pipeline's timer thread after tickets were released. Neither callback is called
+ * with the pipeline's lock held, and released tickets never call back synchronously, so tickets may be destroyed
+ * under the dispatcher's locks.
+ */
+class DeliveryPipeline : public std::enable_shared_from_this<DeliveryPipeline> {
+public:
+    using Deliver = std::function<void(InboundMessage &&, std::shared_ptr<DeliveryTicket>)>;
+    using Acknowledge = std::function<void(uint64_t)>;
+
+    DeliveryPipeline(Deliver deliver, Acknowledge acknowledge);
+    ~DeliveryPipeline();
+
+    DeliveryPipeline(const DeliveryPipeline &) = delete;
+    DeliveryPipeline &operator=(const DeliveryPipeline &) = delete;
+
+    /**
+     * Applies new limits; waiting messages that fit the new window are delivered right away, all of them when the
+     * pipeline gets disabled.
+     */
+    void configure(const FlowControl &flowControl);
+
+    /**
+     * Lock free, checked for every received message.
+     */
+    bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+    void push(InboundMessage &&message);
+
+    /**
+     * Discards the queued messages without acknowledging them and stops calling back, also for tickets still held by
+     * the dispatcher. Called before the owner of the callbacks goes away.
+     */
+    void close();
+
+    /**
+     * {highWaterMark, dropPolicy, queued, inFlight, unacknowledged, dropped}: queued waits here, inFlight was handed to
+     * the dispatcher, unacknowledged of both is QoS 1/2 with its acknowledgement held back, dropped counts the QoS 0
+     * messages given up since the client was created.
+     */
+    EventValue snapshot() const;
+
+private:
+    friend class DeliveryTicket;
+
+    void release(uint64_t acknowledgement);
+    void drain(std::unique_lock<std::mutex> &lock);
+    bool hasWorkLocked() const;
+    size_t windowLocked() const;
+
+    const Deliver deliver_;
+    const Acknowledge acknowledge_;
+
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex mutex_;
+    FlowControl flowControl_;
+    std::deque<InboundMessage> queue_;
+    std::vector<uint64_t> pendingAcknowledgements_;
+    size_t inFlight_ = 0;
+    size_t unacknowledged_ = 0;
+    uint64_t dropped_ = 0;
+    bool draining_ = false;
+    bool closed_ = false;
+
+    // Declared last: its thread drains and is joined first on destruction.
+    FlushTimer drainTimer_;
+};
+
+}
@@ -0,0 +1,602 @@
+//
+//  MqttEventDispatcher.cpp
+//  d11-mqtt
+//
+
+#include "MqttEventDispatcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "MqttJson.h"
+#include "MqttJsonHostObject.h"
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+static std::mutex current_dispatcher_mutex;
+static std::shared_ptr<EventDispatcher> current_dispatcher;
+
+namespace {
+
+/**
+ * Backing store of an ArrayBuffer handed to JS: owns the received payload, freed when JS collects the buffer.
+ */
+class PayloadBuffer : public jsi::MutableBuffer {
+public:
+    explicit PayloadBuffer(std::string bytes) : bytes_(std::move(bytes)) {}
+
+    size_t size() const override { return bytes_.size(); }
+    uint8_t *data() override { return reinterpret_cast<uint8_t *>(bytes_.data()); }
+
+private:
+    std::string bytes_;
+};
+
+/**
+ * Listeners of invalidated dispatchers that releaseListeners() did not get to release on their JS thread, because the
+ * platform never ran the task (the JS thread stopped first) or never tore the instance down. Destroying a
+ * jsi::Function calls into its runtime, and invalidate() runs once the next runtime installed its bindings, when the
+ * previous one may be gone, so these can never be released safely. They are parked in one holder that is itself
+ * never freed (a static vector would release them at exit).
+ */
+std::mutex retired_listeners_mutex;
+
+std::vector<std::shared_ptr<jsi::Function>> &retiredListeners() {
+    static auto *listeners = new std::vector<std::shared_ptr<jsi::Function>>();
+    return *listeners;
+}
+
+// JSC on React Native 0.72 does not implement ArrayBuffers over a MutableBuffer; the first failure switches to copying.
+std::atomic<bool> mutable_buffers_unsupported{false};
+
+jsi::ArrayBuffer createArrayBuffer(jsi::Runtime &runtime, std::string &&bytes) {
+    auto payload = std::make_shared<PayloadBuffer>(std::move(bytes));
+    if (!mutable_buffers_unsupported.load(std::memory_order_relaxed)) {
+        try {
+            return jsi::ArrayBuffer(runtime, payload);
+        } catch (const std::exception &) {
+            mutable_buffers_unsupported.store(true, std::memory_order_relaxed);
+        }
+    }
+    jsi::ArrayBuffer buffer = runtime.global()
+                                  .getPropertyAsFunction(runtime, "ArrayBuffer")
+                                  .callAsConstructor(runtime, static_cast<double>(payload->size()))
+                                  .getObject(runtime)
+                                  .getArrayBuffer(runtime);
+    if (payload->size() > 0) {
+        std::memcpy(buffer.data(runtime), payload->data(), payload->size());
+    }
+    return buffer;
+}
+
+}
+
+EventDispatcher::EventDispatcher(jsi::Runtime &runtime, JSInvoker jsInvoker)
+: runtime_(runtime), jsInvoker_(std::move(jsInvoker)) {}
+
+EventDispatcher::~EventDispatcher() = default;
+
+std::shared_ptr<EventDispatcher> EventDispatcher::current() {
+    std::lock_guard<std::mutex> lock(current_dispatcher_mutex);
+    return current_dispatcher;
+}
+
+void EventDispatcher::setCurrent(std::shared_ptr<EventDispatcher> dispatcher) {
+    std::shared_ptr<EventDispatcher> previous;
+    {
+        std::lock_guard<std::mutex> lock(current_dispatcher_mutex);
+        previous = std::move(current_dispatcher);
+        current_dispatcher = std::move(dispatcher);
+    }
+    if (previous) {
+        previous->invalidate();
+    }
+}
+
+void EventDispatcher::install(jsi::Object &module) {
+    std::weak_ptr<EventDispatcher> weakSelf = shared_from_this();
+
+    auto addEventListener = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "addEventListener"), 2,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (self && count >= 2) {
+                self->addListener(arguments[0].getString(runtime).utf8(runtime),
+                                  arguments[1].getObject(runtime).getFunction(runtime));
+            }
+            return jsi::Value::undefined();
+        });
+    module.setProperty(runtime_, "addEventListener", std::move(addEventListener));
+
+    auto removeEventListener = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "removeEventListener"), 1,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (self && count >= 1) {
+                self->removeListener(arguments[0].getString(runtime).utf8(runtime));
+            }
+            return jsi::Value::undefined();
+        });
+    module.setProperty(runtime_, "removeEventListener", std::move(removeEventListener));
+
+    auto setEventBatching = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "setEventBatching"), 3,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (self && count >= 3) {
+                self->setBatching(arguments[0].getString(runtime).utf8(runtime),
+                                  static_cast<size_t>(std::max(0.0, arguments[1].asNumber())),
+                                  std::chrono::milliseconds(static_cast<int64_t>(std::max(0.0, arguments[2].asNumber()))));
+            }
+            return jsi::Value::undefined();
+        });
+    module.setProperty(runtime_, "setEventBatching", std::move(setEventBatching));
+
+    auto setPayloadFormat = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "setPayloadFormat"), 2,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (self && count >= 2 && arguments[1].isString()) {
+                std::string format = arguments[1].getString(runtime).utf8(runtime);
+                self->setPayloadFormat(arguments[0].getString(runtime).utf8(runtime),
+                                       format == "arraybuffer" ? PayloadFormat::ArrayBuffer
+                                       : format == "json"      ? PayloadFormat::Json
+                                                               : PayloadFormat::String);
+            }
+            return jsi::Value::undefined();
+        });
+    module.setProperty(runtime_, "setPayloadFormat", std::move(setPayloadFormat));
+
+    auto setConflation = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "setConflation"), 2,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (self && count >= 2) {
+                self->setConflation(arguments[0].getString(runtime).utf8(runtime), arguments[1].getBool());
+            }
+            return jsi::Value::undefined();
+        });
+    module.setProperty(runtime_, "setConflation", std::move(setConflation));
+
+    auto getDroppedMessageCount = jsi::Function::createFromHostFunction(
+        runtime_, jsi::PropNameID::forAscii(runtime_, "getDroppedMessageCount"), 1,
+        [weakSelf](jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+            auto self = weakSelf.lock();
+            if (!self || count < 1) {
+                return jsi::Value(0);
+            }
+            return jsi::Value(
+                static_cast<double>(self->droppedMessageCount(arguments[0].getString(runtime).utf8(runtime))));
+        });
+    module.setProperty(runtime_, "getDroppedMessageCount", std::move(getDroppedMessageCount));
+}
+
+void EventDispatcher::addListener(const std::string &eventId, jsi::Function &&listener) {
+    listeners_[eventId] = std::make_shared<jsi::Function>(std::move(listener));
+}
+
+void EventDispatcher::removeListener(const std::string &eventId) {
+    listeners_.erase(eventId);
+    setPayloadFormat(eventId, PayloadFormat::String);
+    setBatching(eventId, 0, std::chrono::milliseconds::zero());
+    setConflation(eventId, false);
+}
+
+void EventDispatcher::setPayloadFormat(const std::string &eventId, PayloadFormat format) {
+    auto current = std::atomic_load(&payloadFormats_);
+    if (format == PayloadFormat::String && current->find(eventId) == current->end()) {
+        return;
+    }
+    auto next = std::make_shared<PayloadFormatMap>(*current);
+    if (format == PayloadFormat::String) {
+        next->erase(eventId);
+    } else {
+        (*next)[eventId] = format;
+    }
+    std::atomic_store(&payloadFormats_, std::shared_ptr<const PayloadFormatMap>(std::move(next)));
+}
+
+PayloadFormat EventDispatcher::payloadFormat(const std::string &eventId) const {
+    auto formats = std::atomic_load(&payloadFormats_);
+    if (formats->empty()) {
+        return PayloadFormat::String;
+    }
+    auto it = formats->find(eventId);
+    return it == formats->end() ? PayloadFormat::String : it->second;
+}
+
+void EventDispatcher::setConflation(const std::string &eventId, bool enabled) {
+    auto current = std::atomic_load(&conflations_);
+    if (enabled == (current->find(eventId) != current->end())) {
+        return;
+    }
+    auto next = std::make_shared<ConflationMap>(*current);
+    if (enabled) {
+        (*next)[eventId] = std::make_shared<ConflationSlots>();
+    } else {
+        next->erase(eventId);
+    }
+    std::atomic_store(&conflations_, std::shared_ptr<const ConflationMap>(std::move(next)));
+}
+
+std::shared_ptr<ConflationSlots> EventDispatcher::findConflation(const std::string &eventId) const {
+    auto conflations = std::atomic_load(&conflations_);
+    if (conflations->empty()) {
+        return nullptr;
+    }
+    auto it = conflations->find(eventId);
+    return it == conflations->end() ? nullptr : it->second;
+}
+
+uint64_t EventDispatcher::droppedMessageCount(const std::string &eventId) const {
+    auto slots = findConflation(eventId);
+    return slots ? slots->droppedCount() : 0;
+}
+
+void EventDispatcher::setBatching(const std::string &eventId, size_t maxBatchSize, std::chrono::milliseconds maxDelay) {
+    auto current = std::atomic_load(&batches_);
+    if (maxBatchSize == 0 && current->find(eventId) == current->end()) {
+        return;
+    }
+    if (maxBatchSize > 0 && !flushTimer_) {
+        std::weak_ptr<EventDispatcher> weakSelf = shared_from_this();
+        flushTimer_ = std::make_unique<FlushTimer>([weakSelf]() {
+            if (auto self = weakSelf.lock()) {
+                self->requestFlush();
+            }
+        });
+    }
+    auto next = std::make_shared<BatchMap>(*current);
+    if (maxBatchSize == 0) {
+        next->erase(eventId);
+    } else {
+        // Messages still buffered under the old settings are delivered by the next flush of the new batch.
+        (*next)[eventId] = std::make_shared<MessageBatch>(maxBatchSize, maxDelay);
+    }
+    std::atomic_store(&batches_, std::shared_ptr<const BatchMap>(std::move(next)));
+}
+
+std::shared_ptr<MessageBatch> EventDispatcher::findBatch(const std::string &eventId) const {
+    auto batches = std::atomic_load(&batches_);
+    if (batches->empty()) {
+        return nullptr;
+    }
+    auto it = batches->find(eventId);
+    return it == batches->end() ? nullptr : it->second;
+}
+
+void EventDispatcher::emit(std::string eventId, EventValue payload) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (invalidated_) {
+            return;
+        }
+        pending_.emplace_back(std::move(eventId), std::move(payload));
+        if (flushScheduled_) {
+            return;
+        }
+        flushScheduled_ = true;
+    }
+    scheduleFlush();
+}
+
+void EventDispatcher::emitMessage(std::string eventId, MqttMessage message) {
+    if (payloadFormat(eventId) != PayloadFormat::Json) {
+        // Parsed by a message filter, but not asked for.
+        message.json.reset();
+    } else if (!message.json) {
+        // Parsed here, on the network thread; on failure the payload stays a string.
+        message.json = parseJson(message.payload);
+    }
+    if (auto slots = findConflation(eventId)) {
+        if (slots->push(std::move(message))) {
+            requestFlush();
+        }
+        return;
+    }
+    auto batch = findBatch(eventId);
+    if (!batch) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (invalidated_) {
+                return;
+            }
+            pending_.emplace_back(std::move(eventId), std::move(message));
+            if (flushScheduled_) {
+                return;
+            }
+            flushScheduled_ = true;
+        }
+        scheduleFlush();
+        return;
+    }
+    switch (batch->push(std::move(message))) {
+        case MessageBatch::PushResult::First:
+            flushTimer_->arm(FlushTimer::Clock::now() + batch->maxDelay());
+            break;
+        case MessageBatch::PushResult::Full:
+            requestFlush();
+            break;
+        case MessageBatch::PushResult::Queued:
+            break;
+    }
+}
+
+void EventDispatcher::requestFlush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (invalidated_ || flushScheduled_) {
+            return;
+        }
+        flushScheduled_ = true;
+    }
+    scheduleFlush();
+}
+
+void EventDispatcher::scheduleFlush() {
+    std::weak_ptr<EventDispatcher> weakSelf = shared_from_this();
+    jsInvoker_([weakSelf]() {
+        if (auto self = weakSelf.lock()) {
+            self->flush();
+        }
+    });
+}
+
+void EventDispatcher::flush() {
+    MQTT_TRACE_SECTION("mqtt::EventDispatcher::flush");
+    int64_t startedAt = monotonicNanos();
+    deliveredInFlush_ = 0;
+    std::vector<PendingEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (invalidated_) {
+            return;
+        }
+        events.swap(pending_);
+        flushScheduled_ = false;
+    }
+
+    // A throwing listener must not swallow the rest of the batch; the first error is rethrown at the end so
+    // the runtime still reports it.
+    std::exception_ptr firstError;
+    for (auto &event : events) {
+        auto it = listeners_.find(event.first);
+        if (it == listeners_.end()) {
+            continue;
+        }
+        // Keep the function alive even if the listener removes itself while being called.
+        std::shared_ptr<jsi::Function> listener = it->second;
+        try {
+            if (auto *message = std::get_if<MqttMessage>(&event.second)) {
+                recordDelivery(*message, startedAt);
+                listener->call(runtime_,
+                               convertMqttMessageToJSIValue(runtime_, *message, payloadFormat(event.first)));
+            } else {
+                listener->call(runtime_, convertEventValueToJSIValue(runtime_, std::get<EventValue>(event.second)));
+            }
+        } catch (...) {
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+        }
+    }
+    flushBatches(firstError);
+    flushConflations(firstError);
+    if (deliveredInFlush_ > 0) {
+        queueDepth_.record(deliveredInFlush_);
+    }
+    flushDurationUs_.record(static_cast<uint64_t>(monotonicNanos() - startedAt) / 1000);
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void EventDispatcher::flushBatches(std::exception_ptr &firstError) {
+    auto batches = std::atomic_load(&batches_);
+    for (const auto &entry : *batches) {
+        bool hasRemaining = false;
+        std::vector<MqttMessage> messages = entry.second->drain(hasRemaining);
+        if (hasRemaining) {
+            // Messages that raced with this drain still need a deadline of their own.
+            flushTimer_->arm(FlushTimer::Clock::now() + entry.second->maxDelay());
+        }
+        auto it = listeners_.find(entry.first);
+        if (messages.empty() || it == listeners_.end()) {
+            continue;
+        }
+        std::shared_ptr<jsi::Function> listener = it->second;
+        PayloadFormat format = payloadFormat(entry.first);
+        int64_t now = monotonicNanos();
+        try {
+            jsi::Array array(runtime_, messages.size());
+            for (size_t i = 0; i < messages.size(); i++) {
+                recordDelivery(messages[i], now);
+                array.setValueAtIndex(runtime_, i, convertMqttMessageToJSIValue(runtime_, messages[i], format));
+            }
+            listener->call(runtime_, std::move(array));
+        } catch (...) {
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+        }
+    }
+}
+
+void EventDispatcher::flushConflations(std::exception_ptr &firstError) {
+    auto conflations = std::atomic_load(&conflations_);
+    for (const auto &entry : *conflations) {
+        std::vector<MqttMessage> messages = entry.second->drain();
+        auto it = listeners_.find(entry.first);
+        if (messages.empty() || it == listeners_.end()) {
+            continue;
+        }
+        std::shared_ptr<jsi::Function> listener = it->second;
+        PayloadFormat format = payloadFormat(entry.first);
+        int64_t now = monotonicNanos();
+        if (findBatch(entry.first)) {
+            try {
+                jsi::Array array(runtime_, messages.size());
+                for (size_t i = 0; i < messages.size(); i++) {
+                    recordDelivery(messages[i], now);
+                    array.setValueAtIndex(runtime_, i, convertMqttMessageToJSIValue(runtime_, messages[i], format));
+                }
+                listener->call(runtime_, std::move(array));
+            } catch (...) {
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+            }
+            continue;
+        }
+        for (auto &message : messages) {
+            recordDelivery(message, now);
+            try {
+                listener->call(runtime_, convertMqttMessageToJSIValue(runtime_, message, format));
+            } catch (...) {
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+            }
+        }
+    }
+}
+
+void EventDispatcher::recordDelivery(const MqttMessage &message, int64_t now) {
+    deliveredInFlush_++;
+    if (message.receivedAt != 0 && now > message.receivedAt) {
+        dispatchLatencyUs_.record(static_cast<uint64_t>(now - message.receivedAt) / 1000);
+    }
+}
+
+EventValue EventDispatcher::metricsSnapshot() const {
+    EventValue::Map fields;
+    fields.emplace_back("dispatchLatencyUs", dispatchLatencyUs_.snapshot());
+    fields.emplace_back("queueDepth", queueDepth_.snapshot());
+    fields.emplace_back("flushDurationUs", flushDurationUs_.snapshot());
+    return EventValue(std::move(fields));
+}
+
+void EventDispatcher::releaseListeners() {
+    if (flushTimer_) {
+        flushTimer_->stop();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        invalidated_ = true;
+        pending_.clear();
+    }
+    std::weak_ptr<EventDispatcher> weakSelf = shared_from_this();
+    jsInvoker_([weakSelf]() {
+        auto self = weakSelf.lock();
+        if (!self) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        // Once another runtime is installed this may not be the JS thread of these listeners; invalidate() parks them.
+        if (EventDispatcher::current() == self) {
+            self->listeners_.clear();
+        }
+    });
+}
+
+void EventDispatcher::invalidate() {
+    // Stopped before taking mutex_: a firing timer calls requestFlush(), which needs it.
+    if (flushTimer_) {
+        flushTimer_->stop();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    invalidated_ = true;
+    pending_.clear();
+    std::lock_guard<std::mutex> retiredLock(retired_listeners_mutex);
+    auto &retired = retiredListeners();
+    for (auto &entry : listeners_) {
+        retired.push_back(std::move(entry.second));
+    }
+    listeners_.clear();
+}
+
+jsi::Value convertEventValueToJSIValue(jsi::Runtime &runtime, const EventValue &value) {
+    switch (value.type()) {
+        case EventValue::Type::Null:
+            return jsi::Value::null();
+        case EventValue::Type::Bool:
+            return jsi::Value(value.getBool());
+        case EventValue::Type::Number:
+            return jsi::Value(value.getNumber());
+        case EventValue::Type::String:
+            return jsi::String::createFromUtf8(runtime, value.getString());
+        case EventValue::Type::Map: {
+            jsi::Object object(runtime);
+            for (const auto &entry : value.getMap()) {
+                object.setProperty(runtime, entry.first.c_str(), convertEventValueToJSIValue(runtime, entry.second));
+            }
+            return object;
+        }
+        case EventValue::Type::Array: {
+            const auto &items = value.getArray();
+            jsi::Array array(runtime, items.size());
+            for (size_t i = 0; i < items.size(); i++) {
+                array.setValueAtIndex(runtime, i, convertEventValueToJSIValue(runtime, items[i]));
+            }
+            return array;
+        }
+    }
+    return jsi::Value::undefined();
+}
+
+EventValue convertJSIValueToEventValue(jsi::Runtime &runtime, const jsi::Value &value, int depth) {
+    if (value.isBool()) {
+        return EventValue(value.getBool());
+    }
+    if (value.isNumber()) {
+        return EventValue(value.getNumber());
+    }
+    if (value.isString()) {
+        return EventValue(value.getString(runtime).utf8(runtime));
+    }
+    if (!value.isObject() || depth >= MAXIMUM_CONVERSION_DEPTH) {
+        return EventValue();
+    }
+    jsi::Object object = value.getObject(runtime);
+    if (object.isFunction(runtime)) {
+        return EventValue();
+    }
+    if (object.isArray(runtime)) {
+        jsi::Array array = object.getArray(runtime);
+        size_t length = array.size(runtime);
+        EventValue::Array items;
+        items.reserve(length);
+        for (size_t i = 0; i < length; i++) {
+            items.push_back(convertJSIValueToEventValue(runtime, array.getValueAtIndex(runtime, i), depth + 1));
+        }
+        return EventValue(std::move(items));
+    }
+    jsi::Array names = object.getPropertyNames(runtime);
+    size_t count = names.size(runtime);
+    EventValue::Map entries;
+    entries.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        jsi::String name = names.getValueAtIndex(runtime, i).getString(runtime);
+        entries.emplace_back(name.utf8(runtime),
+                             convertJSIValueToEventValue(runtime, object.getProperty(runtime, name), depth + 1));
+    }
+    return EventValue(std::move(entries));
+}
+
+jsi::Value convertMqttMessageToJSIValue(jsi::Runtime &runtime, MqttMessage &message, PayloadFormat format) {
+    jsi::Object object(runtime);
+    if (message.json) {
+        object.setProperty(runtime, "payload", convertJsonToJSIValue(runtime, message.json, JsonDocument::ROOT));
+    } else if (format == PayloadFormat::ArrayBuffer) {
+        object.setProperty(runtime, "payload", createArrayBuffer(runtime, std::move(message.payload)));
+    } else {
+        object.setProperty(runtime, "payload", jsi::String::createFromUtf8(runtime, message.payload));
+    }
+    object.setProperty(runtime, "topic", jsi::String::createFromUtf8(runtime, message.topic));
+    object.setProperty(runtime, "qos", message.qos);
+    return object;
+}
+
+}
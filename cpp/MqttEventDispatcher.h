@@ -0,0 +1,173 @@
+//
+//  MqttEventDispatcher.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jsi/jsi.h>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "MqttConflationSlots.h"
+#include "MqttEventValue.h"
+#include "MqttFlushTimer.h"
+#include "MqttMessage.h"
+#include "MqttMessageBatch.h"
+#include "MqttMetrics.h"
+
+namespace mqtt {
+
+namespace jsi = facebook::jsi;
+
+/**
+ * Delivers native MQTT events straight to jsi::Function listeners registered per eventId.
+ *
+ * emit() may be called from any thread. Events are queued and drained on the JS thread through the platform's
+ * JS invoker (the bridge CallInvoker on iOS, the JS message queue on Android), so nothing goes through
+ * RCTDeviceEventEmitter or WritableMap conversion. Listener bookkeeping and flushing only happen on the JS thread.
+ */
+class EventDispatcher : public std::enable_shared_from_this<EventDispatcher> {
+public:
+    using JSInvoker = std::function<void(std::function<void()> &&)>;
+
+    EventDispatcher(jsi::Runtime &runtime, JSInvoker jsInvoker);
+    ~EventDispatcher();
+
+    /**
+     * Dispatcher for the currently installed runtime, or nullptr when JSI bindings are not installed.
+     */
+    static std::shared_ptr<EventDispatcher> current();
+    static void setCurrent(std::shared_ptr<EventDispatcher> dispatcher);
+
+    /**
+     * Adds addEventListener/removeEventListener/setEventBatching/setPayloadFormat/setConflation/
+     * getDroppedMessageCount host functions to the JSI module object.
+     */
+    void install(jsi::Object &module);
+
+    void addListener(const std::string &eventId, jsi::Function &&listener);
+    void removeListener(const std::string &eventId);
+
+    /**
+     * Switches eventId to batched delivery: received messages are buffered and its listener is called with one
+     * array of {topic, payload, qos} once maxBatchSize messages are pending or maxDelayMs passed since the
+     * first one. A maxBatchSize of 0 restores per-message delivery. JS thread only.
+     */
+    void setBatching(const std::string &eventId, size_t maxBatchSize, std::chrono::milliseconds maxDelay);
+
+    /**
+     * Payload format of the messages delivered to eventId, String unless set. JS thread only; emitMessage() reads it
+     * from any thread to parse JSON before the message is queued.
+     */
+    void setPayloadFormat(const std::string &eventId, PayloadFormat format);
+
+    /**
+     * Switches eventId to conflated delivery: only the latest undelivered message per exact topic is kept, and the
+     * JS thread gets whatever is left in the slots when it flushes, as single messages or, if eventId is also
+     * batched, as one array. Disabling delivers nothing further that is still waiting in the slots. JS thread only.
+     */
+    void setConflation(const std::string &eventId, bool enabled);
+
+    /**
+     * Messages of eventId dropped by conflation since it was enabled.
+     */
+    uint64_t droppedMessageCount(const std::string &eventId) const;
+
+    /**
+     * {dispatchLatencyUs, queueDepth, flushDurationUs}: time from a message being received to its listener being
+     * called, messages delivered per flush of the JS thread and time spent in a flush, over all clients.
+     */
+    EventValue metricsSnapshot() const;
+
+    void emit(std::string eventId, EventValue payload);
+
+    /**
+     * Fast path for received messages; goes through the conflation slots or the batch of eventId when enabled for it.
+     */
+    void emitMessage(std::string eventId, MqttMessage message);
+
+    /**
+     * Stops delivery and releases the listeners on the JS thread, through the JS invoker. Called when the React
+     * instance is torn down, while its runtime still exists, so that a reload does not leak them.
+     */
+    void releaseListeners();
+
+    /**
+     * Stops delivery. Called once another runtime installed its dispatcher, when this runtime may already be gone:
+     * listeners releaseListeners() could not release are moved to a process-wide holder that is never freed rather
+     * than destroyed.
+     */
+    void invalidate();
+
+private:
+    using BatchMap = std::unordered_map<std::string, std::shared_ptr<MessageBatch>>;
+    using PayloadFormatMap = std::unordered_map<std::string, PayloadFormat>;
+    using ConflationMap = std::unordered_map<std::string, std::shared_ptr<ConflationSlots>>;
+    // Messages stay MqttMessages until the flush so their payload can be converted in the format of the listener.
+    using PendingEvent = std::pair<std::string, std::variant<EventValue, MqttMessage>>;
+
+    std::shared_ptr<MessageBatch> findBatch(const std::string &eventId) const;
+    std::shared_ptr<ConflationSlots> findConflation(const std::string &eventId) const;
+    void requestFlush();
+    void scheduleFlush();
+    void flush();
+    void flushBatches(std::exception_ptr &firstError);
+    void flushConflations(std::exception_ptr &firstError);
+    PayloadFormat payloadFormat(const std::string &eventId) const;
+    void recordDelivery(const MqttMessage &message, int64_t now);
+
+    jsi::Runtime &runtime_;
+    JSInvoker jsInvoker_;
+    std::unordered_map<std::string, std::shared_ptr<jsi::Function>> listeners_;
+
+    // Copy-on-write snapshot, replaced on the JS thread and read with atomic_load from network threads so
+    // the message path never takes a lock to find its batch.
+    std::shared_ptr<const BatchMap> batches_ = std::make_shared<const BatchMap>();
+    // Copy-on-write as well, for the same reason.
+    std::shared_ptr<const PayloadFormatMap> payloadFormats_ = std::make_shared<const PayloadFormatMap>();
+    std::shared_ptr<const ConflationMap> conflations_ = std::make_shared<const ConflationMap>();
+    std::unique_ptr<FlushTimer> flushTimer_;
+
+    std::mutex mutex_;
+    std::vector<PendingEvent> pending_;
+    bool flushScheduled_ = false;
+    bool invalidated_ = false;
+
+    LatencyHistogram dispatchLatencyUs_;
+    LatencyHistogram queueDepth_;
+    LatencyHistogram flushDurationUs_;
+    // Messages delivered by the flush in progress. JS thread only.
+    size_t deliveredInFlush_ = 0;
+};
+
+jsi::Value convertEventValueToJSIValue(jsi::Runtime &runtime, const EventValue &value);
+
+// Nesting beyond which convertJSIValueToEventValue gives up, which also ends cyclic objects.
+constexpr int MAXIMUM_CONVERSION_DEPTH = 32;
+
+/**
+ * Copies a JS value into an EventValue, to hand it to another runtime. Functions, undefined and values nested deeper
+ * than MAXIMUM_CONVERSION_DEPTH become null; ArrayBuffers and other objects become maps of their enumerable
+ * properties.
+ */
+EventValue convertJSIValueToEventValue(jsi::Runtime &runtime, const jsi::Value &value, int depth = 0);
+
+/**
+ * Converts a received message to {topic, payload, qos}. With PayloadFormat::ArrayBuffer the payload bytes are moved
+ * into the ArrayBuffer's backing store, so message.payload is left empty. A message carrying a parsed JSON document
+ * gets it as payload whatever the format.
+ */
+jsi::Value convertMqttMessageToJSIValue(jsi::Runtime &runtime, MqttMessage &message,
+                                        PayloadFormat format = PayloadFormat::String);
+
+}
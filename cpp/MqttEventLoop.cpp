@@ -0,0 +1,276 @@
+//
+//  MqttEventLoop.cpp
+//  d11-mqtt
+//
+
+#include "MqttEventLoop.h"
+
+#include <cerrno>
+#include <unistd.h>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#include <sys/types.h>
+#else
+#error "The native MQTT engine needs epoll or kqueue"
+#endif
+
+namespace mqtt {
+
+namespace {
+
+// Token of the wake-up notification; watched descriptors start at 1.
+constexpr uint64_t WAKE_TOKEN = 0;
+constexpr int MAX_EVENTS = 64;
+
+}
+
+EventLoop::EventLoop() {
+#if defined(__linux__)
+    pollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_TOKEN;
+    epoll_ctl(pollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+#else
+    pollFd_ = kqueue();
+    struct kevent event;
+    EV_SET(&event, WAKE_TOKEN, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    kevent(pollFd_, &event, 1, nullptr, 0, nullptr);
+#endif
+}
+
+EventLoop::~EventLoop() {
+    stop();
+#if defined(__linux__)
+    close(wakeFd_);
+#endif
+    close(pollFd_);
+}
+
+EventLoop &EventLoop::shared() {
+    // Leaked on purpose: connections may still post work while static destructors run.
+    static EventLoop *loop = new EventLoop();
+    return *loop;
+}
+
+void EventLoop::start() {
+    std::call_once(started_, [this] {
+        running_ = true;
+        thread_ = std::thread([this] {
+            threadId_ = std::this_thread::get_id();
+            run();
+        });
+    });
+}
+
+void EventLoop::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wake();
+    if (thread_.joinable()) {
+        if (isLoopThread()) {
+            thread_.detach();
+        } else {
+            thread_.join();
+        }
+    }
+}
+
+void EventLoop::post(std::function<void()> task) {
+    start();
+    {
+        std::lock_guard<std::mutex> lock(postedMutex_);
+        posted_.push_back(std::move(task));
+    }
+    wake();
+}
+
+void EventLoop::wake() {
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd_, &one, sizeof(one));
+    (void)written;
+#else
+    struct kevent event;
+    EV_SET(&event, WAKE_TOKEN, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    kevent(pollFd_, &event, 1, nullptr, 0, nullptr);
+#endif
+}
+
+void EventLoop::watch(int fd, IOHandler *handler, bool writable) {
+    uint64_t token = nextToken_++;
+    watches_[fd] = Watch{handler, token};
+    handlers_[token] = handler;
+#if defined(__linux__)
+    epoll_event event{};
+    event.events = EPOLLIN | (writable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.u64 = token;
+    epoll_ctl(pollFd_, EPOLL_CTL_ADD, fd, &event);
+#else
+    struct kevent events[2];
+    EV_SET(&events[0], fd, EVFILT_READ, EV_ADD, 0, 0, reinterpret_cast<void *>(token));
+    EV_SET(&events[1], fd, EVFILT_WRITE, EV_ADD | (writable ? EV_ENABLE : EV_DISABLE), 0, 0,
+           reinterpret_cast<void *>(token));
+    kevent(pollFd_, events, 2, nullptr, 0, nullptr);
+#endif
+}
+
+void EventLoop::update(int fd, bool writable) {
+    auto it = watches_.find(fd);
+    if (it == watches_.end()) {
+        return;
+    }
+#if defined(__linux__)
+    epoll_event event{};
+    event.events = EPOLLIN | (writable ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.u64 = it->second.token;
+    epoll_ctl(pollFd_, EPOLL_CTL_MOD, fd, &event);
+#else
+    struct kevent event;
+    EV_SET(&event, fd, EVFILT_WRITE, writable ? EV_ENABLE : EV_DISABLE, 0, 0,
+           reinterpret_cast<void *>(it->second.token));
+    kevent(pollFd_, &event, 1, nullptr, 0, nullptr);
+#endif
+}
+
+void EventLoop::unwatch(int fd) {
+    auto it = watches_.find(fd);
+    if (it == watches_.end()) {
+        return;
+    }
+    handlers_.erase(it->second.token);
+    watches_.erase(it);
+#if defined(__linux__)
+    epoll_ctl(pollFd_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+    struct kevent events[2];
+    EV_SET(&events[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    EV_SET(&events[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    kevent(pollFd_, events, 2, nullptr, 0, nullptr);
+#endif
+}
+
+EventLoop::TimerId EventLoop::addTimer(Clock::duration delay, std::function<void()> callback) {
+    TimerId id = nextTimerId_++;
+    Clock::time_point deadline = Clock::now() + delay;
+    timers_.emplace(id, std::make_pair(deadline, std::move(callback)));
+    timerQueue_.emplace(deadline, id);
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    // The queue entry is skipped when it comes due.
+    timers_.erase(id);
+}
+
+int EventLoop::pollTimeoutMs() {
+    while (!timerQueue_.empty() && timers_.find(timerQueue_.begin()->second) == timers_.end()) {
+        timerQueue_.erase(timerQueue_.begin());
+    }
+    if (timerQueue_.empty()) {
+        return -1;
+    }
+    auto delay = timerQueue_.begin()->first - Clock::now();
+    if (delay <= Clock::duration::zero()) {
+        return 0;
+    }
+    // Round up so the timer is due when the poll returns.
+    return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(delay).count()) + 1;
+}
+
+void EventLoop::runTimers() {
+    Clock::time_point now = Clock::now();
+    while (!timerQueue_.empty() && timerQueue_.begin()->first <= now) {
+        TimerId id = timerQueue_.begin()->second;
+        timerQueue_.erase(timerQueue_.begin());
+        auto it = timers_.find(id);
+        if (it == timers_.end()) {
+            continue;
+        }
+        std::function<void()> callback = std::move(it->second.second);
+        timers_.erase(it);
+        callback();
+    }
+}
+
+void EventLoop::runPosted() {
+    {
+        std::lock_guard<std::mutex> lock(postedMutex_);
+        runningTasks_.swap(posted_);
+    }
+    for (auto &task : runningTasks_) {
+        task();
+    }
+    runningTasks_.clear();
+}
+
+void EventLoop::dispatch(uint64_t token, bool readable, bool writable, bool error) {
+    auto it = handlers_.find(token);
+    if (it == handlers_.end()) {
+        return;
+    }
+    IOHandler *handler = it->second;
+    if (readable || error) {
+        // Errors and hang-ups surface through the handler's next read.
+        handler->onReadable();
+    }
+    if (writable && handlers_.find(token) != handlers_.end()) {
+        handler->onWritable();
+    }
+}
+
+void EventLoop::run() {
+#if defined(__linux__)
+    epoll_event events[MAX_EVENTS];
+#else
+    struct kevent events[MAX_EVENTS];
+#endif
+    while (running_) {
+        int timeoutMs = pollTimeoutMs();
+#if defined(__linux__)
+        int count = epoll_wait(pollFd_, events, MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < count && running_; i++) {
+            uint64_t token = events[i].data.u64;
+            if (token == WAKE_TOKEN) {
+                uint64_t value;
+                ssize_t drained = read(wakeFd_, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+            uint32_t flags = events[i].events;
+            dispatch(token, flags & EPOLLIN, flags & EPOLLOUT, flags & (EPOLLERR | EPOLLHUP));
+        }
+#else
+        struct timespec timeout;
+        struct timespec *timeoutPointer = nullptr;
+        if (timeoutMs >= 0) {
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            timeoutPointer = &timeout;
+        }
+        int count = kevent(pollFd_, nullptr, 0, events, MAX_EVENTS, timeoutPointer);
+        for (int i = 0; i < count && running_; i++) {
+            if (events[i].filter == EVFILT_USER) {
+                continue;
+            }
+            uint64_t token = reinterpret_cast<uint64_t>(events[i].udata);
+            bool error = (events[i].flags & (EV_ERROR | EV_EOF)) != 0;
+            dispatch(token, events[i].filter == EVFILT_READ, events[i].filter == EVFILT_WRITE, error);
+        }
+#endif
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        runTimers();
+        runPosted();
+    }
+}
+
+}
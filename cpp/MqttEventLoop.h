@@ -0,0 +1,107 @@
+//
+//  MqttEventLoop.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt {
+
+/**
+ * Receives readiness notifications for a file descriptor watched by an EventLoop. Called on the loop thread.
+ */
+class IOHandler {
+public:
+    virtual ~IOHandler() = default;
+
+    virtual void onReadable() = 0;
+    virtual void onWritable() = 0;
+};
+
+/**
+ * Single thread non-blocking I/O loop on epoll (Linux, Android) or kqueue (Apple platforms), shared by every
+ * native engine connection.
+ *
+ * watch/update/unwatch and timers must be used from the loop thread; post() can be called from any thread and is
+ * how other threads get work onto it. A handler is never called after unwatch(), even for readiness reported in
+ * the same poll round.
+ */
+class EventLoop {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /**
+     * Lazily started loop used by the native engine on device.
+     */
+    static EventLoop &shared();
+
+    void post(std::function<void()> task);
+    bool isLoopThread() const { return std::this_thread::get_id() == threadId_.load(); }
+
+    void watch(int fd, IOHandler *handler, bool writable);
+    void update(int fd, bool writable);
+    void unwatch(int fd);
+
+    TimerId addTimer(Clock::duration delay, std::function<void()> callback);
+    void cancelTimer(TimerId id);
+
+    /**
+     * Stops and joins the loop thread. Pending tasks are dropped.
+     */
+    void stop();
+
+private:
+    struct Watch {
+        IOHandler *handler;
+        uint64_t token;
+    };
+
+    void start();
+    void run();
+    void wake();
+    int pollTimeoutMs();
+    void runTimers();
+    void runPosted();
+    void dispatch(uint64_t token, bool readable, bool writable, bool error);
+
+    int pollFd_ = -1;
+#if defined(__linux__)
+    int wakeFd_ = -1;
+#endif
+
+    std::thread thread_;
+    std::atomic<std::thread::id> threadId_{};
+    std::atomic<bool> running_{false};
+    std::once_flag started_;
+
+    std::mutex postedMutex_;
+    std::vector<std::function<void()>> posted_;
+    std::vector<std::function<void()>> runningTasks_;
+
+    // Loop thread only.
+    std::unordered_map<int, Watch> watches_;
+    std::unordered_map<uint64_t, IOHandler *> handlers_;
+    uint64_t nextToken_ = 1;
+    std::multimap<Clock::time_point, TimerId> timerQueue_;
+    std::unordered_map<TimerId, std::pair<Clock::time_point, std::function<void()>>> timers_;
+    TimerId nextTimerId_ = 1;
+};
+
+}
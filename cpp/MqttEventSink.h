@@ -0,0 +1,27 @@
+//
+//  MqttEventSink.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <string>
+
+#include "MqttEventValue.h"
+#include "MqttMessage.h"
+
+namespace mqtt {
+
+/**
+ * Destination of events produced by the core. On device this forwards to the JSI EventDispatcher; tests record
+ * the events instead.
+ */
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+
+    virtual void emit(std::string eventId, EventValue payload) = 0;
+    virtual void emitMessage(std::string eventId, MqttMessage message) = 0;
+};
+
+}
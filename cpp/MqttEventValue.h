@@ -0,0 +1,48 @@
+//
+//  MqttEventValue.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace mqtt {
+
+/**
+ * Platform independent copy of an event payload. Kotlin HashMaps and NSDictionaries are converted into an
+ * EventValue on the thread that produced the event, so the JS thread only has to turn it into jsi values.
+ */
+class EventValue {
+public:
+    using Map = std::vector<std::pair<std::string, EventValue>>;
+    using Array = std::vector<EventValue>;
+
+    enum class Type { Null, Bool, Number, String, Map, Array };
+
+    EventValue() = default;
+    EventValue(bool value) : value_(value) {}
+    EventValue(int value) : value_(static_cast<double>(value)) {}
+    EventValue(double value) : value_(value) {}
+    EventValue(const char *value) : value_(std::string(value)) {}
+    EventValue(std::string value) : value_(std::move(value)) {}
+    EventValue(Map value) : value_(std::move(value)) {}
+    EventValue(Array value) : value_(std::move(value)) {}
+
+    Type type() const { return static_cast<Type>(value_.index()); }
+
+    bool getBool() const { return std::get<bool>(value_); }
+    double getNumber() const { return std::get<double>(value_); }
+    const std::string &getString() const { return std::get<std::string>(value_); }
+    const Map &getMap() const { return std::get<Map>(value_); }
+    const Array &getArray() const { return std::get<Array>(value_); }
+
+private:
+    // Alternative order must match Type.
+    std::variant<std::monostate, bool, double, std::string, Map, Array> value_;
+};
+
+}
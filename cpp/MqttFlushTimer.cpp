@@ -0,0 +1,73 @@
+//
+//  MqttFlushTimer.cpp
+//  d11-mqtt
+//
+
+#include "MqttFlushTimer.h"
+
+#include <utility>
+
+namespace mqtt {
+
+FlushTimer::FlushTimer(std::function<void()> callback) : callback_(std::move(callback)) {}
+
+FlushTimer::~FlushTimer() {
+    stop();
+}
+
+void FlushTimer::arm(Clock::time_point deadline) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopped_) {
+        return;
+    }
+    if (armed_ && deadline_ <= deadline) {
+        return;
+    }
+    deadline_ = deadline;
+    armed_ = true;
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&FlushTimer::run, this);
+    } else {
+        condition_.notify_one();
+    }
+}
+
+void FlushTimer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        armed_ = false;
+    }
+    condition_.notify_one();
+    if (!thread_.joinable()) {
+        return;
+    }
+    if (thread_.get_id() == std::this_thread::get_id()) {
+        thread_.detach();
+    } else {
+        thread_.join();
+    }
+}
+
+void FlushTimer::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_) {
+        if (!armed_) {
+            condition_.wait(lock);
+            continue;
+        }
+        if (condition_.wait_until(lock, deadline_) == std::cv_status::no_timeout) {
+            // Re-armed earlier, stopped or spurious wake up; re-check the deadline.
+            continue;
+        }
+        if (!armed_ || Clock::now() < deadline_) {
+            continue;
+        }
+        armed_ = false;
+        lock.unlock();
+        callback_();
+        lock.lock();
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+//
+//  MqttFlushTimer.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace mqtt {
+
+/**
+ * Single background thread that calls back once the earliest armed deadline passes.
+ *
+ * Used to bound how long batched messages wait when a burst never fills a whole batch, and to time the reconnect
+ * backoff of a Client. Arming an earlier deadline wakes the thread; later deadlines are merged into the pending
+ * one. The thread is started lazily and joined by stop() or the destructor.
+ */
+class FlushTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FlushTimer(std::function<void()> callback);
+    ~FlushTimer();
+
+    FlushTimer(const FlushTimer &) = delete;
+    FlushTimer &operator=(const FlushTimer &) = delete;
+
+    void arm(Clock::time_point deadline);
+    void stop();
+
+private:
+    void run();
+
+    std::function<void()> callback_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::thread thread_;
+    Clock::time_point deadline_;
+    bool armed_ = false;
+    bool stopped_ = false;
+};
+
+}
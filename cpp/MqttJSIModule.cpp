@@ -0,0 +1,690 @@
+//
+//  MqttJSIModule.cpp
+//  d11-mqtt
+//
+
+#include "MqttJSIModule.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+
+#include "MqttBackgroundRuntime.h"
+#include "MqttClientRegistry.h"
+#include "MqttConnectionStateHostObject.h"
+#include "MqttConstants.h"
+#include "MqttJson.h"
+#include "MqttLastValueCache.h"
+#include "MqttMessageFilter.h"
+#include "MqttNativeEngine.h"
+#include "MqttOutboundStore.h"
+#include "MqttTrace.h"
+#include "MqttWarmStart.h"
+
+namespace mqtt {
+
+namespace {
+
+class DispatcherEventSink : public EventSink {
+public:
+    void emit(std::string eventId, EventValue payload) override {
+        if (auto dispatcher = EventDispatcher::current()) {
+            dispatcher->emit(std::move(eventId), std::move(payload));
+        }
+    }
+
+    void emitMessage(std::string eventId, MqttMessage message) override {
+        auto background = BackgroundRuntime::current();
+        if (background && background->deliver(eventId, message)) {
+            return;
+        }
+        if (auto dispatcher = EventDispatcher::current()) {
+            dispatcher->emitMessage(std::move(eventId), std::move(message));
+        }
+    }
+};
+
+std::mutex storage_directory_mutex;
+std::string storage_directory;
+
+/**
+ * <storage directory>/mqtt, created if needed, where the native engine keeps its per-client files.
+ */
+std::string engineDirectory(std::string &error) {
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> lock(storage_directory_mutex);
+        directory = storage_directory;
+    }
+    if (directory.empty()) {
+        error = "No storage directory available";
+        return std::string();
+    }
+    directory += "/mqtt";
+    if (mkdir(directory.c_str(), 0700) < 0 && errno != EEXIST) {
+        error = "Failed to create " + directory;
+        return std::string();
+    }
+    return directory;
+}
+
+/**
+ * Path of the outbound store of clientId: one file per client in the engine directory.
+ */
+std::string outboundStorePath(const std::string &clientId, std::string &error) {
+    std::string directory = engineDirectory(error);
+    return directory.empty() ? std::string() : directory + "/" + clientFileName(clientId) + ".outbox";
+}
+
+/**
+ * Path of the last value cache of clientId, next to its outbound store.
+ */
+std::string lastValueCachePath(const std::string &clientId, std::string &error) {
+    std::string directory = engineDirectory(error);
+    return directory.empty() ? std::string() : directory + "/" + clientFileName(clientId) + ".lastvalue";
+}
+
+std::string stringArgument(jsi::Runtime &runtime, const jsi::Value *arguments, size_t count, size_t index) {
+    if (index >= count || !arguments[index].isString()) {
+        return std::string();
+    }
+    return arguments[index].getString(runtime).utf8(runtime);
+}
+
+int intArgument(const jsi::Value *arguments, size_t count, size_t index, int fallback) {
+    if (index >= count || !arguments[index].isNumber()) {
+        return fallback;
+    }
+    return static_cast<int>(arguments[index].getNumber());
+}
+
+std::shared_ptr<Client> findClient(jsi::Runtime &runtime, const jsi::Value *arguments, size_t count, size_t index) {
+    return ClientRegistry::shared().find(stringArgument(runtime, arguments, count, index));
+}
+
+ConnectOptions connectOptionsFromObject(jsi::Runtime &runtime, const jsi::Object &object) {
+    ConnectOptions options;
+    jsi::Value keepAlive = object.getProperty(runtime, "keepAlive");
+    if (keepAlive.isNumber()) {
+        options.keepAlive = static_cast<int>(keepAlive.getNumber());
+    }
+    jsi::Value cleanSession = object.getProperty(runtime, "cleanSession");
+    if (cleanSession.isBool()) {
+        options.cleanSession = cleanSession.getBool();
+    }
+    jsi::Value username = object.getProperty(runtime, "username");
+    if (username.isString()) {
+        options.username = username.getString(runtime).utf8(runtime);
+    }
+    jsi::Value password = object.getProperty(runtime, "password");
+    if (password.isString()) {
+        options.password = password.getString(runtime).utf8(runtime);
+    }
+    jsi::Value receiveMaximum = object.getProperty(runtime, "receiveMaximum");
+    if (receiveMaximum.isNumber()) {
+        options.receiveMaximum = static_cast<int>(receiveMaximum.getNumber());
+    }
+    return options;
+}
+
+FlowControl flowControlFromObject(jsi::Runtime &runtime, const jsi::Object &object) {
+    FlowControl flowControl;
+    jsi::Value highWaterMark = object.getProperty(runtime, "highWaterMark");
+    if (highWaterMark.isNumber()) {
+        flowControl.highWaterMark = static_cast<size_t>(std::max(0.0, highWaterMark.getNumber()));
+    }
+    jsi::Value dropPolicy = object.getProperty(runtime, "dropPolicy");
+    if (dropPolicy.isString() && dropPolicy.getString(runtime).utf8(runtime) == "newest") {
+        flowControl.dropPolicy = DropPolicy::DropNewest;
+    }
+    return flowControl;
+}
+
+ReconnectPolicy reconnectPolicyFromObject(jsi::Runtime &runtime, const jsi::Object &object) {
+    ReconnectPolicy policy;
+    jsi::Value enabled = object.getProperty(runtime, "enabled");
+    policy.enabled = enabled.isBool() && enabled.getBool();
+    jsi::Value maxRetries = object.getProperty(runtime, "maxRetries");
+    if (maxRetries.isNumber()) {
+        policy.maxRetries = static_cast<int>(maxRetries.getNumber());
+    }
+    jsi::Value backoffMs = object.getProperty(runtime, "backoffMs");
+    if (backoffMs.isNumber()) {
+        policy.backoff = std::chrono::milliseconds(static_cast<int64_t>(backoffMs.getNumber()));
+    }
+    jsi::Value maxBackoffMs = object.getProperty(runtime, "maxBackoffMs");
+    if (maxBackoffMs.isNumber()) {
+        policy.maxBackoff = std::chrono::milliseconds(static_cast<int64_t>(maxBackoffMs.getNumber()));
+    }
+    jsi::Value jitterMs = object.getProperty(runtime, "jitterMs");
+    if (jitterMs.isNumber()) {
+        policy.jitter = std::chrono::milliseconds(static_cast<int64_t>(jitterMs.getNumber()));
+    }
+    jsi::Value refreshCredentials = object.getProperty(runtime, "refreshCredentials");
+    policy.refreshCredentials = refreshCredentials.isBool() && refreshCredentials.getBool();
+    return policy;
+}
+
+/**
+ * NativeClientOptions of a client without TLS or a shared connection, with an outbound store of storeCapacity
+ * bytes (none when 0) next to the other files of the engine.
+ */
+NativeClientOptions socketClientOptions(const std::string &clientId, const std::string &host, int port,
+                                        size_t storeCapacity) {
+    NativeClientOptions options;
+    options.host = host;
+    options.port = port;
+    options.storeCapacity = storeCapacity;
+    options.storePath = [clientId](std::string &error) { return outboundStorePath(clientId, error); };
+    return options;
+}
+
+/**
+ * With warmStart, records the session of client after every successful connect, for warmStartClients to start it
+ * at the next launch. Without, forgets a recorded one.
+ */
+void observeWarmStartSession(Client &client, const std::string &clientId, const std::string &host, int port,
+                             size_t storeCapacity, bool warmStart) {
+    std::string error;
+    std::string directory = engineDirectory(error);
+    if (directory.empty()) {
+        return;
+    }
+    if (!warmStart) {
+        client.setSessionObserver(nullptr);
+        WarmStartStore(directory).remove(clientId);
+        return;
+    }
+    client.setSessionObserver([directory, clientId, host, port, storeCapacity](
+                                  const ConnectOptions &options,
+                                  const std::vector<std::pair<std::string, int>> &filters) {
+        WarmStartSession session;
+        session.clientId = clientId;
+        session.host = host;
+        session.port = port;
+        session.options = options;
+        session.storeCapacity = storeCapacity;
+        session.filters = filters;
+        std::string error;
+        WarmStartStore(directory).save(session, error);
+    });
+}
+
+/*
+ * createMqtt of the native engine: the client gets a SocketTransport instead of a HiveMQ/CocoaMQTT transport.
+ * Like the platform createMqtt, an existing client with the same clientId is kept as is. A positive fifth argument
+ * persists outgoing QoS 1/2 messages in an outbound store of at most that many bytes. With a true sixth argument
+ * the client shares one connection with the other sharing clients of the same host, port and credentials. With a
+ * true seventh argument the session is recorded to warm start the client at the next launch; a client warm started
+ * at this launch for the same host and port is taken over instead of creating one.
+ */
+jsi::Value createNativeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                            size_t count) {
+    std::string clientId = stringArgument(runtime, arguments, count, 0);
+    std::string host = stringArgument(runtime, arguments, count, 1);
+    int port = intArgument(arguments, count, 2, 1883);
+    bool enableSsl = count > 3 && arguments[3].isBool() && arguments[3].getBool();
+    double storeCapacity = count > 4 && arguments[4].isNumber() ? arguments[4].getNumber() : 0;
+    bool shareConnection = count > 5 && arguments[5].isBool() && arguments[5].getBool();
+    bool warmStart = count > 6 && arguments[6].isBool() && arguments[6].getBool();
+    size_t capacity = static_cast<size_t>(std::max(0.0, storeCapacity));
+
+    if (shareConnection || enableSsl) {
+        WarmStart::shared().discard(clientId);
+    } else if (auto client = WarmStart::shared().adopt(clientId, host, port)) {
+        client->onInitialized();
+        observeWarmStartSession(*client, clientId, host, port, capacity, warmStart);
+        return jsi::Value::undefined();
+    }
+
+    NativeClientOptions options = socketClientOptions(clientId, host, port, capacity);
+    options.enableSsl = enableSsl;
+    options.shareConnection = shareConnection;
+    std::string error;
+    auto client = createNativeClient(ClientRegistry::shared(), clientId, options, dispatcherEventSink(), error);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    if (!error.empty()) {
+        client->onInitializationFailed(error);
+        return jsi::Value::undefined();
+    }
+    client->onInitialized();
+    if (!shareConnection) {
+        observeWarmStartSession(*client, clientId, host, port, capacity, warmStart);
+    }
+    return jsi::Value::undefined();
+}
+
+jsi::Value removeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+    ClientRegistry::shared().remove(stringArgument(runtime, arguments, count, 0));
+    return jsi::Value::undefined();
+}
+
+jsi::Value connectMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    ConnectOptions options;
+    if (count > 1 && arguments[1].isObject()) {
+        options = connectOptionsFromObject(runtime, arguments[1].getObject(runtime));
+    }
+    client->connect(options);
+    return jsi::Value::undefined();
+}
+
+/*
+ * Hands reconnects over to the core: after a lost connection or a failed attempt it connects again with the last
+ * connectMqtt options and its own backoff, without a round trip through JS.
+ */
+jsi::Value setReconnectPolicy(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                              size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (client && count > 1 && arguments[1].isObject()) {
+        client->setReconnectPolicy(reconnectPolicyFromObject(runtime, arguments[1].getObject(runtime)));
+    }
+    return jsi::Value::undefined();
+}
+
+/*
+ * Bounds the received messages of the client that wait for JS; a highWaterMark of 0 removes the bound.
+ */
+jsi::Value setFlowControl(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                          size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (client && count > 1 && arguments[1].isObject()) {
+        client->setFlowControl(flowControlFromObject(runtime, arguments[1].getObject(runtime)));
+    }
+    return jsi::Value::undefined();
+}
+
+/*
+ * Opens the disk-backed last value cache of the client, see LastValueCache: (clientId, { maxBytes, ttlMs }). Works for
+ * both engines, since every received message passes the shared Client. A cache that fails to open is reported as an
+ * INITIALIZATION error and leaves the client without one. A client keeps the first cache it got: mapping the same file
+ * a second time would leave two writers on it.
+ */
+jsi::Value setLastValueCache(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                             size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client || client->lastValueCache() || count < 2 || !arguments[1].isObject()) {
+        return jsi::Value::undefined();
+    }
+    jsi::Object options = arguments[1].getObject(runtime);
+    jsi::Value maxBytes = options.getProperty(runtime, "maxBytes");
+    jsi::Value ttlMs = options.getProperty(runtime, "ttlMs");
+    size_t capacity = maxBytes.isNumber() && maxBytes.getNumber() > 0 ? static_cast<size_t>(maxBytes.getNumber())
+                                                                      : LastValueCache::DEFAULT_CAPACITY;
+    std::chrono::milliseconds ttl(ttlMs.isNumber() && ttlMs.getNumber() > 0 ? static_cast<int64_t>(ttlMs.getNumber())
+                                                                            : 0);
+    std::string error;
+    std::string path = lastValueCachePath(client->clientId(), error);
+    auto cache = path.empty() ? nullptr : LastValueCache::open(path, capacity, ttl, error);
+    if (!cache) {
+        client->onInitializationFailed("Failed to open the last value cache: " + error);
+        return jsi::Value::undefined();
+    }
+    client->setLastValueCache(std::move(cache));
+    return jsi::Value::undefined();
+}
+
+/*
+ * Last value of a topic from the client's cache as { topic, payload, qos, receivedAt } (milliseconds since the
+ * epoch), with the payload in the given format: (clientId, topic, format). Undefined without a cache or value.
+ */
+jsi::Value getLastValue(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+    MQTT_TRACE_SECTION("mqtt::getLastValue");
+    auto client = findClient(runtime, arguments, count, 0);
+    auto cache = client ? client->lastValueCache() : nullptr;
+    LastValueCache::Value value;
+    if (!cache || !cache->get(stringArgument(runtime, arguments, count, 1), value)) {
+        return jsi::Value::undefined();
+    }
+    std::string format = stringArgument(runtime, arguments, count, 2);
+    MqttMessage message;
+    message.topic = std::move(value.topic);
+    message.payload = std::move(value.payload);
+    message.qos = value.qos;
+    if (format == "json") {
+        message.json = parseJson(message.payload);
+    }
+    jsi::Value result = convertMqttMessageToJSIValue(runtime, message,
+                                                     format == "json"          ? PayloadFormat::Json
+                                                     : format == "arraybuffer" ? PayloadFormat::ArrayBuffer
+                                                                               : PayloadFormat::String);
+    result.getObject(runtime).setProperty(runtime, "receivedAt", static_cast<double>(value.receivedAt));
+    return result;
+}
+
+/*
+ * Snapshot of the client's delivery pipeline (see DeliveryPipeline::snapshot), or undefined for an unknown clientId.
+ */
+jsi::Value getDeliveryState(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                            size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    return convertEventValueToJSIValue(runtime, client->deliveryState());
+}
+
+/*
+ * Registers a preset dictionary (a string or an ArrayBuffer) for the deflate payloads the client receives.
+ */
+jsi::Value addCompressionDictionary(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                                    size_t count) {
+    std::string dictionary;
+    if (count > 1 && arguments[1].isString()) {
+        dictionary = arguments[1].getString(runtime).utf8(runtime);
+    } else if (count > 1 && arguments[1].isObject() && arguments[1].getObject(runtime).isArrayBuffer(runtime)) {
+        jsi::ArrayBuffer arrayBuffer = arguments[1].getObject(runtime).getArrayBuffer(runtime);
+        dictionary.assign(reinterpret_cast<const char *>(arrayBuffer.data(runtime)), arrayBuffer.size(runtime));
+    } else {
+        throw jsi::JSError(runtime, "addCompressionDictionary: dictionary must be a string or an ArrayBuffer");
+    }
+    if (auto client = findClient(runtime, arguments, count, 0)) {
+        client->addCompressionDictionary(std::move(dictionary));
+    }
+    return jsi::Value::undefined();
+}
+
+jsi::Value disconnectMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                          size_t count) {
+    if (auto client = findClient(runtime, arguments, count, 0)) {
+        client->disconnect();
+    }
+    return jsi::Value::undefined();
+}
+
+/*
+ * (eventId, clientId, topic, qos, replayLastValue, filter). The optional filter (see MessageFilter) is compiled here,
+ * once; a malformed one throws before anything is subscribed.
+ */
+jsi::Value subscribeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                         size_t count) {
+    std::shared_ptr<MessageFilter> filter;
+    if (count > 5 && !arguments[5].isUndefined() && !arguments[5].isNull()) {
+        std::string error;
+        filter = MessageFilter::compile(convertJSIValueToEventValue(runtime, arguments[5]), error);
+        if (!filter) {
+            throw jsi::JSError(runtime, "subscribeMqtt: invalid filter: " + error);
+        }
+    }
+    if (auto client = findClient(runtime, arguments, count, 1)) {
+        bool replayLastValue = count > 4 && arguments[4].isBool() && arguments[4].getBool();
+        client->subscribe(stringArgument(runtime, arguments, count, 0), stringArgument(runtime, arguments, count, 2),
+                          intArgument(arguments, count, 3, 0), replayLastValue, std::move(filter));
+    }
+    return jsi::Value::undefined();
+}
+
+/*
+ * Counters of the filter a subscription was made with as { passed, dropped }: (clientId, eventId). Undefined for a
+ * subscription without a filter.
+ */
+jsi::Value getFilterStats(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                          size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    auto filter = client ? client->messageFilter(stringArgument(runtime, arguments, count, 1)) : nullptr;
+    if (!filter) {
+        return jsi::Value::undefined();
+    }
+    jsi::Object stats(runtime);
+    stats.setProperty(runtime, "passed", static_cast<double>(filter->passedCount()));
+    stats.setProperty(runtime, "dropped", static_cast<double>(filter->droppedCount()));
+    return stats;
+}
+
+jsi::Value unsubscribeMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                           size_t count) {
+    if (auto client = findClient(runtime, arguments, count, 1)) {
+        client->unsubscribe(stringArgument(runtime, arguments, count, 0),
+                            stringArgument(runtime, arguments, count, 2));
+    }
+    return jsi::Value::undefined();
+}
+
+jsi::Value getConnectionStatusMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                                   size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    return jsi::String::createFromAscii(runtime, client ? client->connectionStatus() : status::DISCONNECTED);
+}
+
+/*
+ * Returns the live connection state object of the client, or undefined for an unknown clientId. JS keeps the object
+ * and reads its properties instead of calling getConnectionStatusMqtt for every check.
+ */
+jsi::Value getConnectionStateMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                                  size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    return jsi::Object::createFromHostObject(runtime, std::make_shared<ConnectionStateHostObject>(client));
+}
+
+/*
+ * Points data and size at a string (through its UTF-8 copy in utf8) or ArrayBuffer payload argument.
+ */
+void payloadArgument(jsi::Runtime &runtime, const jsi::Value &value, const char *function, std::string &utf8,
+                     const uint8_t *&data, size_t &size) {
+    if (value.isString()) {
+        utf8 = value.getString(runtime).utf8(runtime);
+        data = reinterpret_cast<const uint8_t *>(utf8.data());
+        size = utf8.size();
+    } else if (value.isObject() && value.getObject(runtime).isArrayBuffer(runtime)) {
+        jsi::ArrayBuffer arrayBuffer = value.getObject(runtime).getArrayBuffer(runtime);
+        data = arrayBuffer.data(runtime);
+        size = arrayBuffer.size(runtime);
+    } else {
+        throw jsi::JSError(runtime, std::string(function) + ": payload must be a string or an ArrayBuffer");
+    }
+}
+
+/*
+ * The payload is passed to the transport as a pointer into the ArrayBuffer (or the UTF-8 copy of a string); the
+ * transport makes the only copy, into the buffer type of its platform client.
+ */
+jsi::Value publishMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+    MQTT_TRACE_SECTION("mqtt::publishMqtt");
+    if (count < 3) {
+        return jsi::Value::undefined();
+    }
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    std::string utf8;
+    payloadArgument(runtime, arguments[2], "publishMqtt", utf8, data, size);
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    bool retain = count > 4 && arguments[4].isBool() && arguments[4].getBool();
+    client->publish(stringArgument(runtime, arguments, count, 1), data, size, intArgument(arguments, count, 3, 0),
+                    retain);
+    return jsi::Value::undefined();
+}
+
+/*
+ * Publishes an array of { topic, payload, qos, retain } in one call: (clientId, messages). The native engine encodes
+ * them into its outbox back to back, so the whole batch usually leaves in one socket write.
+ */
+jsi::Value publishManyMqtt(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                           size_t count) {
+    MQTT_TRACE_SECTION("mqtt::publishManyMqtt");
+    if (count < 2 || !arguments[1].isObject() || !arguments[1].getObject(runtime).isArray(runtime)) {
+        return jsi::Value::undefined();
+    }
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    jsi::Array messages = arguments[1].getObject(runtime).getArray(runtime);
+    size_t length = messages.size(runtime);
+    std::string utf8;
+    for (size_t i = 0; i < length; i++) {
+        jsi::Object message = messages.getValueAtIndex(runtime, i).asObject(runtime);
+        jsi::Value topic = message.getProperty(runtime, "topic");
+        if (!topic.isString()) {
+            throw jsi::JSError(runtime, "publishManyMqtt: topic must be a string");
+        }
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+        payloadArgument(runtime, message.getProperty(runtime, "payload"), "publishManyMqtt", utf8, data, size);
+        jsi::Value qos = message.getProperty(runtime, "qos");
+        jsi::Value retain = message.getProperty(runtime, "retain");
+        client->publish(topic.getString(runtime).utf8(runtime), data, size,
+                        qos.isNumber() ? static_cast<int>(qos.getNumber()) : 0, retain.isBool() && retain.getBool());
+    }
+    return jsi::Value::undefined();
+}
+
+/*
+ * Snapshot of the client's counters and latency histograms, with the JS delivery latencies of the dispatcher under
+ * dispatcher, or undefined for an unknown clientId. Per-topic rates cover the time since the previous call.
+ */
+jsi::Value getMetrics(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments, size_t count) {
+    auto client = findClient(runtime, arguments, count, 0);
+    if (!client) {
+        return jsi::Value::undefined();
+    }
+    EventValue::Map metrics = client->metrics().snapshot().getMap();
+    if (auto dispatcher = EventDispatcher::current()) {
+        metrics.emplace_back("dispatcher", dispatcher->metricsSnapshot());
+    }
+    return convertEventValueToJSIValue(runtime, EventValue(std::move(metrics)));
+}
+
+void addHostFunction(jsi::Runtime &runtime, jsi::Object &module, const char *name, unsigned int argc,
+                     jsi::HostFunctionType function) {
+    module.setProperty(runtime, name,
+                       jsi::Function::createFromHostFunction(runtime, jsi::PropNameID::forAscii(runtime, name), argc,
+                                                             std::move(function)));
+}
+
+
+/*
+ * Runs the messages of a subscription eventId through a handler on the background runtime, see BackgroundRuntime:
+ * (eventId, handler source, payload format). Returns false when the platform has no background runtime.
+ */
+jsi::Value setBackgroundHandler(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                                size_t count) {
+    auto background = BackgroundRuntime::current();
+    if (!background) {
+        return jsi::Value(false);
+    }
+    std::string format = stringArgument(runtime, arguments, count, 2);
+    background->addHandler(stringArgument(runtime, arguments, count, 0), stringArgument(runtime, arguments, count, 1),
+                           format == "json"          ? PayloadFormat::Json
+                           : format == "arraybuffer" ? PayloadFormat::ArrayBuffer
+                                                     : PayloadFormat::String);
+    return jsi::Value(true);
+}
+
+jsi::Value removeBackgroundHandler(jsi::Runtime &runtime, const jsi::Value &thisValue, const jsi::Value *arguments,
+                                   size_t count) {
+    if (auto background = BackgroundRuntime::current()) {
+        background->removeHandler(stringArgument(runtime, arguments, count, 0));
+    }
+    return jsi::Value::undefined();
+}
+
+/**
+ * The host functions that drive clients, installed in the UI and in the background runtime alike.
+ */
+void addClientHostFunctions(jsi::Runtime &runtime, jsi::Object &module) {
+    addHostFunction(runtime, module, "createNativeMqtt", 7, createNativeMqtt);
+    addHostFunction(runtime, module, "removeMqtt", 1, removeMqtt);
+    addHostFunction(runtime, module, "connectMqtt", 2, connectMqtt);
+    addHostFunction(runtime, module, "setReconnectPolicy", 2, setReconnectPolicy);
+    addHostFunction(runtime, module, "setFlowControl", 2, setFlowControl);
+    addHostFunction(runtime, module, "getDeliveryState", 1, getDeliveryState);
+    addHostFunction(runtime, module, "setLastValueCache", 2, setLastValueCache);
+    addHostFunction(runtime, module, "getLastValue", 3, getLastValue);
+    addHostFunction(runtime, module, "addCompressionDictionary", 2, addCompressionDictionary);
+    addHostFunction(runtime, module, "disconnectMqtt", 1, disconnectMqtt);
+    addHostFunction(runtime, module, "subscribeMqtt", 6, subscribeMqtt);
+    addHostFunction(runtime, module, "getFilterStats", 2, getFilterStats);
+    addHostFunction(runtime, module, "unsubscribeMqtt", 3, unsubscribeMqtt);
+    addHostFunction(runtime, module, "getConnectionStatusMqtt", 1, getConnectionStatusMqtt);
+    addHostFunction(runtime, module, "getConnectionStateMqtt", 1, getConnectionStateMqtt);
+    addHostFunction(runtime, module, "publishMqtt", 5, publishMqtt);
+    addHostFunction(runtime, module, "publishManyMqtt", 2, publishManyMqtt);
+    addHostFunction(runtime, module, "getMetrics", 1, getMetrics);
+}
+
+void installBackgroundModule(jsi::Runtime &runtime) {
+    jsi::Object module(runtime);
+    addClientHostFunctions(runtime, module);
+    runtime.global().setProperty(runtime, "__MqttModuleProxy", std::move(module));
+}
+
+}
+
+std::shared_ptr<EventSink> dispatcherEventSink() {
+    static std::shared_ptr<EventSink> sink = std::make_shared<DispatcherEventSink>();
+    return sink;
+}
+
+void installJSIModule(jsi::Runtime &runtime, EventDispatcher::JSInvoker jsInvoker, std::string storageDirectory,
+                      BackgroundRuntime::RuntimeFactory createBackgroundRuntime) {
+    {
+        std::lock_guard<std::mutex> lock(storage_directory_mutex);
+        storage_directory = std::move(storageDirectory);
+    }
+    jsi::Object module(runtime);
+
+    auto dispatcher = std::make_shared<EventDispatcher>(runtime, std::move(jsInvoker));
+    dispatcher->install(module);
+    EventDispatcher::setCurrent(dispatcher);
+
+    BackgroundRuntime::setCurrent(
+        createBackgroundRuntime ? std::make_shared<BackgroundRuntime>(std::move(createBackgroundRuntime),
+                                                                      installBackgroundModule, dispatcherEventSink())
+                                : nullptr);
+    addHostFunction(runtime, module, "setBackgroundHandler", 3, setBackgroundHandler);
+    addHostFunction(runtime, module, "removeBackgroundHandler", 1, removeBackgroundHandler);
+    addClientHostFunctions(runtime, module);
+
+    runtime.global().setProperty(runtime, "__MqttModuleProxy", std::move(module));
+}
+
+void releaseJSIModule() {
+    if (auto dispatcher = EventDispatcher::current()) {
+        dispatcher->releaseListeners();
+    }
+}
+
+size_t warmStartClients(std::string storageDirectory, const WarmStart::CredentialsProvider &credentials) {
+    MQTT_TRACE_SECTION("mqtt::warmStartClients");
+    {
+        std::lock_guard<std::mutex> lock(storage_directory_mutex);
+        storage_directory = std::move(storageDirectory);
+    }
+    std::string error;
+    std::string directory = engineDirectory(error);
+    if (directory.empty()) {
+        return 0;
+    }
+    return WarmStart::shared().start(
+        WarmStartStore(directory),
+        [](const WarmStartSession &session) {
+            std::string error;
+            auto client = createNativeClient(
+                ClientRegistry::shared(), session.clientId,
+                socketClientOptions(session.clientId, session.host, session.port, session.storeCapacity),
+                dispatcherEventSink(), error);
+            if (client && !error.empty()) {
+                ClientRegistry::shared().remove(session.clientId);
+                return std::shared_ptr<Client>();
+            }
+            return client;
+        },
+        credentials);
+}
+
+}
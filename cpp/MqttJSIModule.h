@@ -0,0 +1,54 @@
+//
+//  MqttJSIModule.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jsi/jsi.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "MqttBackgroundRuntime.h"
+#include "MqttEventDispatcher.h"
+#include "MqttEventSink.h"
+#include "MqttWarmStart.h"
+
+namespace mqtt {
+
+namespace jsi = facebook::jsi;
+
+/**
+ * Installs global.__MqttModuleProxy: the host functions used by MqttClient (connectMqtt, subscribeMqtt, ...)
+ * bound to the shared ClientRegistry, plus the event listener functions of a new EventDispatcher. Shared by
+ * cpp-adapter.cpp and MqttModule.mm, which only provide the JS invoker, their platform transports and the app's
+ * private storageDirectory, where the native engine keeps its outbound stores, and, where the app runs Hermes, the
+ * factory of the BackgroundRuntime that runs background subscription handlers.
+ */
+void installJSIModule(jsi::Runtime &runtime, EventDispatcher::JSInvoker jsInvoker, std::string storageDirectory = {},
+                      BackgroundRuntime::RuntimeFactory createBackgroundRuntime = nullptr);
+
+/**
+ * Called by the platform modules when the React instance is torn down, before its runtime is destroyed: stops event
+ * delivery and releases the JS listeners on the JS thread, see EventDispatcher::releaseListeners().
+ */
+void releaseJSIModule();
+
+/**
+ * Sink that forwards core events to the dispatcher of the currently installed runtime. Passed to
+ * ClientRegistry::create by the platform createMqtt implementations.
+ */
+std::shared_ptr<EventSink> dispatcherEventSink();
+
+/**
+ * Warm start: connects the native engine clients JS created with warmStart at the last launch, from their recorded
+ * sessions in storageDirectory, so they are connected and subscribed by the time the JS bundle has loaded. Called by
+ * the app at launch (MqttWarmStart.start on Android, [MqttModule warmStart] on iOS), before installJSIModule.
+ * Sessions do not record credentials: clients that connected with a username or password are only started when
+ * credentials supplies them. Returns the number of clients started.
+ */
+size_t warmStartClients(std::string storageDirectory, const WarmStart::CredentialsProvider &credentials = nullptr);
+
+}
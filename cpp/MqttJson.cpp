@@ -0,0 +1,429 @@
+//
+//  MqttJson.cpp
+//  d11-mqtt
+//
+
+#include "MqttJson.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace mqtt {
+
+namespace {
+
+constexpr int MAX_DEPTH = 256;
+constexpr uint64_t ONES = 0x0101010101010101ULL;
+constexpr uint64_t HIGH_BITS = 0x8080808080808080ULL;
+
+/**
+ * Bit 7 of each byte of the result is set where word has a byte below n (n <= 128). Only the lowest flagged byte is
+ * exact; bytes above it can be false positives, which is all a forward scan needs.
+ */
+inline uint64_t bytesBelow(uint64_t word, uint8_t n) {
+    return (word - ONES * n) & ~word & HIGH_BITS;
+}
+
+inline uint64_t bytesEqual(uint64_t word, uint8_t c) {
+    return bytesBelow(word ^ (ONES * c), 1);
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void appendUtf8(std::string &out, uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        out.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+}
+
+/**
+ * Single pass recursive descent parser writing straight into the JsonDocument arrays.
+ */
+class JsonParser {
+public:
+    explicit JsonParser(JsonDocument &document)
+    : document_(document), data_(document.text_.data()), size_(document.text_.size()) {}
+
+    bool parse() {
+        // Most payloads need well under one node per 4 bytes.
+        document_.nodes_.reserve(size_ / 4 + 1);
+        skipWhitespace();
+        if (!value(0)) {
+            return false;
+        }
+        skipWhitespace();
+        return position_ == size_;
+    }
+
+private:
+    using Node = JsonDocument::Node;
+
+    bool value(int depth) {
+        if (position_ >= size_) {
+            return false;
+        }
+        switch (data_[position_]) {
+            case '{':
+                return container(depth, JsonType::Object);
+            case '[':
+                return container(depth, JsonType::Array);
+            case '"':
+                return string();
+            case 't':
+                return literal("true", JsonType::True);
+            case 'f':
+                return literal("false", JsonType::False);
+            case 'n':
+                return literal("null", JsonType::Null);
+            default:
+                return number();
+        }
+    }
+
+    bool container(int depth, JsonType type) {
+        if (depth >= MAX_DEPTH || document_.nodes_.size() >= std::numeric_limits<JsonDocument::Index>::max()) {
+            return false;
+        }
+        const char close = type == JsonType::Object ? '}' : ']';
+        size_t index = document_.nodes_.size();
+        document_.nodes_.push_back(Node{type, false, 0, {0}});
+        position_++;
+        skipWhitespace();
+        uint32_t count = 0;
+        if (position_ < size_ && data_[position_] == close) {
+            position_++;
+        } else {
+            for (;;) {
+                if (type == JsonType::Object) {
+                    if (position_ >= size_ || data_[position_] != '"' || !string()) {
+                        return false;
+                    }
+                    skipWhitespace();
+                    if (position_ >= size_ || data_[position_] != ':') {
+                        return false;
+                    }
+                    position_++;
+                    skipWhitespace();
+                }
+                if (!value(depth + 1)) {
+                    return false;
+                }
+                count++;
+                skipWhitespace();
+                if (position_ >= size_) {
+                    return false;
+                }
+                char c = data_[position_++];
+                if (c == close) {
+                    break;
+                }
+                if (c != ',') {
+                    return false;
+                }
+                skipWhitespace();
+            }
+        }
+        Node &node = document_.nodes_[index];
+        node.length = count;
+        node.end = document_.nodes_.size();
+        return true;
+    }
+
+    bool string() {
+        size_t start = ++position_;
+        size_t end = scanString(start);
+        if (end >= size_) {
+            return false;
+        }
+        if (data_[end] == '"') {
+            document_.nodes_.push_back(Node{JsonType::String, false, static_cast<uint32_t>(end - start), {0}});
+            document_.nodes_.back().offset = start;
+            position_ = end + 1;
+            return true;
+        }
+        if (data_[end] != '\\') {
+            // Unescaped control character.
+            return false;
+        }
+        return escapedString(start, end);
+    }
+
+    /**
+     * Index of the first '"', '\\' or control character at or after start, or size_. Scans 8 bytes at a time.
+     */
+    size_t scanString(size_t start) const {
+        size_t i = start;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; i + 8 <= size_; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data_ + i, sizeof(word));
+            uint64_t mask = bytesEqual(word, '"') | bytesEqual(word, '\\') | bytesBelow(word, 0x20);
+            if (mask != 0) {
+                return i + static_cast<size_t>(__builtin_ctzll(mask) / 8);
+            }
+        }
+#endif
+        for (; i < size_; i++) {
+            unsigned char c = static_cast<unsigned char>(data_[i]);
+            if (c == '"' || c == '\\' || c < 0x20) {
+                return i;
+            }
+        }
+        return size_;
+    }
+
+    bool escapedString(size_t start, size_t escape) {
+        std::string &out = document_.decoded_;
+        size_t offset = out.size();
+        out.append(data_ + start, escape - start);
+        size_t i = escape;
+        for (;;) {
+            if (i >= size_) {
+                return false;
+            }
+            char c = data_[i];
+            if (c == '"') {
+                break;
+            }
+            if (c != '\\') {
+                size_t run = scanString(i);
+                if (run >= size_ || (data_[run] != '"' && data_[run] != '\\')) {
+                    return false;
+                }
+                out.append(data_ + i, run - i);
+                i = run;
+                continue;
+            }
+            if (++i >= size_) {
+                return false;
+            }
+            switch (data_[i++]) {
+                case '"':
+                    out.push_back('"');
+                    break;
+                case '\\':
+                    out.push_back('\\');
+                    break;
+                case '/':
+                    out.push_back('/');
+                    break;
+                case 'b':
+                    out.push_back('\b');
+                    break;
+                case 'f':
+                    out.push_back('\f');
+                    break;
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'u': {
+                    int32_t codePoint = unicodeEscape(i);
+                    if (codePoint < 0) {
+                        return false;
+                    }
+                    i += 4;
+                    if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 6 <= size_ && data_[i] == '\\' &&
+                        data_[i + 1] == 'u') {
+                        int32_t low = unicodeEscape(i + 2);
+                        if (low >= 0xDC00 && low <= 0xDFFF) {
+                            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                    }
+                    if (codePoint >= 0xD800 && codePoint <= 0xDFFF) {
+                        // A lone surrogate has no UTF-8 encoding.
+                        codePoint = 0xFFFD;
+                    }
+                    appendUtf8(out, static_cast<uint32_t>(codePoint));
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        document_.nodes_.push_back(Node{JsonType::String, true, static_cast<uint32_t>(out.size() - offset), {0}});
+        document_.nodes_.back().offset = offset;
+        position_ = i + 1;
+        return true;
+    }
+
+    int32_t unicodeEscape(size_t at) const {
+        if (at + 4 > size_) {
+            return -1;
+        }
+        int32_t codePoint = 0;
+        for (size_t k = 0; k < 4; k++) {
+            int digit = hexValue(data_[at + k]);
+            if (digit < 0) {
+                return -1;
+            }
+            codePoint = (codePoint << 4) | digit;
+        }
+        return codePoint;
+    }
+
+    bool number() {
+        size_t start = position_;
+        size_t i = position_;
+        bool negative = i < size_ && data_[i] == '-';
+        if (negative) {
+            i++;
+        }
+        if (i >= size_ || !isDigit(data_[i])) {
+            return false;
+        }
+        uint64_t integer = 0;
+        size_t digits = 0;
+        if (data_[i] == '0') {
+            i++;
+            digits = 1;
+        } else {
+            for (; i < size_ && isDigit(data_[i]); i++, digits++) {
+                integer = integer * 10 + static_cast<uint64_t>(data_[i] - '0');
+            }
+        }
+        bool integral = true;
+        if (i < size_ && data_[i] == '.') {
+            integral = false;
+            if (++i >= size_ || !isDigit(data_[i])) {
+                return false;
+            }
+            while (i < size_ && isDigit(data_[i])) {
+                i++;
+            }
+        }
+        if (i < size_ && (data_[i] == 'e' || data_[i] == 'E')) {
+            integral = false;
+            if (++i < size_ && (data_[i] == '+' || data_[i] == '-')) {
+                i++;
+            }
+            if (i >= size_ || !isDigit(data_[i])) {
+                return false;
+            }
+            while (i < size_ && isDigit(data_[i])) {
+                i++;
+            }
+        }
+
+        double value;
+        // Up to 15 digits an integer converts to double exactly.
+        if (integral && digits <= 15) {
+            value = negative ? -static_cast<double>(integer) : static_cast<double>(integer);
+        } else {
+            char buffer[64];
+            size_t length = i - start;
+            if (length >= sizeof(buffer)) {
+                std::string token(data_ + start, length);
+                value = std::strtod(token.c_str(), nullptr);
+            } else {
+                std::memcpy(buffer, data_ + start, length);
+                buffer[length] = '\0';
+                value = std::strtod(buffer, nullptr);
+            }
+        }
+        document_.nodes_.push_back(Node{JsonType::Number, false, 0, {value}});
+        position_ = i;
+        return true;
+    }
+
+    bool literal(const char *text, JsonType type) {
+        size_t length = std::strlen(text);
+        if (size_ - position_ < length || std::memcmp(data_ + position_, text, length) != 0) {
+            return false;
+        }
+        position_ += length;
+        document_.nodes_.push_back(Node{type, false, 0, {0}});
+        return true;
+    }
+
+    void skipWhitespace() {
+        while (position_ < size_) {
+            char c = data_[position_];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                return;
+            }
+            position_++;
+        }
+    }
+
+    JsonDocument &document_;
+    const char *data_;
+    const size_t size_;
+    size_t position_ = 0;
+};
+
+std::string_view JsonDocument::string(Index index) const {
+    const Node &node = nodes_[index];
+    const std::string &storage = node.decoded ? decoded_ : text_;
+    return std::string_view(storage.data() + node.offset, node.length);
+}
+
+JsonDocument::Index JsonDocument::next(Index index) const {
+    const Node &node = nodes_[index];
+    if (node.type == JsonType::Object || node.type == JsonType::Array) {
+        return static_cast<Index>(node.end);
+    }
+    return index + 1;
+}
+
+JsonDocument::Index JsonDocument::find(Index object, std::string_view key) const {
+    if (type(object) != JsonType::Object) {
+        return 0;
+    }
+    Index child = object + 1;
+    for (uint32_t i = 0; i < size(object); i++) {
+        if (string(child) == key) {
+            return child + 1;
+        }
+        child = next(child + 1);
+    }
+    return 0;
+}
+
+std::shared_ptr<const JsonDocument> parseJson(std::string &text) {
+    auto document = std::make_shared<JsonDocument>();
+    document->text_ = std::move(text);
+    if (!JsonParser(*document).parse()) {
+        text = std::move(document->text_);
+        return nullptr;
+    }
+    return document;
+}
+
+}
@@ -0,0 +1,100 @@
+//
+//  MqttJson.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mqtt {
+
+enum class JsonType : uint8_t { Null, False, True, Number, String, Array, Object };
+
+/**
+ * A parsed JSON payload. Values are stored in one flat array in document order: a container is followed by its
+ * children (an object by key/value pairs) and records where its last descendant ends, so skipping a value is O(1)
+ * and nothing is allocated per value. Strings without escapes point into the original payload, which the document
+ * owns; escaped strings are decoded once into a side buffer.
+ *
+ * Built on the network thread by parseJson() and read on the JS thread by JsonHostObject; immutable after parsing.
+ */
+class JsonDocument {
+public:
+    using Index = uint32_t;
+
+    static constexpr Index ROOT = 0;
+
+    JsonType type(Index index) const { return nodes_[index].type; }
+    double number(Index index) const { return nodes_[index].number; }
+    std::string_view string(Index index) const;
+
+    /**
+     * Number of elements of an array or members of an object.
+     */
+    uint32_t size(Index index) const { return nodes_[index].length; }
+
+    /**
+     * Index just past the value at index and all of its descendants, i.e. of its next sibling.
+     */
+    Index next(Index index) const;
+
+    /**
+     * Index of the value of the member key of the object at index, or 0 when there is no such member (0 is the root,
+     * which is never a member value).
+     */
+    Index find(Index object, std::string_view key) const;
+
+    /**
+     * Visits the members of an object as visit(keyIndex, valueIndex), or the elements of an array as
+     * visit(valueIndex, valueIndex).
+     */
+    template <typename Visitor>
+    void forEachChild(Index container, Visitor &&visit) const {
+        bool object = type(container) == JsonType::Object;
+        Index child = container + 1;
+        for (uint32_t i = 0; i < size(container); i++) {
+            Index value = object ? child + 1 : child;
+            visit(child, value);
+            child = next(value);
+        }
+    }
+
+    size_t nodeCount() const { return nodes_.size(); }
+
+private:
+    friend class JsonParser;
+    friend std::shared_ptr<const JsonDocument> parseJson(std::string &text);
+
+    struct Node {
+        JsonType type;
+        // Strings: the characters are in decoded_ rather than text_.
+        bool decoded;
+        // Strings: byte length. Containers: element or member count.
+        uint32_t length;
+        union {
+            double number;
+            // Strings: offset into text_ or decoded_.
+            uint64_t offset;
+            // Containers: index past the last descendant.
+            uint64_t end;
+        };
+    };
+
+    std::string text_;
+    std::string decoded_;
+    std::vector<Node> nodes_;
+};
+
+/**
+ * Parses text as JSON (RFC 8259). On success the document takes over text; on failure text is left as it was and
+ * nullptr is returned. Nesting deeper than 256 levels is rejected.
+ */
+std::shared_ptr<const JsonDocument> parseJson(std::string &text);
+
+}
@@ -0,0 +1,60 @@
+//
+//  MqttJsonHostObject.cpp
+//  d11-mqtt
+//
+
+#include "MqttJsonHostObject.h"
+
+#include <string>
+
+namespace mqtt {
+
+jsi::Value JsonHostObject::get(jsi::Runtime &runtime, const jsi::PropNameID &name) {
+    JsonDocument::Index value = document_->find(object_, name.utf8(runtime));
+    if (value == 0) {
+        return jsi::Value::undefined();
+    }
+    return convertJsonToJSIValue(runtime, document_, value);
+}
+
+std::vector<jsi::PropNameID> JsonHostObject::getPropertyNames(jsi::Runtime &runtime) {
+    std::vector<jsi::PropNameID> names;
+    names.reserve(document_->size(object_));
+    document_->forEachChild(object_, [&](JsonDocument::Index key, JsonDocument::Index) {
+        std::string_view text = document_->string(key);
+        names.push_back(
+            jsi::PropNameID::forUtf8(runtime, reinterpret_cast<const uint8_t *>(text.data()), text.size()));
+    });
+    return names;
+}
+
+jsi::Value convertJsonToJSIValue(jsi::Runtime &runtime, const std::shared_ptr<const JsonDocument> &document,
+                                 JsonDocument::Index index) {
+    switch (document->type(index)) {
+        case JsonType::Null:
+            return jsi::Value::null();
+        case JsonType::False:
+            return jsi::Value(false);
+        case JsonType::True:
+            return jsi::Value(true);
+        case JsonType::Number:
+            return jsi::Value(document->number(index));
+        case JsonType::String: {
+            std::string_view text = document->string(index);
+            return jsi::String::createFromUtf8(runtime, reinterpret_cast<const uint8_t *>(text.data()), text.size());
+        }
+        case JsonType::Array: {
+            jsi::Array array(runtime, document->size(index));
+            size_t i = 0;
+            document->forEachChild(index, [&](JsonDocument::Index, JsonDocument::Index value) {
+                array.setValueAtIndex(runtime, i++, convertJsonToJSIValue(runtime, document, value));
+            });
+            return array;
+        }
+        case JsonType::Object:
+            return jsi::Object::createFromHostObject(runtime, std::make_shared<JsonHostObject>(document, index));
+    }
+    return jsi::Value::undefined();
+}
+
+}
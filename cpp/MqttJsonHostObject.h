@@ -0,0 +1,43 @@
+//
+//  MqttJsonHostObject.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <jsi/jsi.h>
+
+#include <memory>
+#include <vector>
+
+#include "MqttJson.h"
+
+namespace mqtt {
+
+namespace jsi = facebook::jsi;
+
+/**
+ * JSON object of a payload parsed off the JS thread. Members are converted to jsi values only when read: scalars and
+ * strings on every access, nested objects as further JsonHostObjects and arrays as plain JS arrays of the same.
+ * Enumeration (Object.keys, spread, JSON.stringify) goes through getPropertyNames. Read-only.
+ */
+class JsonHostObject : public jsi::HostObject {
+public:
+    JsonHostObject(std::shared_ptr<const JsonDocument> document, JsonDocument::Index object)
+    : document_(std::move(document)), object_(object) {}
+
+    jsi::Value get(jsi::Runtime &runtime, const jsi::PropNameID &name) override;
+    std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &runtime) override;
+
+private:
+    const std::shared_ptr<const JsonDocument> document_;
+    const JsonDocument::Index object_;
+};
+
+/**
+ * Converts the value at index of a parsed payload, objects becoming JsonHostObjects.
+ */
+jsi::Value convertJsonToJSIValue(jsi::Runtime &runtime, const std::shared_ptr<const JsonDocument> &document,
+                                 JsonDocument::Index index);
+
+}
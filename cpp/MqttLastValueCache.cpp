@@ -0,0 +1,377 @@
+//
+//  MqttLastValueCache.cpp
+//  d11-mqtt
+//
+
+#include "MqttLastValueCache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <zlib.h>
+
+#include "MqttTopic.h"
+
+namespace mqtt {
+
+namespace {
+
+constexpr uint32_t FILE_MAGIC = 0x564C514D; // "MQLV"
+constexpr uint32_t FILE_VERSION = 1;
+constexpr size_t FILE_HEADER_SIZE = 16;
+constexpr size_t RECORD_ALIGNMENT = 8;
+
+enum RecordType : uint8_t {
+    RECORD_VALUE = 1,
+    RECORD_REMOVED = 2,
+};
+
+/**
+ * Header of every log record, followed by bodyLength bytes (topic, then the payload of a value record) and padding
+ * to RECORD_ALIGNMENT. checksum covers the rest of the header and the body, so a torn write never passes as a record.
+ */
+struct RecordHeader {
+    uint32_t checksum;
+    uint32_t bodyLength;
+    int64_t receivedAt;
+    uint16_t topicLength;
+    uint8_t type;
+    uint8_t qos;
+    uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader is part of the file format");
+
+constexpr size_t aligned(size_t size) {
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+constexpr size_t recordSize(size_t bodyLength) {
+    return aligned(sizeof(RecordHeader) + bodyLength);
+}
+
+constexpr size_t liveSize(size_t bodyLength, size_t topicLength) {
+    return recordSize(bodyLength) + recordSize(topicLength);
+}
+
+uint32_t checksumOf(const RecordHeader &header, const uint8_t *body) {
+    const auto *bytes = reinterpret_cast<const Bytef *>(&header);
+    uLong crc = crc32(crc32(0L, Z_NULL, 0), bytes + sizeof(header.checksum),
+                      static_cast<uInt>(sizeof(RecordHeader) - sizeof(header.checksum)));
+    return static_cast<uint32_t>(crc32(crc, reinterpret_cast<const Bytef *>(body), header.bodyLength));
+}
+
+std::string errnoMessage(const char *operation, const std::string &path) {
+    return std::string(operation) + " " + path + ": " + std::strerror(errno);
+}
+
+}
+
+LastValueCache::LastValueCache(std::string path, size_t capacity, std::chrono::milliseconds ttl)
+    : path_(std::move(path)), capacity_(capacity), ttl_(ttl) {}
+
+LastValueCache::~LastValueCache() {
+    unmap();
+}
+
+int64_t LastValueCache::nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+std::unique_ptr<LastValueCache> LastValueCache::open(const std::string &path, size_t capacity,
+                                                     std::chrono::milliseconds ttl, std::string &error) {
+    capacity = aligned(std::max(capacity, FILE_HEADER_SIZE + liveSize(0, 0)));
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        error = errnoMessage("Failed to open", path);
+        return nullptr;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) < 0) {
+        error = errnoMessage("Failed to stat", path);
+        ::close(fd);
+        return nullptr;
+    }
+    // A file written with another capacity is mapped whole and rewritten at this one by the compaction below.
+    size_t size = std::max(static_cast<size_t>(info.st_size), capacity);
+    if (static_cast<size_t>(info.st_size) < size && ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        error = errnoMessage("Failed to resize", path);
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<LastValueCache> cache(new LastValueCache(path, capacity, ttl));
+    std::lock_guard<std::mutex> lock(cache->mutex_);
+    if (!cache->map(fd, size, error)) {
+        return nullptr;
+    }
+    cache->recover(nowMillis());
+    if (cache->mappedSize_ != capacity) {
+        // Written with a larger capacity: what no longer fits goes, least recently used first.
+        while (!cache->lru_.empty() && FILE_HEADER_SIZE + cache->liveBytes_ > capacity) {
+            cache->removeLocked(cache->entries_.find(cache->lru_.front()));
+        }
+        cache->compact();
+    }
+    return cache;
+}
+
+bool LastValueCache::map(int fd, size_t size, std::string &error) {
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        error = errnoMessage("Failed to map", path_);
+        ::close(fd);
+        return false;
+    }
+    unmap();
+    fd_ = fd;
+    data_ = static_cast<uint8_t *>(data);
+    mappedSize_ = size;
+    return true;
+}
+
+void LastValueCache::unmap() {
+    if (data_ != nullptr) {
+        munmap(data_, mappedSize_);
+        data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void LastValueCache::recover(int64_t now) {
+    uint32_t magic;
+    uint32_t version;
+    std::memcpy(&magic, data_, sizeof(magic));
+    std::memcpy(&version, data_ + sizeof(magic), sizeof(version));
+    if (magic != FILE_MAGIC || version != FILE_VERSION) {
+        // New file, or one this version cannot read: start over.
+        std::memset(data_, 0, mappedSize_);
+        std::memcpy(data_, &FILE_MAGIC, sizeof(FILE_MAGIC));
+        std::memcpy(data_ + sizeof(FILE_MAGIC), &FILE_VERSION, sizeof(FILE_VERSION));
+        end_ = FILE_HEADER_SIZE;
+        return;
+    }
+
+    size_t offset = FILE_HEADER_SIZE;
+    while (offset + sizeof(RecordHeader) <= mappedSize_) {
+        RecordHeader header;
+        std::memcpy(&header, data_ + offset, sizeof(header));
+        if (header.type < RECORD_VALUE || header.type > RECORD_REMOVED ||
+            recordSize(header.bodyLength) > mappedSize_ - offset || header.topicLength > header.bodyLength ||
+            checksumOf(header, data_ + offset + sizeof(RecordHeader)) != header.checksum) {
+            // Zeroed space after the last record, or the record a crash interrupted.
+            break;
+        }
+        std::string topic(reinterpret_cast<const char *>(data_ + offset + sizeof(RecordHeader)), header.topicLength);
+        auto it = entries_.find(topic);
+        if (it != entries_.end()) {
+            removeLocked(it);
+        }
+        if (header.type == RECORD_VALUE) {
+            Location location{offset, header.bodyLength, header.topicLength, header.qos, header.receivedAt, {}};
+            if (!expired(location, now)) {
+                // Replayed in log order, so the value written last ends up most recently used.
+                location.recency = lru_.insert(lru_.end(), topic);
+                liveBytes_ += liveSize(header.bodyLength, header.topicLength);
+                entries_.emplace(std::move(topic), location);
+            }
+        }
+        offset += recordSize(header.bodyLength);
+    }
+    end_ = offset;
+}
+
+bool LastValueCache::expired(const Location &location, int64_t now) const {
+    return ttl_.count() > 0 && now - location.receivedAt > ttl_.count();
+}
+
+void LastValueCache::touch(Location &location) {
+    lru_.splice(lru_.end(), lru_, location.recency);
+}
+
+void LastValueCache::removeLocked(EntryMap::iterator it) {
+    liveBytes_ -= liveSize(it->second.bodyLength, it->second.topicLength);
+    lru_.erase(it->second.recency);
+    entries_.erase(it);
+}
+
+void LastValueCache::put(std::string_view topic, std::string_view payload, int qos, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (data_ == nullptr) {
+        return;
+    }
+    std::string key(topic);
+    auto it = entries_.find(key);
+    bool replaced = it != entries_.end();
+    if (replaced) {
+        // Superseded by the record below, or removed for good if that does not fit.
+        removeLocked(it);
+    }
+    size_t bodyLength = topic.size() + payload.size();
+    size_t needed = liveSize(bodyLength, topic.size());
+    if (topic.size() > UINT16_MAX || bodyLength > UINT32_MAX || FILE_HEADER_SIZE + needed > capacity_) {
+        if (replaced) {
+            writeRecord(RECORD_REMOVED, topic, std::string_view(), 0, now);
+        }
+        return;
+    }
+    while (!lru_.empty() && FILE_HEADER_SIZE + liveBytes_ + needed > capacity_) {
+        auto evicted = entries_.find(lru_.front());
+        std::string evictedTopic = evicted->first;
+        removeLocked(evicted);
+        writeRecord(RECORD_REMOVED, evictedTopic, std::string_view(), 0, now);
+    }
+    auto qosByte = static_cast<uint8_t>(qos);
+    size_t offset = writeRecord(RECORD_VALUE, topic, payload, qosByte, now);
+    if (offset == 0) {
+        return;
+    }
+    Location location{offset, static_cast<uint32_t>(bodyLength), static_cast<uint16_t>(topic.size()), qosByte, now,
+                      lru_.insert(lru_.end(), key)};
+    liveBytes_ += needed;
+    entries_.emplace(std::move(key), location);
+}
+
+bool LastValueCache::get(const std::string &topic, Value &value, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(topic);
+    if (it == entries_.end()) {
+        return false;
+    }
+    if (expired(it->second, now)) {
+        // Skipped by recover() and compact() too, so no record is needed.
+        removeLocked(it);
+        return false;
+    }
+    touch(it->second);
+    value = valueAt(it->second);
+    return true;
+}
+
+void LastValueCache::collectMatches(std::string_view filter, std::vector<Value> &values, int64_t now) {
+    std::string_view effective = effectiveTopicFilter(filter);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        auto current = it++;
+        if (!topicMatchesFilter(current->first, effective)) {
+            continue;
+        }
+        if (expired(current->second, now)) {
+            removeLocked(current);
+            continue;
+        }
+        touch(current->second);
+        values.push_back(valueAt(current->second));
+    }
+}
+
+size_t LastValueCache::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t LastValueCache::liveBytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return liveBytes_;
+}
+
+size_t LastValueCache::writeRecord(uint8_t type, std::string_view topic, std::string_view payload, uint8_t qos,
+                                   int64_t receivedAt) {
+    size_t bodyLength = topic.size() + payload.size();
+    size_t size = recordSize(bodyLength);
+    if (end_ + size > mappedSize_ && (!compact() || end_ + size > mappedSize_)) {
+        return 0;
+    }
+
+    RecordHeader header{};
+    header.bodyLength = static_cast<uint32_t>(bodyLength);
+    header.receivedAt = receivedAt;
+    header.topicLength = static_cast<uint16_t>(topic.size());
+    header.type = type;
+    header.qos = qos;
+
+    // Body first and header last: until the checksum is in place the record does not exist for recover().
+    uint8_t *record = data_ + end_;
+    uint8_t *body = record + sizeof(RecordHeader);
+    if (!topic.empty()) {
+        std::memcpy(body, topic.data(), topic.size());
+    }
+    if (!payload.empty()) {
+        std::memcpy(body + topic.size(), payload.data(), payload.size());
+    }
+    header.checksum = checksumOf(header, body);
+    std::memcpy(record, &header, sizeof(header));
+    size_t offset = end_;
+    end_ += size;
+    return offset;
+}
+
+bool LastValueCache::compact() {
+    std::string compactPath = path_ + ".compact";
+    int fd = ::open(compactPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(capacity_)) < 0) {
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+    void *mapped = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+
+    // Live values in recency order, so a later recover() rebuilds the same LRU order.
+    auto *target = static_cast<uint8_t *>(mapped);
+    std::memcpy(target, data_, FILE_HEADER_SIZE);
+    size_t offset = FILE_HEADER_SIZE;
+    int64_t now = nowMillis();
+    for (auto topic = lru_.begin(); topic != lru_.end();) {
+        auto it = entries_.find(*topic++);
+        if (expired(it->second, now)) {
+            removeLocked(it);
+            continue;
+        }
+        size_t size = recordSize(it->second.bodyLength);
+        std::memcpy(target + offset, data_ + it->second.offset, size);
+        it->second.offset = offset;
+        offset += size;
+    }
+
+    if (rename(compactPath.c_str(), path_.c_str()) < 0) {
+        munmap(mapped, capacity_);
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+    unmap();
+    fd_ = fd;
+    data_ = target;
+    mappedSize_ = capacity_;
+    end_ = offset;
+    return true;
+}
+
+LastValueCache::Value LastValueCache::valueAt(const Location &location) const {
+    const char *body = reinterpret_cast<const char *>(data_ + location.offset + sizeof(RecordHeader));
+    Value value;
+    value.topic.assign(body, location.topicLength);
+    value.payload.assign(body + location.topicLength, location.bodyLength - location.topicLength);
+    value.qos = location.qos;
+    value.receivedAt = location.receivedAt;
+    return value;
+}
+
+}
@@ -0,0 +1,128 @@
+//
+//  MqttLastValueCache.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt {
+
+/**
+ * Last received payload of every topic of one client, kept on disk so a screen can render the latest known value
+ * right away, before SUBACK and the next PUBLISH, and after a process restart.
+ *
+ * Like OutboundStore, an append-only log of checksummed records in a memory-mapped file of fixed size: a newer value
+ * of a topic supersedes the older one, and when the log reaches the end of the file the live values are compacted
+ * into a fresh file that replaces it. Values older than the TTL are not served and dropped by the next compaction.
+ * When the live values would exceed the capacity, the least recently used ones (written or read) are evicted. It is
+ * a cache: the compacted file is not synced before it replaces the old one, so a power loss may empty it, but a
+ * torn record never passes as a value.
+ *
+ * Thread safe: written from the network threads that receive messages and read from the JS thread.
+ */
+class LastValueCache {
+public:
+    struct Value {
+        std::string topic;
+        std::string payload;
+        int qos = 0;
+        // Milliseconds since the Unix epoch when the value was received.
+        int64_t receivedAt = 0;
+    };
+
+    static constexpr size_t DEFAULT_CAPACITY = 1024 * 1024;
+
+    /**
+     * Opens or creates the cache file at path and loads the values in it that are not older than ttl (zero keeps
+     * them forever). Returns nullptr and sets error when the file cannot be created or mapped.
+     */
+    static std::unique_ptr<LastValueCache> open(const std::string &path, size_t capacity, std::chrono::milliseconds ttl,
+                                                std::string &error);
+
+    ~LastValueCache();
+
+    LastValueCache(const LastValueCache &) = delete;
+    LastValueCache &operator=(const LastValueCache &) = delete;
+
+    /**
+     * Records payload as the last value of topic. A value that does not fit into the cache at all removes the
+     * previous one of its topic instead.
+     */
+    void put(std::string_view topic, std::string_view payload, int qos, int64_t now = nowMillis());
+
+    /**
+     * The last value of topic unless there is none or it expired.
+     */
+    bool get(const std::string &topic, Value &value, int64_t now = nowMillis());
+
+    /**
+     * Appends the unexpired values of every topic matching filter, which may contain wildcards, to values.
+     */
+    void collectMatches(std::string_view filter, std::vector<Value> &values, int64_t now = nowMillis());
+
+    size_t size();
+
+    /**
+     * Log bytes the live values take after a compaction.
+     */
+    size_t liveBytes();
+    size_t capacity() const { return capacity_; }
+
+    static int64_t nowMillis();
+
+private:
+    struct Location {
+        size_t offset;
+        uint32_t bodyLength;
+        uint16_t topicLength;
+        uint8_t qos;
+        int64_t receivedAt;
+        // Position in lru_, least recently used first.
+        std::list<std::string>::iterator recency;
+    };
+    using EntryMap = std::unordered_map<std::string, Location>;
+
+    LastValueCache(std::string path, size_t capacity, std::chrono::milliseconds ttl);
+
+    // mutex_ held.
+    bool map(int fd, size_t size, std::string &error);
+    void unmap();
+    void recover(int64_t now);
+    bool expired(const Location &location, int64_t now) const;
+    void touch(Location &location);
+    void removeLocked(EntryMap::iterator it);
+    /**
+     * Appends a record, compacting first when the log is full. Returns its offset, or 0 when there is no room.
+     */
+    size_t writeRecord(uint8_t type, std::string_view topic, std::string_view payload, uint8_t qos,
+                       int64_t receivedAt);
+    bool compact();
+    Value valueAt(const Location &location) const;
+
+    const std::string path_;
+    const size_t capacity_;
+    const std::chrono::milliseconds ttl_;
+
+    std::mutex mutex_;
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    size_t mappedSize_ = 0;
+    size_t end_ = 0;
+    // Log bytes the live values need after a compaction, including room for the record removing each of them.
+    size_t liveBytes_ = 0;
+    EntryMap entries_;
+    std::list<std::string> lru_;
+};
+
+}
@@ -0,0 +1,48 @@
+//
+//  MqttMessage.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+
+class DeliveryTicket;
+class JsonDocument;
+
+/**
+ * MQTT 5 user properties of a received message as (name, value) pairs, kept with it until it is routed.
+ */
+using MessageProperties = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * A received PUBLISH as handed over by the platform client: topic, raw payload bytes and QoS.
+ */
+struct MqttMessage {
+    std::string topic;
+    std::string payload;
+    int qos = 0;
+    // monotonicNanos() when the platform client handed the message over.
+    int64_t receivedAt = 0;
+    // Set instead of payload when the subscription asked for JSON and the payload parsed. A message filter that
+    // parsed the payload hands its document on here, for the EventSink to use or drop as the format says.
+    std::shared_ptr<const JsonDocument> json;
+    // Held while the message waits for JS when the client's DeliveryPipeline is enabled.
+    std::shared_ptr<DeliveryTicket> ticket;
+};
+
+/**
+ * How the payload of a received message reaches JS, chosen per subscription eventId. String decodes the bytes as
+ * UTF-8; ArrayBuffer hands JS the received bytes as they are, without transcoding or copying; Json parses them on
+ * the thread that received the message and hands JS a lazily converted object (the UTF-8 string if they are not
+ * valid JSON).
+ */
+enum class PayloadFormat { String, ArrayBuffer, Json };
+
+}
@@ -0,0 +1,58 @@
+//
+//  MqttMessageBatch.cpp
+//  d11-mqtt
+//
+
+#include "MqttMessageBatch.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace mqtt {
+
+// Room for a few batches so a short JS stall does not spill into the overflow list.
+static constexpr size_t kMinRingCapacity = 256;
+static constexpr size_t kRingBatches = 4;
+
+MessageBatch::MessageBatch(size_t maxBatchSize, std::chrono::milliseconds maxDelay)
+: maxBatchSize_(std::max<size_t>(maxBatchSize, 1)),
+  maxDelay_(maxDelay),
+  ring_(std::max(kMinRingCapacity, maxBatchSize_ * kRingBatches)) {}
+
+MessageBatch::PushResult MessageBatch::push(MqttMessage &&message) {
+    // Counted before it is visible to drain(), so a drain racing with this push reports it as remaining
+    // instead of losing track of it.
+    size_t previous = size_.fetch_add(1, std::memory_order_acq_rel);
+    if (overflowing_.load(std::memory_order_acquire) || !ring_.tryPush(std::move(message))) {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        overflowing_.store(true, std::memory_order_release);
+        overflow_.push_back(std::move(message));
+    }
+    if (previous + 1 == maxBatchSize_) {
+        return PushResult::Full;
+    }
+    return previous == 0 ? PushResult::First : PushResult::Queued;
+}
+
+std::vector<MqttMessage> MessageBatch::drain(bool &hasRemaining) {
+    std::vector<MqttMessage> messages;
+    messages.reserve(std::min(size_.load(std::memory_order_acquire), ring_.capacity()));
+
+    MqttMessage message;
+    while (ring_.tryPop(message)) {
+        messages.push_back(std::move(message));
+    }
+    {
+        std::lock_guard<std::mutex> lock(overflowMutex_);
+        std::move(overflow_.begin(), overflow_.end(), std::back_inserter(messages));
+        overflow_.clear();
+        overflowing_.store(false, std::memory_order_release);
+    }
+
+    size_t remaining = size_.fetch_sub(messages.size(), std::memory_order_acq_rel) - messages.size();
+    hasRemaining = remaining > 0;
+    return messages;
+}
+
+}
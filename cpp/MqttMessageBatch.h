@@ -0,0 +1,61 @@
+//
+//  MqttMessageBatch.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "MqttMessage.h"
+#include "MqttMessageRing.h"
+
+namespace mqtt {
+
+/**
+ * Messages buffered for one batched subscription until the next flush.
+ *
+ * push() is called from network threads and only touches the lock-free ring. If the ring is full (the JS
+ * thread is stalled), messages spill into a mutex guarded overflow list instead of being dropped; once a
+ * spill started, later pushes keep spilling until the next drain so a single producer stays in order.
+ */
+class MessageBatch {
+public:
+    enum class PushResult {
+        // First message since the last drain: the caller arms the delay timer.
+        First,
+        // The batch reached maxBatchSize: the caller flushes right away.
+        Full,
+        Queued,
+    };
+
+    MessageBatch(size_t maxBatchSize, std::chrono::milliseconds maxDelay);
+
+    size_t maxBatchSize() const { return maxBatchSize_; }
+    std::chrono::milliseconds maxDelay() const { return maxDelay_; }
+
+    PushResult push(MqttMessage &&message);
+
+    /**
+     * Takes every buffered message in arrival order. Only called from the JS thread.
+     * @param hasRemaining set when messages arrived while draining and still wait for a later flush.
+     */
+    std::vector<MqttMessage> drain(bool &hasRemaining);
+
+private:
+    const size_t maxBatchSize_;
+    const std::chrono::milliseconds maxDelay_;
+
+    MessageRing<MqttMessage> ring_;
+    std::atomic<size_t> size_{0};
+
+    std::atomic<bool> overflowing_{false};
+    std::mutex overflowMutex_;
+    std::vector<MqttMessage> overflow_;
+};
+
+}
@@ -0,0 +1,333 @@
+//
+//  MqttMessageFilter.cpp
+//  d11-mqtt
+//
+
+#include "MqttMessageFilter.h"
+#include "MqttJson.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+
+namespace mqtt {
+
+namespace {
+
+bool isScalar(const EventValue &value) {
+    return value.type() != EventValue::Type::Map && value.type() != EventValue::Type::Array;
+}
+
+}
+
+const std::shared_ptr<const JsonDocument> &FilterSubject::json() {
+    if (!parsed_) {
+        parsed_ = true;
+        // parseJson takes the text over, the payload stays with the message.
+        std::string text(payload_);
+        json_ = parseJson(text);
+    }
+    return json_;
+}
+
+const std::vector<std::string_view> &FilterSubject::levels() {
+    if (!split_) {
+        split_ = true;
+        size_t start = 0;
+        while (true) {
+            size_t end = topic_.find('/', start);
+            // The last level runs to the end: npos - start is past it.
+            levels_.push_back(topic_.substr(start, end - start));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            start = end + 1;
+        }
+    }
+    return levels_;
+}
+
+std::shared_ptr<MessageFilter> MessageFilter::compile(const EventValue &spec, std::string &error) {
+    if (spec.type() != EventValue::Type::Array) {
+        error = "filter must be an array of conditions";
+        return nullptr;
+    }
+    auto filter = std::make_shared<MessageFilter>();
+    for (const auto &entry : spec.getArray()) {
+        if (entry.type() != EventValue::Type::Map) {
+            error = "filter conditions must be objects";
+            return nullptr;
+        }
+        Condition base;
+        bool hasSource = false;
+        for (const auto &member : entry.getMap()) {
+            const std::string &name = member.first;
+            const EventValue &value = member.second;
+            if (name == "topicSegment") {
+                double index = value.type() == EventValue::Type::Number ? value.getNumber() : 0.5;
+                if (std::floor(index) != index || std::fabs(index) > INT_MAX) {
+                    error = "topicSegment must be an integer";
+                    return nullptr;
+                }
+                base.source = Source::TopicSegment;
+                base.segment = static_cast<int>(index);
+            } else if (name == "userProperty" || name == "jsonField") {
+                if (value.type() != EventValue::Type::String) {
+                    error = name + " must be a string";
+                    return nullptr;
+                }
+                base.source = name == "userProperty" ? Source::UserProperty : Source::JsonField;
+                base.key = value.getString();
+            } else {
+                continue;
+            }
+            if (hasSource) {
+                error = "a condition names more than one of topicSegment, userProperty and jsonField";
+                return nullptr;
+            }
+            hasSource = true;
+        }
+        if (!hasSource) {
+            error = "a condition must name a topicSegment, userProperty or jsonField";
+            return nullptr;
+        }
+
+        size_t operators = 0;
+        for (const auto &member : entry.getMap()) {
+            const std::string &name = member.first;
+            const EventValue &value = member.second;
+            if (name == "topicSegment" || name == "userProperty" || name == "jsonField") {
+                continue;
+            }
+            // Undefined options arrive as null, which only eq and ne compare with.
+            if (value.type() == EventValue::Type::Null && name != "eq" && name != "ne") {
+                continue;
+            }
+            operators++;
+            Condition condition{base.source, base.segment, base.key, Operator::Exists, {}};
+            if (name == "exists") {
+                if (value.type() != EventValue::Type::Bool) {
+                    error = "exists must be a boolean";
+                    return nullptr;
+                }
+                condition.op = value.getBool() ? Operator::Exists : Operator::Absent;
+            } else if (name == "eq" || name == "ne") {
+                if (!isScalar(value)) {
+                    error = name + " must be a string, number, boolean or null";
+                    return nullptr;
+                }
+                condition.op = name == "eq" ? Operator::Equals : Operator::NotEquals;
+                condition.operands.push_back(value);
+            } else if (name == "in" || name == "notIn") {
+                if (value.type() != EventValue::Type::Array ||
+                    !std::all_of(value.getArray().begin(), value.getArray().end(), isScalar)) {
+                    error = name + " must be an array of strings, numbers, booleans or null";
+                    return nullptr;
+                }
+                condition.op = name == "in" ? Operator::In : Operator::NotIn;
+                condition.operands = value.getArray();
+            } else if (name == "lt" || name == "lte" || name == "gt" || name == "gte") {
+                if (value.type() != EventValue::Type::Number) {
+                    error = name + " must be a number";
+                    return nullptr;
+                }
+                condition.op = name == "lt"    ? Operator::Less
+                               : name == "lte" ? Operator::LessOrEqual
+                               : name == "gt"  ? Operator::Greater
+                                               : Operator::GreaterOrEqual;
+                condition.operands.push_back(value);
+            } else if (name == "increases") {
+                if (value.type() != EventValue::Type::Bool) {
+                    error = "increases must be a boolean";
+                    return nullptr;
+                }
+                if (!value.getBool()) {
+                    continue;
+                }
+                if (filter->increasing_ >= 0) {
+                    error = "only one condition of a filter may use increases";
+                    return nullptr;
+                }
+                condition.op = Operator::Increases;
+                filter->increasing_ = static_cast<int>(filter->conditions_.size());
+            } else {
+                error = "unknown filter operator " + name;
+                return nullptr;
+            }
+            filter->usesUserProperties_ |= condition.source == Source::UserProperty;
+            filter->conditions_.push_back(std::move(condition));
+        }
+        if (operators == 0) {
+            error = "a condition must have an operator";
+            return nullptr;
+        }
+    }
+    // Evaluated last, so its state only moves for messages every other condition let through.
+    if (filter->increasing_ >= 0) {
+        auto increasing = filter->conditions_.begin() + filter->increasing_;
+        std::rotate(increasing, increasing + 1, filter->conditions_.end());
+        filter->increasing_ = static_cast<int>(filter->conditions_.size()) - 1;
+    }
+    return filter;
+}
+
+bool MessageFilter::matches(FilterSubject &subject) {
+    double increasingValue = 0;
+    for (const auto &condition : conditions_) {
+        Field field = fieldOf(condition, subject);
+        double number = 0;
+        bool holds = false;
+        switch (condition.op) {
+            case Operator::Exists:
+                holds = field.kind != Field::Kind::Missing;
+                break;
+            case Operator::Absent:
+                holds = field.kind == Field::Kind::Missing;
+                break;
+            case Operator::Equals:
+                holds = equals(field, condition.operands[0]);
+                break;
+            case Operator::NotEquals:
+                holds = !equals(field, condition.operands[0]);
+                break;
+            case Operator::In:
+                holds = std::any_of(condition.operands.begin(), condition.operands.end(),
+                                    [&field](const EventValue &operand) { return equals(field, operand); });
+                break;
+            case Operator::NotIn:
+                holds = std::none_of(condition.operands.begin(), condition.operands.end(),
+                                     [&field](const EventValue &operand) { return equals(field, operand); });
+                break;
+            case Operator::Less:
+                holds = numberOf(field, number) && number < condition.operands[0].getNumber();
+                break;
+            case Operator::LessOrEqual:
+                holds = numberOf(field, number) && number <= condition.operands[0].getNumber();
+                break;
+            case Operator::Greater:
+                holds = numberOf(field, number) && number > condition.operands[0].getNumber();
+                break;
+            case Operator::GreaterOrEqual:
+                holds = numberOf(field, number) && number >= condition.operands[0].getNumber();
+                break;
+            case Operator::Increases:
+                holds = numberOf(field, increasingValue);
+                break;
+        }
+        if (!holds) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    if (increasing_ >= 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto inserted = lastValues_.try_emplace(std::string(subject.topic_), increasingValue);
+        if (!inserted.second) {
+            if (!(increasingValue > inserted.first->second)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            inserted.first->second = increasingValue;
+        }
+    }
+    passed_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+MessageFilter::Field MessageFilter::fieldOf(const Condition &condition, FilterSubject &subject) {
+    Field field;
+    switch (condition.source) {
+        case Source::TopicSegment: {
+            const auto &levels = subject.levels();
+            long index = condition.segment < 0 ? static_cast<long>(levels.size()) + condition.segment
+                                               : condition.segment;
+            if (index >= 0 && index < static_cast<long>(levels.size())) {
+                field.kind = Field::Kind::String;
+                field.string = levels[index];
+                field.spellsNumber = true;
+            }
+            break;
+        }
+        case Source::UserProperty:
+            for (const auto &property : subject.userProperties_) {
+                if (property.first == condition.key) {
+                    field.kind = Field::Kind::String;
+                    field.string = property.second;
+                    field.spellsNumber = true;
+                    break;
+                }
+            }
+            break;
+        case Source::JsonField: {
+            const auto &json = subject.json();
+            if (!json || json->type(JsonDocument::ROOT) != JsonType::Object) {
+                break;
+            }
+            JsonDocument::Index index = json->find(JsonDocument::ROOT, condition.key);
+            if (index == 0) {
+                break;
+            }
+            switch (json->type(index)) {
+                case JsonType::String:
+                    field.kind = Field::Kind::String;
+                    field.string = json->string(index);
+                    break;
+                case JsonType::Number:
+                    field.kind = Field::Kind::Number;
+                    field.number = json->number(index);
+                    break;
+                case JsonType::True:
+                case JsonType::False:
+                    field.kind = Field::Kind::Bool;
+                    field.boolean = json->type(index) == JsonType::True;
+                    break;
+                case JsonType::Null:
+                    field.kind = Field::Kind::Null;
+                    break;
+                default:
+                    field.kind = Field::Kind::Other;
+                    break;
+            }
+            break;
+        }
+    }
+    return field;
+}
+
+bool MessageFilter::numberOf(const Field &field, double &number) {
+    if (field.kind == Field::Kind::Number) {
+        number = field.number;
+        return true;
+    }
+    if (field.kind != Field::Kind::String || !field.spellsNumber || field.string.empty() ||
+        std::isspace(static_cast<unsigned char>(field.string.front()))) {
+        return false;
+    }
+    std::string text(field.string);
+    char *end = nullptr;
+    number = std::strtod(text.c_str(), &end);
+    return end == text.c_str() + text.size() && !std::isnan(number);
+}
+
+bool MessageFilter::equals(const Field &field, const EventValue &operand) {
+    double number = 0;
+    switch (operand.type()) {
+        case EventValue::Type::Null:
+            return field.kind == Field::Kind::Null;
+        case EventValue::Type::Bool:
+            if (field.kind == Field::Kind::String) {
+                return field.spellsNumber && field.string == (operand.getBool() ? "true" : "false");
+            }
+            return field.kind == Field::Kind::Bool && field.boolean == operand.getBool();
+        case EventValue::Type::Number:
+            return numberOf(field, number) && number == operand.getNumber();
+        case EventValue::Type::String:
+            return field.kind == Field::Kind::String && field.string == operand.getString();
+        default:
+            return false;
+    }
+}
+
+}
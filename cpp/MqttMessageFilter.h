@@ -0,0 +1,158 @@
+//
+//  MqttMessageFilter.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MqttEventValue.h"
+#include "MqttMessage.h"
+
+namespace mqtt {
+
+class JsonDocument;
+
+/**
+ * A received message as the filters of its subscriptions see it. The topic is split into levels and the payload
+ * parsed as JSON at most once, by the first filter that needs them, however many subscriptions the message matches.
+ *
+ * Borrows topic, payload and userProperties, which must outlive it. Not thread safe.
+ */
+class FilterSubject {
+public:
+    FilterSubject(std::string_view topic, std::string_view payload, const MessageProperties &userProperties)
+    : topic_(topic), payload_(payload), userProperties_(userProperties) {}
+
+    /**
+     * The parsed payload, nullptr when it is not valid JSON. A subscription asking for JSON payloads is handed this
+     * document instead of parsing the payload again.
+     */
+    const std::shared_ptr<const JsonDocument> &json();
+
+    /**
+     * The document json() parsed, nullptr when no filter asked for it.
+     */
+    const std::shared_ptr<const JsonDocument> &parsedJson() const { return json_; }
+
+private:
+    friend class MessageFilter;
+
+    const std::vector<std::string_view> &levels();
+
+    std::string_view topic_;
+    std::string_view payload_;
+    const MessageProperties &userProperties_;
+    std::vector<std::string_view> levels_;
+    bool split_ = false;
+    std::shared_ptr<const JsonDocument> json_;
+    bool parsed_ = false;
+};
+
+/**
+ * Native predicate of one JS subscription, compiled from its filter option and evaluated on the thread that routes
+ * a received message, before the message is converted for or handed to JS: a message it drops costs no JS work.
+ *
+ * The filter is an array of conditions that must all hold. A condition names one value of the message, a topic level
+ * ({ topicSegment: index }, negative indexes count from the last level), a user property ({ userProperty: name }) or
+ * a member of a JSON object payload ({ jsonField: name }), and tests it with one or more operators:
+ *
+ *  - exists: true when the value is present, false when it is not.
+ *  - eq, ne: equal or not equal to a string, number, boolean or null. Topic levels and user properties are strings,
+ *    compared with a number as the number they spell and with a boolean as "true" or "false". ne also holds for a
+ *    missing value.
+ *  - in, notIn: eq to one element of an array, or to none of them.
+ *  - lt, lte, gt, gte: numeric comparisons; never hold for a value that is not a number.
+ *  - increases: true holds when the value is a number greater than that of the last message of the same topic the
+ *    filter passed, or the first one of that topic. At most one condition of a filter may use it.
+ *
+ * Thread safe. Counts the messages it passed and dropped.
+ */
+class MessageFilter {
+public:
+    /**
+     * Compiles the filter option of a subscription, converted from JS. Returns nullptr and sets error when it is
+     * malformed.
+     */
+    static std::shared_ptr<MessageFilter> compile(const EventValue &spec, std::string &error);
+
+    /**
+     * Whether the message passes every condition. Counted as passed or dropped.
+     */
+    bool matches(FilterSubject &subject);
+
+    /**
+     * A condition reads a user property, so received messages have to keep theirs until they are routed.
+     */
+    bool usesUserProperties() const { return usesUserProperties_; }
+
+    uint64_t passedCount() const { return passed_.load(std::memory_order_relaxed); }
+    uint64_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    enum class Source : uint8_t { TopicSegment, UserProperty, JsonField };
+    enum class Operator : uint8_t {
+        Exists,
+        Absent,
+        Equals,
+        NotEquals,
+        In,
+        NotIn,
+        Less,
+        LessOrEqual,
+        Greater,
+        GreaterOrEqual,
+        Increases
+    };
+
+    struct Condition {
+        Source source = Source::TopicSegment;
+        // TopicSegment: level index, negative from the end.
+        int segment = 0;
+        // UserProperty: property name. JsonField: member name.
+        std::string key;
+        Operator op = Operator::Exists;
+        // One for eq, ne and the comparisons, any number for in and notIn.
+        EventValue::Array operands;
+    };
+
+    /**
+     * The value of one condition's source in a message.
+     */
+    struct Field {
+        enum class Kind : uint8_t { Missing, String, Number, Bool, Null, Other } kind = Kind::Missing;
+        std::string_view string;
+        // Topic levels and user properties: a string that compares with numbers and booleans as what it spells.
+        bool spellsNumber = false;
+        double number = 0;
+        bool boolean = false;
+    };
+
+    static Field fieldOf(const Condition &condition, FilterSubject &subject);
+    static bool numberOf(const Field &field, double &number);
+    static bool equals(const Field &field, const EventValue &operand);
+
+    std::vector<Condition> conditions_;
+    bool usesUserProperties_ = false;
+    // Index into conditions_ of the increases condition, -1 without one.
+    int increasing_ = -1;
+
+    std::mutex mutex_;
+    // increases: value of the last message of every topic the filter passed.
+    std::unordered_map<std::string, double> lastValues_;
+
+    std::atomic<uint64_t> passed_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+}
@@ -0,0 +1,100 @@
+//
+//  MqttMessageRing.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace mqtt {
+
+/**
+ * Bounded lock-free ring buffer (Vyukov's MPMC queue with per-slot sequence numbers).
+ *
+ * Network threads push received messages and the JS thread pops them on flush, so neither side ever blocks
+ * the other. Capacity is rounded up to a power of two; tryPush() returns false instead of waiting when full.
+ */
+template <typename T>
+class MessageRing {
+public:
+    explicit MessageRing(size_t capacity)
+    : capacity_(roundUpToPowerOfTwo(capacity)), mask_(capacity_ - 1), slots_(new Slot[capacity_]) {
+        for (size_t i = 0; i < capacity_; i++) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MessageRing(const MessageRing &) = delete;
+    MessageRing &operator=(const MessageRing &) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    bool tryPush(T &&value) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots_[position & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T &value) {
+        size_t position = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots_[position & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    // Producers and the consumer touch different cache lines.
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+};
+
+}
@@ -0,0 +1,194 @@
+//
+//  MqttMetrics.cpp
+//  d11-mqtt
+//
+
+#include "MqttMetrics.h"
+
+#include <time.h>
+
+namespace mqtt {
+
+namespace {
+
+constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+constexpr const char *QUANTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+
+int mostSignificantBit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+}
+
+int64_t monotonicNanos() {
+#if defined(__APPLE__)
+    return static_cast<int64_t>(clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+namespace {
+
+// Initialized when the library's static initializers run, i.e. when it is loaded.
+const int64_t LIBRARY_LOADED_AT = monotonicNanos();
+
+}
+
+int64_t libraryLoadedAt() {
+    return LIBRARY_LOADED_AT;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    for (auto &bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    // Values in [2^m, 2^(m+1)) fall into group m - SUB_BUCKET_BITS + 1, split linearly by the bits below the top one.
+    int shift = mostSignificantBit(value) - SUB_BUCKET_BITS;
+    size_t subBucket = static_cast<size_t>(value >> shift) & (SUB_BUCKETS - 1);
+    return (static_cast<size_t>(shift) + 1) * SUB_BUCKETS + subBucket;
+}
+
+uint64_t LatencyHistogram::bucketHighestValue(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    uint64_t subBucket = index % SUB_BUCKETS;
+    uint64_t lowest = (SUB_BUCKETS + subBucket) << shift;
+    return lowest + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    buckets_[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t min = min_.load(std::memory_order_relaxed);
+    while (value < min && !min_.compare_exchange_weak(min, value, std::memory_order_relaxed)) {
+    }
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::valueAtQuantile(double quantile) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(quantile * static_cast<double>(total));
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKETS; ++index) {
+        seen += buckets_[index].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            uint64_t highest = bucketHighestValue(index);
+            uint64_t max = max_.load(std::memory_order_relaxed);
+            return highest < max ? highest : max;
+        }
+    }
+    return max_.load(std::memory_order_relaxed);
+}
+
+EventValue LatencyHistogram::snapshot() const {
+    uint64_t total = count();
+    EventValue::Map fields;
+    fields.emplace_back("count", static_cast<double>(total));
+    fields.emplace_back("min", total ? static_cast<double>(min_.load(std::memory_order_relaxed)) : 0.0);
+    fields.emplace_back("max", static_cast<double>(max_.load(std::memory_order_relaxed)));
+    fields.emplace_back("mean",
+                        total ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(total)
+                              : 0.0);
+    for (size_t i = 0; i < sizeof(QUANTILES) / sizeof(QUANTILES[0]); ++i) {
+        fields.emplace_back(QUANTILE_NAMES[i], static_cast<double>(valueAtQuantile(QUANTILES[i])));
+    }
+    return EventValue(std::move(fields));
+}
+
+void ClientMetrics::recordReceived(const std::string &topic, size_t bytes) {
+    messagesIn_.fetch_add(1, std::memory_order_relaxed);
+    bytesIn_.fetch_add(bytes, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(topicsMutex_);
+    auto found = topics_.find(topic);
+    TopicCounters *counters;
+    if (found != topics_.end()) {
+        counters = &found->second;
+    } else if (topics_.size() < MAX_TRACKED_TOPICS) {
+        counters = &topics_[topic];
+    } else {
+        counters = &otherTopics_;
+    }
+    counters->messages += 1;
+    counters->bytes += bytes;
+}
+
+void ClientMetrics::recordSent(size_t bytes) {
+    messagesOut_.fetch_add(1, std::memory_order_relaxed);
+    bytesOut_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ClientMetrics::recordConversion(int64_t nanos) {
+    conversionTimeNs_.record(nanos > 0 ? static_cast<uint64_t>(nanos) : 0);
+}
+
+void ClientMetrics::recordReconnect(int64_t millis) {
+    reconnects_.fetch_add(1, std::memory_order_relaxed);
+    reconnectDurationMs_.record(millis > 0 ? static_cast<uint64_t>(millis) : 0);
+}
+
+EventValue ClientMetrics::snapshot() {
+    EventValue::Map fields;
+    fields.emplace_back("messagesIn", static_cast<double>(messagesIn_.load(std::memory_order_relaxed)));
+    fields.emplace_back("bytesIn", static_cast<double>(bytesIn_.load(std::memory_order_relaxed)));
+    fields.emplace_back("messagesOut", static_cast<double>(messagesOut_.load(std::memory_order_relaxed)));
+    fields.emplace_back("bytesOut", static_cast<double>(bytesOut_.load(std::memory_order_relaxed)));
+    fields.emplace_back("reconnects", static_cast<double>(reconnects_.load(std::memory_order_relaxed)));
+    fields.emplace_back("conversionTimeNs", conversionTimeNs_.snapshot());
+    fields.emplace_back("reconnectDurationMs", reconnectDurationMs_.snapshot());
+    EventValue::Map startup;
+    startup.emplace_back("warmStart", warmStarted_.load(std::memory_order_relaxed));
+    auto addMilestone = [&startup](const char *name, const std::atomic<int64_t> &milestone) {
+        int64_t at = milestone.load(std::memory_order_relaxed);
+        if (at != 0) {
+            startup.emplace_back(name, static_cast<double>(at - libraryLoadedAt()) / 1e6);
+        }
+    };
+    addMilestone("jsAttachedMs", jsAttachedAt_);
+    addMilestone("connectedMs", firstConnectAt_);
+    addMilestone("firstMessageMs", firstMessageAt_);
+    fields.emplace_back("startup", std::move(startup));
+
+    std::lock_guard<std::mutex> lock(topicsMutex_);
+    int64_t now = monotonicNanos();
+    double seconds = lastSnapshotAt_ ? static_cast<double>(now - lastSnapshotAt_) / 1e9 : 0.0;
+    lastSnapshotAt_ = now;
+    auto countersValue = [seconds](TopicCounters &counters) {
+        uint64_t recent = counters.messages - counters.messagesAtLastSnapshot;
+        counters.messagesAtLastSnapshot = counters.messages;
+        EventValue::Map topic;
+        topic.emplace_back("messages", static_cast<double>(counters.messages));
+        topic.emplace_back("bytes", static_cast<double>(counters.bytes));
+        topic.emplace_back("messagesPerSecond", seconds > 0 ? static_cast<double>(recent) / seconds : 0.0);
+        return EventValue(std::move(topic));
+    };
+    EventValue::Map topics;
+    topics.reserve(topics_.size());
+    for (auto &entry : topics_) {
+        topics.emplace_back(entry.first, countersValue(entry.second));
+    }
+    fields.emplace_back("topics", std::move(topics));
+    fields.emplace_back("otherTopics", countersValue(otherTopics_));
+    return EventValue(std::move(fields));
+}
+
+}
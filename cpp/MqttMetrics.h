@@ -0,0 +1,140 @@
+//
+//  MqttMetrics.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "MqttEventValue.h"
+
+namespace mqtt {
+
+/**
+ * Nanoseconds on the monotonic clock the platform layers stamp received messages with: CLOCK_MONOTONIC, which is
+ * System.nanoTime() on Android, and CLOCK_UPTIME_RAW on Apple platforms, which Swift reads with
+ * clock_gettime_nsec_np.
+ */
+int64_t monotonicNanos();
+
+/**
+ * monotonicNanos() when the native library was loaded, the reference of the startup timings: the library is loaded
+ * at app launch (iOS) or by the first use of the module or of MqttWarmStart (Android), before the JS bundle runs.
+ */
+int64_t libraryLoadedAt();
+
+/**
+ * Latency histogram with HDR-style log-linear buckets: values are grouped by power of two and every group is split
+ * into 16 linear sub-buckets, so a reported percentile is within 1/16 of the recorded values at a fixed size,
+ * whatever their range. record() is wait free and may be called from any thread; snapshots taken concurrently may
+ * miss the records in flight.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    /**
+     * Highest value of the bucket holding the given quantile (0 to 1) of the recorded values, 0 when empty.
+     */
+    uint64_t valueAtQuantile(double quantile) const;
+
+    /**
+     * {count, min, max, mean, p50, p90, p99, p999}.
+     */
+    EventValue snapshot() const;
+
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketHighestValue(size_t index);
+
+private:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{UINT64_MAX};
+    std::atomic<uint64_t> max_{0};
+};
+
+/**
+ * Counters of one client, updated on the hot paths with relaxed atomics and read by getMetrics(clientId).
+ *
+ * Received messages are also counted per exact topic, for the first MAX_TRACKED_TOPICS topics; later topics are
+ * summed up under otherTopics so a wildcard subscription over unbounded topics cannot grow the map.
+ */
+class ClientMetrics {
+public:
+    static constexpr size_t MAX_TRACKED_TOPICS = 256;
+
+    void recordReceived(const std::string &topic, size_t bytes);
+    void recordSent(size_t bytes);
+
+    /**
+     * Time from the platform client handing over a message to the core having it as an MqttMessage, i.e. the
+     * JNI/Objective-C conversion.
+     */
+    void recordConversion(int64_t nanos);
+
+    void recordReconnect(int64_t millis);
+
+    /**
+     * Startup milestones of the client, each recorded once at monotonicNanos() time nanos: JS took the client over
+     * (created it, or attached to the warm started one), the first CONNACK and the first received message.
+     */
+    void markWarmStarted() { warmStarted_.store(true, std::memory_order_relaxed); }
+    void recordJsAttached(int64_t nanos) { recordOnce(jsAttachedAt_, nanos); }
+    void recordFirstConnect(int64_t nanos) { recordOnce(firstConnectAt_, nanos); }
+    void recordFirstMessage(int64_t nanos) { recordOnce(firstMessageAt_, nanos); }
+
+    /**
+     * {messagesIn, bytesIn, messagesOut, bytesOut, reconnects, conversionTimeNs, reconnectDurationMs, startup,
+     * topics, otherTopics}. startup is {warmStart, jsAttachedMs, connectedMs, firstMessageMs}, milliseconds since
+     * libraryLoadedAt() of the milestones reached so far. topics maps every tracked topic to {messages, bytes, messagesPerSecond}, the rate over the time
+     * since the previous snapshot.
+     */
+    EventValue snapshot();
+
+private:
+    static void recordOnce(std::atomic<int64_t> &milestone, int64_t nanos) {
+        int64_t unset = 0;
+        milestone.compare_exchange_strong(unset, nanos, std::memory_order_relaxed);
+    }
+
+    struct TopicCounters {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        uint64_t messagesAtLastSnapshot = 0;
+    };
+
+    std::atomic<uint64_t> messagesIn_{0};
+    std::atomic<uint64_t> bytesIn_{0};
+    std::atomic<uint64_t> messagesOut_{0};
+    std::atomic<uint64_t> bytesOut_{0};
+    std::atomic<uint64_t> reconnects_{0};
+    std::atomic<bool> warmStarted_{false};
+    std::atomic<int64_t> jsAttachedAt_{0};
+    std::atomic<int64_t> firstConnectAt_{0};
+    std::atomic<int64_t> firstMessageAt_{0};
+    LatencyHistogram conversionTimeNs_;
+    LatencyHistogram reconnectDurationMs_;
+
+    std::mutex topicsMutex_;
+    std::unordered_map<std::string, TopicCounters> topics_;
+    TopicCounters otherTopics_;
+    int64_t lastSnapshotAt_ = 0;
+};
+
+}
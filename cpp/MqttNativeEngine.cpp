@@ -0,0 +1,67 @@
+//
+//  MqttNativeEngine.cpp
+//  d11-mqtt
+//
+
+#include "MqttNativeEngine.h"
+#include "MqttConstants.h"
+#include "MqttOutboundStore.h"
+#include "MqttSharedConnection.h"
+#include "MqttSocketTransport.h"
+
+namespace mqtt {
+
+std::string unsupportedNativeOptions(const NativeClientOptions &options) {
+    if (options.enableSsl) {
+        return "TLS is not supported by the native engine, use engine: 'platform'";
+    }
+    if (options.shareConnection && options.storeCapacity > 0) {
+        return "persistence is not supported together with shareConnection";
+    }
+    return std::string();
+}
+
+std::shared_ptr<Client> createNativeClient(ClientRegistry &registry, const std::string &clientId,
+                                           const NativeClientOptions &options, const std::shared_ptr<EventSink> &sink,
+                                           std::string &error) {
+    std::string unsupported = unsupportedNativeOptions(options);
+    if (!unsupported.empty()) {
+        sink->emit(clientId + events::MQTT_ERROR, EventValue(Client::initializationError(unsupported)));
+        return nullptr;
+    }
+
+    if (options.shareConnection) {
+        auto channel = std::make_shared<SharedChannel>(
+            clientId, options.host, options.port,
+            [](const std::string &connectionId, const std::string &connectionHost, int connectionPort,
+               std::weak_ptr<TransportListener> listener) {
+                auto transport = std::make_shared<SocketTransport>(connectionId, connectionHost, connectionPort);
+                transport->attach(std::move(listener));
+                return transport;
+            });
+        auto client = registry.create(clientId, channel, sink);
+        if (client) {
+            channel->attach(client);
+        }
+        return client;
+    }
+
+    auto transport = std::make_shared<SocketTransport>(clientId, options.host, options.port);
+    auto client = registry.create(clientId, transport, sink);
+    if (!client) {
+        return nullptr;
+    }
+    transport->attach(client);
+    if (options.storeCapacity > 0) {
+        std::string path = options.storePath ? options.storePath(error) : std::string();
+        auto store = path.empty() ? nullptr : OutboundStore::open(path, options.storeCapacity, error);
+        if (!store) {
+            error = "Failed to open the outbound store: " + error;
+            return client;
+        }
+        transport->setOutboundStore(std::move(store));
+    }
+    return client;
+}
+
+}
@@ -0,0 +1,51 @@
+//
+//  MqttNativeEngine.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "MqttClientRegistry.h"
+#include "MqttEventSink.h"
+
+namespace mqtt {
+
+/**
+ * createMqtt options of a native engine client, see createNativeClient().
+ */
+struct NativeClientOptions {
+    std::string host;
+    int port = 1883;
+    bool enableSsl = false;
+    // Positive: outgoing QoS 1/2 messages are persisted in an outbound store of at most that many bytes.
+    size_t storeCapacity = 0;
+    // Path of the outbound store; returns an empty path and sets error when there is none.
+    std::function<std::string(std::string &error)> storePath;
+    // Shares one connection with the other sharing clients of the same host, port and credentials.
+    bool shareConnection = false;
+};
+
+/**
+ * Why the native engine cannot create a client with options, as the initialization error to report; empty when it
+ * supports them all.
+ */
+std::string unsupportedNativeOptions(const NativeClientOptions &options);
+
+/**
+ * Registers clientId in registry with a SocketTransport, or a SharedChannel with shareConnection.
+ *
+ * Options the engine does not support are rejected before anything is created: the initialization error is emitted
+ * to sink and nullptr returned, so there is no client that a later connect could take to the broker without them
+ * (in the clear instead of over TLS, say). Also returns nullptr when clientId is taken. A store that fails to open
+ * leaves the client without one and is reported in error.
+ */
+std::shared_ptr<Client> createNativeClient(ClientRegistry &registry, const std::string &clientId,
+                                           const NativeClientOptions &options, const std::shared_ptr<EventSink> &sink,
+                                           std::string &error);
+
+}
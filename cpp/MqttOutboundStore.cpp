@@ -0,0 +1,411 @@
+//
+//  MqttOutboundStore.cpp
+//  d11-mqtt
+//
+
+#include "MqttOutboundStore.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace mqtt {
+
+namespace {
+
+constexpr uint32_t FILE_MAGIC = 0x424F514D; // "MQOB"
+constexpr uint32_t FILE_VERSION = 1;
+constexpr size_t FILE_HEADER_SIZE = 16;
+constexpr size_t RECORD_ALIGNMENT = 8;
+
+enum RecordType : uint8_t {
+    RECORD_PUBLISH = 1,
+    RECORD_PACKET_ID = 2,
+    RECORD_RELEASED = 3,
+    RECORD_COMPLETED = 4,
+};
+
+constexpr uint8_t FLAG_RETAIN = 0x01;
+constexpr uint8_t FLAG_RELEASED = 0x02;
+
+/**
+ * Header of every log record, followed by bodyLength bytes (topic and payload of a publish record) and padding to
+ * RECORD_ALIGNMENT. checksum covers the rest of the header and the body, so a torn write never passes as a record.
+ */
+struct RecordHeader {
+    uint32_t checksum;
+    uint32_t bodyLength;
+    uint64_t sequence;
+    uint16_t packetId;
+    uint16_t topicLength;
+    uint8_t type;
+    uint8_t qos;
+    uint8_t flags;
+    uint8_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 24, "RecordHeader is part of the file format");
+
+// A pending message writes at most a packet identifier, a released and a completed record after its publish record.
+constexpr size_t STATE_RECORDS_PER_MESSAGE = 3;
+
+constexpr size_t aligned(size_t size) {
+    return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+constexpr size_t recordSize(size_t bodyLength) {
+    return aligned(sizeof(RecordHeader) + bodyLength);
+}
+
+constexpr size_t liveSize(size_t bodyLength) {
+    return recordSize(bodyLength) + STATE_RECORDS_PER_MESSAGE * recordSize(0);
+}
+
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+CrcTables makeCrcTables() {
+    CrcTables tables{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+        }
+        tables[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (size_t t = 1; t < tables.size(); t++) {
+            tables[t][i] = (tables[t - 1][i] >> 8) ^ tables[0][tables[t - 1][i] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+/**
+ * CRC-32 (the zlib polynomial), eight bytes per step with the slicing-by-8 tables.
+ */
+uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    static const CrcTables tables = makeCrcTables();
+    crc = ~crc;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, data, sizeof(low));
+        std::memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+        crc = tables[7][low & 0xFF] ^ tables[6][(low >> 8) & 0xFF] ^ tables[5][(low >> 16) & 0xFF] ^
+              tables[4][low >> 24] ^ tables[3][high & 0xFF] ^ tables[2][(high >> 8) & 0xFF] ^
+              tables[1][(high >> 16) & 0xFF] ^ tables[0][high >> 24];
+    }
+#endif
+    for (; size > 0; data++, size--) {
+        crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t checksumOf(const RecordHeader &header, const uint8_t *body) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&header);
+    uint32_t crc = crc32(0, bytes + sizeof(header.checksum), sizeof(RecordHeader) - sizeof(header.checksum));
+    return crc32(crc, body, header.bodyLength);
+}
+
+std::string errnoMessage(const char *operation, const std::string &path) {
+    return std::string(operation) + " " + path + ": " + std::strerror(errno);
+}
+
+}
+
+OutboundStore::OutboundStore(std::string path, size_t capacity) : path_(std::move(path)), capacity_(capacity) {}
+
+OutboundStore::~OutboundStore() {
+    unmap();
+}
+
+std::unique_ptr<OutboundStore> OutboundStore::open(const std::string &path, size_t capacity, std::string &error) {
+    capacity = aligned(std::max(capacity, FILE_HEADER_SIZE + liveSize(0)));
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        error = errnoMessage("Failed to open", path);
+        return nullptr;
+    }
+    struct stat info {};
+    if (fstat(fd, &info) < 0) {
+        error = errnoMessage("Failed to stat", path);
+        ::close(fd);
+        return nullptr;
+    }
+    // A file written with a larger capacity is mapped whole and shrunk by the compaction below.
+    size_t size = std::max(static_cast<size_t>(info.st_size), capacity);
+    if (static_cast<size_t>(info.st_size) < size && ftruncate(fd, static_cast<off_t>(size)) < 0) {
+        error = errnoMessage("Failed to resize", path);
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<OutboundStore> store(new OutboundStore(path, capacity));
+    if (!store->map(fd, size, error)) {
+        return nullptr;
+    }
+    store->recover();
+    if (store->mappedSize_ != capacity && FILE_HEADER_SIZE + store->liveBytes_ <= capacity) {
+        store->compact();
+    }
+    return store;
+}
+
+bool OutboundStore::map(int fd, size_t size, std::string &error) {
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        error = errnoMessage("Failed to map", path_);
+        ::close(fd);
+        return false;
+    }
+    unmap();
+    fd_ = fd;
+    data_ = static_cast<uint8_t *>(data);
+    mappedSize_ = size;
+    return true;
+}
+
+void OutboundStore::unmap() {
+    if (data_ != nullptr) {
+        munmap(data_, mappedSize_);
+        data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void OutboundStore::recover() {
+    uint32_t magic;
+    uint32_t version;
+    std::memcpy(&magic, data_, sizeof(magic));
+    std::memcpy(&version, data_ + sizeof(magic), sizeof(version));
+    if (magic != FILE_MAGIC || version != FILE_VERSION) {
+        // New file, or one this version cannot read: start over.
+        std::memset(data_, 0, mappedSize_);
+        std::memcpy(data_, &FILE_MAGIC, sizeof(FILE_MAGIC));
+        std::memcpy(data_ + sizeof(FILE_MAGIC), &FILE_VERSION, sizeof(FILE_VERSION));
+        end_ = FILE_HEADER_SIZE;
+        return;
+    }
+
+    size_t offset = FILE_HEADER_SIZE;
+    while (offset + sizeof(RecordHeader) <= mappedSize_) {
+        RecordHeader header;
+        std::memcpy(&header, data_ + offset, sizeof(header));
+        if (header.type < RECORD_PUBLISH || header.type > RECORD_COMPLETED ||
+            recordSize(header.bodyLength) > mappedSize_ - offset || header.topicLength > header.bodyLength ||
+            checksumOf(header, data_ + offset + sizeof(RecordHeader)) != header.checksum) {
+            // Zeroed space after the last record, or the record a crash interrupted.
+            break;
+        }
+        auto it = entries_.find(header.sequence);
+        switch (header.type) {
+            case RECORD_PUBLISH:
+                entries_[header.sequence] = Location{offset,
+                                                     header.bodyLength,
+                                                     header.topicLength,
+                                                     header.qos,
+                                                     (header.flags & FLAG_RETAIN) != 0,
+                                                     header.packetId,
+                                                     (header.flags & FLAG_RELEASED) != 0};
+                liveBytes_ += liveSize(header.bodyLength);
+                nextSequence_ = std::max(nextSequence_, header.sequence + 1);
+                break;
+            case RECORD_PACKET_ID:
+                if (it != entries_.end()) {
+                    it->second.packetId = header.packetId;
+                }
+                break;
+            case RECORD_RELEASED:
+                if (it != entries_.end()) {
+                    it->second.released = true;
+                }
+                break;
+            case RECORD_COMPLETED:
+                if (it != entries_.end()) {
+                    liveBytes_ -= liveSize(it->second.bodyLength);
+                    entries_.erase(it);
+                }
+                break;
+        }
+        offset += recordSize(header.bodyLength);
+    }
+    end_ = offset;
+}
+
+uint64_t OutboundStore::append(std::string_view topic, const uint8_t *payload, size_t size, uint8_t qos, bool retain,
+                               uint16_t packetId) {
+    size_t bodyLength = topic.size() + size;
+    if (topic.size() > UINT16_MAX || bodyLength > UINT32_MAX ||
+        FILE_HEADER_SIZE + liveBytes_ + liveSize(bodyLength) > capacity_) {
+        return 0;
+    }
+    uint64_t sequence = nextSequence_;
+    Location location{0, static_cast<uint32_t>(bodyLength), static_cast<uint16_t>(topic.size()), qos, retain,
+                      packetId, false};
+    location.offset = writeRecord(RECORD_PUBLISH, sequence, location, topic, payload, size);
+    if (location.offset == 0) {
+        return 0;
+    }
+    nextSequence_++;
+    entries_[sequence] = location;
+    liveBytes_ += liveSize(bodyLength);
+    return sequence;
+}
+
+void OutboundStore::assignPacketId(uint64_t sequence, uint16_t packetId) {
+    auto it = entries_.find(sequence);
+    if (it == entries_.end()) {
+        return;
+    }
+    it->second.packetId = packetId;
+    writeRecord(RECORD_PACKET_ID, sequence, it->second, std::string_view(), nullptr, 0);
+}
+
+void OutboundStore::release(uint64_t sequence) {
+    auto it = entries_.find(sequence);
+    if (it == entries_.end() || it->second.released) {
+        return;
+    }
+    it->second.released = true;
+    writeRecord(RECORD_RELEASED, sequence, it->second, std::string_view(), nullptr, 0);
+}
+
+void OutboundStore::complete(uint64_t sequence) {
+    auto it = entries_.find(sequence);
+    if (it == entries_.end()) {
+        return;
+    }
+    Location location = it->second;
+    liveBytes_ -= liveSize(location.bodyLength);
+    entries_.erase(it);
+    writeRecord(RECORD_COMPLETED, sequence, location, std::string_view(), nullptr, 0);
+}
+
+size_t OutboundStore::writeRecord(uint8_t type, uint64_t sequence, Location location, std::string_view topic,
+                                  const uint8_t *payload, size_t payloadSize) {
+    size_t bodyLength = topic.size() + payloadSize;
+    size_t size = recordSize(bodyLength);
+    if (end_ + size > mappedSize_ && (!compact() || end_ + size > mappedSize_)) {
+        return 0;
+    }
+
+    RecordHeader header{};
+    header.bodyLength = static_cast<uint32_t>(bodyLength);
+    header.sequence = sequence;
+    header.packetId = location.packetId;
+    header.topicLength = static_cast<uint16_t>(topic.size());
+    header.type = type;
+    header.qos = location.qos;
+    header.flags = (location.retain ? FLAG_RETAIN : 0) | (location.released ? FLAG_RELEASED : 0);
+
+    // Body first and header last: until the checksum is in place the record does not exist for recover().
+    uint8_t *record = data_ + end_;
+    uint8_t *body = record + sizeof(RecordHeader);
+    if (!topic.empty()) {
+        std::memcpy(body, topic.data(), topic.size());
+    }
+    if (payloadSize > 0) {
+        std::memcpy(body + topic.size(), payload, payloadSize);
+    }
+    header.checksum = checksumOf(header, body);
+    std::memcpy(record, &header, sizeof(header));
+    size_t offset = end_;
+    end_ += size;
+    return offset;
+}
+
+bool OutboundStore::compact() {
+    std::string compactPath = path_ + ".compact";
+    int fd = ::open(compactPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(capacity_)) < 0) {
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+    void *mapped = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+
+    // Every pending message becomes a single publish record carrying its current state.
+    auto *target = static_cast<uint8_t *>(mapped);
+    std::memcpy(target, data_, FILE_HEADER_SIZE);
+    size_t offset = FILE_HEADER_SIZE;
+    std::map<uint64_t, Location> moved;
+    for (const auto &entry : entries_) {
+        const Location &location = entry.second;
+        size_t size = recordSize(location.bodyLength);
+        std::memcpy(target + offset, data_ + location.offset, size);
+        RecordHeader header;
+        std::memcpy(&header, target + offset, sizeof(header));
+        header.type = RECORD_PUBLISH;
+        header.packetId = location.packetId;
+        header.flags = (location.retain ? FLAG_RETAIN : 0) | (location.released ? FLAG_RELEASED : 0);
+        header.checksum = checksumOf(header, target + offset + sizeof(RecordHeader));
+        std::memcpy(target + offset, &header, sizeof(header));
+        Location copy = location;
+        copy.offset = offset;
+        moved.emplace(entry.first, copy);
+        offset += size;
+    }
+
+    // The new file has to be on disk before it replaces the old one.
+    if (msync(mapped, capacity_, MS_SYNC) < 0 || rename(compactPath.c_str(), path_.c_str()) < 0) {
+        munmap(mapped, capacity_);
+        ::close(fd);
+        unlink(compactPath.c_str());
+        return false;
+    }
+    unmap();
+    fd_ = fd;
+    data_ = target;
+    mappedSize_ = capacity_;
+    end_ = offset;
+    entries_ = std::move(moved);
+    return true;
+}
+
+OutboundStore::Entry OutboundStore::entryAt(uint64_t sequence, const Location &location) const {
+    const uint8_t *body = data_ + location.offset + sizeof(RecordHeader);
+    return Entry{sequence,
+                 std::string_view(reinterpret_cast<const char *>(body), location.topicLength),
+                 body + location.topicLength,
+                 location.bodyLength - location.topicLength,
+                 location.qos,
+                 location.retain,
+                 location.packetId,
+                 location.released};
+}
+
+std::string clientFileName(const std::string &clientId) {
+    static const char HEX[] = "0123456789ABCDEF";
+    std::string name;
+    for (unsigned char c : clientId) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_') {
+            name.push_back(static_cast<char>(c));
+        } else {
+            name.push_back('%');
+            name.push_back(HEX[c >> 4]);
+            name.push_back(HEX[c & 0x0F]);
+        }
+    }
+    return name;
+}
+
+}
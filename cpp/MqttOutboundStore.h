@@ -0,0 +1,132 @@
+//
+//  MqttOutboundStore.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace mqtt {
+
+/**
+ * Crash-safe store of the outgoing QoS 1/2 messages of one client, kept until the broker acknowledged them.
+ *
+ * An append-only log in a memory-mapped file of fixed size. Every change (message added, packet identifier assigned,
+ * PUBREC received, message completed) is one checksummed record, so a process killed mid-write loses at most the
+ * record it was writing and reopening recovers everything before it. When the log reaches the end of the file, the
+ * pending messages are compacted into a fresh file that atomically replaces it; when they alone fill the file,
+ * append() refuses new messages, so disk usage never exceeds the capacity.
+ *
+ * Not thread safe: SocketTransport only calls it under its own mutex.
+ */
+class OutboundStore {
+public:
+    /**
+     * A pending message. topic and payload point into the mapping and stay valid until the store is modified.
+     */
+    struct Entry {
+        uint64_t sequence;
+        std::string_view topic;
+        const uint8_t *payload;
+        size_t payloadSize;
+        uint8_t qos;
+        bool retain;
+        // 0 until the message was sent for the first time.
+        uint16_t packetId;
+        // PUBREC received; only the PUBREL/PUBCOMP exchange is left.
+        bool released;
+    };
+
+    static constexpr size_t DEFAULT_CAPACITY = 4 * 1024 * 1024;
+
+    /**
+     * Opens or creates the store file at path and recovers the messages pending in it. Returns nullptr and sets error
+     * when the file cannot be created or mapped.
+     */
+    static std::unique_ptr<OutboundStore> open(const std::string &path, size_t capacity, std::string &error);
+
+    ~OutboundStore();
+
+    OutboundStore(const OutboundStore &) = delete;
+    OutboundStore &operator=(const OutboundStore &) = delete;
+
+    /**
+     * Adds a message; packetId is 0 when it is stored to be sent later. Returns its sequence number (never 0), or 0
+     * when the pending messages leave no room for it.
+     */
+    uint64_t append(std::string_view topic, const uint8_t *payload, size_t size, uint8_t qos, bool retain,
+                    uint16_t packetId);
+
+    void assignPacketId(uint64_t sequence, uint16_t packetId);
+    void release(uint64_t sequence);
+    void complete(uint64_t sequence);
+
+    /**
+     * Visits the pending messages in the order they were appended. The store must not be modified while visiting.
+     */
+    template <typename Visitor>
+    void forEach(Visitor &&visit) const {
+        for (const auto &entry : entries_) {
+            visit(entryAt(entry.first, entry.second));
+        }
+    }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    size_t capacity() const { return capacity_; }
+
+    /**
+     * Bytes of the log in use, including records of completed messages that were not compacted away yet.
+     */
+    size_t usedBytes() const { return end_; }
+
+private:
+    struct Location {
+        size_t offset;
+        uint32_t bodyLength;
+        uint16_t topicLength;
+        uint8_t qos;
+        bool retain;
+        uint16_t packetId;
+        bool released;
+    };
+
+    OutboundStore(std::string path, size_t capacity);
+
+    bool map(int fd, size_t size, std::string &error);
+    void unmap();
+    void recover();
+    /**
+     * Appends a record, compacting first when the log is full. Returns its offset, or 0 when there is no room. location
+     * is taken by value: a compaction replaces entries_.
+     */
+    size_t writeRecord(uint8_t type, uint64_t sequence, Location location, std::string_view topic,
+                       const uint8_t *payload, size_t payloadSize);
+    bool compact();
+    Entry entryAt(uint64_t sequence, const Location &location) const;
+
+    const std::string path_;
+    const size_t capacity_;
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    size_t mappedSize_ = 0;
+    size_t end_ = 0;
+    uint64_t nextSequence_ = 1;
+    // Log bytes the pending messages need after a compaction, including room for their remaining state records.
+    size_t liveBytes_ = 0;
+    std::map<uint64_t, Location> entries_;
+};
+
+/**
+ * File name for the per-client files of the native engine (outbound store, warm start session): clientId with every
+ * character that is not safe in a file name hex-escaped.
+ */
+std::string clientFileName(const std::string &clientId);
+
+}
@@ -0,0 +1,185 @@
+//
+//  MqttPayloadDecompressor.cpp
+//  d11-mqtt
+//
+
+#include "MqttPayloadDecompressor.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+namespace {
+
+// Idle inflaters kept for the next messages; more only exist while several threads decompress at once.
+constexpr size_t MAXIMUM_IDLE_INFLATERS = 4;
+constexpr size_t INITIAL_BUFFER_SIZE = 16 * 1024;
+// Output buffers that grew beyond this for an unusually large payload are not pooled.
+constexpr size_t MAXIMUM_POOLED_BUFFER_SIZE = 1024 * 1024;
+// Accepts zlib and gzip streams alike.
+constexpr int WINDOW_BITS_AUTO_DETECT = 15 + 32;
+
+bool equalsIgnoringCase(std::string_view value, std::string_view expected) {
+    if (value.size() != expected.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < value.size(); i++) {
+        char c = value[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        if (c != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+struct PayloadDecompressor::Inflater {
+    z_stream stream{};
+    std::unique_ptr<Bytef[]> buffer;
+    size_t capacity = 0;
+
+    ~Inflater() { inflateEnd(&stream); }
+
+    void grow(size_t produced, size_t size) {
+        std::unique_ptr<Bytef[]> grown(new Bytef[size]);
+        if (produced > 0) {
+            std::memcpy(grown.get(), buffer.get(), produced);
+        }
+        buffer = std::move(grown);
+        capacity = size;
+    }
+};
+
+PayloadDecompressor::PayloadDecompressor() : dictionaries_(std::make_shared<DictionaryMap>()) {}
+
+PayloadDecompressor::~PayloadDecompressor() = default;
+
+void PayloadDecompressor::addDictionary(std::string dictionary) {
+    uint32_t id = static_cast<uint32_t>(
+        adler32(adler32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(dictionary.data()),
+                static_cast<uInt>(dictionary.size())));
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto next = std::make_shared<DictionaryMap>(*dictionaries_);
+    next->emplace(id, std::make_shared<const std::string>(std::move(dictionary)));
+    std::atomic_store(&dictionaries_, std::shared_ptr<const DictionaryMap>(std::move(next)));
+}
+
+size_t PayloadDecompressor::dictionaryCount() const {
+    return std::atomic_load(&dictionaries_)->size();
+}
+
+bool PayloadDecompressor::decompress(std::string_view encoding, std::string &payload, std::string &error) {
+    MQTT_TRACE_SECTION("mqtt::PayloadDecompressor::decompress");
+    if (!equalsIgnoringCase(encoding, "deflate") && !equalsIgnoringCase(encoding, "gzip")) {
+        error = "Unsupported content encoding: " + std::string(encoding);
+        return false;
+    }
+    auto inflater = acquire(error);
+    if (!inflater) {
+        return false;
+    }
+    z_stream &stream = inflater->stream;
+    stream.next_in = reinterpret_cast<Bytef *>(payload.data());
+    stream.avail_in = static_cast<uInt>(payload.size());
+    size_t produced = 0;
+    bool done = false;
+    while (!done) {
+        if (produced == inflater->capacity) {
+            if (inflater->capacity >= MAXIMUM_DECOMPRESSED_SIZE) {
+                error = "Decompressed payload is larger than the limit";
+                break;
+            }
+            inflater->grow(produced, std::min(std::max(inflater->capacity * 2, INITIAL_BUFFER_SIZE),
+                                              MAXIMUM_DECOMPRESSED_SIZE));
+        }
+        stream.next_out = inflater->buffer.get() + produced;
+        stream.avail_out = static_cast<uInt>(inflater->capacity - produced);
+        int result = inflate(&stream, Z_NO_FLUSH);
+        produced = inflater->capacity - stream.avail_out;
+        switch (result) {
+            case Z_STREAM_END:
+                done = true;
+                break;
+            case Z_OK:
+                break;
+            case Z_NEED_DICT: {
+                auto dictionaries = std::atomic_load(&dictionaries_);
+                auto dictionary = dictionaries->find(static_cast<uint32_t>(stream.adler));
+                if (dictionary == dictionaries->end()) {
+                    char id[16];
+                    snprintf(id, sizeof(id), "%08lX", static_cast<unsigned long>(stream.adler));
+                    error = std::string("Payload needs a dictionary that is not registered (Adler-32 ") + id + ")";
+                    break;
+                }
+                const std::string &bytes = *dictionary->second;
+                inflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(bytes.data()),
+                                     static_cast<uInt>(bytes.size()));
+                break;
+            }
+            case Z_BUF_ERROR:
+                // No progress: either the output is full, which grows it above, or the input ended early.
+                if (stream.avail_out != 0) {
+                    error = "Compressed payload is truncated";
+                }
+                break;
+            default:
+                error = std::string("Corrupt compressed payload: ") + (stream.msg != nullptr ? stream.msg : "unknown");
+                break;
+        }
+        if (!error.empty()) {
+            break;
+        }
+    }
+    if (done) {
+        payload.assign(reinterpret_cast<const char *>(inflater->buffer.get()), produced);
+    }
+    release(std::move(inflater));
+    return done;
+}
+
+std::unique_ptr<PayloadDecompressor::Inflater> PayloadDecompressor::acquire(std::string &error) {
+    std::unique_ptr<Inflater> inflater;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            inflater = std::move(idle_.back());
+            idle_.pop_back();
+        }
+    }
+    if (inflater) {
+        inflateReset(&inflater->stream);
+        return inflater;
+    }
+    inflater = std::make_unique<Inflater>();
+    if (inflateInit2(&inflater->stream, WINDOW_BITS_AUTO_DETECT) != Z_OK) {
+        error = "Failed to set up decompression";
+        // Nothing to release for a stream that failed to initialize.
+        inflater->stream = z_stream{};
+        return nullptr;
+    }
+    return inflater;
+}
+
+void PayloadDecompressor::release(std::unique_ptr<Inflater> inflater) {
+    if (inflater->capacity > MAXIMUM_POOLED_BUFFER_SIZE) {
+        inflater->buffer.reset();
+        inflater->capacity = 0;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < MAXIMUM_IDLE_INFLATERS) {
+        idle_.push_back(std::move(inflater));
+    }
+}
+
+}
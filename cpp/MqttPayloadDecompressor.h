@@ -0,0 +1,69 @@
+//
+//  MqttPayloadDecompressor.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mqtt {
+
+// Bound on a decompressed payload, well above the packet size the clients accept, against decompression bombs.
+constexpr size_t MAXIMUM_DECOMPRESSED_SIZE = 16 * 1024 * 1024;
+
+/**
+ * Inflates received payloads before they are routed to the subscriptions, so JS only ever sees the original text.
+ *
+ * Deflate payloads may be compressed with a preset dictionary. Dictionaries are registered per client from JS and
+ * picked by the Adler-32 checksum the zlib stream names, so publishers can move to a newly trained dictionary
+ * while subscribers still have the old one registered.
+ *
+ * Inflaters and their output buffers are pooled: a message costs an inflateReset and one copy into the exact-size
+ * payload, instead of an inflateInit with its window and state allocations. Thread safe; dictionaries are read
+ * through a copy-on-write snapshot, so the transport thread never waits for a registration.
+ */
+class PayloadDecompressor {
+public:
+    PayloadDecompressor();
+    ~PayloadDecompressor();
+
+    PayloadDecompressor(const PayloadDecompressor &) = delete;
+    PayloadDecompressor &operator=(const PayloadDecompressor &) = delete;
+
+    /**
+     * Makes dictionary available to deflate payloads that were compressed with it. Registering the same dictionary
+     * again has no effect.
+     */
+    void addDictionary(std::string dictionary);
+
+    size_t dictionaryCount() const;
+
+    /**
+     * Replaces payload with its decompressed form. Returns false with error set, leaving payload untouched, for
+     * an unsupported encoding, corrupt or truncated data, a dictionary that was not registered, or an output larger
+     * than MAXIMUM_DECOMPRESSED_SIZE.
+     */
+    bool decompress(std::string_view encoding, std::string &payload, std::string &error);
+
+private:
+    struct Inflater;
+    using DictionaryMap = std::unordered_map<uint32_t, std::shared_ptr<const std::string>>;
+
+    std::unique_ptr<Inflater> acquire(std::string &error);
+    void release(std::unique_ptr<Inflater> inflater);
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Inflater>> idle_;
+    // Copy-on-write, replaced under mutex_ and read with atomic_load.
+    std::shared_ptr<const DictionaryMap> dictionaries_;
+};
+
+}
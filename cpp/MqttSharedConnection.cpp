@@ -0,0 +1,551 @@
+//
+//  MqttSharedConnection.cpp
+//  d11-mqtt
+//
+
+#include "MqttSharedConnection.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "MqttConstants.h"
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+SharedConnection::SharedConnection(SharedConnectionPool &pool, std::string key)
+: pool_(pool), key_(std::move(key)), routes_(std::make_shared<Routes>()) {}
+
+SharedConnection::~SharedConnection() {
+    if (transport_) {
+        transport_->close();
+    }
+    pool_.release(key_);
+}
+
+void SharedConnection::join(SharedChannel *channel, std::weak_ptr<TransportListener> listener,
+                            const ConnectOptions &options) {
+    bool startConnect = false;
+    bool alreadyConnected = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Member *member = findLocked(channel);
+        if (member == nullptr) {
+            members_.emplace_back();
+            member = &members_.back();
+            member->channel = channel;
+        }
+        member->listener = listener;
+        member->joined = true;
+        if (state_ == State::Connected) {
+            alreadyConnected = true;
+        } else if (state_ == State::Idle) {
+            state_ = State::Connecting;
+            startConnect = true;
+        }
+    }
+    if (startConnect) {
+        transport_->connect(options);
+    } else if (alreadyConnected) {
+        if (auto client = listener.lock()) {
+            client->onConnected(0);
+        }
+    }
+}
+
+void SharedConnection::leave(SharedChannel *channel, bool remove) {
+    std::vector<std::string> unsubscribe;
+    std::vector<uint64_t> acknowledgements;
+    bool disconnect = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto member = std::find_if(members_.begin(), members_.end(),
+                                   [channel](const Member &candidate) { return candidate.channel == channel; });
+        if (member == members_.end()) {
+            return;
+        }
+        member->joined = false;
+        releaseLocked(*member, unsubscribe, acknowledgements);
+        if (remove) {
+            members_.erase(member);
+        }
+        rebuildRoutesLocked();
+        if (!anyJoinedLocked() && state_ != State::Idle) {
+            state_ = State::Idle;
+            disconnecting_ = true;
+            disconnect = true;
+        } else if (state_ != State::Connected) {
+            unsubscribe.clear();
+        }
+    }
+    if (disconnect) {
+        transport_->disconnect();
+        return;
+    }
+    for (uint64_t acknowledgement : acknowledgements) {
+        transport_->acknowledge(acknowledgement);
+    }
+    for (const auto &filter : unsubscribe) {
+        transport_->unsubscribe(filter);
+    }
+}
+
+void SharedConnection::subscribe(SharedChannel *channel, const std::vector<std::pair<std::string, int>> &filters) {
+    std::vector<std::pair<std::string, int>> send;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Member *member = findLocked(channel);
+        // Clients subscribe once connected; until then there is nothing to send.
+        if (member == nullptr || !member->joined || state_ != State::Connected) {
+            return;
+        }
+        for (const auto &filter : filters) {
+            member->filters[filter.first] = filter.second;
+        }
+        for (const auto &filter : filters) {
+            send.emplace_back(filter.first, maxQosLocked(filter.first));
+        }
+        rebuildRoutesLocked();
+    }
+    if (send.size() == 1) {
+        transport_->subscribe(send[0].first, send[0].second);
+    } else if (!send.empty()) {
+        transport_->subscribeMany(send);
+    }
+}
+
+void SharedConnection::unsubscribe(SharedChannel *channel, const std::string &topic) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Member *member = findLocked(channel);
+        if (member == nullptr || member->filters.erase(topic) == 0) {
+            return;
+        }
+        rebuildRoutesLocked();
+        if (hasFilterLocked(topic) || state_ != State::Connected) {
+            return;
+        }
+        unsubscribers_[topic] = channel;
+    }
+    transport_->unsubscribe(topic);
+}
+
+void SharedConnection::publish(SharedChannel *channel, const std::string &topic, const uint8_t *payload, size_t size,
+                               int qos, bool retain) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (Member *member = findLocked(channel)) {
+            member->publishedTopics.insert(topic);
+        }
+    }
+    transport_->publish(topic, payload, size, qos, retain);
+}
+
+void SharedConnection::acknowledge(SharedChannel *channel, uint64_t acknowledgement) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto pending = pendingAcknowledgements_.find(acknowledgement);
+        if (pending == pendingAcknowledgements_.end()) {
+            return;
+        }
+        auto &waiting = pending->second;
+        auto found = std::find(waiting.begin(), waiting.end(), channel);
+        if (found != waiting.end()) {
+            waiting.erase(found);
+        }
+        if (!waiting.empty()) {
+            return;
+        }
+        pendingAcknowledgements_.erase(pending);
+    }
+    transport_->acknowledge(acknowledgement);
+}
+
+size_t SharedConnection::channelCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return members_.size();
+}
+
+void SharedConnection::onConnected(int reasonCode) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (disconnecting_ && !anyJoinedLocked()) {
+            // CONNACK of an attempt given up on before it completed; the disconnect follows.
+            return;
+        }
+        disconnecting_ = false;
+        state_ = State::Connected;
+        listeners = listenersLocked(nullptr);
+    }
+    for (const auto &listener : listeners) {
+        listener->onConnected(reasonCode);
+    }
+}
+
+void SharedConnection::onConnectionFailed(int reasonCode, const std::string &errorMessage,
+                                          const std::string &errorCause) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (disconnecting_) {
+            disconnecting_ = false;
+            return;
+        }
+        listeners = connectionDownLocked();
+    }
+    for (const auto &listener : listeners) {
+        listener->onConnectionFailed(reasonCode, errorMessage, errorCause);
+    }
+}
+
+void SharedConnection::onDisconnected(int reasonCode, const std::string &errorMessage) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (disconnecting_) {
+            disconnecting_ = false;
+            return;
+        }
+        listeners = connectionDownLocked();
+    }
+    for (const auto &listener : listeners) {
+        listener->onDisconnected(reasonCode, errorMessage);
+    }
+}
+
+void SharedConnection::onSubscribed(const std::string &topic, int qos, const std::string &message) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners = listenersLocked(&topic);
+    }
+    for (const auto &listener : listeners) {
+        listener->onSubscribed(topic, qos, message);
+    }
+}
+
+void SharedConnection::onSubscribeFailed(const std::string &topic, int reasonCode, const std::string &errorMessage) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listeners = listenersLocked(&topic);
+    }
+    for (const auto &listener : listeners) {
+        listener->onSubscribeFailed(topic, reasonCode, errorMessage);
+    }
+}
+
+void SharedConnection::onUnsubscribeFailed(const std::string &topic, const std::string &errorMessage) {
+    std::shared_ptr<TransportListener> listener;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto unsubscriber = unsubscribers_.find(topic);
+        if (unsubscriber == unsubscribers_.end()) {
+            return;
+        }
+        if (Member *member = findLocked(unsubscriber->second)) {
+            listener = member->listener.lock();
+        }
+        unsubscribers_.erase(unsubscriber);
+    }
+    if (listener) {
+        listener->onUnsubscribeFailed(topic, errorMessage);
+    }
+}
+
+void SharedConnection::onPublishFailed(const std::string &topic, const std::string &errorMessage) {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &member : members_) {
+            if (member.publishedTopics.count(topic) == 0) {
+                continue;
+            }
+            if (auto listener = member.listener.lock()) {
+                listeners.push_back(std::move(listener));
+            }
+        }
+    }
+    for (const auto &listener : listeners) {
+        listener->onPublishFailed(topic, errorMessage);
+    }
+}
+
+void SharedConnection::onMessage(const std::string &topic, std::string payload, int qos, int64_t receivedAt,
+                                 uint64_t acknowledgement, const UserProperties &userProperties) {
+    MQTT_TRACE_SECTION("mqtt::SharedConnection::onMessage");
+    auto routes = std::atomic_load(&routes_);
+    std::vector<size_t> targets;
+    routes->filters.forEachMatch(topic, [&targets](size_t index) {
+        // One copy per client, however many of its filters match.
+        if (std::find(targets.begin(), targets.end(), index) == targets.end()) {
+            targets.push_back(index);
+        }
+    });
+    if (targets.empty()) {
+        if (acknowledgement != 0) {
+            transport_->acknowledge(acknowledgement);
+        }
+        return;
+    }
+    if (acknowledgement != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &waiting = pendingAcknowledgements_[acknowledgement];
+        for (size_t index : targets) {
+            waiting.push_back(routes->routes[index].channel);
+        }
+    }
+    for (size_t i = 0; i < targets.size(); i++) {
+        const Route &route = routes->routes[targets[i]];
+        auto listener = route.listener.lock();
+        if (!listener) {
+            if (acknowledgement != 0) {
+                acknowledge(route.channel, acknowledgement);
+            }
+            continue;
+        }
+        bool last = i + 1 == targets.size();
+        // Each client decompresses with its own dictionaries and filters with its own subscriptions.
+        listener->onMessage(topic, last ? std::move(payload) : payload, qos, receivedAt, acknowledgement,
+                            userProperties);
+    }
+}
+
+SharedConnection::Member *SharedConnection::findLocked(SharedChannel *channel) {
+    for (auto &member : members_) {
+        if (member.channel == channel) {
+            return &member;
+        }
+    }
+    return nullptr;
+}
+
+int SharedConnection::maxQosLocked(const std::string &filter) const {
+    int qos = 0;
+    for (const auto &member : members_) {
+        auto found = member.filters.find(filter);
+        if (found != member.filters.end()) {
+            qos = std::max(qos, found->second);
+        }
+    }
+    return qos;
+}
+
+bool SharedConnection::hasFilterLocked(const std::string &filter) const {
+    for (const auto &member : members_) {
+        if (member.filters.count(filter) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SharedConnection::anyJoinedLocked() const {
+    for (const auto &member : members_) {
+        if (member.joined) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SharedConnection::releaseLocked(Member &member, std::vector<std::string> &unsubscribe,
+                                     std::vector<uint64_t> &acknowledgements) {
+    auto filters = std::move(member.filters);
+    member.filters.clear();
+    member.publishedTopics.clear();
+    for (const auto &filter : filters) {
+        if (!hasFilterLocked(filter.first)) {
+            unsubscribe.push_back(filter.first);
+        }
+    }
+    for (auto pending = pendingAcknowledgements_.begin(); pending != pendingAcknowledgements_.end();) {
+        auto &waiting = pending->second;
+        waiting.erase(std::remove(waiting.begin(), waiting.end(), member.channel), waiting.end());
+        if (waiting.empty()) {
+            acknowledgements.push_back(pending->first);
+            pending = pendingAcknowledgements_.erase(pending);
+        } else {
+            ++pending;
+        }
+    }
+    for (auto unsubscriber = unsubscribers_.begin(); unsubscriber != unsubscribers_.end();) {
+        if (unsubscriber->second == member.channel) {
+            unsubscriber = unsubscribers_.erase(unsubscriber);
+        } else {
+            ++unsubscriber;
+        }
+    }
+}
+
+void SharedConnection::rebuildRoutesLocked() {
+    auto routes = std::make_shared<Routes>();
+    for (const auto &member : members_) {
+        if (member.filters.empty()) {
+            continue;
+        }
+        size_t index = routes->routes.size();
+        routes->routes.push_back(Route{member.channel, member.listener});
+        for (const auto &filter : member.filters) {
+            routes->filters.insert(filter.first, index);
+        }
+    }
+    std::atomic_store(&routes_, std::shared_ptr<const Routes>(std::move(routes)));
+}
+
+std::vector<std::shared_ptr<TransportListener>> SharedConnection::listenersLocked(const std::string *filter) const {
+    std::vector<std::shared_ptr<TransportListener>> listeners;
+    for (const auto &member : members_) {
+        bool wanted = filter == nullptr ? member.joined : member.filters.count(*filter) != 0;
+        if (!wanted) {
+            continue;
+        }
+        if (auto listener = member.listener.lock()) {
+            listeners.push_back(std::move(listener));
+        }
+    }
+    return listeners;
+}
+
+std::vector<std::shared_ptr<TransportListener>> SharedConnection::connectionDownLocked() {
+    state_ = State::Idle;
+    for (auto &member : members_) {
+        member.filters.clear();
+    }
+    // Acknowledgements of the lost connection are not sent anymore, the broker delivers those messages again.
+    pendingAcknowledgements_.clear();
+    unsubscribers_.clear();
+    rebuildRoutesLocked();
+    return listenersLocked(nullptr);
+}
+
+SharedConnectionPool &SharedConnectionPool::shared() {
+    static SharedConnectionPool *pool = new SharedConnectionPool();
+    return *pool;
+}
+
+std::shared_ptr<SharedConnection> SharedConnectionPool::acquire(const std::string &clientId, const std::string &host,
+                                                                int port, const ConnectOptions &options,
+                                                                const SharedTransportFactory &factory) {
+    std::string key = host + '\0' + std::to_string(port) + '\0' + options.username + '\0' + options.password;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = connections_[key];
+    auto connection = slot.lock();
+    if (!connection) {
+        connection = std::make_shared<SharedConnection>(*this, key);
+        // Under the lock, so a concurrent acquire never sees the connection without its transport.
+        connection->transport_ = factory(clientId, host, port, connection);
+        slot = connection;
+    }
+    return connection;
+}
+
+size_t SharedConnectionPool::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_.size();
+}
+
+void SharedConnectionPool::release(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto connection = connections_.find(key);
+    // A connection opened for the same key in the meantime stays.
+    if (connection != connections_.end() && connection->second.expired()) {
+        connections_.erase(connection);
+    }
+}
+
+SharedChannel::SharedChannel(std::string clientId, std::string host, int port, SharedTransportFactory factory,
+                             SharedConnectionPool &pool)
+: clientId_(std::move(clientId)), host_(std::move(host)), port_(port), factory_(std::move(factory)), pool_(pool) {}
+
+SharedChannel::~SharedChannel() {
+    close();
+}
+
+void SharedChannel::attach(std::weak_ptr<TransportListener> listener) {
+    listener_ = std::move(listener);
+}
+
+void SharedChannel::connect(const ConnectOptions &options) {
+    auto connection = pool_.acquire(clientId_, host_, port_, options, factory_);
+    std::shared_ptr<SharedConnection> previous;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        if (connection_ != connection) {
+            // New credentials: the client moves to the connection that uses them.
+            previous = std::move(connection_);
+            connection_ = connection;
+        }
+    }
+    if (previous) {
+        previous->leave(this, true);
+    }
+    connection->join(this, listener_, options);
+}
+
+void SharedChannel::disconnect() {
+    if (auto connection = this->connection()) {
+        connection->leave(this, false);
+    }
+    if (auto listener = listener_.lock()) {
+        listener->onDisconnected(NORMAL_DISCONNECTION, "");
+    }
+}
+
+void SharedChannel::subscribe(const std::string &topic, int qos) {
+    if (auto connection = this->connection()) {
+        connection->subscribe(this, {{topic, qos}});
+    }
+}
+
+void SharedChannel::subscribeMany(const std::vector<std::pair<std::string, int>> &filters) {
+    if (auto connection = this->connection()) {
+        connection->subscribe(this, filters);
+    }
+}
+
+void SharedChannel::unsubscribe(const std::string &topic) {
+    if (auto connection = this->connection()) {
+        connection->unsubscribe(this, topic);
+    }
+}
+
+void SharedChannel::publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) {
+    if (auto connection = this->connection()) {
+        connection->publish(this, topic, payload, size, qos, retain);
+    } else if (auto listener = listener_.lock()) {
+        listener->onPublishFailed(topic, "Failed to publish message on topic: " + topic + " (not connected)");
+    }
+}
+
+void SharedChannel::acknowledge(uint64_t acknowledgement) {
+    if (auto connection = this->connection()) {
+        connection->acknowledge(this, acknowledgement);
+    }
+}
+
+void SharedChannel::close() {
+    std::shared_ptr<SharedConnection> connection;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        connection = std::move(connection_);
+    }
+    if (connection) {
+        connection->leave(this, true);
+    }
+}
+
+std::shared_ptr<SharedConnection> SharedChannel::connection() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connection_;
+}
+
+}
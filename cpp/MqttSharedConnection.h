@@ -0,0 +1,225 @@
+//
+//  MqttSharedConnection.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "MqttTopicTrie.h"
+#include "MqttTransport.h"
+
+namespace mqtt {
+
+class SharedChannel;
+class SharedConnectionPool;
+
+/**
+ * Creates the transport of a shared connection and attaches listener to it. clientId is the MQTT client identifier
+ * the connection uses: the one of the logical client that opened it.
+ */
+using SharedTransportFactory = std::function<std::shared_ptr<Transport>(
+    const std::string &clientId, const std::string &host, int port, std::weak_ptr<TransportListener> listener)>;
+
+/**
+ * One physical connection shared by the logical clients (SharedChannels) that connect to the same host, port and
+ * credentials. The broker sees a single client with the union of their subscriptions; the connection hands every
+ * outcome back to the logical clients it concerns:
+ *
+ * - CONNACK and connection loss go to the clients that called connect() and not disconnect() since. A client that
+ *   connects while the connection is up is connected right away. The connection is closed once no client wants it.
+ * - A received message goes once to each client with a matching filter. Its acknowledgement is sent once every one
+ *   of them acknowledged it, so flow control of one client holds the broker back for all of them.
+ * - SUBACK, unsubscribe and publish failures go to the clients that subscribed, unsubscribed or published the topic.
+ * - A filter is unsubscribed from the broker when the last client holding it unsubscribes or disconnects, and
+ *   subscribed with the highest QoS any client asked for.
+ *
+ * The first client's connect options (keep alive, clean session, receive maximum) apply to the connection. Calls
+ * come from the clients' threads and the transport's; the lock is never held while calling out. Received messages
+ * are routed through a copy-on-write snapshot of the filters, so the transport thread does not take it.
+ */
+class SharedConnection : public TransportListener, public std::enable_shared_from_this<SharedConnection> {
+public:
+    SharedConnection(SharedConnectionPool &pool, std::string key);
+    ~SharedConnection() override;
+
+    SharedConnection(const SharedConnection &) = delete;
+    SharedConnection &operator=(const SharedConnection &) = delete;
+
+    void join(SharedChannel *channel, std::weak_ptr<TransportListener> listener, const ConnectOptions &options);
+
+    /**
+     * The channel no longer wants the connection: its filters are dropped, and the connection is disconnected when
+     * no other channel wants it. With remove, the channel is forgotten altogether (it was closed or switched to
+     * another connection).
+     */
+    void leave(SharedChannel *channel, bool remove);
+
+    void subscribe(SharedChannel *channel, const std::vector<std::pair<std::string, int>> &filters);
+    void unsubscribe(SharedChannel *channel, const std::string &topic);
+    void publish(SharedChannel *channel, const std::string &topic, const uint8_t *payload, size_t size, int qos,
+                 bool retain);
+    void acknowledge(SharedChannel *channel, uint64_t acknowledgement);
+
+    /**
+     * Logical clients using the connection.
+     */
+    size_t channelCount() const;
+
+    void onConnected(int reasonCode) override;
+    void onConnectionFailed(int reasonCode, const std::string &errorMessage, const std::string &errorCause) override;
+    void onDisconnected(int reasonCode, const std::string &errorMessage) override;
+    void onSubscribed(const std::string &topic, int qos, const std::string &message) override;
+    void onSubscribeFailed(const std::string &topic, int reasonCode, const std::string &errorMessage) override;
+    void onUnsubscribeFailed(const std::string &topic, const std::string &errorMessage) override;
+    void onPublishFailed(const std::string &topic, const std::string &errorMessage) override;
+    void onMessage(const std::string &topic, std::string payload, int qos, int64_t receivedAt = 0,
+                   uint64_t acknowledgement = 0, const UserProperties &userProperties = {}) override;
+
+private:
+    friend class SharedConnectionPool;
+
+    enum class State { Idle, Connecting, Connected };
+
+    struct Member {
+        SharedChannel *channel = nullptr;
+        std::weak_ptr<TransportListener> listener;
+        // Between connect() and disconnect() of the channel.
+        bool joined = false;
+        // Filter to requested QoS.
+        std::unordered_map<std::string, int> filters;
+        std::unordered_set<std::string> publishedTopics;
+    };
+
+    struct Route {
+        SharedChannel *channel;
+        std::weak_ptr<TransportListener> listener;
+    };
+
+    /**
+     * Filters of the members, rebuilt whenever they change.
+     */
+    struct Routes {
+        std::vector<Route> routes;
+        // Values index routes.
+        TopicTrie<size_t> filters;
+    };
+
+    Member *findLocked(SharedChannel *channel);
+    int maxQosLocked(const std::string &filter) const;
+    bool hasFilterLocked(const std::string &filter) const;
+    bool anyJoinedLocked() const;
+
+    /**
+     * Drops the member's filters and pending acknowledgements; appends the filters nobody else holds to unsubscribe
+     * and the acknowledgements that are now complete to acknowledgements.
+     */
+    void releaseLocked(Member &member, std::vector<std::string> &unsubscribe, std::vector<uint64_t> &acknowledgements);
+    void rebuildRoutesLocked();
+
+    /**
+     * Listeners of the joined members, or of those holding filter when it is not null.
+     */
+    std::vector<std::shared_ptr<TransportListener>> listenersLocked(const std::string *filter) const;
+
+    /**
+     * Marks the connection down after a loss or a failed attempt, forgetting every filter since the clients send
+     * them again on the next connect. Returns the listeners to tell.
+     */
+    std::vector<std::shared_ptr<TransportListener>> connectionDownLocked();
+
+    SharedConnectionPool &pool_;
+    const std::string key_;
+    // Set once by the pool right after construction.
+    std::shared_ptr<Transport> transport_;
+
+    mutable std::mutex mutex_;
+    State state_ = State::Idle;
+    // The connection disconnects itself; the transport's disconnect callback is not passed on.
+    bool disconnecting_ = false;
+    std::vector<Member> members_;
+    // Acknowledgement to the channels that have not acknowledged the message yet.
+    std::unordered_map<uint64_t, std::vector<SharedChannel *>> pendingAcknowledgements_;
+    std::unordered_map<std::string, SharedChannel *> unsubscribers_;
+    // Copy-on-write, replaced under mutex_ and read with atomic_load on the transport's thread.
+    std::shared_ptr<const Routes> routes_;
+};
+
+/**
+ * Process wide map of the open shared connections by host, port and credentials.
+ */
+class SharedConnectionPool {
+public:
+    static SharedConnectionPool &shared();
+
+    /**
+     * The connection for host, port and the credentials in options, opened with factory if there is none.
+     */
+    std::shared_ptr<SharedConnection> acquire(const std::string &clientId, const std::string &host, int port,
+                                              const ConnectOptions &options, const SharedTransportFactory &factory);
+
+    /**
+     * Open connections.
+     */
+    size_t size() const;
+
+private:
+    friend class SharedConnection;
+
+    void release(const std::string &key);
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::weak_ptr<SharedConnection>> connections_;
+};
+
+/**
+ * Transport of a client created with shareConnection: commands go to the SharedConnection of the host, port and
+ * credentials of the last connect(), joined on connect and left on close or when the credentials change.
+ */
+class SharedChannel : public Transport {
+public:
+    SharedChannel(std::string clientId, std::string host, int port, SharedTransportFactory factory,
+                  SharedConnectionPool &pool = SharedConnectionPool::shared());
+    ~SharedChannel() override;
+
+    /**
+     * Sets the client that receives the transport callbacks. Must be called before connect().
+     */
+    void attach(std::weak_ptr<TransportListener> listener);
+
+    void connect(const ConnectOptions &options) override;
+    void disconnect() override;
+    void subscribe(const std::string &topic, int qos) override;
+    void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) override;
+    void unsubscribe(const std::string &topic) override;
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) override;
+    void acknowledge(uint64_t acknowledgement) override;
+    void close() override;
+
+private:
+    std::shared_ptr<SharedConnection> connection() const;
+
+    const std::string clientId_;
+    const std::string host_;
+    const int port_;
+    const SharedTransportFactory factory_;
+    SharedConnectionPool &pool_;
+    std::weak_ptr<TransportListener> listener_;
+
+    mutable std::mutex mutex_;
+    // Joined on connect; null before and after close().
+    std::shared_ptr<SharedConnection> connection_;
+    bool closed_ = false;
+};
+
+}
@@ -0,0 +1,937 @@
+//
+//  MqttSocketTransport.cpp
+//  d11-mqtt
+//
+
+#include "MqttSocketTransport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+#include "MqttConstants.h"
+#include "MqttTopic.h"
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+namespace {
+
+constexpr size_t READ_CHUNK_SIZE = 16 * 1024;
+// Bounds the time one connection keeps the loop busy before others get their turn.
+constexpr int MAX_READS_PER_WAKEUP = 16;
+// Matches the limit the platform clients announce.
+constexpr uint32_t MAXIMUM_PACKET_SIZE = 1024 * 1024;
+constexpr auto CONNECT_TIMEOUT = std::chrono::seconds(10);
+// Bound on the filters of one SUBSCRIBE sent by subscribeMany, well below the packet size brokers accept.
+constexpr size_t SUBSCRIBE_BATCH_BYTES = 64 * 1024;
+// Bound on the packets queued behind a send() that has not drained yet, i.e. on a slow or stalled connection.
+constexpr size_t MAX_OUTBOX_BYTES = 8 * 1024 * 1024;
+// An aliased repeat costs an empty topic and a 3 byte property, so shorter topics are sent as they are.
+constexpr size_t MIN_ALIASED_TOPIC_LENGTH = 4;
+
+// MQTT 5 reason codes used by the engine itself.
+constexpr uint8_t REASON_MALFORMED_PACKET = 0x81;
+// DISCONNECT reason codes of a broker refusing one PUBLISH (section 3.14.2.1).
+constexpr uint8_t REASON_TOPIC_NAME_INVALID = 0x90;
+constexpr uint8_t REASON_PAYLOAD_FORMAT_INVALID = 0x99;
+constexpr uint8_t REASON_RETAIN_NOT_SUPPORTED = 0x9A;
+constexpr uint8_t REASON_QOS_NOT_SUPPORTED = 0x9B;
+constexpr uint8_t REASON_PACKET_TOO_LARGE = 0x95;
+constexpr uint8_t REASON_KEEP_ALIVE_TIMEOUT = 0x8D;
+
+#if defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+// Layout of the acknowledgements handed to Client::onMessage: connection, PUBREC flag and packet identifier.
+constexpr uint64_t ACKNOWLEDGE_PUBREC = 1ull << 16;
+constexpr int ACKNOWLEDGE_CONNECTION_SHIFT = 32;
+
+std::string errnoMessage(int error) {
+    return std::string(std::strerror(error));
+}
+
+bool isPublishRejection(uint8_t reasonCode) {
+    return reasonCode == REASON_TOPIC_NAME_INVALID || reasonCode == REASON_PACKET_TOO_LARGE ||
+           reasonCode == REASON_PAYLOAD_FORMAT_INVALID || reasonCode == REASON_RETAIN_NOT_SUPPORTED ||
+           reasonCode == REASON_QOS_NOT_SUPPORTED;
+}
+
+std::string reasonMessage(const char *prefix, const std::string &topic, uint8_t reasonCode) {
+    char code[8];
+    snprintf(code, sizeof(code), "0x%02X", reasonCode);
+    return std::string(prefix) + topic + " (reason code " + code + ")";
+}
+
+}
+
+SocketTransport::SocketTransport(std::string clientId, std::string host, int port, EventLoop &loop)
+: clientId_(std::move(clientId)), host_(std::move(host)), port_(port), loop_(loop), reader_(MAXIMUM_PACKET_SIZE) {}
+
+SocketTransport::~SocketTransport() {
+    // self_ keeps the transport alive while a socket is open, so there is nothing left to unregister here.
+}
+
+void SocketTransport::attach(std::weak_ptr<TransportListener> listener) {
+    listener_ = std::move(listener);
+}
+
+void SocketTransport::setOutboundStore(std::unique_ptr<OutboundStore> store) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    store_ = std::move(store);
+}
+
+void SocketTransport::connect(const ConnectOptions &options) {
+    auto self = shared_from_this();
+    loop_.post([self, options] { self->startConnect(options); });
+}
+
+void SocketTransport::disconnect() {
+    auto self = shared_from_this();
+    loop_.post([self] {
+        if (self->closed_ || self->state_ == State::Idle) {
+            return;
+        }
+        bool wasConnected = self->state_ == State::Connected;
+        if (wasConnected) {
+            // Best effort: the socket is closed right after, whatever send() manages to write.
+            std::vector<uint8_t> packet;
+            PacketWriter(packet).disconnect();
+            ssize_t sent = send(self->fd_, packet.data(), packet.size(), SEND_FLAGS);
+            (void)sent;
+        }
+        self->closeSocket();
+        if (auto listener = self->listener_.lock()) {
+            listener->onDisconnected(NORMAL_DISCONNECTION, "");
+        }
+    });
+}
+
+void SocketTransport::subscribe(const std::string &topic, int qos) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            return;
+        }
+        uint16_t packetId = nextPacketIdLocked();
+        TopicFilter filter{topic, static_cast<uint8_t>(qos)};
+        PacketWriter(outbox_).subscribe(packetId, &filter, 1);
+        pendingSubscribes_[packetId] = {topic};
+    }
+    scheduleFlush();
+}
+
+void SocketTransport::subscribeMany(const std::vector<std::pair<std::string, int>> &filters) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            return;
+        }
+        std::vector<TopicFilter> batch;
+        std::vector<std::string> topics;
+        size_t batchBytes = 0;
+        for (size_t i = 0; i < filters.size(); i++) {
+            batch.push_back(TopicFilter{filters[i].first, static_cast<uint8_t>(filters[i].second)});
+            topics.push_back(filters[i].first);
+            // Length prefix, filter and subscription options.
+            batchBytes += 2 + filters[i].first.size() + 1;
+            bool last = i + 1 == filters.size();
+            if (!last && batchBytes + 3 + filters[i + 1].first.size() <= SUBSCRIBE_BATCH_BYTES) {
+                continue;
+            }
+            uint16_t packetId = nextPacketIdLocked();
+            PacketWriter(outbox_).subscribe(packetId, batch.data(), batch.size());
+            pendingSubscribes_[packetId] = std::move(topics);
+            batch.clear();
+            topics.clear();
+            batchBytes = 0;
+        }
+    }
+    scheduleFlush();
+}
+
+void SocketTransport::unsubscribe(const std::string &topic) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            return;
+        }
+        uint16_t packetId = nextPacketIdLocked();
+        std::string_view filter = topic;
+        PacketWriter(outbox_).unsubscribe(packetId, &filter, 1);
+        pendingUnsubscribes_[packetId] = topic;
+    }
+    scheduleFlush();
+}
+
+void SocketTransport::publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) {
+    const char *failure = nullptr;
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PublishPacket packet;
+        packet.topic = topic;
+        packet.payload = payload;
+        packet.payloadSize = size;
+        packet.qos = static_cast<uint8_t>(qos);
+        packet.retain = retain;
+        // Beyond the broker's Receive Maximum a QoS 1/2 publish waits for an acknowledgement (section 4.9).
+        bool hold = qos > 0 && connected_ && pendingPublishes_.size() >= receiveMaximum_;
+        if (qos > 0 && connected_ && !hold) {
+            packet.packetId = nextPacketIdLocked();
+        }
+        uint64_t sequence = 0;
+        // Checked before the store: a stored publish the broker disconnects for would be replayed on every connect.
+        if (const char *invalid = invalidTopicName(topic)) {
+            failure = invalid;
+        } else if (!PacketWriter::encodable(packet)) {
+            failure = "packet too large";
+        } else if (exceedsMaximumPacketSizeLocked(packet)) {
+            failure = "larger than the broker's maximum packet size";
+        } else if (connected_ && outbox_.size() + heldBytes_ >= MAX_OUTBOX_BYTES) {
+            failure = "outbound queue full";
+        } else if (qos > 0 && store_) {
+            // Stored while disconnected too; replayed after the next CONNACK.
+            sequence = store_->append(topic, payload, size, packet.qos, retain, packet.packetId);
+            if (sequence == 0) {
+                failure = "outbound store full";
+            }
+        } else if (!connected_) {
+            failure = "not connected";
+        }
+        if (failure == nullptr && hold) {
+            heldPublishes_.push_back(HeldPublish{topic, std::string(reinterpret_cast<const char *>(payload), size),
+                                                 packet.qos, retain, sequence});
+            heldBytes_ += topic.size() + size;
+        } else if (failure == nullptr && connected_) {
+            if (qos > 0) {
+                pendingPublishes_[packet.packetId] = PendingPublish{topic, sequence};
+            }
+            assignTopicAliasLocked(topic, packet);
+            PacketWriter(outbox_).publish(packet);
+            queued = true;
+        }
+    }
+    if (failure != nullptr) {
+        if (auto listener = listener_.lock()) {
+            listener->onPublishFailed(topic, "Failed to publish message on topic: " + topic + " (" + failure + ")");
+        }
+        return;
+    }
+    if (queued) {
+        scheduleFlush();
+    }
+}
+
+size_t SocketTransport::topicAliasCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return topicAliases_.size();
+}
+
+void SocketTransport::acknowledge(uint64_t acknowledgement) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_ || (acknowledgement >> ACKNOWLEDGE_CONNECTION_SHIFT) != connection_) {
+            // The broker sends the message again on the next connection.
+            return;
+        }
+        auto packetId = static_cast<uint16_t>(acknowledgement & 0xFFFF);
+        PacketWriter(outbox_).ack(acknowledgement & ACKNOWLEDGE_PUBREC ? PacketType::Pubrec : PacketType::Puback,
+                                  packetId);
+    }
+    scheduleFlush();
+}
+
+void SocketTransport::close() {
+    auto self = shared_from_this();
+    loop_.post([self] {
+        self->closed_ = true;
+        self->closeSocket();
+        self->listener_.reset();
+    });
+}
+
+uint16_t SocketTransport::nextPacketIdLocked() {
+    // Packet identifiers are non-zero (section 2.2.1) and must not be reused while a publish still holds one.
+    do {
+        if (++packetId_ == 0) {
+            packetId_ = 1;
+        }
+    } while (pendingPublishes_.count(packetId_) != 0);
+    return packetId_;
+}
+
+std::string SocketTransport::completeRejectedLocked() {
+    // The broker handles packets in order and acknowledged every publish before the one it refused, so that is the
+    // oldest one still unacknowledged.
+    auto rejected = pendingPublishes_.end();
+    for (auto it = pendingPublishes_.begin(); it != pendingPublishes_.end(); ++it) {
+        if (it->second.sequence != 0 && !it->second.released &&
+            (rejected == pendingPublishes_.end() || it->second.sequence < rejected->second.sequence)) {
+            rejected = it;
+        }
+    }
+    if (rejected == pendingPublishes_.end()) {
+        return std::string();
+    }
+    store_->complete(rejected->second.sequence);
+    std::string topic = std::move(rejected->second.topic);
+    pendingPublishes_.erase(rejected);
+    return topic;
+}
+
+bool SocketTransport::exceedsMaximumPacketSizeLocked(const PublishPacket &packet) const {
+    return maximumPacketSize_ != 0 && PacketWriter::publishSize(packet) > maximumPacketSize_;
+}
+
+bool SocketTransport::sendHeldLocked() {
+    bool sent = false;
+    while (!heldPublishes_.empty() && pendingPublishes_.size() < receiveMaximum_) {
+        HeldPublish held = std::move(heldPublishes_.front());
+        heldPublishes_.pop_front();
+        heldBytes_ -= held.topic.size() + held.payload.size();
+        PublishPacket packet;
+        packet.topic = held.topic;
+        packet.payload = reinterpret_cast<const uint8_t *>(held.payload.data());
+        packet.payloadSize = held.payload.size();
+        packet.qos = held.qos;
+        packet.retain = held.retain;
+        packet.packetId = nextPacketIdLocked();
+        if (held.sequence != 0) {
+            store_->assignPacketId(held.sequence, packet.packetId);
+        }
+        pendingPublishes_[packet.packetId] = PendingPublish{held.topic, held.sequence};
+        assignTopicAliasLocked(held.topic, packet);
+        PacketWriter(outbox_).publish(packet);
+        sent = true;
+    }
+    return sent;
+}
+
+void SocketTransport::assignTopicAliasLocked(const std::string &topic, PublishPacket &packet) {
+    if (topicAliasMaximum_ == 0 || topic.size() < MIN_ALIASED_TOPIC_LENGTH) {
+        return;
+    }
+    auto it = topicAliases_.find(topic);
+    if (it != topicAliases_.end()) {
+        packet.topic = std::string_view();
+        packet.topicAlias = it->second;
+        return;
+    }
+    if (topicAliases_.size() < topicAliasMaximum_) {
+        // Sent with the full topic this once, which tells the broker what the alias stands for.
+        packet.topicAlias = static_cast<uint16_t>(topicAliases_.size() + 1);
+        topicAliases_.emplace(topic, packet.topicAlias);
+    }
+}
+
+void SocketTransport::scheduleFlush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (flushScheduled_) {
+            return;
+        }
+        flushScheduled_ = true;
+    }
+    auto self = shared_from_this();
+    loop_.post([self] { self->flush(); });
+}
+
+void SocketTransport::startConnect(const ConnectOptions &options) {
+    if (closed_ || state_ != State::Idle) {
+        return;
+    }
+    options_ = options;
+    state_ = State::Resolving;
+    uint64_t attempt = ++attempt_;
+    auto self = shared_from_this();
+    connectTimer_ = loop_.addTimer(CONNECT_TIMEOUT, [self, attempt] {
+        if (self->attempt_ == attempt && self->state_ != State::Connected && self->state_ != State::Idle) {
+            self->connectTimer_ = 0;
+            self->connectionFailed(CONNECTION_ERROR, "Connection timed out", "");
+        }
+    });
+
+    // getaddrinfo blocks, so it runs off the loop and posts its result back.
+    std::string host = host_;
+    std::string port = std::to_string(port_);
+    std::thread([self, attempt, host, port] {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *result = nullptr;
+        int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+        std::shared_ptr<addrinfo> addresses(result, [](addrinfo *info) {
+            if (info != nullptr) {
+                freeaddrinfo(info);
+            }
+        });
+        std::string error = status == 0 ? std::string() : std::string(gai_strerror(status));
+        self->loop_.post([self, attempt, addresses, error] { self->onResolved(attempt, addresses, error); });
+    }).detach();
+}
+
+void SocketTransport::onResolved(uint64_t attempt, std::shared_ptr<addrinfo> addresses, const std::string &error) {
+    if (closed_ || attempt != attempt_ || state_ != State::Resolving) {
+        return;
+    }
+    if (!error.empty() || !addresses) {
+        connectionFailed(CONNECTION_ERROR, "Failed to resolve " + host_, error);
+        return;
+    }
+    addresses_ = std::move(addresses);
+    nextAddress_ = addresses_.get();
+    lastSocketError_.clear();
+    connectNextAddress();
+}
+
+void SocketTransport::connectNextAddress() {
+    while (nextAddress_ != nullptr) {
+        addrinfo *address = nextAddress_;
+        nextAddress_ = address->ai_next;
+
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            lastSocketError_ = errnoMessage(errno);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#if defined(SO_NOSIGPIPE)
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        int result = ::connect(fd, address->ai_addr, address->ai_addrlen);
+        if (result < 0 && errno != EINPROGRESS) {
+            lastSocketError_ = errnoMessage(errno);
+            ::close(fd);
+            continue;
+        }
+        fd_ = fd;
+        self_ = shared_from_this();
+        state_ = State::Connecting;
+        loop_.watch(fd_, this, true);
+        if (result == 0) {
+            finishConnect();
+        }
+        return;
+    }
+    connectionFailed(CONNECTION_ERROR, "Failed to connect to " + host_ + ":" + std::to_string(port_),
+                     lastSocketError_);
+}
+
+void SocketTransport::finishConnect() {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+        error = errno;
+    }
+    if (error != 0) {
+        lastSocketError_ = errnoMessage(error);
+        loop_.unwatch(fd_);
+        ::close(fd_);
+        fd_ = -1;
+        state_ = State::Resolving;
+        // self_ stays set until the last address failed or connected.
+        connectNextAddress();
+        return;
+    }
+    addresses_.reset();
+    nextAddress_ = nullptr;
+    // Write interest was only needed to learn about the connect result.
+    loop_.update(fd_, false);
+
+    ConnectPacket connect;
+    connect.clientId = clientId_;
+    connect.username = options_.username;
+    connect.password = options_.password;
+    connect.keepAlive = static_cast<uint16_t>(options_.keepAlive);
+    connect.cleanStart = options_.cleanSession;
+    connect.receiveMaximum = static_cast<uint16_t>(std::min(std::max(options_.receiveMaximum, 0), 65535));
+    connect.maximumPacketSize = MAXIMUM_PACKET_SIZE;
+    PacketWriter(sendBuffer_).connect(connect);
+    state_ = State::AwaitingConnack;
+    flush();
+}
+
+void SocketTransport::onReadable() {
+    MQTT_TRACE_SECTION("mqtt::SocketTransport::onReadable");
+    // A lost connection drops self_, which may be the last reference.
+    auto self = shared_from_this();
+    if (state_ == State::Connecting) {
+        finishConnect();
+        return;
+    }
+    for (int i = 0; i < MAX_READS_PER_WAKEUP && fd_ >= 0; i++) {
+        uint8_t *buffer = reader_.prepare(READ_CHUNK_SIZE);
+        ssize_t received = recv(fd_, buffer, READ_CHUNK_SIZE, 0);
+        if (received > 0) {
+            reader_.commit(static_cast<size_t>(received));
+            if (static_cast<size_t>(received) < READ_CHUNK_SIZE) {
+                break;
+            }
+            continue;
+        }
+        if (received == 0) {
+            connectionLost(DISCONNECTION_ERROR, "Connection closed by broker");
+            return;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        connectionLost(DISCONNECTION_ERROR, errnoMessage(errno));
+        return;
+    }
+
+    while (fd_ >= 0) {
+        DecodeStatus status = reader_.next(packet_);
+        if (status == DecodeStatus::Incomplete) {
+            break;
+        }
+        if (status != DecodeStatus::Ok) {
+            PacketWriter(sendBuffer_)
+                .disconnect(status == DecodeStatus::TooLarge ? REASON_PACKET_TOO_LARGE : REASON_MALFORMED_PACKET);
+            flush();
+            connectionLost(DISCONNECTION_ERROR, status == DecodeStatus::TooLarge ? "Packet too large"
+                                                                                  : "Malformed packet");
+            return;
+        }
+        handlePacket(packet_);
+    }
+    // Acks written while handling the packets go out in one send().
+    flush();
+}
+
+void SocketTransport::onWritable() {
+    auto self = shared_from_this();
+    if (state_ == State::Connecting) {
+        finishConnect();
+        return;
+    }
+    flush();
+}
+
+void SocketTransport::handlePacket(const Packet &packet) {
+    if (state_ == State::AwaitingConnack) {
+        if (packet.type == PacketType::Connack) {
+            handleConnack(packet);
+        } else {
+            connectionFailed(CONNECTION_ERROR, "Expected CONNACK", "");
+        }
+        return;
+    }
+    switch (packet.type) {
+        case PacketType::Publish:
+            handlePublish(packet);
+            break;
+        case PacketType::Puback:
+        case PacketType::Pubcomp:
+        case PacketType::Pubrec: {
+            std::string topic;
+            bool failed = packet.reasonCode >= 0x80;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = pendingPublishes_.find(packet.packetId);
+                if (it == pendingPublishes_.end()) {
+                    break;
+                }
+                if (packet.type == PacketType::Pubrec && !failed) {
+                    // The topic stays pending until PUBCOMP.
+                    if (store_) {
+                        store_->release(it->second.sequence);
+                    }
+                    it->second.released = true;
+                    PacketWriter(sendBuffer_).ack(PacketType::Pubrel, packet.packetId);
+                    break;
+                }
+                // A rejected message is not retried either.
+                if (store_) {
+                    store_->complete(it->second.sequence);
+                }
+                topic = std::move(it->second.topic);
+                pendingPublishes_.erase(it);
+                // Written to the outbox, which onReadable() flushes once the packets read are handled.
+                sendHeldLocked();
+            }
+            if (failed) {
+                if (auto listener = listener_.lock()) {
+                    listener->onPublishFailed(topic,
+                                            reasonMessage("Failed to publish message on topic: ", topic,
+                                                          packet.reasonCode));
+                }
+            }
+            break;
+        }
+        case PacketType::Pubrel:
+            incomingQos2_.erase(packet.packetId);
+            PacketWriter(sendBuffer_).ack(PacketType::Pubcomp, packet.packetId);
+            break;
+        case PacketType::Suback:
+            handleSuback(packet);
+            break;
+        case PacketType::Unsuback:
+            handleUnsuback(packet);
+            break;
+        case PacketType::Pingresp:
+            pingOutstanding_ = false;
+            break;
+        case PacketType::Disconnect: {
+            std::string message = packet.properties.reasonString.empty()
+                                      ? std::string("Disconnected by broker")
+                                      : std::string(packet.properties.reasonString);
+            std::string rejected;
+            if (isPublishRejection(packet.reasonCode)) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                rejected = completeRejectedLocked();
+            }
+            connectionLost(packet.reasonCode, message);
+            if (!rejected.empty()) {
+                if (auto listener = listener_.lock()) {
+                    listener->onPublishFailed(rejected, reasonMessage("Failed to publish message on topic: ", rejected,
+                                                                      packet.reasonCode));
+                }
+            }
+            break;
+        }
+        default:
+            PacketWriter(sendBuffer_).disconnect(REASON_MALFORMED_PACKET);
+            flush();
+            connectionLost(DISCONNECTION_ERROR, "Unexpected packet from broker");
+            break;
+    }
+}
+
+void SocketTransport::handleConnack(const Packet &packet) {
+    if (connectTimer_ != 0) {
+        loop_.cancelTimer(connectTimer_);
+        connectTimer_ = 0;
+    }
+    if (packet.reasonCode >= 0x80) {
+        connectionFailed(packet.reasonCode, "Connection refused",
+                         std::string(packet.properties.reasonString));
+        return;
+    }
+    state_ = State::Connected;
+    keepAliveSeconds_ = packet.properties.serverKeepAlive.value_or(static_cast<uint16_t>(options_.keepAlive));
+    pingOutstanding_ = false;
+    // Stored publishes the broker cannot take, completed instead of replayed, and why.
+    std::vector<std::pair<std::string, const char *>> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Nothing queued for an earlier connection may reach this one.
+        outbox_.clear();
+        pendingSubscribes_.clear();
+        pendingUnsubscribes_.clear();
+        pendingPublishes_.clear();
+        // Held publishes went the way of the pending ones: lost, or replayed from the store below.
+        heldPublishes_.clear();
+        heldBytes_ = 0;
+        topicAliasMaximum_ = packet.properties.topicAliasMaximum.value_or(0);
+        topicAliases_.clear();
+        // A Receive Maximum of 0 is a protocol error; it is taken as the default.
+        receiveMaximum_ = std::max<uint16_t>(packet.properties.receiveMaximum.value_or(0xFFFF), 1);
+        maximumPacketSize_ = packet.properties.maximumPacketSize.value_or(0);
+        connection_++;
+        connected_ = true;
+        if (store_ && !store_->empty()) {
+            replayStoredLocked(packet.sessionPresent, failed);
+        }
+    }
+    scheduleKeepAlive();
+    if (auto listener = listener_.lock()) {
+        listener->onConnected(packet.reasonCode);
+        for (const auto &failure : failed) {
+            listener->onPublishFailed(failure.first,
+                                      "Failed to publish message on topic: " + failure.first + " (" + failure.second +
+                                          ")");
+        }
+    }
+}
+
+void SocketTransport::replayStoredLocked(bool sessionPresent,
+                                         std::vector<std::pair<std::string, const char *>> &failed) {
+    if (sessionPresent) {
+        // The broker still knows these packet identifiers; new ones must not collide with them.
+        store_->forEach([this](const OutboundStore::Entry &entry) {
+            if (entry.packetId != 0) {
+                pendingPublishes_[entry.packetId] =
+                    PendingPublish{std::string(entry.topic), entry.sequence, entry.released};
+            }
+        });
+    }
+    std::vector<std::pair<uint64_t, uint16_t>> assigned;
+    std::vector<uint64_t> completed;
+    PacketWriter writer(outbox_);
+    store_->forEach([&](const OutboundStore::Entry &entry) {
+        bool resume = sessionPresent && entry.packetId != 0;
+        if (entry.released) {
+            if (resume) {
+                writer.ack(PacketType::Pubrel, entry.packetId);
+            } else {
+                // PUBREC means the broker took the message; a new session only forgot its packet identifier.
+                completed.push_back(entry.sequence);
+            }
+            return;
+        }
+        PublishPacket packet;
+        packet.topic = entry.topic;
+        packet.payload = entry.payload;
+        packet.payloadSize = entry.payloadSize;
+        packet.qos = entry.qos;
+        packet.retain = entry.retain;
+        // Stored by an older version without these checks, or too large for this broker.
+        const char *invalid = invalidTopicName(entry.topic);
+        if (invalid == nullptr && !PacketWriter::encodable(packet)) {
+            invalid = "packet too large";
+        } else if (invalid == nullptr && exceedsMaximumPacketSizeLocked(packet)) {
+            invalid = "larger than the broker's maximum packet size";
+        }
+        if (invalid != nullptr) {
+            if (resume) {
+                pendingPublishes_.erase(entry.packetId);
+            }
+            failed.emplace_back(std::string(entry.topic), invalid);
+            completed.push_back(entry.sequence);
+            return;
+        }
+        if (resume) {
+            packet.packetId = entry.packetId;
+            packet.dup = true;
+        } else if (pendingPublishes_.size() >= receiveMaximum_) {
+            heldPublishes_.push_back(HeldPublish{std::string(entry.topic),
+                                                 std::string(reinterpret_cast<const char *>(entry.payload),
+                                                             entry.payloadSize),
+                                                 entry.qos, entry.retain, entry.sequence});
+            heldBytes_ += entry.topic.size() + entry.payloadSize;
+            return;
+        } else {
+            packet.packetId = nextPacketIdLocked();
+            pendingPublishes_[packet.packetId] = PendingPublish{std::string(entry.topic), entry.sequence};
+            assigned.emplace_back(entry.sequence, packet.packetId);
+        }
+        writer.publish(packet);
+    });
+    // Written after the visit, which must not modify the store.
+    for (const auto &entry : assigned) {
+        store_->assignPacketId(entry.first, entry.second);
+    }
+    for (uint64_t sequence : completed) {
+        store_->complete(sequence);
+    }
+}
+
+void SocketTransport::handlePublish(const Packet &packet) {
+    if (packet.qos == 2 && !incomingQos2_.insert(packet.packetId).second) {
+        // A redelivered QoS 2 message was already handed to the client before its PUBREL.
+        PacketWriter(sendBuffer_).ack(PacketType::Pubrec, packet.packetId);
+        return;
+    }
+    // The client acknowledges once the message reached JS, so a Receive Maximum holds the broker back.
+    uint64_t acknowledgement = 0;
+    if (packet.qos > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        acknowledgement = (static_cast<uint64_t>(connection_) << ACKNOWLEDGE_CONNECTION_SHIFT) |
+                          (packet.qos == 2 ? ACKNOWLEDGE_PUBREC : 0) | packet.packetId;
+    }
+    if (auto listener = listener_.lock()) {
+        listener->onMessage(std::string(packet.topic),
+                          std::string(reinterpret_cast<const char *>(packet.payload), packet.payloadSize),
+                          packet.qos, 0, acknowledgement, packet.properties.userProperties);
+    }
+}
+
+void SocketTransport::handleSuback(const Packet &packet) {
+    std::vector<std::string> topics;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pendingSubscribes_.find(packet.packetId);
+        if (it == pendingSubscribes_.end()) {
+            return;
+        }
+        topics = std::move(it->second);
+        pendingSubscribes_.erase(it);
+    }
+    auto listener = listener_.lock();
+    if (!listener) {
+        return;
+    }
+    for (size_t i = 0; i < topics.size(); i++) {
+        uint8_t reasonCode = i < packet.reasonCodeCount ? packet.reasonCodes[i] : REASON_MALFORMED_PACKET;
+        if (reasonCode < 0x80) {
+            // Granted QoS 0-2.
+            listener->onSubscribed(topics[i], reasonCode, "");
+        } else {
+            listener->onSubscribeFailed(topics[i], SUBSCRIPTION_ERROR,
+                                      reasonMessage("Failed to subscribe to topic: ", topics[i], reasonCode));
+        }
+    }
+}
+
+void SocketTransport::handleUnsuback(const Packet &packet) {
+    std::string topic;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pendingUnsubscribes_.find(packet.packetId);
+        if (it == pendingUnsubscribes_.end()) {
+            return;
+        }
+        topic = std::move(it->second);
+        pendingUnsubscribes_.erase(it);
+    }
+    uint8_t reasonCode = packet.reasonCodeCount > 0 ? packet.reasonCodes[0] : 0;
+    if (reasonCode >= 0x80) {
+        if (auto listener = listener_.lock()) {
+            listener->onUnsubscribeFailed(topic, reasonMessage("Failed to unsubscribe from topic: ", topic, reasonCode));
+        }
+    }
+}
+
+void SocketTransport::scheduleKeepAlive() {
+    if (keepAliveSeconds_ <= 0) {
+        return;
+    }
+    auto self = shared_from_this();
+    uint64_t attempt = attempt_;
+    keepAliveTimer_ = loop_.addTimer(std::chrono::seconds(keepAliveSeconds_), [self, attempt] {
+        if (self->attempt_ != attempt || self->state_ != State::Connected) {
+            return;
+        }
+        self->keepAliveTimer_ = 0;
+        if (self->pingOutstanding_) {
+            PacketWriter(self->sendBuffer_).disconnect(REASON_KEEP_ALIVE_TIMEOUT);
+            self->flush();
+            self->connectionLost(DISCONNECTION_ERROR, "Keep alive timeout");
+            return;
+        }
+        self->pingOutstanding_ = true;
+        PacketWriter(self->sendBuffer_).pingreq();
+        self->flush();
+        self->scheduleKeepAlive();
+    });
+}
+
+void SocketTransport::connectionFailed(int reasonCode, const std::string &errorMessage,
+                                       const std::string &errorCause) {
+    closeSocket();
+    if (auto listener = listener_.lock()) {
+        listener->onConnectionFailed(reasonCode, errorMessage, errorCause);
+    }
+}
+
+void SocketTransport::connectionLost(int reasonCode, const std::string &errorMessage) {
+    bool wasConnected = state_ == State::Connected;
+    closeSocket();
+    if (auto listener = listener_.lock()) {
+        if (wasConnected) {
+            listener->onDisconnected(reasonCode, errorMessage);
+        } else {
+            listener->onConnectionFailed(reasonCode, errorMessage, "");
+        }
+    }
+}
+
+void SocketTransport::closeSocket() {
+    if (connectTimer_ != 0) {
+        loop_.cancelTimer(connectTimer_);
+        connectTimer_ = 0;
+    }
+    if (keepAliveTimer_ != 0) {
+        loop_.cancelTimer(keepAliveTimer_);
+        keepAliveTimer_ = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connected_ = false;
+        outbox_.clear();
+    }
+    if (fd_ >= 0) {
+        loop_.unwatch(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    // Invalidates pending resolutions and timers of this attempt.
+    attempt_++;
+    state_ = State::Idle;
+    addresses_.reset();
+    nextAddress_ = nullptr;
+    sendBuffer_.clear();
+    sendOffset_ = 0;
+    wantWrite_ = false;
+    reader_.reset();
+    incomingQos2_.clear();
+    self_.reset();
+}
+
+void SocketTransport::flush() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        flushScheduled_ = false;
+        // While the socket is full, the outbox keeps what comes next and publish() bounds it.
+        if (fd_ >= 0 && connected_ && !outbox_.empty() && !wantWrite_) {
+            if (sendOffset_ == sendBuffer_.size()) {
+                // Both buffers keep their capacity, so steady publishing does not allocate.
+                sendBuffer_.clear();
+                sendOffset_ = 0;
+                sendBuffer_.swap(outbox_);
+            } else {
+                sendBuffer_.insert(sendBuffer_.end(), outbox_.begin(), outbox_.end());
+                outbox_.clear();
+            }
+        }
+    }
+    if (fd_ < 0 || state_ == State::Connecting) {
+        return;
+    }
+    while (sendOffset_ < sendBuffer_.size()) {
+        ssize_t sent = send(fd_, sendBuffer_.data() + sendOffset_, sendBuffer_.size() - sendOffset_, SEND_FLAGS);
+        if (sent > 0) {
+            sendOffset_ += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!wantWrite_) {
+                wantWrite_ = true;
+                loop_.update(fd_, true);
+            }
+            return;
+        }
+        connectionLost(DISCONNECTION_ERROR, errnoMessage(errno));
+        return;
+    }
+    sendBuffer_.clear();
+    sendOffset_ = 0;
+    if (wantWrite_) {
+        wantWrite_ = false;
+        loop_.update(fd_, false);
+        // What queued up in the outbox while the socket was full goes out as the next batch.
+        bool queued;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queued = !outbox_.empty();
+        }
+        if (queued) {
+            scheduleFlush();
+        }
+    }
+}
+
+}
@@ -0,0 +1,195 @@
+//
+//  MqttSocketTransport.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "MqttClient.h"
+#include "MqttCodec.h"
+#include "MqttEventLoop.h"
+#include "MqttOutboundStore.h"
+#include "MqttTransport.h"
+
+struct addrinfo;
+
+namespace mqtt {
+
+/**
+ * Transport of the native engine: speaks MQTT 5 over a plain TCP socket using MqttCodec, driven by an EventLoop.
+ * Selected with `engine: 'native'` in createMqtt instead of the HiveMQ/CocoaMQTT backed platform transports.
+ *
+ * Commands may come from any thread. Packets they produce are encoded straight into a shared outbox buffer and a
+ * single flush is scheduled on the loop, so a burst of publishes costs one send() and no per-packet allocation.
+ * While a previous send() is still draining, the outbox keeps filling; beyond MAX_OUTBOX_BYTES publishes fail with
+ * "outbound queue full" instead of buffering without bound. Everything else (socket, reader, keep alive) lives on the
+ * loop thread. TLS is not supported.
+ *
+ * When the broker's CONNACK announces a Topic Alias Maximum, that many of the topics published on a connection get
+ * an alias, first come first served: later publishes on the same topic carry the 2 byte alias and an empty topic
+ * name. Aliases belong to one connection and start over after every CONNACK; replayed messages are sent unaliased.
+ *
+ * With an OutboundStore, QoS 1/2 publishes are persisted until acknowledged: they are accepted while disconnected
+ * and, like those left unacknowledged by a lost connection or a killed process, sent in one batch after CONNACK.
+ * Publishes the broker would refuse are not stored, and a stored one it refuses anyway is dropped, not replayed.
+ *
+ * The limits the broker's CONNACK announces are kept: at most Receive Maximum QoS 1/2 publishes are unacknowledged
+ * at a time, the next ones are held (within MAX_OUTBOX_BYTES) and sent as acknowledgements come in, and a publish
+ * larger than the Maximum Packet Size fails instead of getting the connection closed.
+ */
+class SocketTransport : public Transport, public IOHandler, public std::enable_shared_from_this<SocketTransport> {
+public:
+    SocketTransport(std::string clientId, std::string host, int port, EventLoop &loop = EventLoop::shared());
+    ~SocketTransport() override;
+
+    /**
+     * Sets the client (or shared connection) that receives the transport callbacks. Must be called before connect().
+     */
+    void attach(std::weak_ptr<TransportListener> listener);
+
+    /**
+     * Persists outgoing QoS 1/2 messages in store. Must be called before connect().
+     */
+    void setOutboundStore(std::unique_ptr<OutboundStore> store);
+
+    void connect(const ConnectOptions &options) override;
+    void disconnect() override;
+    void subscribe(const std::string &topic, int qos) override;
+
+    /**
+     * Sends the filters in as few SUBSCRIBE packets as SUBSCRIBE_BATCH_BYTES allows, usually one.
+     */
+    void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) override;
+    void unsubscribe(const std::string &topic) override;
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) override;
+
+    /**
+     * Topic aliases assigned on the current connection, at most the broker's Topic Alias Maximum.
+     */
+    size_t topicAliasCount();
+
+    /**
+     * Received QoS 1/2 messages are handed over unacknowledged; their PUBACK/PUBREC goes out through here.
+     */
+    void acknowledge(uint64_t acknowledgement) override;
+    void close() override;
+
+    void onReadable() override;
+    void onWritable() override;
+
+private:
+    enum class State { Idle, Resolving, Connecting, AwaitingConnack, Connected };
+
+    struct PendingPublish {
+        std::string topic;
+        // Sequence number in store_, 0 without a store.
+        uint64_t sequence = 0;
+        // PUBREC came in, PUBCOMP has not.
+        bool released = false;
+    };
+
+    // A QoS 1/2 publish waiting for the broker's Receive Maximum to let it through.
+    struct HeldPublish {
+        std::string topic;
+        std::string payload;
+        uint8_t qos = 1;
+        bool retain = false;
+        uint64_t sequence = 0;
+    };
+
+    // Loop thread.
+    void startConnect(const ConnectOptions &options);
+    void onResolved(uint64_t attempt, std::shared_ptr<addrinfo> addresses, const std::string &error);
+    void connectNextAddress();
+    void finishConnect();
+    void handlePacket(const Packet &packet);
+    void handleConnack(const Packet &packet);
+    void handlePublish(const Packet &packet);
+    void handleSuback(const Packet &packet);
+    void handleUnsuback(const Packet &packet);
+    void replayStoredLocked(bool sessionPresent, std::vector<std::pair<std::string, const char *>> &failed);
+
+    /**
+     * The broker disconnected refusing a publish: completes the stored one it refused, so that it is not replayed
+     * on every connect. Returns its topic, empty when there is none.
+     */
+    std::string completeRejectedLocked();
+    void scheduleKeepAlive();
+    void connectionFailed(int reasonCode, const std::string &errorMessage, const std::string &errorCause);
+    void connectionLost(int reasonCode, const std::string &errorMessage);
+    void closeSocket();
+    void flush();
+
+    // Any thread.
+    uint16_t nextPacketIdLocked();
+    void assignTopicAliasLocked(const std::string &topic, PublishPacket &packet);
+    bool exceedsMaximumPacketSizeLocked(const PublishPacket &packet) const;
+
+    /**
+     * Sends held publishes while the broker's Receive Maximum allows. Returns whether it sent any.
+     */
+    bool sendHeldLocked();
+    void scheduleFlush();
+
+    const std::string clientId_;
+    const std::string host_;
+    const int port_;
+    EventLoop &loop_;
+    std::weak_ptr<TransportListener> listener_;
+
+    std::mutex mutex_;
+    std::vector<uint8_t> outbox_;
+    bool flushScheduled_ = false;
+    uint16_t packetId_ = 0;
+    std::unordered_map<uint16_t, std::vector<std::string>> pendingSubscribes_;
+    std::unordered_map<uint16_t, std::string> pendingUnsubscribes_;
+    std::unordered_map<uint16_t, PendingPublish> pendingPublishes_;
+    std::deque<HeldPublish> heldPublishes_;
+    size_t heldBytes_ = 0;
+    // From the CONNACK of the current connection, kept for the publishes made while disconnected. The protocol
+    // defaults: no limits.
+    uint16_t receiveMaximum_ = 0xFFFF;
+    uint32_t maximumPacketSize_ = 0;
+    // From the CONNACK of the current connection; 0 when the broker takes no aliases.
+    uint16_t topicAliasMaximum_ = 0;
+    std::unordered_map<std::string, uint16_t> topicAliases_;
+    std::unique_ptr<OutboundStore> store_;
+    std::atomic<bool> connected_{false};
+    // Counts accepted CONNACKs; acknowledgements of messages received on an earlier connection are not sent.
+    uint32_t connection_ = 0;
+
+    // Loop thread only.
+    State state_ = State::Idle;
+    bool closed_ = false;
+    int fd_ = -1;
+    uint64_t attempt_ = 0;
+    ConnectOptions options_;
+    std::shared_ptr<addrinfo> addresses_;
+    addrinfo *nextAddress_ = nullptr;
+    std::string lastSocketError_;
+    std::vector<uint8_t> sendBuffer_;
+    size_t sendOffset_ = 0;
+    bool wantWrite_ = false;
+    PacketReader reader_;
+    Packet packet_;
+    std::unordered_set<uint16_t> incomingQos2_;
+    EventLoop::TimerId connectTimer_ = 0;
+    EventLoop::TimerId keepAliveTimer_ = 0;
+    int keepAliveSeconds_ = 0;
+    bool pingOutstanding_ = false;
+    // Keeps the transport alive while its socket is registered with the loop.
+    std::shared_ptr<SocketTransport> self_;
+};
+
+}
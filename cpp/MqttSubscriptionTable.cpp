@@ -0,0 +1,125 @@
+//
+//  MqttSubscriptionTable.cpp
+//  d11-mqtt
+//
+
+#include "MqttSubscriptionTable.h"
+
+#include <algorithm>
+
+namespace mqtt {
+
+static int maxQosOf(const std::vector<SubscriptionTable::Subscriber> &subscribers) {
+    int qos = -1;
+    for (const auto &subscriber : subscribers) {
+        qos = std::max(qos, subscriber.qos);
+    }
+    return qos;
+}
+
+bool SubscriptionTable::add(const std::string &eventId, const std::string &filter, int qos) {
+    auto inserted = filters_.try_emplace(filter);
+    auto &subscribers = inserted.first->second;
+    if (inserted.second) {
+        trie_.insert(filter, &subscribers);
+    }
+    int previousMaxQos = maxQosOf(subscribers);
+    auto it = std::find_if(subscribers.begin(), subscribers.end(),
+                           [&eventId](const Subscriber &subscriber) { return subscriber.eventId == eventId; });
+    if (it != subscribers.end()) {
+        it->qos = qos;
+        it->pendingAck = true;
+    } else {
+        subscribers.push_back(Subscriber{eventId, qos, true});
+    }
+    return maxQosOf(subscribers) > previousMaxQos;
+}
+
+bool SubscriptionTable::remove(const std::string &eventId, const std::string &filter) {
+    auto entry = filters_.find(filter);
+    if (entry == filters_.end()) {
+        return false;
+    }
+    auto &subscribers = entry->second;
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+                                     [&eventId](const Subscriber &subscriber) { return subscriber.eventId == eventId; }),
+                      subscribers.end());
+    if (!subscribers.empty()) {
+        return false;
+    }
+    trie_.erase(filter, &subscribers);
+    filters_.erase(entry);
+    return true;
+}
+
+bool SubscriptionTable::contains(const std::string &filter) const {
+    return filters_.find(filter) != filters_.end();
+}
+
+bool SubscriptionTable::hasPendingAck(const std::string &filter) const {
+    auto entry = filters_.find(filter);
+    if (entry == filters_.end()) {
+        return false;
+    }
+    return std::any_of(entry->second.begin(), entry->second.end(),
+                       [](const Subscriber &subscriber) { return subscriber.pendingAck; });
+}
+
+int SubscriptionTable::maxQos(const std::string &filter) const {
+    auto entry = filters_.find(filter);
+    return entry == filters_.end() ? -1 : maxQosOf(entry->second);
+}
+
+std::vector<std::pair<std::string, int>> SubscriptionTable::filters() const {
+    std::vector<std::pair<std::string, int>> result;
+    result.reserve(filters_.size());
+    for (const auto &entry : filters_) {
+        result.emplace_back(entry.first, maxQosOf(entry.second));
+    }
+    return result;
+}
+
+void SubscriptionTable::markAllPending() {
+    for (auto &entry : filters_) {
+        for (auto &subscriber : entry.second) {
+            subscriber.pendingAck = true;
+        }
+    }
+}
+
+std::vector<std::string> SubscriptionTable::takePendingAcks(const std::string &filter) {
+    std::vector<std::string> eventIds;
+    auto entry = filters_.find(filter);
+    if (entry == filters_.end()) {
+        return eventIds;
+    }
+    for (auto &subscriber : entry->second) {
+        if (subscriber.pendingAck) {
+            subscriber.pendingAck = false;
+            eventIds.push_back(subscriber.eventId);
+        }
+    }
+    return eventIds;
+}
+
+void SubscriptionTable::clearPending(const std::string &eventId, const std::string &filter) {
+    auto entry = filters_.find(filter);
+    if (entry == filters_.end()) {
+        return;
+    }
+    for (auto &subscriber : entry->second) {
+        if (subscriber.eventId == eventId) {
+            subscriber.pendingAck = false;
+        }
+    }
+}
+
+void SubscriptionTable::collectMatches(const std::string &topic, std::vector<std::string> &eventIds) const {
+    trie_.forEachMatch(topic, [&eventIds](const std::vector<Subscriber> *subscribers) {
+        for (const auto &subscriber : *subscribers) {
+            eventIds.push_back(subscriber.eventId);
+        }
+    });
+}
+
+}
@@ -0,0 +1,79 @@
+//
+//  MqttSubscriptionTable.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MqttTopicTrie.h"
+
+namespace mqtt {
+
+/**
+ * Subscriptions of one client, keyed by topic filter. Several JS subscriptions (eventIds) can share a filter; the
+ * broker only sees one SUBSCRIBE per filter at the highest QoS any of them asked for. Filters are also indexed in a
+ * TopicTrie so a received message is routed with a single walk instead of testing every filter.
+ *
+ * Not thread safe, Client guards it with its own mutex.
+ */
+class SubscriptionTable {
+public:
+    struct Subscriber {
+        std::string eventId;
+        int qos;
+        // Waiting for the SUBACK of the filter before its success/failure event can be emitted.
+        bool pendingAck;
+    };
+
+    /**
+     * @return true when the filter is new or its maximum QoS went up, i.e. a SUBSCRIBE has to be sent.
+     */
+    bool add(const std::string &eventId, const std::string &filter, int qos);
+
+    /**
+     * @return true when the last subscriber of the filter was removed, i.e. an UNSUBSCRIBE has to be sent.
+     */
+    bool remove(const std::string &eventId, const std::string &filter);
+
+    bool contains(const std::string &filter) const;
+    bool hasPendingAck(const std::string &filter) const;
+    int maxQos(const std::string &filter) const;
+
+    /**
+     * Every filter with its maximum QoS, used to resubscribe after a (re)connect.
+     */
+    std::vector<std::pair<std::string, int>> filters() const;
+
+    void markAllPending();
+
+    /**
+     * Clears the pending flag of the filter's subscribers and returns their eventIds.
+     */
+    std::vector<std::string> takePendingAcks(const std::string &filter);
+
+    /**
+     * Removes a single subscriber from the pending set, used when it is acknowledged right away.
+     */
+    void clearPending(const std::string &eventId, const std::string &filter);
+
+    /**
+     * Appends the eventIds of every filter matching the topic of a received message. A subscriber reached through
+     * several matching filters is appended once per filter.
+     */
+    void collectMatches(const std::string &topic, std::vector<std::string> &eventIds) const;
+
+    bool empty() const { return filters_.empty(); }
+    size_t size() const { return filters_.size(); }
+
+private:
+    std::unordered_map<std::string, std::vector<Subscriber>> filters_;
+    // Points at the subscriber lists in filters_, which stay put for as long as their filter is present.
+    TopicTrie<const std::vector<Subscriber> *> trie_;
+};
+
+}
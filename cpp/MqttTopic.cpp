@@ -0,0 +1,72 @@
+//
+//  MqttTopic.cpp
+//  d11-mqtt
+//
+
+#include "MqttTopic.h"
+
+namespace mqtt {
+
+static constexpr std::string_view kSharePrefix = "$share/";
+
+std::string_view effectiveTopicFilter(std::string_view filter) {
+    if (filter.substr(0, kSharePrefix.size()) != kSharePrefix) {
+        return filter;
+    }
+    size_t groupEnd = filter.find('/', kSharePrefix.size());
+    if (groupEnd == std::string_view::npos) {
+        return filter;
+    }
+    return filter.substr(groupEnd + 1);
+}
+
+bool topicMatchesFilter(std::string_view topic, std::string_view filter) {
+    filter = effectiveTopicFilter(filter);
+    if (!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+
+    size_t t = 0;
+    size_t f = 0;
+    for (;;) {
+        size_t filterLevelEnd = filter.find('/', f);
+        std::string_view filterLevel =
+            filter.substr(f, filterLevelEnd == std::string_view::npos ? std::string_view::npos : filterLevelEnd - f);
+        if (filterLevel == "#") {
+            return true;
+        }
+        size_t topicLevelEnd = topic.find('/', t);
+        std::string_view topicLevel =
+            topic.substr(t, topicLevelEnd == std::string_view::npos ? std::string_view::npos : topicLevelEnd - t);
+        if (filterLevel != "+" && filterLevel != topicLevel) {
+            return false;
+        }
+
+        bool filterDone = filterLevelEnd == std::string_view::npos;
+        bool topicDone = topicLevelEnd == std::string_view::npos;
+        if (filterDone || topicDone) {
+            if (filterDone && topicDone) {
+                return true;
+            }
+            // Only "<levels>/#" can match a topic with one level less.
+            return topicDone && filter.substr(filterLevelEnd + 1) == "#";
+        }
+        t = topicLevelEnd + 1;
+        f = filterLevelEnd + 1;
+    }
+}
+
+const char *invalidTopicName(std::string_view topic) {
+    if (topic.empty()) {
+        return "empty topic";
+    }
+    if (topic.size() > 0xFFFF) {
+        return "topic longer than 65535 bytes";
+    }
+    if (topic.find_first_of(std::string_view("+#\0", 3)) != std::string_view::npos) {
+        return "wildcard or null character in topic";
+    }
+    return nullptr;
+}
+
+}
@@ -0,0 +1,29 @@
+//
+//  MqttTopic.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <string_view>
+
+namespace mqtt {
+
+/**
+ * Strips the "$share/<group>/" prefix of a shared subscription, returning the filter messages are matched against.
+ */
+std::string_view effectiveTopicFilter(std::string_view filter);
+
+/**
+ * MQTT 5 topic filter matching (section 4.7): '+' matches one level, a trailing '#' matches the parent level and
+ * everything below it, and wildcards at the first level do not match topics starting with '$'.
+ */
+bool topicMatchesFilter(std::string_view topic, std::string_view filter);
+
+/**
+ * Why topic cannot be published to (section 4.7.3: it is empty, longer than a UTF-8 string can be or contains a
+ * wildcard or a null character), nullptr when it can.
+ */
+const char *invalidTopicName(std::string_view topic);
+
+}
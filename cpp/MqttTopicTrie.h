@@ -0,0 +1,201 @@
+//
+//  MqttTopicTrie.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MqttTopic.h"
+
+namespace mqtt {
+
+/**
+ * Index of topic filters, one node per filter level, with '+' and '#' kept as dedicated children. Matching a topic
+ * walks it once, level by level, so its cost depends on the topic depth and the wildcards on the way rather than on
+ * the number of filters. Matching does not allocate.
+ *
+ * Shared subscriptions are indexed under their effective filter ("$share/<group>/" stripped), and first level
+ * wildcards do not match topics starting with '$', the same rules as topicMatchesFilter().
+ *
+ * Values are compared with operator== on erase. Not thread safe.
+ */
+template <typename Value>
+class TopicTrie {
+public:
+    void insert(std::string_view filter, Value value) {
+        filter = effectiveTopicFilter(filter);
+        Node *node = &root_;
+        size_t start = 0;
+        for (;;) {
+            size_t end = filter.find('/', start);
+            node = node->childFor(filter.substr(start, end == std::string_view::npos ? end : end - start));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            start = end + 1;
+        }
+        node->values.push_back(std::move(value));
+        size_++;
+    }
+
+    /**
+     * Removes one value stored under the filter and prunes the nodes left empty.
+     *
+     * @return false when the filter did not hold the value.
+     */
+    bool erase(std::string_view filter, const Value &value) {
+        if (!eraseFrom(root_, effectiveTopicFilter(filter), 0, value)) {
+            return false;
+        }
+        size_--;
+        return true;
+    }
+
+    /**
+     * Calls visit(const Value &) for every value whose filter matches the topic. A value stored under several
+     * matching filters is visited once per filter.
+     */
+    template <typename Visitor>
+    void forEachMatch(std::string_view topic, Visitor &&visit) const {
+        bool systemTopic = !topic.empty() && topic[0] == '$';
+        if (!systemTopic) {
+            if (root_.hash) {
+                visitValues(*root_.hash, visit);
+            }
+            if (root_.plus) {
+                matchFrom(*root_.plus, topic, nextLevel(topic, 0), visit);
+            }
+        }
+        size_t end = topic.find('/');
+        auto child = root_.children.find(topic.substr(0, end));
+        if (child != root_.children.end()) {
+            matchFrom(*child->second, topic, nextLevel(topic, 0), visit);
+        }
+    }
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+private:
+    struct Node {
+        // Owns the level text the parent's children map is keyed by.
+        std::string level;
+        std::unordered_map<std::string_view, std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> plus;
+        std::unique_ptr<Node> hash;
+        std::vector<Value> values;
+
+        Node *childFor(std::string_view name) {
+            if (name == "+" || name == "#") {
+                auto &wildcard = name == "+" ? plus : hash;
+                if (!wildcard) {
+                    wildcard = std::make_unique<Node>();
+                    wildcard->level = std::string(name);
+                }
+                return wildcard.get();
+            }
+            auto existing = children.find(name);
+            if (existing != children.end()) {
+                return existing->second.get();
+            }
+            auto child = std::make_unique<Node>();
+            child->level = std::string(name);
+            Node *raw = child.get();
+            children.emplace(std::string_view(raw->level), std::move(child));
+            return raw;
+        }
+
+        bool unused() const { return values.empty() && children.empty() && !plus && !hash; }
+    };
+
+    static constexpr size_t END = std::string_view::npos;
+
+    /**
+     * Start of the level after the one starting at start, or END when that was the last level.
+     */
+    static size_t nextLevel(std::string_view topic, size_t start) {
+        size_t end = topic.find('/', start);
+        return end == std::string_view::npos ? END : end + 1;
+    }
+
+    /**
+     * Visits the matches below node, which matched the topic up to (not including) the level starting at start.
+     */
+    template <typename Visitor>
+    static void matchFrom(const Node &node, std::string_view topic, size_t start, Visitor &visit) {
+        // "<levels>/#" also matches "<levels>" itself.
+        if (node.hash) {
+            visitValues(*node.hash, visit);
+        }
+        if (start == END) {
+            visitValues(node, visit);
+            return;
+        }
+        size_t next = nextLevel(topic, start);
+        if (node.plus) {
+            matchFrom(*node.plus, topic, next, visit);
+        }
+        if (!node.children.empty()) {
+            std::string_view level = topic.substr(start, next == END ? END : next - 1 - start);
+            auto child = node.children.find(level);
+            if (child != node.children.end()) {
+                matchFrom(*child->second, topic, next, visit);
+            }
+        }
+    }
+
+    template <typename Visitor>
+    static void visitValues(const Node &node, Visitor &visit) {
+        for (const auto &value : node.values) {
+            visit(value);
+        }
+    }
+
+    static bool eraseFrom(Node &node, std::string_view filter, size_t start, const Value &value) {
+        if (start == END) {
+            auto it = std::find(node.values.begin(), node.values.end(), value);
+            if (it == node.values.end()) {
+                return false;
+            }
+            node.values.erase(it);
+            return true;
+        }
+        size_t next = nextLevel(filter, start);
+        std::string_view name = filter.substr(start, next == END ? END : next - 1 - start);
+        std::unique_ptr<Node> *slot = nullptr;
+        typename std::unordered_map<std::string_view, std::unique_ptr<Node>>::iterator child;
+        if (name == "+") {
+            slot = &node.plus;
+        } else if (name == "#") {
+            slot = &node.hash;
+        } else {
+            child = node.children.find(name);
+            if (child != node.children.end()) {
+                slot = &child->second;
+            }
+        }
+        if (slot == nullptr || !*slot || !eraseFrom(**slot, filter, next, value)) {
+            return false;
+        }
+        if ((*slot)->unused()) {
+            if (name == "+" || name == "#") {
+                slot->reset();
+            } else {
+                node.children.erase(child);
+            }
+        }
+        return true;
+    }
+
+    Node root_;
+    size_t size_ = 0;
+};
+
+}
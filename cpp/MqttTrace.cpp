@@ -0,0 +1,102 @@
+//
+//  MqttTrace.cpp
+//  d11-mqtt
+//
+
+#include "MqttTrace.h"
+
+#if defined(__ANDROID__)
+#include <dlfcn.h>
+#elif defined(__APPLE__)
+#include <os/log.h>
+#include <os/signpost.h>
+#endif
+
+namespace mqtt {
+namespace trace {
+
+#if defined(__ANDROID__)
+
+namespace {
+
+// The NDK tracing functions exist from API 23 on; they are looked up at runtime so the library still loads on 21.
+struct ATraceFunctions {
+    bool (*isEnabled)() = nullptr;
+    void (*beginSection)(const char *) = nullptr;
+    void (*endSection)() = nullptr;
+
+    ATraceFunctions() {
+        auto enabled = reinterpret_cast<bool (*)()>(dlsym(RTLD_DEFAULT, "ATrace_isEnabled"));
+        auto begin = reinterpret_cast<void (*)(const char *)>(dlsym(RTLD_DEFAULT, "ATrace_beginSection"));
+        auto end = reinterpret_cast<void (*)()>(dlsym(RTLD_DEFAULT, "ATrace_endSection"));
+        if (enabled && begin && end) {
+            isEnabled = enabled;
+            beginSection = begin;
+            endSection = end;
+        }
+    }
+};
+
+const ATraceFunctions &atrace() {
+    static const ATraceFunctions functions;
+    return functions;
+}
+
+}
+
+Section::Section(const char *name) {
+    const auto &functions = atrace();
+    if (functions.isEnabled && functions.isEnabled()) {
+        functions.beginSection(name);
+        active_ = true;
+    }
+}
+
+Section::~Section() {
+    if (active_) {
+        atrace().endSection();
+    }
+}
+
+#elif defined(__APPLE__)
+
+namespace {
+
+os_log_t signpostLog() {
+    static os_log_t log = os_log_create("com.d11.mqtt", OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return log;
+}
+
+}
+
+// os_signpost needs literal interval names, so every section is one "mqtt" interval labelled with its name. It is
+// only available from iOS 12 on; older systems get no sections.
+Section::Section(const char *name) : name_(name) {
+    if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+        os_log_t log = signpostLog();
+        if (os_signpost_enabled(log)) {
+            signpostId_ = os_signpost_id_generate(log);
+            os_signpost_interval_begin(log, signpostId_, "mqtt", "%{public}s", name_);
+            active_ = true;
+        }
+    }
+}
+
+Section::~Section() {
+    if (active_) {
+        if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+            os_signpost_interval_end(signpostLog(), signpostId_, "mqtt", "%{public}s", name_);
+        }
+    }
+}
+
+#else
+
+Section::Section(const char *) {}
+
+Section::~Section() {}
+
+#endif
+
+}
+}
@@ -0,0 +1,41 @@
+//
+//  MqttTrace.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace mqtt {
+namespace trace {
+
+/**
+ * Marks the enclosing scope as a named section in the platform profiler: an ATrace section on Android (systrace,
+ * Perfetto) and an os_signpost interval in the Points of Interest log on Apple platforms (Instruments). A no-op in
+ * host builds. name must be a string literal.
+ *
+ * Costs one check of whether tracing is on when no trace is being recorded.
+ */
+class Section {
+public:
+    explicit Section(const char *name);
+    ~Section();
+
+    Section(const Section &) = delete;
+    Section &operator=(const Section &) = delete;
+
+private:
+#if defined(__APPLE__)
+    const char *name_;
+    uint64_t signpostId_ = 0;
+#endif
+    bool active_ = false;
+};
+
+}
+}
+
+#define MQTT_TRACE_CONCAT_INNER(a, b) a##b
+#define MQTT_TRACE_CONCAT(a, b) MQTT_TRACE_CONCAT_INNER(a, b)
+#define MQTT_TRACE_SECTION(name) ::mqtt::trace::Section MQTT_TRACE_CONCAT(mqttTraceSection, __LINE__)(name)
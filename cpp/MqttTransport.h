@@ -0,0 +1,102 @@
+//
+//  MqttTransport.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mqtt {
+
+struct ConnectOptions {
+    int keepAlive = 60;
+    bool cleanSession = true;
+    std::string username;
+    std::string password;
+    // MQTT 5 Receive Maximum announced in CONNECT: QoS 1/2 messages the broker may send before it waits for their
+    // acknowledgement. 0 keeps the transport's default.
+    int receiveMaximum = 0;
+};
+
+/**
+ * MQTT 5 user properties of a received message as (name, value) pairs in the order they were sent. They point into
+ * the transport's buffers and are only valid for the duration of the onMessage call.
+ */
+using UserProperties = std::vector<std::pair<std::string_view, std::string_view>>;
+
+/**
+ * Receives the outcomes a transport reports. Implemented by Client, and by SharedConnection, which hands them on
+ * to the logical clients sharing one connection.
+ */
+class TransportListener {
+public:
+    virtual ~TransportListener() = default;
+
+    virtual void onConnected(int reasonCode) = 0;
+    virtual void onConnectionFailed(int reasonCode, const std::string &errorMessage, const std::string &errorCause) = 0;
+    virtual void onDisconnected(int reasonCode, const std::string &errorMessage) = 0;
+    virtual void onSubscribed(const std::string &topic, int qos, const std::string &message) = 0;
+    virtual void onSubscribeFailed(const std::string &topic, int reasonCode, const std::string &errorMessage) = 0;
+    virtual void onUnsubscribeFailed(const std::string &topic, const std::string &errorMessage) = 0;
+    virtual void onPublishFailed(const std::string &topic, const std::string &errorMessage) = 0;
+    /**
+     * userProperties include the content-encoding of a compressed payload.
+     */
+    virtual void onMessage(const std::string &topic, std::string payload, int qos, int64_t receivedAt = 0,
+                           uint64_t acknowledgement = 0, const UserProperties &userProperties = {}) = 0;
+};
+
+/**
+ * The platform MQTT client (HiveMQ on Android, CocoaMQTT on iOS) as seen by the shared core.
+ *
+ * The core decides what to send; a transport only performs the network operation and reports the outcome back
+ * through the TransportListener callbacks (onConnected, onSubscribed, onMessage, ...). Calls come from the JS thread or from
+ * a transport callback and must not block on the network.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual void connect(const ConnectOptions &options) = 0;
+    virtual void disconnect() = 0;
+    virtual void subscribe(const std::string &topic, int qos) = 0;
+
+    /**
+     * Subscribes to several filters at once, as (filter, qos) pairs; used to restore every subscription after a
+     * connect. Transports that can carry many filters in one SUBSCRIBE override it, the default sends one per filter.
+     */
+    virtual void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) {
+        for (const auto &filter : filters) {
+            subscribe(filter.first, filter.second);
+        }
+    }
+
+    virtual void unsubscribe(const std::string &topic) = 0;
+
+    /**
+     * The payload is only valid for the duration of the call (it may point into JS memory); implementations copy
+     * it into their own buffer.
+     */
+    virtual void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) = 0;
+
+    /**
+     * Sends the PUBACK/PUBREC of a received QoS 1/2 message, for transports that handed it to Client::onMessage
+     * with a non-zero acknowledgement instead of acknowledging it on receipt. The client calls it once the message
+     * reached JS, or right away without flow control. May be called from any thread, also after the connection the
+     * message came in on is gone, in which case it does nothing.
+     */
+    virtual void acknowledge(uint64_t /*acknowledgement*/) {}
+
+    /**
+     * Called once when the client is removed; the transport releases its platform client.
+     */
+    virtual void close() = 0;
+};
+
+}
@@ -0,0 +1,89 @@
+//
+//  MqttUtf16.cpp
+//  d11-mqtt
+//
+
+#include "MqttUtf16.h"
+
+#include <cstdint>
+
+namespace mqtt {
+
+namespace {
+
+constexpr char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+void appendUtf8(std::string &out, char32_t codePoint) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codePoint >> 12));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codePoint >> 18));
+        out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+bool isHighSurrogate(char32_t unit) { return unit >= 0xD800 && unit <= 0xDBFF; }
+bool isLowSurrogate(char32_t unit) { return unit >= 0xDC00 && unit <= 0xDFFF; }
+
+}
+
+std::string utf16ToUtf8(const char16_t *chars, size_t length) {
+    std::string out;
+    out.reserve(length);
+    for (size_t i = 0; i < length; i++) {
+        char32_t unit = chars[i];
+        if (isHighSurrogate(unit) && i + 1 < length && isLowSurrogate(chars[i + 1])) {
+            unit = 0x10000 + ((unit - 0xD800) << 10) + (chars[++i] - 0xDC00);
+        } else if (isHighSurrogate(unit) || isLowSurrogate(unit)) {
+            unit = REPLACEMENT_CHARACTER;
+        }
+        appendUtf8(out, unit);
+    }
+    return out;
+}
+
+std::u16string utf8ToUtf16(std::string_view utf8) {
+    std::u16string out;
+    out.reserve(utf8.size());
+    size_t i = 0;
+    while (i < utf8.size()) {
+        auto lead = static_cast<uint8_t>(utf8[i]);
+        size_t extra = lead < 0x80 ? 0 : (lead >> 5) == 0x6 ? 1 : (lead >> 4) == 0xE ? 2 : (lead >> 3) == 0x1E ? 3 : 4;
+        char32_t codePoint = extra == 0 ? lead : extra == 1 ? lead & 0x1F : extra == 2 ? lead & 0x0F : lead & 0x07;
+        bool valid = extra < 4 && i + extra < utf8.size();
+        for (size_t k = 1; valid && k <= extra; k++) {
+            auto next = static_cast<uint8_t>(utf8[i + k]);
+            valid = (next & 0xC0) == 0x80;
+            codePoint = (codePoint << 6) | (next & 0x3F);
+        }
+        // Overlong encodings, surrogates and code points beyond U+10FFFF are not valid UTF-8 either.
+        static constexpr char32_t MINIMUM[] = {0, 0x80, 0x800, 0x10000};
+        valid = valid && codePoint >= MINIMUM[extra] && codePoint <= 0x10FFFF &&
+                !(codePoint >= 0xD800 && codePoint <= 0xDFFF);
+        if (!valid) {
+            out += static_cast<char16_t>(REPLACEMENT_CHARACTER);
+            i++;
+            continue;
+        }
+        if (codePoint >= 0x10000) {
+            codePoint -= 0x10000;
+            out += static_cast<char16_t>(0xD800 + (codePoint >> 10));
+            out += static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF));
+        } else {
+            out += static_cast<char16_t>(codePoint);
+        }
+        i += extra + 1;
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,26 @@
+//
+//  MqttUtf16.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace mqtt {
+
+/**
+ * UTF-8 of a UTF-16 string, as Java and JavaScript strings are. JNI's own GetStringUTFChars/NewStringUTF use modified
+ * UTF-8 instead (surrogate pairs as two 3 byte sequences, U+0000 as 0xC0 0x80), which is not valid in MQTT strings.
+ * An unpaired surrogate becomes U+FFFD.
+ */
+std::string utf16ToUtf8(const char16_t *chars, size_t length);
+
+/**
+ * UTF-16 of a UTF-8 string; each byte of an invalid sequence becomes U+FFFD.
+ */
+std::u16string utf8ToUtf16(std::string_view utf8);
+
+}
@@ -0,0 +1,310 @@
+//
+//  MqttWarmStart.cpp
+//  d11-mqtt
+//
+
+#include "MqttWarmStart.h"
+
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MqttOutboundStore.h"
+#include "MqttTrace.h"
+
+namespace mqtt {
+
+namespace {
+
+constexpr uint32_t FILE_MAGIC = 0x5357514D; // "MQWS"
+// Version 1 recorded the username and password.
+constexpr uint32_t FILE_VERSION = 2;
+// Magic, version and the CRC-32 of the body.
+constexpr size_t FILE_HEADER_SIZE = 12;
+constexpr const char *FILE_EXTENSION = ".warmstart";
+// A session file is a few hundred bytes; anything much larger is not one.
+constexpr size_t MAXIMUM_FILE_SIZE = 1024 * 1024;
+
+template <typename T>
+void appendValue(std::string &out, T value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void appendString(std::string &out, const std::string &value) {
+    appendValue(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+/**
+ * Reads the fields appendValue/appendString wrote, failing once past the end.
+ */
+class Reader {
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    bool read(T &value) {
+        if (data_.size() - offset_ < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data_.data() + offset_, sizeof(T));
+        offset_ += sizeof(T);
+        return true;
+    }
+
+    bool read(std::string &value) {
+        uint32_t size;
+        if (!read(size) || data_.size() - offset_ < size) {
+            return false;
+        }
+        value.assign(data_.data() + offset_, size);
+        offset_ += size;
+        return true;
+    }
+
+    bool atEnd() const { return offset_ == data_.size(); }
+
+private:
+    std::string_view data_;
+    size_t offset_ = 0;
+};
+
+uint32_t checksum(std::string_view body) {
+    return static_cast<uint32_t>(
+        crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(body.data()), static_cast<uInt>(body.size())));
+}
+
+bool writeAll(int fd, const std::string &data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+bool readFile(const std::string &path, std::string &data) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat status;
+    bool ok = fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) <= MAXIMUM_FILE_SIZE;
+    if (ok) {
+        data.resize(static_cast<size_t>(status.st_size));
+        size_t offset = 0;
+        while (ok && offset < data.size()) {
+            ssize_t result = read(fd, &data[offset], data.size() - offset);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = result > 0;
+            offset += ok ? static_cast<size_t>(result) : 0;
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+bool endsWith(const std::string &value, std::string_view suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}
+
+WarmStartStore::WarmStartStore(std::string directory) : directory_(std::move(directory)) {}
+
+std::string WarmStartStore::pathOf(const std::string &clientId) const {
+    return directory_ + "/" + clientFileName(clientId) + FILE_EXTENSION;
+}
+
+std::string WarmStartStore::encode(const WarmStartSession &session) {
+    std::string body;
+    appendString(body, session.clientId);
+    appendString(body, session.host);
+    appendValue(body, static_cast<int32_t>(session.port));
+    appendValue(body, static_cast<int32_t>(session.options.keepAlive));
+    appendValue(body, static_cast<uint8_t>(session.options.cleanSession));
+    // The credentials themselves stay out of the file, which is not encrypted.
+    appendValue(body, static_cast<uint8_t>(session.requiresCredentials || !session.options.username.empty() ||
+                                           !session.options.password.empty()));
+    appendValue(body, static_cast<int32_t>(session.options.receiveMaximum));
+    appendValue(body, static_cast<uint64_t>(session.storeCapacity));
+    appendValue(body, static_cast<uint32_t>(session.filters.size()));
+    for (const auto &filter : session.filters) {
+        appendString(body, filter.first);
+        appendValue(body, static_cast<uint8_t>(filter.second));
+    }
+    std::string data;
+    data.reserve(FILE_HEADER_SIZE + body.size());
+    appendValue(data, FILE_MAGIC);
+    appendValue(data, FILE_VERSION);
+    appendValue(data, checksum(body));
+    return data + body;
+}
+
+bool WarmStartStore::decode(std::string_view data, WarmStartSession &session) {
+    Reader header(data);
+    uint32_t magic, version, sum;
+    if (!header.read(magic) || !header.read(version) || !header.read(sum) || magic != FILE_MAGIC ||
+        version != FILE_VERSION) {
+        return false;
+    }
+    std::string_view body = data.substr(FILE_HEADER_SIZE);
+    if (checksum(body) != sum) {
+        return false;
+    }
+    Reader reader(body);
+    int32_t port, keepAlive, receiveMaximum;
+    uint8_t cleanSession, requiresCredentials;
+    uint64_t storeCapacity;
+    uint32_t filterCount;
+    if (!reader.read(session.clientId) || !reader.read(session.host) || !reader.read(port) ||
+        !reader.read(keepAlive) || !reader.read(cleanSession) || !reader.read(requiresCredentials) ||
+        !reader.read(receiveMaximum) || !reader.read(storeCapacity) ||
+        !reader.read(filterCount)) {
+        return false;
+    }
+    session.port = port;
+    session.options.keepAlive = keepAlive;
+    session.options.cleanSession = cleanSession != 0;
+    session.options.username.clear();
+    session.options.password.clear();
+    session.requiresCredentials = requiresCredentials != 0;
+    session.options.receiveMaximum = receiveMaximum;
+    session.storeCapacity = static_cast<size_t>(storeCapacity);
+    session.filters.clear();
+    for (uint32_t i = 0; i < filterCount; i++) {
+        std::string filter;
+        uint8_t qos;
+        if (!reader.read(filter) || !reader.read(qos)) {
+            return false;
+        }
+        session.filters.emplace_back(std::move(filter), qos);
+    }
+    return reader.atEnd();
+}
+
+bool WarmStartStore::save(const WarmStartSession &session, std::string &error) const {
+    MQTT_TRACE_SECTION("mqtt::WarmStartStore::save");
+    std::string path = pathOf(session.clientId);
+    std::string temporaryPath = path + ".tmp";
+    int fd = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        error = "Failed to create " + temporaryPath + ": " + std::strerror(errno);
+        return false;
+    }
+    bool written = writeAll(fd, encode(session)) && fsync(fd) == 0;
+    close(fd);
+    // The rename replaces the previous session atomically, so a crash leaves either one intact.
+    if (!written || rename(temporaryPath.c_str(), path.c_str()) < 0) {
+        error = "Failed to write " + path + ": " + std::strerror(errno);
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void WarmStartStore::remove(const std::string &clientId) const {
+    unlink(pathOf(clientId).c_str());
+}
+
+std::vector<WarmStartSession> WarmStartStore::load() const {
+    std::vector<WarmStartSession> sessions;
+    DIR *directory = opendir(directory_.c_str());
+    if (directory == nullptr) {
+        return sessions;
+    }
+    while (dirent *entry = readdir(directory)) {
+        std::string name = entry->d_name;
+        std::string path = directory_ + "/" + name;
+        std::string data;
+        WarmStartSession session;
+        if (!endsWith(name, FILE_EXTENSION) || !readFile(path, data)) {
+            continue;
+        }
+        if (decode(data, session)) {
+            sessions.push_back(std::move(session));
+        } else {
+            unlink(path.c_str());
+        }
+    }
+    closedir(directory);
+    return sessions;
+}
+
+WarmStart &WarmStart::shared() {
+    static WarmStart *warmStart = new WarmStart();
+    return *warmStart;
+}
+
+size_t WarmStart::start(const WarmStartStore &store, const ClientFactory &createClient,
+                        const CredentialsProvider &credentials) {
+    MQTT_TRACE_SECTION("mqtt::WarmStart::start");
+    size_t started = 0;
+    for (auto &session : store.load()) {
+        if (session.requiresCredentials &&
+            (!credentials || !credentials(session.clientId, session.options.username, session.options.password))) {
+            continue;
+        }
+        auto client = createClient(session);
+        if (!client) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_[session.clientId] = {session.host, session.port};
+        }
+        client->warmStart(session.options, session.filters);
+        started++;
+    }
+    return started;
+}
+
+std::shared_ptr<Client> WarmStart::adopt(const std::string &clientId, const std::string &host, int port,
+                                         ClientRegistry &registry) {
+    bool sameServer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(clientId);
+        if (it == pending_.end()) {
+            return nullptr;
+        }
+        sameServer = it->second.first == host && it->second.second == port;
+        pending_.erase(it);
+    }
+    if (!sameServer) {
+        registry.remove(clientId);
+        return nullptr;
+    }
+    return registry.find(clientId);
+}
+
+void WarmStart::discard(const std::string &clientId, ClientRegistry &registry) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_.erase(clientId) == 0) {
+            return;
+        }
+    }
+    registry.remove(clientId);
+}
+
+size_t WarmStart::pendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+}
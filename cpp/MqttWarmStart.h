@@ -0,0 +1,122 @@
+//
+//  MqttWarmStart.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MqttClient.h"
+#include "MqttClientRegistry.h"
+#include "MqttTransport.h"
+
+namespace mqtt {
+
+/**
+ * What a native engine client needs to connect and subscribe again at the next launch, recorded after its last
+ * successful connect and subscription change.
+ */
+struct WarmStartSession {
+    std::string clientId;
+    std::string host;
+    int port = 1883;
+    // Its username and password are not recorded; see requiresCredentials.
+    ConnectOptions options;
+    // The connect had a username or password, which the app supplies again at warm start.
+    bool requiresCredentials = false;
+    // Capacity of the client's outbound store, 0 without persistence.
+    size_t storeCapacity = 0;
+    std::vector<std::pair<std::string, int>> filters;
+};
+
+/**
+ * Directory of recorded sessions, one checksummed file per client, each replaced atomically. The files hold the
+ * host, client id and filters but no credentials; the directory should still be private to the app.
+ */
+class WarmStartStore {
+public:
+    explicit WarmStartStore(std::string directory);
+
+    bool save(const WarmStartSession &session, std::string &error) const;
+    void remove(const std::string &clientId) const;
+
+    /**
+     * Every session recorded in the directory; unreadable files are skipped, corrupt ones (and ones of an earlier
+     * version, which held the password) are deleted.
+     */
+    std::vector<WarmStartSession> load() const;
+
+    static std::string encode(const WarmStartSession &session);
+    static bool decode(std::string_view data, WarmStartSession &session);
+
+private:
+    std::string pathOf(const std::string &clientId) const;
+
+    const std::string directory_;
+};
+
+/**
+ * Process wide record of the clients started natively at launch (warm start) that JS has not taken over yet.
+ *
+ * start() runs from Application.onCreate / didFinishLaunching, in parallel with loading the JS bundle: every
+ * recorded session becomes a registered Client that connects and subscribes right away and holds what it receives
+ * (see Client::warmStart). When JS then creates a client with the same clientId, host and port, adopt() hands it
+ * the running one instead of a new one.
+ */
+class WarmStart {
+public:
+    /**
+     * Creates and registers the client of a session, or returns nullptr when it cannot be created.
+     */
+    using ClientFactory = std::function<std::shared_ptr<Client>(const WarmStartSession &session)>;
+
+    /**
+     * Fills in the username and password of a session that requires credentials, from wherever the app keeps them
+     * (Keychain, Keystore), or returns false to leave that client to JS.
+     */
+    using CredentialsProvider =
+        std::function<bool(const std::string &clientId, std::string &username, std::string &password)>;
+
+    static WarmStart &shared();
+
+    /**
+     * Starts a client for every session in store; without credentials, sessions that require them are skipped.
+     * Returns the number of clients started.
+     */
+    size_t start(const WarmStartStore &store, const ClientFactory &createClient,
+                 const CredentialsProvider &credentials = nullptr);
+
+    /**
+     * JS creates clientId: returns the warm started client when it connects to host and port. One for another host
+     * or port is removed from registry, so JS creates a fresh client; nullptr then, as without a warm started one.
+     */
+    std::shared_ptr<Client> adopt(const std::string &clientId, const std::string &host, int port,
+                                  ClientRegistry &registry = ClientRegistry::shared());
+
+    /**
+     * JS creates clientId in a way the warm started client cannot serve (TLS, a shared connection): removes it from
+     * registry so JS creates a fresh client.
+     */
+    void discard(const std::string &clientId, ClientRegistry &registry = ClientRegistry::shared());
+
+    /**
+     * Warm started clients JS has not taken over.
+     */
+    size_t pendingCount() const;
+
+private:
+    mutable std::mutex mutex_;
+    // clientId to host and port.
+    std::unordered_map<std::string, std::pair<std::string, int>> pending_;
+};
+
+}
@@ -0,0 +1,126 @@
+//
+//  DecompressionBenchmark.cpp
+//  d11-mqtt
+//
+//  Cost of inflating received payloads natively (PayloadDecompressor) against the size of the string JS would
+//  otherwise receive: scorecard JSON of growing size, compressed without and with a preset dictionary. The counters
+//  report the bytes on the wire next to the bytes of the JS string, and BM_ClientOnMessage* compare routing a plain
+//  message with routing its compressed form.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <zlib.h>
+
+#include <memory>
+#include <string>
+
+#include "MqttClient.h"
+#include "MqttEventSink.h"
+#include "MqttPayloadDecompressor.h"
+
+using namespace mqtt;
+
+namespace {
+
+const std::string DICTIONARY =
+    "{\"over\":,\"runs\":,\"wickets\":,\"bowler\":\"player-\",\"batter\":\"player-\",\"extras\":0}"
+    "{\"matchId\":\"IND-AUS-2026-T20-03\",\"innings\":[";
+
+std::string scorecard(int overs) {
+    std::string json = "{\"matchId\":\"IND-AUS-2026-T20-03\",\"innings\":[";
+    for (int over = 0; over < overs; over++) {
+        json += (over ? "," : "");
+        json += "{\"over\":" + std::to_string(over) + ",\"runs\":" + std::to_string(over * 7 % 13) +
+                ",\"wickets\":" + std::to_string(over % 3 == 0) + ",\"bowler\":\"player-" + std::to_string(over % 5) +
+                "\",\"batter\":\"player-" + std::to_string(over % 11) + "\",\"extras\":0}";
+    }
+    return json + "]}";
+}
+
+std::string compress(const std::string &input, bool withDictionary) {
+    z_stream stream{};
+    deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+    if (withDictionary) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(DICTIONARY.data()),
+                             static_cast<uInt>(DICTIONARY.size()));
+    }
+    std::string output(deflateBound(&stream, input.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+class NullSink : public EventSink {
+public:
+    void emit(std::string, EventValue) override {}
+    void emitMessage(std::string, MqttMessage message) override { benchmark::DoNotOptimize(message.payload.data()); }
+};
+
+class NullTransport : public Transport {
+public:
+    void connect(const ConnectOptions &) override {}
+    void disconnect() override {}
+    void subscribe(const std::string &, int) override {}
+    void unsubscribe(const std::string &) override {}
+    void publish(const std::string &, const uint8_t *, size_t, int, bool) override {}
+    void close() override {}
+};
+
+}
+
+/**
+ * Args: overs in the scorecard, whether it was compressed with the preset dictionary.
+ */
+void BM_Decompress(benchmark::State &state) {
+    PayloadDecompressor decompressor;
+    decompressor.addDictionary(DICTIONARY);
+    const std::string original = scorecard(static_cast<int>(state.range(0)));
+    const std::string compressed = compress(original, state.range(1) != 0);
+    std::string error;
+    for (auto _ : state) {
+        std::string payload = compressed;
+        if (!decompressor.decompress("deflate", payload, error)) {
+            state.SkipWithError(error.c_str());
+            break;
+        }
+        benchmark::DoNotOptimize(payload.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * original.size()));
+    state.counters["wireBytes"] = static_cast<double>(compressed.size());
+    state.counters["jsStringBytes"] = static_cast<double>(original.size());
+}
+BENCHMARK(BM_Decompress)->Args({2, 0})->Args({2, 1})->Args({20, 0})->Args({20, 1})->Args({200, 0})->Args({200, 1});
+
+void BM_ClientOnMessagePlain(benchmark::State &state) {
+    Client client("client", std::make_shared<NullTransport>(), std::make_shared<NullSink>());
+    client.subscribe("a", "score/#", 0);
+    const std::string original = scorecard(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        client.onMessage("score/match/1", original, 0);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * original.size()));
+}
+BENCHMARK(BM_ClientOnMessagePlain)->Arg(20)->Arg(200);
+
+void BM_ClientOnMessageCompressed(benchmark::State &state) {
+    Client client("client", std::make_shared<NullTransport>(), std::make_shared<NullSink>());
+    client.subscribe("a", "score/#", 0);
+    client.addCompressionDictionary(DICTIONARY);
+    const std::string original = scorecard(static_cast<int>(state.range(0)));
+    const std::string compressed = compress(original, true);
+    const UserProperties deflate{{CONTENT_ENCODING_PROPERTY, "deflate"}};
+    for (auto _ : state) {
+        client.onMessage("score/match/1", compressed, 0, 0, 0, deflate);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * original.size()));
+    state.counters["wireBytes"] = static_cast<double>(compressed.size());
+}
+BENCHMARK(BM_ClientOnMessageCompressed)->Arg(20)->Arg(200);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,194 @@
+//
+//  EngineBenchmark.cpp
+//  d11-mqtt
+//
+//  Codec and loopback benchmarks of the native engine. HiveMQ and CocoaMQTT do not run on the host, so their
+//  per-packet allocation pattern (a fresh frame plus an owned payload copy for every message) is reproduced in
+//  BM_EncodePublishAllocating as the baseline for BM_EncodePublishReused. Round trips go through LoopbackBroker.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "LoopbackBroker.h"
+#include "MqttClient.h"
+#include "MqttCodec.h"
+#include "MqttEventLoop.h"
+#include "MqttEventSink.h"
+#include "MqttSocketTransport.h"
+
+using namespace mqtt;
+
+namespace {
+
+PublishPacket makePublish(const std::string &payload) {
+    PublishPacket publish;
+    publish.topic = "score/match/1234/innings/1";
+    publish.payload = reinterpret_cast<const uint8_t *>(payload.data());
+    publish.payloadSize = payload.size();
+    publish.qos = 1;
+    publish.packetId = 1;
+    return publish;
+}
+
+void BM_EncodePublishReused(benchmark::State &state) {
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    PublishPacket publish = makePublish(payload);
+    std::vector<uint8_t> buffer;
+    for (auto _ : state) {
+        buffer.clear();
+        PacketWriter(buffer).publish(publish);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_EncodePublishReused)->Arg(64)->Arg(1024)->Arg(16 * 1024);
+
+void BM_EncodePublishAllocating(benchmark::State &state) {
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        // Owned message copy, then a frame of its own, as the platform clients do per publish.
+        auto message = std::make_unique<std::vector<uint8_t>>(payload.begin(), payload.end());
+        std::string topic = "score/match/1234/innings/1";
+        PublishPacket publish = makePublish(payload);
+        publish.topic = topic;
+        publish.payload = message->data();
+        std::vector<uint8_t> frame;
+        PacketWriter(frame).publish(publish);
+        benchmark::DoNotOptimize(frame.data());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_EncodePublishAllocating)->Arg(64)->Arg(1024)->Arg(16 * 1024);
+
+void BM_DecodePublishStream(benchmark::State &state) {
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    PublishPacket publish = makePublish(payload);
+    std::vector<uint8_t> stream;
+    const int packets = 256;
+    for (int i = 0; i < packets; i++) {
+        PacketWriter(stream).publish(publish);
+    }
+    PacketReader reader;
+    Packet packet;
+    for (auto _ : state) {
+        reader.append(stream.data(), stream.size());
+        while (reader.next(packet) == DecodeStatus::Ok) {
+            benchmark::DoNotOptimize(packet.payload);
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * packets);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(stream.size()));
+}
+BENCHMARK(BM_DecodePublishStream)->Arg(64)->Arg(1024);
+
+/**
+ * Counts delivered messages and lets the benchmark thread wait for a target count.
+ */
+class CountingSink : public EventSink {
+public:
+    void emit(std::string eventId, EventValue) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(std::move(eventId));
+        changed_.notify_all();
+    }
+
+    void emitMessage(std::string, MqttMessage) override {
+        if (received_.fetch_add(1, std::memory_order_acq_rel) + 1 >= target_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changed_.notify_all();
+        }
+    }
+
+    void waitForEvent(const std::string &eventId) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] {
+            for (const auto &event : events_) {
+                if (event == eventId) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    void expect(uint64_t count) { target_.store(received_.load() + count, std::memory_order_release); }
+
+    void waitForMessages() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] { return received_.load(std::memory_order_acquire) >= target_.load(); });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::string> events_;
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> target_{~0ull};
+};
+
+struct LoopbackSession {
+    LoopbackSession() {
+        transport = std::make_shared<SocketTransport>("bench", "127.0.0.1", broker.port(), loop);
+        client = std::make_shared<Client>("bench", transport, sink);
+        transport->attach(client);
+        client->connect(ConnectOptions());
+        sink->waitForEvent("benchconnected");
+        client->subscribe("sub", "bench/#", 0);
+        sink->waitForEvent("subsubscribe_success");
+    }
+
+    ~LoopbackSession() {
+        client->close();
+        std::promise<void> drained;
+        loop.post([&drained] { drained.set_value(); });
+        drained.get_future().wait();
+    }
+
+    EventLoop loop;
+    test::LoopbackBroker broker;
+    std::shared_ptr<CountingSink> sink = std::make_shared<CountingSink>();
+    std::shared_ptr<SocketTransport> transport;
+    std::shared_ptr<Client> client;
+};
+
+void BM_LoopbackRoundTrip(benchmark::State &state) {
+    LoopbackSession session;
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    const auto *data = reinterpret_cast<const uint8_t *>(payload.data());
+    for (auto _ : state) {
+        session.sink->expect(1);
+        session.client->publish("bench/latency", data, payload.size(), 0, false);
+        session.sink->waitForMessages();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_LoopbackRoundTrip)->Arg(64)->Arg(4096)->UseRealTime();
+
+void BM_LoopbackThroughput(benchmark::State &state) {
+    LoopbackSession session;
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    const auto *data = reinterpret_cast<const uint8_t *>(payload.data());
+    const int burst = 1000;
+    for (auto _ : state) {
+        session.sink->expect(burst);
+        for (int i = 0; i < burst; i++) {
+            session.client->publish("bench/throughput", data, payload.size(), 0, false);
+        }
+        session.sink->waitForMessages();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * burst);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * burst * state.range(0));
+}
+BENCHMARK(BM_LoopbackThroughput)->Arg(64)->Arg(4096)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,127 @@
+//
+//  JNIBindingBenchmark.cpp
+//  d11-mqtt
+//
+//  Per-call overhead of calling into Java from the Android adapter, in an embedded JVM. Each pair compares the
+//  lookups cpp-adapter.cpp used to repeat on every call (FindClass, GetObjectClass, GetMethodID, varargs Call*Method)
+//  with the typed jni::Method / jni::StaticMethod it now resolves once at install: a call with a String argument like
+//  the transport's subscribe, and the direct ByteBuffer allocation and fill of every publish. Android's ART is not
+//  HotSpot, so absolute numbers differ on devices; the gap between the two columns is what this tracks.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "JNIBinding.h"
+
+namespace {
+
+/**
+ * The JVM of the process, created on first use; a process can only create one.
+ */
+JNIEnv *jniEnv() {
+    static JNIEnv *env = [] {
+        JavaVM *vm = nullptr;
+        JNIEnv *created = nullptr;
+        JavaVMInitArgs args{};
+        args.version = JNI_VERSION_1_8;
+        args.ignoreUnrecognized = JNI_FALSE;
+        if (JNI_CreateJavaVM(&vm, reinterpret_cast<void **>(&created), &args) != JNI_OK) {
+            std::fprintf(stderr, "Failed to create the JVM\n");
+            std::abort();
+        }
+        return created;
+    }();
+    return env;
+}
+
+jclass globalClass(JNIEnv *env, const char *name) {
+    jclass local = env->FindClass(name);
+    auto global = static_cast<jclass>(env->NewGlobalRef(local));
+    env->DeleteLocalRef(local);
+    return global;
+}
+
+/*
+ * String.compareTo(String): an instance method taking a String, the shape of MqttHelper.subscribe(topic, qos).
+ */
+void BM_StringCallWithPerCallLookup(benchmark::State &state) {
+    JNIEnv *env = jniEnv();
+    jstring receiver = env->NewStringUTF("score/1");
+    jstring topic = env->NewStringUTF("score/2");
+    for (auto _ : state) {
+        // The boxing classes executeJNIFunction looked up before every call.
+        for (const char *name : {"java/lang/Double", "java/lang/Boolean", "java/lang/Integer", "java/lang/Long",
+                                 "java/util/HashMap", "java/util/ArrayList", "java/lang/String", "java/lang/Float"}) {
+            jclass clazz = env->FindClass(name);
+            env->DeleteLocalRef(clazz);
+        }
+        jclass clazz = env->GetObjectClass(receiver);
+        jmethodID compareTo = env->GetMethodID(clazz, "compareTo", "(Ljava/lang/String;)I");
+        benchmark::DoNotOptimize(env->CallIntMethod(receiver, compareTo, topic));
+        env->DeleteLocalRef(clazz);
+    }
+    env->DeleteLocalRef(topic);
+    env->DeleteLocalRef(receiver);
+}
+BENCHMARK(BM_StringCallWithPerCallLookup);
+
+void BM_StringCallWithTypedMethod(benchmark::State &state) {
+    JNIEnv *env = jniEnv();
+    jclass stringClass = globalClass(env, "java/lang/String");
+    mqtt::jni::Method<jint(jstring)> compareTo;
+    compareTo.resolve(env, stringClass, "compareTo");
+    jstring receiver = env->NewStringUTF("score/1");
+    jstring topic = env->NewStringUTF("score/2");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compareTo(env, receiver, topic));
+    }
+    env->DeleteLocalRef(topic);
+    env->DeleteLocalRef(receiver);
+    env->DeleteGlobalRef(stringClass);
+}
+BENCHMARK(BM_StringCallWithTypedMethod);
+
+/*
+ * ByteBuffer.allocateDirect(size) and the copy of the payload into it, as JNITransport::publish does for every
+ * publish; range(0) is the payload size.
+ */
+void BM_PublishBufferWithPerCallLookup(benchmark::State &state) {
+    JNIEnv *env = jniEnv();
+    std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
+        jmethodID allocateDirect =
+            env->GetStaticMethodID(byteBufferClass, "allocateDirect", "(I)Ljava/nio/ByteBuffer;");
+        jobject buffer = env->CallStaticObjectMethod(byteBufferClass, allocateDirect, (jint)payload.size());
+        std::memcpy(env->GetDirectBufferAddress(buffer), payload.data(), payload.size());
+        env->DeleteLocalRef(buffer);
+        env->DeleteLocalRef(byteBufferClass);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_PublishBufferWithPerCallLookup)->Arg(64)->Arg(4096);
+
+void BM_PublishBufferWithTypedMethod(benchmark::State &state) {
+    JNIEnv *env = jniEnv();
+    jclass byteBufferClass = globalClass(env, "java/nio/ByteBuffer");
+    mqtt::jni::StaticMethod<mqtt::jni::ByteBuffer(jint)> allocateDirect;
+    allocateDirect.resolve(env, byteBufferClass, "allocateDirect");
+    std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        mqtt::jni::ByteBuffer buffer = allocateDirect(env, (jint)payload.size());
+        std::memcpy(env->GetDirectBufferAddress(buffer.ref), payload.data(), payload.size());
+        env->DeleteLocalRef(buffer.ref);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    env->DeleteGlobalRef(byteBufferClass);
+}
+BENCHMARK(BM_PublishBufferWithTypedMethod)->Arg(64)->Arg(4096);
+
+}
+
+BENCHMARK_MAIN();
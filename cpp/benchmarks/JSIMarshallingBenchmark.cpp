@@ -0,0 +1,143 @@
+//
+//  JSIMarshallingBenchmark.cpp
+//  d11-mqtt
+//
+//  The jsi::Value half of the native<->JS marshalling, on a host Hermes runtime: convertEventValueToJSIValue for the
+//  payloads MarshallingBenchmark.cpp builds, convertJSIValueToEventValue for the values JS hands to native code
+//  (message filters, background handler results), a received message in each payload format, and a whole
+//  EventDispatcher flush into a JS listener. Hermes on a device is slower than on a CI host; the changes between
+//  runs are what this tracks.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <hermes/hermes.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MarshallingPayloads.h"
+#include "MqttEventDispatcher.h"
+#include "MqttJson.h"
+
+using namespace mqtt;
+using namespace mqtt::benchmarks;
+
+namespace {
+
+jsi::Value evaluate(jsi::Runtime &runtime, const std::string &source) {
+    return runtime.evaluateJavaScript(std::make_shared<jsi::StringBuffer>(source), "JSIMarshallingBenchmark.js");
+}
+
+void convertToJSI(benchmark::State &state, const EventValue &value) {
+    auto runtime = facebook::hermes::makeHermesRuntime();
+    for (auto _ : state) {
+        jsi::Value converted = convertEventValueToJSIValue(*runtime, value);
+        benchmark::DoNotOptimize(&converted);
+    }
+}
+
+void convertFromJSI(benchmark::State &state, const EventValue &value) {
+    auto runtime = facebook::hermes::makeHermesRuntime();
+    jsi::Value source = convertEventValueToJSIValue(*runtime, value);
+    for (auto _ : state) {
+        EventValue converted = convertJSIValueToEventValue(*runtime, source);
+        benchmark::DoNotOptimize(&converted);
+    }
+}
+
+void BM_FlatMapToJSI(benchmark::State &state) {
+    convertToJSI(state, makeFlatMap());
+}
+BENCHMARK(BM_FlatMapToJSI);
+
+void BM_NestedMapToJSI(benchmark::State &state) {
+    convertToJSI(state, makeNestedMap(static_cast<int>(state.range(0))));
+}
+BENCHMARK(BM_NestedMapToJSI)->Arg(1)->Arg(20);
+
+void BM_LargeArrayToJSI(benchmark::State &state) {
+    convertToJSI(state, makeLargeArray(static_cast<size_t>(state.range(0))));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_LargeArrayToJSI)->Arg(1000)->Arg(100000);
+
+void BM_FlatMapFromJSI(benchmark::State &state) {
+    convertFromJSI(state, makeFlatMap());
+}
+BENCHMARK(BM_FlatMapFromJSI);
+
+void BM_NestedMapFromJSI(benchmark::State &state) {
+    convertFromJSI(state, makeNestedMap(static_cast<int>(state.range(0))));
+}
+BENCHMARK(BM_NestedMapFromJSI)->Arg(1)->Arg(20);
+
+/**
+ * A received message as its listener gets it; range(0) is the PayloadFormat, range(1) the payload size. The Json
+ * payload is parsed once up front, as the network thread does before the message is queued.
+ */
+void BM_MessageToJSI(benchmark::State &state) {
+    auto runtime = facebook::hermes::makeHermesRuntime();
+    auto format = static_cast<PayloadFormat>(state.range(0));
+    MqttMessage message;
+    message.topic = "score/match/1";
+    message.payload = "{\"runs\":\"" + std::string(static_cast<size_t>(state.range(1)), 'x') + "\"}";
+    if (format == PayloadFormat::Json) {
+        std::string text = message.payload;
+        message.json = parseJson(text);
+    }
+    for (auto _ : state) {
+        // ArrayBuffer moves the payload out of the message.
+        MqttMessage copy = message;
+        jsi::Value converted = convertMqttMessageToJSIValue(*runtime, copy, format);
+        benchmark::DoNotOptimize(&converted);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+}
+BENCHMARK(BM_MessageToJSI)
+    ->ArgNames({"format", "size"})
+    ->Args({static_cast<int64_t>(PayloadFormat::String), 64})
+    ->Args({static_cast<int64_t>(PayloadFormat::String), 4096})
+    ->Args({static_cast<int64_t>(PayloadFormat::ArrayBuffer), 64})
+    ->Args({static_cast<int64_t>(PayloadFormat::ArrayBuffer), 4096})
+    ->Args({static_cast<int64_t>(PayloadFormat::Json), 64});
+
+/**
+ * range(0) messages emitted from native code, then the JS thread's flush that hands each of them to a JS listener.
+ */
+void BM_DispatcherFlush(benchmark::State &state) {
+    auto runtime = facebook::hermes::makeHermesRuntime();
+    std::vector<std::function<void()>> tasks;
+    auto dispatcher = std::make_shared<EventDispatcher>(
+        *runtime, [&tasks](std::function<void()> &&task) { tasks.push_back(std::move(task)); });
+    evaluate(*runtime, "globalThis.received = 0");
+    dispatcher->addListener(
+        "benchmessage", evaluate(*runtime, "(message) => { received++; }").getObject(*runtime).getFunction(*runtime));
+
+    MqttMessage message;
+    message.topic = "score/match/1";
+    message.payload = std::string(64, 'x');
+    for (auto _ : state) {
+        for (int64_t i = 0; i < state.range(0); i++) {
+            dispatcher->emitMessage("benchmessage", message);
+        }
+        std::vector<std::function<void()>> scheduled;
+        scheduled.swap(tasks);
+        for (auto &task : scheduled) {
+            task();
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    dispatcher->releaseListeners();
+    for (auto &task : tasks) {
+        task();
+    }
+}
+BENCHMARK(BM_DispatcherFlush)->Arg(1)->Arg(100);
+
+}
+
+BENCHMARK_MAIN();
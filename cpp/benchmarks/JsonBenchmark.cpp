@@ -0,0 +1,55 @@
+//
+//  JsonBenchmark.cpp
+//  d11-mqtt
+//
+//  Parsing cost of a typical live score payload with parseJson, which runs on the network thread for subscriptions
+//  with payloadFormat 'json' instead of JSON.parse on the JS thread.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "MqttJson.h"
+
+using namespace mqtt;
+
+namespace {
+
+std::string makeScorePayload(int balls) {
+    std::string payload = R"({"matchId":"IND-AUS-2026-T20-03","status":"live","innings":2,"batting":"IND",)"
+                          R"("score":{"runs":187,"wickets":4,"overs":18.3},"commentary":"Short and wide, \"cut\" away for four",)"
+                          R"("balls":[)";
+    for (int i = 0; i < balls; i++) {
+        payload += (i ? "," : "");
+        payload += R"({"over":)" + std::to_string(i / 6) + R"(,"ball":)" + std::to_string(i % 6 + 1) +
+                   R"(,"runs":4,"extras":0,"batter":"Player Name","bowler":"Other Player","wicket":false})";
+    }
+    payload += "]}";
+    return payload;
+}
+
+void BM_ParseJson(benchmark::State &state) {
+    const std::string payload = makeScorePayload(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        std::string text = payload;
+        auto document = parseJson(text);
+        benchmark::DoNotOptimize(document.get());
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(payload.size()));
+}
+BENCHMARK(BM_ParseJson)->Arg(1)->Arg(36)->Arg(600);
+
+void BM_FindMember(benchmark::State &state) {
+    std::string text = makeScorePayload(36);
+    auto document = parseJson(text);
+    for (auto _ : state) {
+        auto score = document->find(JsonDocument::ROOT, "score");
+        benchmark::DoNotOptimize(document->number(document->find(score, "runs")));
+    }
+}
+BENCHMARK(BM_FindMember);
+
+}
+
+BENCHMARK_MAIN();
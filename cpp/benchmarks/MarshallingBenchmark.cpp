@@ -0,0 +1,228 @@
+//
+//  MarshallingBenchmark.cpp
+//  d11-mqtt
+//
+//  Cost of the platform independent half of the native<->JS marshalling: building the EventValue copies that the
+//  platform threads hand to the dispatcher (flat option/event maps, nested snapshots, large arrays), routing a
+//  received message through Client to its subscribers, and the end-to-end delivery latency of paced traffic through
+//  LoopbackBroker. The jsi::Value half is JSIMarshallingBenchmark.cpp.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LoopbackBroker.h"
+#include "MarshallingPayloads.h"
+#include "MqttClient.h"
+#include "MqttEventLoop.h"
+#include "MqttEventSink.h"
+#include "MqttMetrics.h"
+#include "MqttSocketTransport.h"
+
+using namespace mqtt;
+using namespace mqtt::benchmarks;
+
+namespace {
+
+void BM_BuildFlatMap(benchmark::State &state) {
+    for (auto _ : state) {
+        EventValue value = makeFlatMap();
+        benchmark::DoNotOptimize(&value);
+    }
+}
+BENCHMARK(BM_BuildFlatMap);
+
+void BM_BuildNestedMap(benchmark::State &state) {
+    for (auto _ : state) {
+        EventValue value = makeNestedMap(static_cast<int>(state.range(0)));
+        benchmark::DoNotOptimize(&value);
+    }
+}
+BENCHMARK(BM_BuildNestedMap)->Arg(1)->Arg(20);
+
+void BM_BuildLargeArray(benchmark::State &state) {
+    for (auto _ : state) {
+        EventValue value = makeLargeArray(static_cast<size_t>(state.range(0)));
+        benchmark::DoNotOptimize(&value);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_BuildLargeArray)->Arg(1000)->Arg(100000);
+
+/**
+ * Copying an already built payload, as the baseline that BM_BuildNestedMap's per-node allocations compare against.
+ */
+void BM_CopyNestedMap(benchmark::State &state) {
+    const EventValue source = makeNestedMap(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        EventValue copy = source;
+        benchmark::DoNotOptimize(&copy);
+    }
+}
+BENCHMARK(BM_CopyNestedMap)->Arg(1)->Arg(20);
+
+void BM_MetricsSnapshot(benchmark::State &state) {
+    ClientMetrics metrics;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        metrics.recordReceived("score/match/" + std::to_string(i), 64);
+    }
+    for (auto _ : state) {
+        EventValue snapshot = metrics.snapshot();
+        benchmark::DoNotOptimize(&snapshot);
+    }
+}
+BENCHMARK(BM_MetricsSnapshot)->Arg(1)->Arg(256);
+
+class NullTransport : public Transport {
+public:
+    void connect(const ConnectOptions &) override {}
+    void disconnect() override {}
+    void subscribe(const std::string &, int) override {}
+    void unsubscribe(const std::string &) override {}
+    void publish(const std::string &, const uint8_t *, size_t, int, bool) override {}
+    void close() override {}
+};
+
+class NullSink : public EventSink {
+public:
+    void emit(std::string, EventValue) override {}
+    void emitMessage(std::string eventId, MqttMessage message) override {
+        benchmark::DoNotOptimize(eventId.data());
+        benchmark::DoNotOptimize(message.payload.data());
+    }
+};
+
+/**
+ * What a received message costs in the core before it reaches the dispatcher: metrics, routing and one MqttMessage
+ * per matching subscription. range(0) is the payload size, range(1) the number of matching subscriptions.
+ */
+void BM_ClientOnMessage(benchmark::State &state) {
+    Client client("bench", std::make_shared<NullTransport>(), std::make_shared<NullSink>());
+    const char *filters[] = {"score/match/1", "score/+/1", "score/#", "#"};
+    for (int64_t i = 0; i < state.range(1); i++) {
+        client.subscribe("sub" + std::to_string(i), filters[i], 0);
+    }
+    const std::string payload(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        client.onMessage("score/match/1", payload, 0);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_ClientOnMessage)->Args({64, 1})->Args({4096, 1})->Args({64, 4});
+
+/**
+ * Records the delay between the send time stamped into each payload and its delivery.
+ */
+class LatencySink : public EventSink {
+public:
+    void emit(std::string eventId, EventValue) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.push_back(std::move(eventId));
+        changed_.notify_all();
+    }
+
+    void emitMessage(std::string, MqttMessage message) override {
+        int64_t sentAt = 0;
+        if (message.payload.size() >= sizeof(sentAt)) {
+            std::memcpy(&sentAt, message.payload.data(), sizeof(sentAt));
+            latencyUs.record(static_cast<uint64_t>(monotonicNanos() - sentAt) / 1000);
+        }
+        if (received_.fetch_add(1, std::memory_order_acq_rel) + 1 >= target_.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            changed_.notify_all();
+        }
+    }
+
+    void waitForEvent(const std::string &eventId) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&] {
+            for (const auto &event : events_) {
+                if (event == eventId) {
+                    return true;
+                }
+            }
+            return false;
+        });
+    }
+
+    void expect(uint64_t count) { target_.store(received_.load() + count, std::memory_order_release); }
+
+    bool waitForMessages(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, timeout,
+                                 [&] { return received_.load(std::memory_order_acquire) >= target_.load(); });
+    }
+
+    LatencyHistogram latencyUs;
+
+private:
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::string> events_;
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> target_{~0ull};
+};
+
+/**
+ * Publishes at range(0) messages per second through the native engine and LoopbackBroker for 200 ms per iteration
+ * and reports the delivery latency percentiles as counters, in microseconds.
+ */
+void BM_LoopbackDeliveryLatency(benchmark::State &state) {
+    EventLoop loop;
+    test::LoopbackBroker broker;
+    auto sink = std::make_shared<LatencySink>();
+    auto transport = std::make_shared<SocketTransport>("bench", "127.0.0.1", broker.port(), loop);
+    auto client = std::make_shared<Client>("bench", transport, sink);
+    transport->attach(client);
+    client->connect(ConnectOptions());
+    sink->waitForEvent("benchconnected");
+    client->subscribe("sub", "bench/#", 0);
+    sink->waitForEvent("subsubscribe_success");
+
+    const auto rate = state.range(0);
+    const auto interval = std::chrono::nanoseconds(1000000000 / rate);
+    const int64_t perIteration = rate / 5;
+    std::string payload(64, 'x');
+    int64_t lost = 0;
+    for (auto _ : state) {
+        sink->expect(static_cast<uint64_t>(perIteration));
+        auto next = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < perIteration; i++) {
+            std::this_thread::sleep_until(next);
+            next += interval;
+            int64_t sentAt = monotonicNanos();
+            std::memcpy(&payload[0], &sentAt, sizeof(sentAt));
+            client->publish("bench/latency", reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 0,
+                            false);
+        }
+        if (!sink->waitForMessages(std::chrono::seconds(5))) {
+            lost++;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * perIteration);
+    state.counters["p50_us"] = static_cast<double>(sink->latencyUs.valueAtQuantile(0.5));
+    state.counters["p99_us"] = static_cast<double>(sink->latencyUs.valueAtQuantile(0.99));
+    state.counters["max_us"] = static_cast<double>(sink->latencyUs.valueAtQuantile(1));
+    state.counters["timeouts"] = static_cast<double>(lost);
+
+    client->close();
+    std::promise<void> drained;
+    loop.post([&drained] { drained.set_value(); });
+    drained.get_future().wait();
+}
+BENCHMARK(BM_LoopbackDeliveryLatency)->Arg(1000)->Arg(10000)->Arg(50000)->Iterations(5)->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
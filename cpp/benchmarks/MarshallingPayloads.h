@@ -0,0 +1,79 @@
+//
+//  MarshallingPayloads.h
+//  d11-mqtt
+//
+//  Event payloads of the shapes the marshalling benchmarks convert, shared so the EventValue and the jsi::Value
+//  halves measure the same data.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include "MqttEventValue.h"
+
+namespace mqtt {
+namespace benchmarks {
+
+/**
+ * The connection_state payload: a handful of scalar fields, the shape of most client events.
+ */
+inline EventValue makeFlatMap() {
+    EventValue::Map payload;
+    payload.emplace_back("state", "connected");
+    payload.emplace_back("lastReasonCode", 0);
+    payload.emplace_back("retryCount", 0);
+    payload.emplace_back("lastConnectedAt", 1.7e12);
+    payload.emplace_back("clientConnected", true);
+    payload.emplace_back("errorMessage", "");
+    return EventValue(std::move(payload));
+}
+
+/**
+ * A nested payload of the depth of a scoreboard update: innings, then overs, then balls.
+ */
+inline EventValue makeNestedMap(int width) {
+    EventValue::Array innings;
+    for (int i = 0; i < 2; i++) {
+        EventValue::Array overs;
+        for (int over = 0; over < width; over++) {
+            EventValue::Array balls;
+            for (int ball = 0; ball < 6; ball++) {
+                EventValue::Map delivery;
+                delivery.emplace_back("ball", ball + 1);
+                delivery.emplace_back("runs", 4);
+                delivery.emplace_back("batter", "Player Name");
+                delivery.emplace_back("wicket", false);
+                balls.emplace_back(std::move(delivery));
+            }
+            EventValue::Map entry;
+            entry.emplace_back("over", over);
+            entry.emplace_back("balls", std::move(balls));
+            overs.emplace_back(std::move(entry));
+        }
+        EventValue::Map entry;
+        entry.emplace_back("team", i == 0 ? "IND" : "AUS");
+        entry.emplace_back("overs", std::move(overs));
+        innings.emplace_back(std::move(entry));
+    }
+    EventValue::Map payload;
+    payload.emplace_back("matchId", "IND-AUS-2026-T20-03");
+    payload.emplace_back("innings", std::move(innings));
+    return EventValue(std::move(payload));
+}
+
+/**
+ * An array of size numbers, the shape of a bulk update.
+ */
+inline EventValue makeLargeArray(size_t size) {
+    EventValue::Array items;
+    items.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        items.emplace_back(static_cast<double>(i));
+    }
+    return EventValue(std::move(items));
+}
+
+}
+}
@@ -0,0 +1,78 @@
+//
+//  OutboundStoreBenchmark.cpp
+//  d11-mqtt
+//
+//  Cost of persisting outgoing QoS 1 messages in the OutboundStore (append on publish, complete on PUBACK,
+//  including the compactions this triggers) and of recovering a store full of pending messages on startup.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "MqttOutboundStore.h"
+
+using namespace mqtt;
+
+namespace {
+
+std::string storePath(const char *name) {
+    return std::string(P_tmpdir) + "/mqtt-benchmark-" + name + ".outbox";
+}
+
+std::unique_ptr<OutboundStore> openStore(const std::string &path, size_t capacity) {
+    std::string error;
+    auto store = OutboundStore::open(path, capacity, error);
+    if (!store) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        std::abort();
+    }
+    return store;
+}
+
+void BM_AppendComplete(benchmark::State &state) {
+    const std::string path = storePath("append");
+    std::remove(path.c_str());
+    auto store = openStore(path, OutboundStore::DEFAULT_CAPACITY);
+    const std::string payload(static_cast<size_t>(state.range(0)), 'p');
+    const auto *bytes = reinterpret_cast<const uint8_t *>(payload.data());
+    for (auto _ : state) {
+        uint64_t sequence = store->append("orders/user/12345", bytes, payload.size(), 1, false, 1);
+        store->complete(sequence);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    store.reset();
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_AppendComplete)->Arg(64)->Arg(512)->Arg(4096);
+
+void BM_Recover(benchmark::State &state) {
+    const std::string path = storePath("recover");
+    std::remove(path.c_str());
+    const size_t capacity = 16 * 1024 * 1024;
+    const std::string payload(256, 'p');
+    int64_t pending = 0;
+    {
+        auto store = openStore(path, capacity);
+        for (int64_t i = 0; i < state.range(0); i++) {
+            if (store->append("orders/user/12345", reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 1,
+                              false, 0) != 0) {
+                pending++;
+            }
+        }
+    }
+    for (auto _ : state) {
+        auto store = openStore(path, capacity);
+        benchmark::DoNotOptimize(store->size());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * pending);
+    std::remove(path.c_str());
+}
+BENCHMARK(BM_Recover)->Arg(1000)->Arg(10000)->Unit(benchmark::kMicrosecond);
+
+}
+
+BENCHMARK_MAIN();
@@ -0,0 +1,84 @@
+//
+//  PublishBenchmark.cpp
+//  d11-mqtt
+//
+//  Outbound publishing of the native engine through LoopbackBroker: messages per second and bytes on the wire per
+//  message, with and without topic aliases. The first argument is the Topic Alias Maximum the broker announces (0
+//  for none), the second the payload size. Bursts cycle over a small set of long telemetry topics, as a device
+//  reporting its sensors does.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LoopbackBroker.h"
+#include "MqttClient.h"
+#include "MqttEventLoop.h"
+#include "MqttEventSink.h"
+#include "MqttSocketTransport.h"
+
+using namespace mqtt;
+
+namespace {
+
+class NullSink : public EventSink {
+public:
+    void emit(std::string, EventValue) override {}
+    void emitMessage(std::string, MqttMessage) override {}
+};
+
+void waitForPublishes(test::LoopbackBroker &broker, size_t count) {
+    while (broker.publishPacketCount() < count) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+void BM_PublishBurst(benchmark::State &state) {
+    test::LoopbackBroker broker;
+    broker.setTopicAliasMaximum(static_cast<uint16_t>(state.range(0)));
+    EventLoop loop;
+    auto transport = std::make_shared<SocketTransport>("bench", "127.0.0.1", broker.port(), loop);
+    auto client = std::make_shared<Client>("bench", transport, std::make_shared<NullSink>());
+    transport->attach(client);
+    client->connect(ConnectOptions());
+    while (client->connectionStatus() != std::string(status::CONNECTED)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::vector<std::string> topics;
+    for (int i = 0; i < 8; i++) {
+        topics.push_back("telemetry/device/8f2c41d0/sensor/" + std::to_string(i) + "/reading");
+    }
+    const std::string payload(static_cast<size_t>(state.range(1)), 'x');
+    const auto *data = reinterpret_cast<const uint8_t *>(payload.data());
+    const int burst = 1000;
+    size_t published = broker.publishPacketCount();
+    size_t bytesBefore = broker.receivedByteCount();
+    for (auto _ : state) {
+        for (int i = 0; i < burst; i++) {
+            client->publish(topics[i % topics.size()], data, payload.size(), 0, false);
+        }
+        published += burst;
+        waitForPublishes(broker, published);
+    }
+    double wireBytes = static_cast<double>(broker.receivedByteCount() - bytesBefore);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * burst);
+    state.counters["wireBytesPerMessage"] = wireBytes / static_cast<double>(state.iterations() * burst);
+    state.counters["wireBytes"] = benchmark::Counter(wireBytes, benchmark::Counter::kIsRate);
+
+    client->close();
+    std::promise<void> drained;
+    loop.post([&drained] { drained.set_value(); });
+    drained.get_future().wait();
+}
+BENCHMARK(BM_PublishBurst)->Args({0, 32})->Args({16, 32})->Args({0, 256})->Args({16, 256})->UseRealTime();
+
+}
+
+BENCHMARK_MAIN();
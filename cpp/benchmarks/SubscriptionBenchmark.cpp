@@ -0,0 +1,108 @@
+//
+//  SubscriptionBenchmark.cpp
+//  d11-mqtt
+//
+//  Routing of received messages with 10k subscribed filters. BM_RouteLinearScan tests every filter with
+//  topicMatchesFilter, as SubscriptionTable did before it indexed filters in a TopicTrie; BM_RouteSubscriptionTable
+//  is the current lookup.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "MqttSubscriptionTable.h"
+#include "MqttTopic.h"
+
+using namespace mqtt;
+
+namespace {
+
+/**
+ * Per-match filters of a fantasy sports feed: mostly exact topics, some per-match '+' filters and a few '#'.
+ */
+std::vector<std::string> makeFilters(int count) {
+    std::vector<std::string> filters;
+    filters.reserve(static_cast<size_t>(count));
+    for (int i = 0; filters.size() < static_cast<size_t>(count); i++) {
+        std::string match = std::to_string(i);
+        switch (i % 10) {
+            case 0:
+                filters.push_back("match/" + match + "/#");
+                break;
+            case 1:
+            case 2:
+                filters.push_back("match/" + match + "/+/score");
+                break;
+            default:
+                filters.push_back("match/" + match + "/innings/score");
+                break;
+        }
+    }
+    return filters;
+}
+
+std::vector<std::string> makeTopics(int filterCount) {
+    std::vector<std::string> topics;
+    for (int i = 0; i < 1024; i++) {
+        topics.push_back("match/" + std::to_string((i * 7919) % filterCount) + "/innings/score");
+    }
+    return topics;
+}
+
+void BM_RouteLinearScan(benchmark::State &state) {
+    const int filterCount = static_cast<int>(state.range(0));
+    std::vector<std::string> filters = makeFilters(filterCount);
+    std::vector<std::string> topics = makeTopics(filterCount);
+    std::vector<std::string> eventIds;
+    size_t next = 0;
+    for (auto _ : state) {
+        eventIds.clear();
+        const std::string &topic = topics[next++ % topics.size()];
+        for (const auto &filter : filters) {
+            if (topicMatchesFilter(topic, filter)) {
+                eventIds.push_back(filter);
+            }
+        }
+        benchmark::DoNotOptimize(eventIds.data());
+    }
+}
+BENCHMARK(BM_RouteLinearScan)->Arg(100)->Arg(1000)->Arg(10000);
+
+void BM_RouteSubscriptionTable(benchmark::State &state) {
+    const int filterCount = static_cast<int>(state.range(0));
+    SubscriptionTable table;
+    for (const auto &filter : makeFilters(filterCount)) {
+        table.add(filter, filter, 1);
+    }
+    std::vector<std::string> topics = makeTopics(filterCount);
+    std::vector<std::string> eventIds;
+    size_t next = 0;
+    for (auto _ : state) {
+        eventIds.clear();
+        table.collectMatches(topics[next++ % topics.size()], eventIds);
+        benchmark::DoNotOptimize(eventIds.data());
+    }
+}
+BENCHMARK(BM_RouteSubscriptionTable)->Arg(100)->Arg(1000)->Arg(10000);
+
+void BM_SubscribeUnsubscribe(benchmark::State &state) {
+    std::vector<std::string> filters = makeFilters(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        SubscriptionTable table;
+        for (const auto &filter : filters) {
+            table.add(filter, filter, 1);
+        }
+        for (const auto &filter : filters) {
+            table.remove(filter, filter);
+        }
+        benchmark::DoNotOptimize(table.empty());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SubscribeUnsubscribe)->Arg(10000);
+
+}
+
+BENCHMARK_MAIN();
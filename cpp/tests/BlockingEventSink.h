@@ -0,0 +1,98 @@
+//
+//  BlockingEventSink.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MqttEventSink.h"
+
+namespace mqtt {
+namespace test {
+
+/**
+ * Thread safe event recorder for tests where events arrive on a transport thread. waitFor() blocks until the
+ * expected number of events (or messages) was emitted under an eventId, or the timeout passed.
+ */
+class BlockingEventSink : public EventSink {
+public:
+    void emit(std::string eventId, EventValue payload) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.emplace_back(std::move(eventId), std::move(payload));
+        }
+        changed_.notify_all();
+    }
+
+    void emitMessage(std::string eventId, MqttMessage message) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            messages_.emplace_back(std::move(eventId), std::move(message));
+        }
+        changed_.notify_all();
+    }
+
+    bool waitFor(const std::string &eventId, size_t count = 1,
+                 std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, timeout, [&] { return countLocked(eventId) >= count; });
+    }
+
+    bool waitForMessages(size_t count, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, timeout, [&] { return messages_.size() >= count; });
+    }
+
+    size_t count(const std::string &eventId) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return countLocked(eventId);
+    }
+
+    std::vector<std::pair<std::string, MqttMessage>> messages() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_;
+    }
+
+    std::vector<std::pair<std::string, EventValue>> events(const std::string &eventId) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<std::string, EventValue>> matching;
+        for (const auto &event : events_) {
+            if (event.first == eventId) {
+                matching.push_back(event);
+            }
+        }
+        return matching;
+    }
+
+    void clearMessages() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        messages_.clear();
+    }
+
+private:
+    size_t countLocked(const std::string &eventId) const {
+        size_t n = 0;
+        for (const auto &event : events_) {
+            n += event.first == eventId;
+        }
+        for (const auto &message : messages_) {
+            n += message.first == eventId;
+        }
+        return n;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::pair<std::string, EventValue>> events_;
+    std::vector<std::pair<std::string, MqttMessage>> messages_;
+};
+
+}
+}
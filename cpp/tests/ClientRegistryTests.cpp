@@ -0,0 +1,52 @@
+//
+//  ClientRegistryTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "FakeBroker.h"
+#include "MqttClientRegistry.h"
+
+using namespace mqtt;
+using mqtt::test::FakeBroker;
+using mqtt::test::RecordingEventSink;
+
+TEST(ClientRegistryTests, KeepsFirstClientForDuplicateIds) {
+    ClientRegistry registry;
+    auto sink = std::make_shared<RecordingEventSink>();
+    auto first = registry.create("client", std::make_shared<FakeBroker>(), sink);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(registry.create("client", std::make_shared<FakeBroker>(), sink), nullptr);
+    EXPECT_EQ(registry.find("client"), first);
+    EXPECT_EQ(registry.find("unknown"), nullptr);
+}
+
+TEST(ClientRegistryTests, RemoveClosesTransport) {
+    ClientRegistry registry;
+    auto broker = std::make_shared<FakeBroker>();
+    auto client = registry.create("client", broker, std::make_shared<RecordingEventSink>());
+    broker->attach(client.get());
+
+    registry.remove("client");
+    EXPECT_TRUE(broker->closed);
+    EXPECT_EQ(registry.find("client"), nullptr);
+    ASSERT_NE(registry.create("client", std::make_shared<FakeBroker>(), std::make_shared<RecordingEventSink>()),
+              nullptr);
+}
+
+TEST(ClientRegistryTests, ClearClosesEveryClient) {
+    ClientRegistry registry;
+    auto first = std::make_shared<FakeBroker>();
+    auto second = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    registry.create("first", first, sink);
+    registry.create("second", second, sink);
+
+    registry.clear();
+    EXPECT_TRUE(first->closed);
+    EXPECT_TRUE(second->closed);
+    EXPECT_EQ(registry.find("first"), nullptr);
+}
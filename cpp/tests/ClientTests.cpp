@@ -0,0 +1,388 @@
+//
+//  ClientTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttConstants.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::FakeBroker;
+using mqtt::test::field;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+class ClientTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        broker = std::make_shared<FakeBroker>();
+        sink = std::make_shared<RecordingEventSink>();
+        client = std::make_unique<Client>("client", broker, sink);
+        broker->attach(client.get());
+    }
+
+    void publish(const std::string &topic, const std::string &payload) {
+        client->publish(topic, reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 0, false);
+    }
+
+    std::shared_ptr<FakeBroker> broker;
+    std::shared_ptr<RecordingEventSink> sink;
+    std::unique_ptr<Client> client;
+};
+
+// Reconnect attempts run on the client's timer thread, so events are awaited through a thread safe sink.
+class ClientReconnectTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        broker = std::make_shared<FakeBroker>();
+        sink = std::make_shared<BlockingEventSink>();
+        client = std::make_unique<Client>("client", broker, sink);
+        broker->attach(client.get());
+        policy.enabled = true;
+        policy.maxRetries = 2;
+        policy.backoff = std::chrono::milliseconds(1);
+        policy.maxBackoff = std::chrono::milliseconds(20);
+        policy.jitter = std::chrono::milliseconds(0);
+    }
+
+    std::shared_ptr<FakeBroker> broker;
+    std::shared_ptr<BlockingEventSink> sink;
+    std::unique_ptr<Client> client;
+    ReconnectPolicy policy;
+};
+
+}
+
+TEST_F(ClientTests, ConnectReportsStateAndEvent) {
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+    broker->autoAck = false;
+    client->connect(ConnectOptions());
+    EXPECT_STREQ(client->connectionStatus(), status::CONNECTING);
+
+    client->onConnected(0);
+    EXPECT_STREQ(client->connectionStatus(), status::CONNECTED);
+    EXPECT_EQ(sink->count("clientconnected"), 1u);
+}
+
+TEST_F(ClientTests, ConnectionStatusIsReadableFromAnyThread) {
+    std::atomic<bool> done{false};
+    std::atomic<int> invalidReads{0};
+    std::thread poller([&] {
+        while (!done.load()) {
+            const char *status = client->connectionStatus();
+            if (std::strcmp(status, status::CONNECTED) != 0 && std::strcmp(status, status::CONNECTING) != 0 &&
+                std::strcmp(status, status::DISCONNECTED) != 0) {
+                invalidReads++;
+            }
+        }
+    });
+    for (int i = 0; i < 1000; i++) {
+        client->connect(ConnectOptions());
+        client->onDisconnected(NORMAL_DISCONNECTION, "");
+    }
+    done = true;
+    poller.join();
+
+    EXPECT_EQ(invalidReads.load(), 0);
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+    EXPECT_EQ(sink->count("clientconnected"), 1000u);
+}
+
+TEST_F(ClientTests, SubscriptionsBeforeConnectAreSentOnConnect) {
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/+", 1);
+    EXPECT_TRUE(broker->subscribes.empty());
+    EXPECT_EQ(sink->count("asubscribe_success"), 0u);
+
+    client->connect(ConnectOptions());
+    EXPECT_EQ(broker->subscribes.size(), 2u);
+    EXPECT_EQ(sink->count("asubscribe_success"), 1u);
+    EXPECT_EQ(sink->count("bsubscribe_success"), 1u);
+}
+
+TEST_F(ClientTests, ResubscribesAfterReconnect) {
+    client->connect(ConnectOptions());
+    client->subscribe("a", "score/1", 1);
+    EXPECT_EQ(broker->subscribes.size(), 1u);
+
+    broker->dropConnection("network lost");
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+    client->connect(ConnectOptions());
+
+    ASSERT_EQ(broker->subscribes.size(), 2u);
+    EXPECT_EQ(broker->subscribes[1], std::make_pair(std::string("score/1"), 1));
+    EXPECT_EQ(sink->count("asubscribe_success"), 2u);
+
+    publish("score/1", "42");
+    ASSERT_EQ(sink->messages.size(), 1u);
+    EXPECT_EQ(sink->messages[0].second.payload, "42");
+}
+
+TEST_F(ClientTests, ResubscribesEveryFilterInOneBatch) {
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/+", 1);
+    client->subscribe("c", "match/#", 2);
+    client->connect(ConnectOptions());
+    EXPECT_EQ(broker->subscribeBatches, 1);
+    EXPECT_EQ(broker->subscribes.size(), 3u);
+
+    broker->dropConnection("network lost");
+    client->connect(ConnectOptions());
+    EXPECT_EQ(broker->subscribeBatches, 2);
+    EXPECT_EQ(broker->subscribes.size(), 6u);
+    EXPECT_EQ(sink->count("csubscribe_success"), 2u);
+}
+
+TEST_F(ClientTests, SharedFilterIsSubscribedOnceAndAcknowledgedForEachSubscriber) {
+    client->connect(ConnectOptions());
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/1", 0);
+    EXPECT_EQ(broker->subscribes.size(), 1u);
+    EXPECT_EQ(sink->count("asubscribe_success"), 1u);
+    EXPECT_EQ(sink->count("bsubscribe_success"), 1u);
+
+    // A higher QoS upgrades the broker side subscription.
+    client->subscribe("c", "score/1", 1);
+    ASSERT_EQ(broker->subscribes.size(), 2u);
+    EXPECT_EQ(broker->subscribes[1].second, 1);
+    EXPECT_EQ(sink->count("asubscribe_success"), 1u);
+    EXPECT_EQ(sink->count("csubscribe_success"), 1u);
+}
+
+TEST_F(ClientTests, SubscriberJoiningPendingFilterWaitsForSuback) {
+    client->connect(ConnectOptions());
+    broker->autoAck = false;
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/1", 0);
+    EXPECT_EQ(sink->count("bsubscribe_success"), 0u);
+
+    client->onSubscribeFailed("score/1", SUBSCRIPTION_ERROR, "not authorized");
+    EXPECT_EQ(sink->count("asubscribe_failed"), 1u);
+    EXPECT_EQ(sink->count("bsubscribe_failed"), 1u);
+}
+
+TEST_F(ClientTests, UnsubscribesWhenLastSubscriberLeaves) {
+    client->connect(ConnectOptions());
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/1", 0);
+
+    client->unsubscribe("a", "score/1");
+    EXPECT_TRUE(broker->unsubscribes.empty());
+    publish("score/1", "1");
+    ASSERT_EQ(sink->messages.size(), 1u);
+    EXPECT_EQ(sink->messages[0].first, "b");
+
+    client->unsubscribe("b", "score/1");
+    EXPECT_EQ(broker->unsubscribes, std::vector<std::string>{"score/1"});
+}
+
+TEST_F(ClientTests, RoutesMessagesToWildcardSubscriptions) {
+    client->connect(ConnectOptions());
+    client->subscribe("exact", "score/match/1", 0);
+    client->subscribe("single", "score/+/1", 0);
+    client->subscribe("multi", "score/#", 0);
+    client->subscribe("other", "news/#", 0);
+
+    publish("score/match/1", "goal");
+    ASSERT_EQ(sink->messages.size(), 3u);
+    for (const auto &message : sink->messages) {
+        EXPECT_NE(message.first, "other");
+        EXPECT_EQ(message.second.topic, "score/match/1");
+        EXPECT_EQ(message.second.payload, "goal");
+    }
+}
+
+TEST_F(ClientTests, ReportsEachDisconnectOnce) {
+    client->connect(ConnectOptions());
+    broker->dropConnection("network lost");
+    client->onDisconnected(-3, "network lost");
+    EXPECT_EQ(sink->count("clientdisconnected"), 1u);
+}
+
+TEST_F(ClientTests, FailedConnectionAttemptEmitsErrorAndSingleDisconnect) {
+    broker->autoAck = false;
+    client->connect(ConnectOptions());
+    client->onConnectionFailed(5, "Connection refused", "");
+    client->onDisconnected(-3, "Connection refused");
+
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+    EXPECT_EQ(sink->count("clientdisconnected"), 1u);
+    ASSERT_EQ(sink->count("clientmqtt_error"), 1u);
+    for (const auto &event : sink->events) {
+        if (event.first == "clientmqtt_error") {
+            EXPECT_EQ(field(event.second, "errorType")->getString(), errorType::CONNECTION);
+            EXPECT_EQ(field(event.second, "reasonCode")->getNumber(), CONNECTION_ERROR);
+        }
+    }
+}
+
+TEST_F(ClientTests, RejectsInvalidTopicNamesBeforeTheTransport) {
+    client->connect(ConnectOptions());
+    publish("", "empty");
+    publish("score/+", "wildcard");
+    publish("score/#", "wildcard");
+    publish(std::string("score\0", 6), "null");
+    publish(std::string(70000, 't'), "long");
+    publish("score/1", "valid");
+
+    ASSERT_EQ(broker->publishes.size(), 1u);
+    EXPECT_EQ(broker->publishes[0].first, "score/1");
+    ASSERT_EQ(sink->count("clientmqtt_error"), 5u);
+    for (const auto &event : sink->events) {
+        if (event.first == "clientmqtt_error") {
+            EXPECT_EQ(field(event.second, "errorType")->getString(), errorType::PUBLISH);
+            EXPECT_EQ(field(event.second, "reasonCode")->getNumber(), PUBLISH_ERROR);
+        }
+    }
+}
+
+TEST_F(ClientTests, TracksReasonCodeRetriesAndLastConnect) {
+    EXPECT_EQ(client->lastConnectedAt(), 0);
+    broker->autoAck = false;
+    client->connect(ConnectOptions());
+    client->onConnectionFailed(135, "Not authorized", "");
+    client->connect(ConnectOptions());
+    client->onConnectionFailed(CONNECTION_ERROR, "Timeout", "");
+    EXPECT_EQ(client->retryCount(), 2);
+    EXPECT_EQ(client->lastReasonCode(), CONNECTION_ERROR);
+
+    client->connect(ConnectOptions());
+    client->onConnected(0);
+    EXPECT_EQ(client->retryCount(), 0);
+    EXPECT_EQ(client->lastReasonCode(), 0);
+    EXPECT_GT(client->lastConnectedAt(), 0);
+
+    client->onDisconnected(142, "Session taken over");
+    EXPECT_EQ(client->lastReasonCode(), 142);
+}
+
+TEST_F(ClientTests, EmitsConnectionStateOnEveryTransition) {
+    broker->autoAck = false;
+    client->connect(ConnectOptions());
+    client->connect(ConnectOptions());
+    client->onConnected(0);
+    client->onDisconnected(NORMAL_DISCONNECTION, "");
+
+    std::vector<std::string> states;
+    for (const auto &event : sink->events) {
+        if (event.first == "clientconnection_state") {
+            states.push_back(field(event.second, "state")->getString());
+            EXPECT_NE(field(event.second, "retryCount"), nullptr);
+            EXPECT_NE(field(event.second, "lastConnectedAt"), nullptr);
+        }
+    }
+    EXPECT_EQ(states, (std::vector<std::string>{status::CONNECTING, status::CONNECTED, status::DISCONNECTED}));
+}
+
+TEST_F(ClientTests, IgnoresCallbacksAfterClose) {
+    client->connect(ConnectOptions());
+    client->subscribe("a", "score/1", 0);
+    size_t events = sink->events.size();
+
+    client->close();
+    EXPECT_TRUE(broker->closed);
+    client->onMessage("score/1", "late", 0);
+    client->onDisconnected(-3, "");
+    client->connect(ConnectOptions());
+
+    EXPECT_EQ(sink->events.size(), events);
+    EXPECT_TRUE(sink->messages.empty());
+    EXPECT_EQ(broker->connects.size(), 1u);
+}
+
+TEST(ClientReconnectDelayTests, GrowsExponentiallyUpToTheCap) {
+    ReconnectPolicy policy;
+    policy.backoff = std::chrono::milliseconds(100);
+    policy.maxBackoff = std::chrono::milliseconds(1000);
+    policy.jitter = std::chrono::milliseconds(50);
+
+    EXPECT_EQ(Client::reconnectDelay(policy, 1, 0.0).count(), 200);
+    EXPECT_EQ(Client::reconnectDelay(policy, 2, 0.0).count(), 400);
+    EXPECT_EQ(Client::reconnectDelay(policy, 2, 0.5).count(), 425);
+    EXPECT_EQ(Client::reconnectDelay(policy, 4, 0.0).count(), 1000);
+    EXPECT_EQ(Client::reconnectDelay(policy, 64, 0.99).count(), 1000);
+}
+
+TEST_F(ClientReconnectTests, ReconnectsAndResubscribesAfterDroppedConnection) {
+    client->setReconnectPolicy(policy);
+    ConnectOptions options;
+    options.username = "user";
+    client->connect(options);
+    client->subscribe("a", "score/1", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    broker->dropConnection("network lost");
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+    ASSERT_TRUE(sink->waitFor("asubscribe_success", 2));
+    EXPECT_STREQ(client->connectionStatus(), status::CONNECTED);
+    ASSERT_EQ(broker->connects.size(), 2u);
+    EXPECT_EQ(broker->connects[1].username, "user");
+    EXPECT_EQ(broker->subscribeBatches, 1);
+}
+
+TEST_F(ClientReconnectTests, GivesUpAfterMaxRetries) {
+    client->setReconnectPolicy(policy);
+    broker->refuseReasonCode = 0x88;
+    client->connect(ConnectOptions());
+
+    // The first attempt and maxRetries retries.
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error", 3));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(sink->count("clientmqtt_error"), 3u);
+    EXPECT_EQ(client->retryCount(), 3);
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+}
+
+TEST_F(ClientReconnectTests, DisconnectCancelsPendingReconnect) {
+    policy.backoff = std::chrono::milliseconds(20);
+    client->setReconnectPolicy(policy);
+    broker->refuseReasonCode = 0x88;
+    client->connect(ConnectOptions());
+    client->disconnect();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    EXPECT_EQ(sink->count("clientmqtt_error"), 1u);
+    EXPECT_EQ(client->retryCount(), 1);
+}
+
+TEST_F(ClientReconnectTests, AsksForCredentialsWhenTheyAreRejected) {
+    policy.refreshCredentials = true;
+    client->setReconnectPolicy(policy);
+    broker->refuseReasonCode = 0x86;
+    client->connect(ConnectOptions());
+
+    ASSERT_TRUE(sink->waitFor("clientcredentials_required"));
+    EXPECT_EQ(sink->count("clientmqtt_error"), 1u);
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+
+    broker->refuseReasonCode = 0;
+    ConnectOptions options;
+    options.password = "fresh token";
+    client->connect(options);
+    EXPECT_STREQ(client->connectionStatus(), status::CONNECTED);
+    ASSERT_EQ(broker->connects.size(), 2u);
+    EXPECT_EQ(broker->connects[1].password, "fresh token");
+}
+
+TEST_F(ClientReconnectTests, RetriesRejectedCredentialsWithoutRefreshListener) {
+    client->setReconnectPolicy(policy);
+    broker->refuseReasonCode = 0x86;
+    client->connect(ConnectOptions());
+
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error", 3));
+    EXPECT_EQ(sink->count("clientcredentials_required"), 0u);
+}
@@ -0,0 +1,271 @@
+//
+//  CodecTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "MqttCodec.h"
+#include "MqttConstants.h"
+
+using namespace mqtt;
+
+namespace {
+
+/**
+ * Decoded views point into the reader, so it is owned by the caller.
+ */
+Packet decodeSingle(PacketReader &reader, const std::vector<uint8_t> &bytes) {
+    reader.append(bytes.data(), bytes.size());
+    Packet packet;
+    EXPECT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(reader.buffered(), 0u);
+    return packet;
+}
+
+}
+
+TEST(CodecTests, VarintBoundaries) {
+    const uint32_t values[] = {0, 127, 128, 16383, 16384, 2097151, 2097152, 268435455};
+    for (uint32_t value : values) {
+        size_t size = varintSize(value);
+        uint8_t encoded[4];
+        uint32_t remaining = value;
+        for (size_t i = 0; i < size; i++) {
+            encoded[i] = static_cast<uint8_t>(remaining % 128) | (i + 1 < size ? 0x80 : 0);
+            remaining /= 128;
+        }
+        uint32_t decoded = 0;
+        EXPECT_EQ(decodeVarint(encoded, size, decoded), static_cast<int>(size));
+        EXPECT_EQ(decoded, value);
+        EXPECT_EQ(decodeVarint(encoded, size - 1, decoded), 0);
+    }
+    const uint8_t tooLong[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+    uint32_t decoded = 0;
+    EXPECT_EQ(decodeVarint(tooLong, sizeof(tooLong), decoded), -1);
+}
+
+TEST(CodecTests, ConnectRoundTrip) {
+    std::vector<uint8_t> buffer;
+    ConnectPacket connect;
+    connect.clientId = "client-1";
+    connect.username = "user";
+    connect.password = "secret";
+    connect.keepAlive = 30;
+    connect.cleanStart = true;
+    connect.receiveMaximum = 100;
+    connect.maximumPacketSize = 1024 * 1024;
+    PacketWriter(buffer).connect(connect);
+
+    PacketReader reader;
+    Packet packet = decodeSingle(reader, buffer);
+    EXPECT_EQ(packet.type, PacketType::Connect);
+    EXPECT_EQ(packet.connect.clientId, "client-1");
+    EXPECT_EQ(packet.connect.username, "user");
+    EXPECT_EQ(packet.connect.password, "secret");
+    EXPECT_EQ(packet.connect.keepAlive, 30);
+    EXPECT_TRUE(packet.connect.cleanStart);
+    EXPECT_EQ(packet.connect.receiveMaximum, 100);
+    EXPECT_EQ(packet.connect.maximumPacketSize, 1024u * 1024u);
+}
+
+TEST(CodecTests, ConnackCarriesProperties) {
+    std::vector<uint8_t> buffer;
+    Properties properties;
+    properties.serverKeepAlive = 20;
+    properties.receiveMaximum = 10;
+    properties.reasonString = "welcome";
+    PacketWriter(buffer).connack(true, 0, &properties);
+
+    PacketReader reader;
+    Packet packet = decodeSingle(reader, buffer);
+    EXPECT_EQ(packet.type, PacketType::Connack);
+    EXPECT_TRUE(packet.sessionPresent);
+    EXPECT_EQ(packet.reasonCode, 0);
+    EXPECT_EQ(packet.properties.serverKeepAlive, 20);
+    EXPECT_EQ(packet.properties.receiveMaximum, 10);
+    EXPECT_EQ(packet.properties.reasonString, "welcome");
+}
+
+TEST(CodecTests, PublishRoundTripForEachQos) {
+    const std::string payload(300, 'x');
+    for (uint8_t qos = 0; qos <= 2; qos++) {
+        std::vector<uint8_t> buffer;
+        PublishPacket publish;
+        publish.topic = "score/match/1";
+        publish.payload = reinterpret_cast<const uint8_t *>(payload.data());
+        publish.payloadSize = payload.size();
+        publish.qos = qos;
+        publish.retain = qos == 1;
+        publish.packetId = qos > 0 ? 42 : 0;
+        publish.topicAlias = 3;
+        PacketWriter(buffer).publish(publish);
+
+        PacketReader reader;
+        Packet packet = decodeSingle(reader, buffer);
+        EXPECT_EQ(packet.type, PacketType::Publish);
+        EXPECT_EQ(packet.topic, "score/match/1");
+        EXPECT_EQ(packet.qos, qos);
+        EXPECT_EQ(packet.retain, qos == 1);
+        EXPECT_EQ(packet.packetId, qos > 0 ? 42 : 0);
+        EXPECT_EQ(packet.properties.topicAlias, 3);
+        EXPECT_EQ(std::string(reinterpret_cast<const char *>(packet.payload), packet.payloadSize), payload);
+    }
+}
+
+TEST(CodecTests, RefusesPublishesThatCannotBeEncoded) {
+    std::vector<uint8_t> buffer;
+    const std::string topic(70000, 't');
+    PublishPacket publish;
+    publish.topic = topic;
+    EXPECT_FALSE(PacketWriter(buffer).publish(publish));
+    EXPECT_TRUE(buffer.empty());
+
+    // Only the size is looked at, the payload is never read.
+    const uint8_t byte = 0;
+    publish.topic = "score/1";
+    publish.payload = &byte;
+    publish.payloadSize = MAX_REMAINING_LENGTH;
+    EXPECT_GT(PacketWriter::publishSize(publish), MAX_REMAINING_LENGTH);
+    EXPECT_FALSE(PacketWriter(buffer).publish(publish));
+    EXPECT_TRUE(buffer.empty());
+
+    publish.payloadSize = 1;
+    publish.qos = 1;
+    publish.packetId = 7;
+    ASSERT_TRUE(PacketWriter(buffer).publish(publish));
+    EXPECT_EQ(buffer.size(), PacketWriter::publishSize(publish));
+}
+
+TEST(CodecTests, SubscribeAndSubackRoundTrip) {
+    std::vector<uint8_t> buffer;
+    TopicFilter filters[] = {{"score/+", 1}, {"news/#", 0}};
+    PacketWriter writer(buffer);
+    writer.subscribe(7, filters, 2);
+    const uint8_t reasonCodes[] = {1, 0x87};
+    writer.suback(7, reasonCodes, 2);
+
+    PacketReader reader;
+    reader.append(buffer.data(), buffer.size());
+    Packet packet;
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Subscribe);
+    EXPECT_EQ(packet.packetId, 7);
+    ASSERT_EQ(packet.topicFilters.size(), 2u);
+    EXPECT_EQ(packet.topicFilters[0].filter, "score/+");
+    EXPECT_EQ(packet.topicFilters[0].qos, 1);
+    EXPECT_EQ(packet.topicFilters[1].filter, "news/#");
+
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Suback);
+    ASSERT_EQ(packet.reasonCodeCount, 2u);
+    EXPECT_EQ(packet.reasonCodes[0], 1);
+    EXPECT_EQ(packet.reasonCodes[1], 0x87);
+    EXPECT_EQ(reader.next(packet), DecodeStatus::Incomplete);
+}
+
+TEST(CodecTests, AcksPingAndDisconnect) {
+    std::vector<uint8_t> buffer;
+    PacketWriter writer(buffer);
+    writer.ack(PacketType::Puback, 1);
+    writer.ack(PacketType::Pubrec, 2, 0x80);
+    writer.ack(PacketType::Pubrel, 3);
+    writer.pingreq();
+    writer.disconnect(0x8D);
+
+    PacketReader reader;
+    reader.append(buffer.data(), buffer.size());
+    Packet packet;
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Puback);
+    EXPECT_EQ(packet.packetId, 1);
+    EXPECT_EQ(packet.reasonCode, 0);
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Pubrec);
+    EXPECT_EQ(packet.reasonCode, 0x80);
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Pubrel);
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Pingreq);
+    ASSERT_EQ(reader.next(packet), DecodeStatus::Ok);
+    EXPECT_EQ(packet.type, PacketType::Disconnect);
+    EXPECT_EQ(packet.reasonCode, 0x8D);
+}
+
+TEST(CodecTests, DecodesStreamFedOneByteAtATime) {
+    std::vector<uint8_t> buffer;
+    PacketWriter writer(buffer);
+    const std::string payload(200, 'p');
+    PublishPacket publish;
+    publish.topic = "a/b";
+    publish.payload = reinterpret_cast<const uint8_t *>(payload.data());
+    publish.payloadSize = payload.size();
+    for (int i = 0; i < 3; i++) {
+        writer.publish(publish);
+    }
+
+    PacketReader reader;
+    Packet packet;
+    int decoded = 0;
+    for (uint8_t byte : buffer) {
+        reader.append(&byte, 1);
+        while (reader.next(packet) == DecodeStatus::Ok) {
+            EXPECT_EQ(packet.payloadSize, payload.size());
+            decoded++;
+        }
+    }
+    EXPECT_EQ(decoded, 3);
+}
+
+TEST(CodecTests, RejectsMalformedAndOversizedPackets) {
+    Packet packet;
+    {
+        // SUBSCRIBE must carry flags 0x2.
+        const uint8_t bytes[] = {0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x01, 'a'};
+        PacketReader reader;
+        reader.append(bytes, sizeof(bytes));
+        EXPECT_EQ(reader.next(packet), DecodeStatus::Malformed);
+    }
+    {
+        // PUBLISH with QoS 3.
+        const uint8_t bytes[] = {0x36, 0x04, 0x00, 0x01, 'a', 0x00};
+        PacketReader reader;
+        reader.append(bytes, sizeof(bytes));
+        EXPECT_EQ(reader.next(packet), DecodeStatus::Malformed);
+    }
+    {
+        // Topic length runs past the end of the packet.
+        const uint8_t bytes[] = {0x30, 0x03, 0x00, 0x09, 'a'};
+        PacketReader reader;
+        reader.append(bytes, sizeof(bytes));
+        EXPECT_EQ(reader.next(packet), DecodeStatus::Malformed);
+    }
+    {
+        const uint8_t bytes[] = {0x30, 0xFF, 0x7F};
+        PacketReader reader(1024);
+        reader.append(bytes, sizeof(bytes));
+        EXPECT_EQ(reader.next(packet), DecodeStatus::TooLarge);
+    }
+}
+
+TEST(CodecTests, WriterReusesBufferCapacity) {
+    std::vector<uint8_t> buffer;
+    const std::string payload(64, 'x');
+    PublishPacket publish;
+    publish.topic = "score";
+    publish.payload = reinterpret_cast<const uint8_t *>(payload.data());
+    publish.payloadSize = payload.size();
+
+    PacketWriter(buffer).publish(publish);
+    size_t capacity = buffer.capacity();
+    const uint8_t *data = buffer.data();
+    for (int i = 0; i < 100; i++) {
+        buffer.clear();
+        PacketWriter(buffer).publish(publish);
+    }
+    EXPECT_EQ(buffer.capacity(), capacity);
+    EXPECT_EQ(buffer.data(), data);
+}
@@ -0,0 +1,86 @@
+//
+//  ConflationSlotsTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MqttConflationSlots.h"
+
+using namespace mqtt;
+
+namespace {
+
+MqttMessage message(const std::string &topic, int index) {
+    MqttMessage message;
+    message.topic = topic;
+    message.payload = std::to_string(index);
+    return message;
+}
+
+}
+
+TEST(ConflationSlotsTests, KeepsLatestMessagePerTopic) {
+    ConflationSlots slots;
+    EXPECT_TRUE(slots.push(message("odds/1", 0)));
+    EXPECT_FALSE(slots.push(message("odds/2", 1)));
+    EXPECT_FALSE(slots.push(message("odds/1", 2)));
+    EXPECT_FALSE(slots.push(message("odds/1", 3)));
+
+    auto messages = slots.drain();
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0].topic, "odds/1");
+    EXPECT_EQ(messages[0].payload, "3");
+    EXPECT_EQ(messages[1].topic, "odds/2");
+    EXPECT_EQ(messages[1].payload, "1");
+    EXPECT_EQ(slots.droppedCount(), 2u);
+
+    EXPECT_TRUE(slots.drain().empty());
+    EXPECT_TRUE(slots.push(message("odds/1", 4)));
+    EXPECT_EQ(slots.drain()[0].payload, "4");
+    EXPECT_EQ(slots.droppedCount(), 2u);
+}
+
+TEST(ConflationSlotsTests, AccountsForEveryMessageUnderConcurrentDrains) {
+    ConflationSlots slots;
+    const int producers = 4;
+    const int count = 10000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&slots, p]() {
+            for (int i = 0; i < count; i++) {
+                slots.push(message("score/" + std::to_string(p) + "/" + std::to_string(i % 8), i));
+            }
+        });
+    }
+    std::vector<int> lastSeen(producers * 8, -1);
+    uint64_t delivered = 0;
+    auto consume = [&]() {
+        for (auto &received : slots.drain()) {
+            delivered++;
+            int p = received.topic[6] - '0';
+            int slot = p * 8 + (received.topic.back() - '0');
+            int index = std::stoi(received.payload);
+            // Per topic, a later drain never delivers an older message.
+            EXPECT_GT(index, lastSeen[slot]);
+            lastSeen[slot] = index;
+        }
+    };
+    for (int i = 0; i < 1000; i++) {
+        consume();
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    consume();
+    EXPECT_EQ(delivered + slots.droppedCount(), static_cast<uint64_t>(producers) * count);
+    for (int p = 0; p < producers; p++) {
+        for (int s = 0; s < 8; s++) {
+            EXPECT_EQ(lastSeen[p * 8 + s], count - 8 + s);
+        }
+    }
+}
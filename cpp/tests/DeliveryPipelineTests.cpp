@@ -0,0 +1,221 @@
+//
+//  DeliveryPipelineTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttDeliveryPipeline.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::FakeBroker;
+using mqtt::test::field;
+
+namespace {
+
+/**
+ * Stands in for the client: keeps every delivered entry with its ticket, the way the dispatcher holds messages
+ * until JS took them, and records the acknowledgements.
+ */
+class PipelineTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pipeline = std::make_shared<DeliveryPipeline>(
+            [this](InboundMessage &&message, std::shared_ptr<DeliveryTicket> ticket) {
+                std::lock_guard<std::mutex> lock(mutex);
+                delivered.emplace_back(std::move(message), std::move(ticket));
+            },
+            [this](uint64_t acknowledgement) {
+                std::lock_guard<std::mutex> lock(mutex);
+                acknowledged.push_back(acknowledgement);
+            });
+    }
+
+    void push(const std::string &payload, int qos = 0, uint64_t acknowledgement = 0) {
+        pipeline->push(InboundMessage{"score/1", payload, qos, 0, acknowledgement, MessageProperties()});
+    }
+
+    /**
+     * Lets JS "consume" the delivered entries: their tickets are released, which drains the pipeline on its timer.
+     */
+    std::vector<std::string> consume() {
+        std::vector<std::pair<InboundMessage, std::shared_ptr<DeliveryTicket>>> taken;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            taken.swap(delivered);
+        }
+        std::vector<std::string> payloads;
+        for (const auto &entry : taken) {
+            payloads.push_back(entry.first.payload);
+        }
+        return payloads;
+    }
+
+    size_t deliveredCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return delivered.size();
+    }
+
+    std::vector<uint64_t> acknowledgements() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return acknowledged;
+    }
+
+    template <typename Predicate>
+    bool eventually(Predicate predicate) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    double stateField(const char *name) { return field(pipeline->snapshot(), name)->getNumber(); }
+
+    std::mutex mutex;
+    std::vector<std::pair<InboundMessage, std::shared_ptr<DeliveryTicket>>> delivered;
+    std::vector<uint64_t> acknowledged;
+    std::shared_ptr<DeliveryPipeline> pipeline;
+};
+
+}
+
+TEST_F(PipelineTests, HandsOverHalfTheHighWaterMarkAndQueuesTheRest) {
+    pipeline->configure(FlowControl{4, DropPolicy::DropOldest});
+    for (int i = 0; i < 4; i++) {
+        push(std::to_string(i));
+    }
+    EXPECT_EQ(deliveredCount(), 2u);
+    EXPECT_EQ(stateField("inFlight"), 2);
+    EXPECT_EQ(stateField("queued"), 2);
+
+    EXPECT_EQ(consume(), (std::vector<std::string>{"0", "1"}));
+    ASSERT_TRUE(eventually([&] { return deliveredCount() == 2; }));
+    EXPECT_EQ(consume(), (std::vector<std::string>{"2", "3"}));
+    ASSERT_TRUE(eventually([&] { return stateField("inFlight") == 0; }));
+    EXPECT_EQ(stateField("queued"), 0);
+    EXPECT_EQ(stateField("dropped"), 0);
+}
+
+TEST_F(PipelineTests, DropOldestReplacesTheOldestQueuedQos0Message) {
+    pipeline->configure(FlowControl{4, DropPolicy::DropOldest});
+    for (int i = 0; i < 6; i++) {
+        push(std::to_string(i));
+    }
+    EXPECT_EQ(stateField("dropped"), 2);
+    EXPECT_EQ(consume(), (std::vector<std::string>{"0", "1"}));
+    ASSERT_TRUE(eventually([&] { return deliveredCount() == 2; }));
+    EXPECT_EQ(consume(), (std::vector<std::string>{"4", "5"}));
+}
+
+TEST_F(PipelineTests, DropNewestKeepsTheQueuedMessages) {
+    pipeline->configure(FlowControl{4, DropPolicy::DropNewest});
+    for (int i = 0; i < 6; i++) {
+        push(std::to_string(i));
+    }
+    EXPECT_EQ(stateField("dropped"), 2);
+    EXPECT_EQ(consume(), (std::vector<std::string>{"0", "1"}));
+    ASSERT_TRUE(eventually([&] { return deliveredCount() == 2; }));
+    EXPECT_EQ(consume(), (std::vector<std::string>{"2", "3"}));
+}
+
+TEST_F(PipelineTests, NeverDropsQos1AndAcknowledgesOnceDelivered) {
+    pipeline->configure(FlowControl{2, DropPolicy::DropNewest});
+    push("a", 1, 11);
+    push("b", 1, 12);
+    push("c", 1, 13);
+    push("d", 0);
+    EXPECT_EQ(deliveredCount(), 1u);
+    EXPECT_EQ(stateField("queued"), 2);
+    EXPECT_EQ(stateField("unacknowledged"), 3);
+    EXPECT_EQ(stateField("dropped"), 1);
+    EXPECT_TRUE(acknowledgements().empty());
+
+    consume();
+    ASSERT_TRUE(eventually([&] { return deliveredCount() == 1; }));
+    EXPECT_EQ(acknowledgements(), (std::vector<uint64_t>{11}));
+    consume();
+    ASSERT_TRUE(eventually([&] { return deliveredCount() == 1; }));
+    consume();
+    ASSERT_TRUE(eventually([&] { return acknowledgements().size() == 3; }));
+    EXPECT_EQ(acknowledgements(), (std::vector<uint64_t>{11, 12, 13}));
+    EXPECT_EQ(stateField("unacknowledged"), 0);
+}
+
+TEST_F(PipelineTests, DisablingDeliversEverythingQueued) {
+    pipeline->configure(FlowControl{4, DropPolicy::DropOldest});
+    for (int i = 0; i < 4; i++) {
+        push(std::to_string(i));
+    }
+    pipeline->configure(FlowControl{});
+    EXPECT_FALSE(pipeline->enabled());
+    EXPECT_EQ(deliveredCount(), 4u);
+}
+
+TEST_F(PipelineTests, CloseStopsDeliveryAndAcknowledgements) {
+    pipeline->configure(FlowControl{2, DropPolicy::DropOldest});
+    push("a", 1, 1);
+    push("b", 1, 2);
+    pipeline->close();
+    consume();
+    EXPECT_TRUE(acknowledgements().empty());
+    EXPECT_EQ(deliveredCount(), 0u);
+}
+
+TEST(ClientFlowControlTests, DefersAcknowledgementsOnlyWithFlowControl) {
+    class AcknowledgingBroker : public FakeBroker {
+    public:
+        void acknowledge(uint64_t acknowledgement) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            acknowledged.push_back(acknowledgement);
+        }
+
+        std::vector<uint64_t> acknowledgements() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return acknowledged;
+        }
+
+    private:
+        std::mutex mutex;
+        std::vector<uint64_t> acknowledged;
+    };
+    auto broker = std::make_shared<AcknowledgingBroker>();
+    auto sink = std::make_shared<BlockingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    client.connect(ConnectOptions());
+    client.subscribe("sub", "score/#", 1);
+
+    client.onMessage("score/1", "now", 1, 0, 7);
+    EXPECT_EQ(broker->acknowledgements(), (std::vector<uint64_t>{7}));
+
+    client.setFlowControl(FlowControl{2, DropPolicy::DropOldest});
+    client.onMessage("score/1", "later", 1, 0, 8);
+    ASSERT_TRUE(sink->waitForMessages(2));
+    EXPECT_EQ(broker->acknowledgements().size(), 1u);
+    EXPECT_EQ(field(client.deliveryState(), "unacknowledged")->getNumber(), 1);
+
+    // The sink let go of the messages, as the dispatcher does once JS got them.
+    sink->clearMessages();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (broker->acknowledgements().size() < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(broker->acknowledgements(), (std::vector<uint64_t>{7, 8}));
+    client.close();
+}
@@ -0,0 +1,145 @@
+//
+//  FakeBroker.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MqttClient.h"
+#include "MqttEventSink.h"
+#include "MqttTopic.h"
+#include "MqttTransport.h"
+
+namespace mqtt {
+namespace test {
+
+/**
+ * Transport standing in for a platform client and its broker. Records what the core sends and, unless disabled,
+ * answers synchronously like a broker would: CONNACK on connect (or a refusal), SUBACK on subscribe and delivery of
+ * publishes to its own subscriptions.
+ */
+class FakeBroker : public Transport {
+public:
+    void attach(TransportListener *client) { client_ = client; }
+
+    void connect(const ConnectOptions &options) override {
+        connects.push_back(options);
+        if (refuseReasonCode != 0 && client_ != nullptr) {
+            client_->onConnectionFailed(refuseReasonCode, "Connection refused", "");
+        } else if (autoAck && client_ != nullptr) {
+            client_->onConnected(0);
+        }
+    }
+
+    void disconnect() override {
+        disconnects++;
+        filters.clear();
+        if (client_ != nullptr) {
+            client_->onDisconnected(0, "");
+        }
+    }
+
+    void subscribe(const std::string &topic, int qos) override {
+        subscribes.emplace_back(topic, qos);
+        filters.push_back(topic);
+        if (autoAck && client_ != nullptr) {
+            client_->onSubscribed(topic, qos, "");
+        }
+    }
+
+    void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) override {
+        subscribeBatches++;
+        Transport::subscribeMany(filters);
+    }
+
+    void unsubscribe(const std::string &topic) override {
+        unsubscribes.push_back(topic);
+        for (auto it = filters.begin(); it != filters.end(); ++it) {
+            if (*it == topic) {
+                filters.erase(it);
+                break;
+            }
+        }
+    }
+
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool /*retain*/) override {
+        publishes.emplace_back(topic, std::string(reinterpret_cast<const char *>(payload), size));
+        if (client_ == nullptr) {
+            return;
+        }
+        for (const auto &filter : filters) {
+            if (topicMatchesFilter(topic, effectiveTopicFilter(filter))) {
+                // A broker delivers one copy per client however many of its filters match.
+                client_->onMessage(topic, publishes.back().second, qos);
+                break;
+            }
+        }
+    }
+
+    void close() override {
+        closed = true;
+        client_ = nullptr;
+    }
+
+    /**
+     * Simulates the network dropping the connection.
+     */
+    void dropConnection(const std::string &errorMessage) {
+        filters.clear();
+        client_->onDisconnected(-3, errorMessage);
+    }
+
+    bool autoAck = true;
+    // Non-zero: connects are refused with this CONNACK reason code.
+    int refuseReasonCode = 0;
+    bool closed = false;
+    int subscribeBatches = 0;
+    int disconnects = 0;
+    std::vector<ConnectOptions> connects;
+    std::vector<std::pair<std::string, int>> subscribes;
+    std::vector<std::string> unsubscribes;
+    std::vector<std::pair<std::string, std::string>> publishes;
+    std::vector<std::string> filters;
+
+private:
+    TransportListener *client_ = nullptr;
+};
+
+class RecordingEventSink : public EventSink {
+public:
+    void emit(std::string eventId, EventValue payload) override {
+        events.emplace_back(std::move(eventId), std::move(payload));
+    }
+
+    void emitMessage(std::string eventId, MqttMessage message) override {
+        messages.emplace_back(std::move(eventId), std::move(message));
+    }
+
+    size_t count(const std::string &eventId) const {
+        size_t n = 0;
+        for (const auto &event : events) {
+            n += event.first == eventId;
+        }
+        return n;
+    }
+
+    std::vector<std::pair<std::string, EventValue>> events;
+    std::vector<std::pair<std::string, MqttMessage>> messages;
+};
+
+inline const EventValue *field(const EventValue &value, const std::string &key) {
+    for (const auto &entry : value.getMap()) {
+        if (entry.first == key) {
+            return &entry.second;
+        }
+    }
+    return nullptr;
+}
+
+}
+}
@@ -0,0 +1,162 @@
+//
+//  JSIBindingTests.cpp
+//  d11-mqtt
+//
+//  The JSI bindings on a host Hermes runtime: the EventValue <-> jsi::Value conversions, message delivery through
+//  EventDispatcher, and the module installJSIModule puts on the global object.
+//
+
+#include <gtest/gtest.h>
+
+#include <hermes/hermes.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "FakeBroker.h"
+#include "MqttEventDispatcher.h"
+#include "MqttJSIModule.h"
+
+using namespace mqtt;
+using mqtt::test::field;
+
+namespace {
+
+class JSIBindingTests : public ::testing::Test {
+protected:
+    void SetUp() override { runtime_ = facebook::hermes::makeHermesRuntime(); }
+
+    void TearDown() override {
+        EventDispatcher::setCurrent(nullptr);
+        runtime_.reset();
+    }
+
+    jsi::Value evaluate(const std::string &source) {
+        return runtime_->evaluateJavaScript(std::make_shared<jsi::StringBuffer>(source), "JSIBindingTests.js");
+    }
+
+    std::string stringify(jsi::Value value) {
+        runtime_->global().setProperty(*runtime_, "value", std::move(value));
+        return evaluate("JSON.stringify(value)").getString(*runtime_).utf8(*runtime_);
+    }
+
+    /**
+     * JS invoker that queues tasks until runTasks(), like a JS thread that is busy until then.
+     */
+    EventDispatcher::JSInvoker queueingInvoker() {
+        return [this](std::function<void()> &&task) { tasks_.push_back(std::move(task)); };
+    }
+
+    void runTasks() {
+        std::vector<std::function<void()>> tasks;
+        tasks.swap(tasks_);
+        for (auto &task : tasks) {
+            task();
+        }
+    }
+
+    std::unique_ptr<jsi::Runtime> runtime_;
+    std::vector<std::function<void()>> tasks_;
+};
+
+}
+
+TEST_F(JSIBindingTests, ConvertsEventValuesToJSValues) {
+    EventValue::Map payload;
+    payload.emplace_back("state", "connected");
+    payload.emplace_back("retryCount", 2);
+    payload.emplace_back("clientConnected", true);
+    payload.emplace_back("topics", EventValue::Array{EventValue("score/1"), EventValue(0.5), EventValue()});
+    jsi::Value value = convertEventValueToJSIValue(*runtime_, EventValue(std::move(payload)));
+    EXPECT_EQ(stringify(std::move(value)),
+              R"({"state":"connected","retryCount":2,"clientConnected":true,"topics":["score/1",0.5,null]})");
+}
+
+TEST_F(JSIBindingTests, ConvertsJSValuesToEventValues) {
+    EventValue value = convertJSIValueToEventValue(
+        *runtime_, evaluate("({qos: 1, retain: false, topic: 'score/é', tags: ['a', 2], onMessage() {}, "
+                            "missing: undefined})"));
+    ASSERT_EQ(value.type(), EventValue::Type::Map);
+    EXPECT_EQ(value.getMap().size(), 6u);
+    EXPECT_EQ(field(value, "qos")->getNumber(), 1);
+    EXPECT_FALSE(field(value, "retain")->getBool());
+    EXPECT_EQ(field(value, "topic")->getString(), "score/é");
+    ASSERT_EQ(field(value, "tags")->getArray().size(), 2u);
+    EXPECT_EQ(field(value, "tags")->getArray()[0].getString(), "a");
+    EXPECT_EQ(field(value, "onMessage")->type(), EventValue::Type::Null);
+    EXPECT_EQ(field(value, "missing")->type(), EventValue::Type::Null);
+}
+
+TEST_F(JSIBindingTests, EndsCyclicValuesAtTheMaximumDepth) {
+    EventValue value =
+        convertJSIValueToEventValue(*runtime_, evaluate("(() => { const o = {}; o.self = o; return o; })()"));
+    int depth = 0;
+    const EventValue *node = &value;
+    while (node->type() == EventValue::Type::Map) {
+        node = field(*node, "self");
+        ASSERT_NE(node, nullptr);
+        depth++;
+    }
+    EXPECT_EQ(depth, MAXIMUM_CONVERSION_DEPTH);
+}
+
+TEST_F(JSIBindingTests, ConvertsMessagesInEachPayloadFormat) {
+    MqttMessage message;
+    message.topic = "score/1";
+    message.payload = "{\"runs\":4}";
+    message.qos = 1;
+    MqttMessage copy = message;
+    EXPECT_EQ(stringify(convertMqttMessageToJSIValue(*runtime_, copy)),
+              R"({"payload":"{\"runs\":4}","topic":"score/1","qos":1})");
+
+    copy = message;
+    runtime_->global().setProperty(*runtime_, "message",
+                                   convertMqttMessageToJSIValue(*runtime_, copy, PayloadFormat::ArrayBuffer));
+    EXPECT_TRUE(copy.payload.empty());
+    jsi::Value bytes = evaluate("String.fromCharCode(...new Uint8Array(message.payload))");
+    EXPECT_EQ(bytes.getString(*runtime_).utf8(*runtime_), message.payload);
+}
+
+TEST_F(JSIBindingTests, DeliversEventsOnTheJSThread) {
+    auto dispatcher = std::make_shared<EventDispatcher>(*runtime_, queueingInvoker());
+    evaluate("globalThis.received = []");
+    dispatcher->addListener("client1message", evaluate("(message) => received.push(message)")
+                                                  .getObject(*runtime_)
+                                                  .getFunction(*runtime_));
+
+    MqttMessage message;
+    message.topic = "score/1";
+    message.payload = "four";
+    dispatcher->emitMessage("client1message", message);
+    dispatcher->emit("client1connected", EventValue("ignored, no listener"));
+    EXPECT_EQ(evaluate("received.length").getNumber(), 0);
+
+    runTasks();
+    EXPECT_EQ(stringify(evaluate("received")), R"([{"payload":"four","topic":"score/1","qos":0}])");
+
+    dispatcher->releaseListeners();
+    runTasks();
+}
+
+TEST_F(JSIBindingTests, InstallsTheModuleProxy) {
+    installJSIModule(*runtime_, queueingInvoker());
+    for (const char *name : {"addEventListener", "removeEventListener", "setEventBatching", "createNativeMqtt",
+                             "connectMqtt", "subscribeMqtt", "getMetrics", "setBackgroundHandler"}) {
+        EXPECT_EQ(evaluate(std::string("typeof __MqttModuleProxy.") + name).getString(*runtime_).utf8(*runtime_),
+                  "function")
+            << name;
+    }
+
+    evaluate("__MqttModuleProxy.createNativeMqtt('jsi-tests', '127.0.0.1', 1883)");
+    jsi::Value metrics = evaluate("__MqttModuleProxy.getMetrics('jsi-tests')");
+    ASSERT_TRUE(metrics.isObject());
+    EXPECT_TRUE(metrics.getObject(*runtime_).hasProperty(*runtime_, "dispatcher"));
+    evaluate("__MqttModuleProxy.removeMqtt('jsi-tests')");
+    EXPECT_TRUE(evaluate("__MqttModuleProxy.getMetrics('jsi-tests') === undefined").getBool());
+
+    releaseJSIModule();
+    runTasks();
+}
@@ -0,0 +1,103 @@
+//
+//  JsonTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "MqttJson.h"
+
+using mqtt::JsonDocument;
+using mqtt::JsonType;
+using mqtt::parseJson;
+
+namespace {
+
+std::shared_ptr<const JsonDocument> parse(std::string text) {
+    return parseJson(text);
+}
+
+}
+
+TEST(JsonTests, ParsesNestedObjectsAndArrays) {
+    auto document = parse(R"( {"match": {"id": 1234, "live": true, "teams": ["IND", "AUS"]}, "score": null} )");
+    ASSERT_NE(document, nullptr);
+    ASSERT_EQ(document->type(JsonDocument::ROOT), JsonType::Object);
+    EXPECT_EQ(document->size(JsonDocument::ROOT), 2u);
+
+    auto match = document->find(JsonDocument::ROOT, "match");
+    ASSERT_NE(match, 0u);
+    EXPECT_EQ(document->type(match), JsonType::Object);
+    EXPECT_EQ(document->number(document->find(match, "id")), 1234);
+    EXPECT_EQ(document->type(document->find(match, "live")), JsonType::True);
+
+    auto teams = document->find(match, "teams");
+    ASSERT_EQ(document->type(teams), JsonType::Array);
+    std::string joined;
+    document->forEachChild(teams, [&](JsonDocument::Index, JsonDocument::Index value) {
+        joined += std::string(document->string(value)) + ",";
+    });
+    EXPECT_EQ(joined, "IND,AUS,");
+
+    EXPECT_EQ(document->type(document->find(JsonDocument::ROOT, "score")), JsonType::Null);
+    EXPECT_EQ(document->find(JsonDocument::ROOT, "missing"), 0u);
+    EXPECT_EQ(document->next(match), document->find(JsonDocument::ROOT, "score") - 1);
+}
+
+TEST(JsonTests, ParsesNumbers) {
+    auto document = parse("[0, -7, 12.5, -0.25, 1e3, 2E-2, 123456789012345678, 9007199254740993.0]");
+    ASSERT_NE(document, nullptr);
+    std::vector<double> numbers;
+    document->forEachChild(JsonDocument::ROOT,
+                           [&](JsonDocument::Index, JsonDocument::Index value) { numbers.push_back(document->number(value)); });
+    ASSERT_EQ(numbers.size(), 8u);
+    EXPECT_EQ(numbers[0], 0);
+    EXPECT_EQ(numbers[1], -7);
+    EXPECT_EQ(numbers[2], 12.5);
+    EXPECT_EQ(numbers[3], -0.25);
+    EXPECT_EQ(numbers[4], 1000);
+    EXPECT_DOUBLE_EQ(numbers[5], 0.02);
+    EXPECT_EQ(numbers[6], 123456789012345678.0);
+    EXPECT_EQ(numbers[7], 9007199254740992.0);
+}
+
+TEST(JsonTests, DecodesEscapes) {
+    auto document = parse(R"(["plain text that is longer than one word", "tab\tquote\" slash\/ \u00e9\u20ac\ud83c\udfcf", "\ud800"])");
+    ASSERT_NE(document, nullptr);
+    auto first = JsonDocument::ROOT + 1;
+    auto second = document->next(first);
+    auto third = document->next(second);
+    EXPECT_EQ(document->string(first), "plain text that is longer than one word");
+    EXPECT_EQ(document->string(second), "tab\tquote\" slash/ \xC3\xA9\xE2\x82\xAC\xF0\x9F\x8F\x8F");
+    EXPECT_EQ(document->string(third), "\xEF\xBF\xBD");
+}
+
+TEST(JsonTests, RejectsMalformedInputAndKeepsText) {
+    for (const char *text : {"", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "01", "1.", "-", "tru", "\"open",
+                             "\"control\x01\"", "\"bad \\x escape\"", "[1] 2", "{1: 2}", "\"\\u12\""}) {
+        std::string input = text;
+        EXPECT_EQ(parseJson(input), nullptr) << text;
+        EXPECT_EQ(input, text);
+    }
+}
+
+TEST(JsonTests, RejectsExcessiveNesting) {
+    EXPECT_NE(parse(std::string(200, '[') + std::string(200, ']')), nullptr);
+    EXPECT_EQ(parse(std::string(300, '[') + std::string(300, ']')), nullptr);
+}
+
+TEST(JsonTests, ParsesEmptyContainersAndScalars) {
+    auto document = parse("{\"a\": {}, \"b\": [], \"c\": \"\"}");
+    ASSERT_NE(document, nullptr);
+    EXPECT_EQ(document->size(document->find(JsonDocument::ROOT, "a")), 0u);
+    EXPECT_EQ(document->size(document->find(JsonDocument::ROOT, "b")), 0u);
+    EXPECT_EQ(document->string(document->find(JsonDocument::ROOT, "c")), "");
+
+    auto scalar = parse(" 42 ");
+    ASSERT_NE(scalar, nullptr);
+    EXPECT_EQ(scalar->type(JsonDocument::ROOT), JsonType::Number);
+    EXPECT_EQ(scalar->nodeCount(), 1u);
+}
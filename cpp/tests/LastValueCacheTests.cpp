@@ -0,0 +1,178 @@
+//
+//  LastValueCacheTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttLastValueCache.h"
+
+using namespace mqtt;
+using mqtt::test::FakeBroker;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+class LastValueCacheTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "lastvalue-" + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::remove(path.c_str());
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+        std::remove((path + ".compact").c_str());
+    }
+
+    std::unique_ptr<LastValueCache> open(size_t capacity = 64 * 1024,
+                                         std::chrono::milliseconds ttl = std::chrono::milliseconds(0)) {
+        std::string error;
+        auto cache = LastValueCache::open(path, capacity, ttl, error);
+        EXPECT_NE(cache, nullptr) << error;
+        return cache;
+    }
+
+    static std::string payloadOf(LastValueCache &cache, const std::string &topic, int64_t now = 1000) {
+        LastValueCache::Value value;
+        return cache.get(topic, value, now) ? value.payload : std::string("<none>");
+    }
+
+    std::string path;
+};
+
+}
+
+TEST_F(LastValueCacheTests, KeepsTheLastValueOfEveryTopic) {
+    auto cache = open();
+    cache->put("score/1", "1-0", 1, 100);
+    cache->put("score/2", "0-0", 0, 100);
+    cache->put("score/1", "2-0", 1, 200);
+
+    LastValueCache::Value value;
+    ASSERT_TRUE(cache->get("score/1", value, 300));
+    EXPECT_EQ(value.topic, "score/1");
+    EXPECT_EQ(value.payload, "2-0");
+    EXPECT_EQ(value.qos, 1);
+    EXPECT_EQ(value.receivedAt, 200);
+    EXPECT_EQ(payloadOf(*cache, "score/2"), "0-0");
+    EXPECT_EQ(payloadOf(*cache, "score/3"), "<none>");
+    EXPECT_EQ(cache->size(), 2u);
+}
+
+TEST_F(LastValueCacheTests, SurvivesReopening) {
+    {
+        auto cache = open();
+        cache->put("score/1", "1-0", 1, 100);
+        cache->put("score/2", std::string("\0binary", 7), 0, 100);
+        cache->put("score/1", "2-0", 1, 200);
+    }
+    auto cache = open();
+    EXPECT_EQ(cache->size(), 2u);
+    EXPECT_EQ(payloadOf(*cache, "score/1"), "2-0");
+    EXPECT_EQ(payloadOf(*cache, "score/2"), std::string("\0binary", 7));
+}
+
+TEST_F(LastValueCacheTests, IgnoresATornRecord) {
+    {
+        auto cache = open();
+        cache->put("score/1", "kept", 0, 100);
+        cache->put("score/2", "torn", 0, 100);
+    }
+    // Flips a payload byte of the second record, as a write a crash interrupted would leave it.
+    int fd = ::open(path.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    const size_t secondPayload = 16 + 40 + 24 + 7;
+    char byte = 'X';
+    ASSERT_EQ(pwrite(fd, &byte, 1, secondPayload), 1);
+    close(fd);
+
+    auto cache = open();
+    EXPECT_EQ(payloadOf(*cache, "score/1"), "kept");
+    EXPECT_EQ(payloadOf(*cache, "score/2"), "<none>");
+}
+
+TEST_F(LastValueCacheTests, ExpiresValuesOlderThanTheTtl) {
+    auto cache = open(64 * 1024, std::chrono::milliseconds(1000));
+    cache->put("score/1", "old", 0, 1000);
+    cache->put("score/2", "new", 0, 1800);
+    EXPECT_EQ(payloadOf(*cache, "score/1", 2000), "old");
+    EXPECT_EQ(payloadOf(*cache, "score/1", 2001), "<none>");
+
+    std::vector<LastValueCache::Value> values;
+    cache->collectMatches("score/+", values, 2500);
+    ASSERT_EQ(values.size(), 1u);
+    EXPECT_EQ(values[0].payload, "new");
+}
+
+TEST_F(LastValueCacheTests, EvictsTheLeastRecentlyUsedValues) {
+    // Room for about three of these values.
+    const std::string payload(300, 'x');
+    auto cache = open(1200);
+    cache->put("topic/a", payload, 0);
+    cache->put("topic/b", payload, 0);
+    cache->put("topic/c", payload, 0);
+    // Reading a makes b the least recently used.
+    EXPECT_EQ(payloadOf(*cache, "topic/a", LastValueCache::nowMillis()), payload);
+    cache->put("topic/d", payload, 0);
+
+    EXPECT_EQ(cache->size(), 3u);
+    EXPECT_EQ(payloadOf(*cache, "topic/b", LastValueCache::nowMillis()), "<none>");
+    EXPECT_EQ(payloadOf(*cache, "topic/a", LastValueCache::nowMillis()), payload);
+    EXPECT_LE(cache->liveBytes() + 16, cache->capacity());
+
+    // Evictions are recorded, so the evicted value does not come back.
+    cache.reset();
+    cache = open(1200);
+    EXPECT_EQ(cache->size(), 3u);
+    EXPECT_EQ(payloadOf(*cache, "topic/b", LastValueCache::nowMillis()), "<none>");
+}
+
+TEST_F(LastValueCacheTests, CompactsWhenTheLogIsFull) {
+    auto cache = open(4096);
+    for (int i = 0; i < 1000; i++) {
+        cache->put("score/" + std::to_string(i % 4), std::to_string(i), 0);
+    }
+    EXPECT_EQ(cache->size(), 4u);
+    EXPECT_EQ(payloadOf(*cache, "score/3", LastValueCache::nowMillis()), "999");
+
+    cache.reset();
+    cache = open(4096);
+    EXPECT_EQ(cache->size(), 4u);
+    EXPECT_EQ(payloadOf(*cache, "score/0", LastValueCache::nowMillis()), "996");
+}
+
+TEST_F(LastValueCacheTests, ReplaysCachedValuesIntoNewSubscriptions) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    std::shared_ptr<LastValueCache> cache = open();
+    client.setLastValueCache(cache);
+    client.connect(ConnectOptions());
+
+    client.subscribe("live", "score/#", 1);
+    client.onMessage("score/1", "1-0", 1);
+    client.onMessage("score/2", "0-0", 0);
+    client.onMessage("news/1", "headline", 0);
+    EXPECT_EQ(cache->size(), 3u);
+
+    sink->messages.clear();
+    client.subscribe("screen", "score/+", 0, true);
+    client.subscribe("plain", "news/1", 0);
+    ASSERT_EQ(sink->messages.size(), 2u);
+    for (const auto &message : sink->messages) {
+        EXPECT_EQ(message.first, "screen");
+        EXPECT_EQ(message.second.payload, message.second.topic == "score/1" ? "1-0" : "0-0");
+    }
+}
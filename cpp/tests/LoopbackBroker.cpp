@@ -0,0 +1,455 @@
+//
+//  LoopbackBroker.cpp
+//  d11-mqtt
+//
+
+#include "LoopbackBroker.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <future>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "MqttTopic.h"
+
+namespace mqtt {
+namespace test {
+
+namespace {
+
+constexpr uint8_t REASON_NOT_AUTHORIZED = 0x87;
+constexpr uint8_t REASON_TOPIC_NAME_INVALID = 0x90;
+constexpr uint8_t REASON_RECEIVE_MAXIMUM_EXCEEDED = 0x93;
+constexpr uint8_t REASON_PACKET_TOO_LARGE = 0x95;
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+#if defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+}
+
+LoopbackBroker::LoopbackBroker() {
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    listen(listenFd_, 64);
+    socklen_t length = sizeof(address);
+    getsockname(listenFd_, reinterpret_cast<sockaddr *>(&address), &length);
+    port_ = ntohs(address.sin_port);
+    setNonBlocking(listenFd_);
+
+    if (pipe(wakePipe_) == 0) {
+        setNonBlocking(wakePipe_[0]);
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+LoopbackBroker::~LoopbackBroker() {
+    running_ = false;
+    char byte = 0;
+    ssize_t written = write(wakePipe_[1], &byte, 1);
+    (void)written;
+    thread_.join();
+    for (auto &session : sessions_) {
+        ::close(session->fd);
+    }
+    ::close(listenFd_);
+    ::close(wakePipe_[0]);
+    ::close(wakePipe_[1]);
+}
+
+void LoopbackBroker::runOnBroker(std::function<void()> command) {
+    auto done = std::make_shared<std::promise<void>>();
+    std::future<void> finished = done->get_future();
+    {
+        std::lock_guard<std::mutex> lock(commandsMutex_);
+        commands_.push_back([command, done] {
+            command();
+            done->set_value();
+        });
+    }
+    char byte = 0;
+    ssize_t written = write(wakePipe_[1], &byte, 1);
+    (void)written;
+    finished.wait();
+}
+
+void LoopbackBroker::dropClients() {
+    runOnBroker([this] {
+        while (!sessions_.empty()) {
+            closeSession(sessions_.size() - 1);
+        }
+    });
+}
+
+void LoopbackBroker::setConnackReasonCode(uint8_t reasonCode) {
+    runOnBroker([this, reasonCode] { connackReasonCode_ = reasonCode; });
+}
+
+void LoopbackBroker::setTopicAliasMaximum(uint16_t maximum) {
+    runOnBroker([this, maximum] { topicAliasMaximum_ = maximum; });
+}
+
+void LoopbackBroker::setReading(bool reading) {
+    runOnBroker([this, reading] { reading_ = reading; });
+}
+
+void LoopbackBroker::setReceiveMaximum(uint16_t maximum) {
+    runOnBroker([this, maximum] { receiveMaximum_ = maximum; });
+}
+
+void LoopbackBroker::setMaximumPacketSize(uint32_t maximum) {
+    runOnBroker([this, maximum] { maximumPacketSize_ = maximum; });
+}
+
+void LoopbackBroker::setAcknowledging(bool acknowledging) {
+    runOnBroker([this, acknowledging] {
+        acknowledging_ = acknowledging;
+        if (!acknowledging) {
+            return;
+        }
+        for (auto &session : sessions_) {
+            for (const auto &ack : session->withheldAcks) {
+                PacketWriter(session->out).ack(ack.first, ack.second);
+            }
+            // Sent by the loop, which polls for writing next.
+            session->withheldAcks.clear();
+        }
+    });
+}
+
+size_t LoopbackBroker::violationCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = violations_; });
+    return count;
+}
+
+size_t LoopbackBroker::sessionCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = sessions_.size(); });
+    return count;
+}
+
+size_t LoopbackBroker::subscribePacketCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = subscribePackets_; });
+    return count;
+}
+
+size_t LoopbackBroker::pubackPacketCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = pubackPackets_; });
+    return count;
+}
+
+size_t LoopbackBroker::publishPacketCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = publishPackets_; });
+    return count;
+}
+
+size_t LoopbackBroker::receivedByteCount() {
+    size_t count = 0;
+    runOnBroker([this, &count] { count = receivedBytes_; });
+    return count;
+}
+
+void LoopbackBroker::run() {
+    std::vector<pollfd> fds;
+    while (running_) {
+        fds.clear();
+        fds.push_back(pollfd{wakePipe_[0], POLLIN, 0});
+        fds.push_back(pollfd{listenFd_, POLLIN, 0});
+        for (auto &session : sessions_) {
+            short events = reading_ ? POLLIN : 0;
+            if (session->outOffset < session->out.size()) {
+                events |= POLLOUT;
+            }
+            fds.push_back(pollfd{session->fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char buffer[64];
+            while (read(wakePipe_[0], buffer, sizeof(buffer)) > 0) {
+            }
+            std::vector<std::function<void()>> commands;
+            {
+                std::lock_guard<std::mutex> lock(commandsMutex_);
+                commands.swap(commands_);
+            }
+            for (auto &command : commands) {
+                command();
+            }
+            // Sessions may have changed, poll again with a fresh descriptor list.
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            accept();
+        }
+        // Sessions accepted above are not in fds yet; iterate backwards so closing keeps indices valid.
+        size_t polled = fds.size() - 2;
+        for (size_t i = polled; i-- > 0;) {
+            short revents = fds[i + 2].revents;
+            bool alive = true;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                alive = readSession(*sessions_[i]);
+            }
+            if (alive) {
+                alive = writeSession(*sessions_[i]);
+            }
+            if (!alive) {
+                closeSession(i);
+            }
+        }
+        // Routing may have queued data on sessions that were not readable this round.
+        for (size_t i = sessions_.size(); i-- > 0;) {
+            if (!writeSession(*sessions_[i])) {
+                closeSession(i);
+            }
+        }
+    }
+}
+
+void LoopbackBroker::accept() {
+    while (true) {
+        int fd = ::accept(listenFd_, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        setNonBlocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#if defined(SO_NOSIGPIPE)
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        auto session = std::make_unique<Session>();
+        session->fd = fd;
+        sessions_.push_back(std::move(session));
+    }
+}
+
+bool LoopbackBroker::readSession(Session &session) {
+    while (true) {
+        uint8_t *buffer = session.reader.prepare(16 * 1024);
+        ssize_t received = recv(session.fd, buffer, 16 * 1024, 0);
+        if (received > 0) {
+            session.reader.commit(static_cast<size_t>(received));
+            receivedBytes_ += static_cast<size_t>(received);
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+    while (true) {
+        DecodeStatus status = session.reader.next(packet_);
+        if (status == DecodeStatus::Incomplete) {
+            return true;
+        }
+        if (status != DecodeStatus::Ok || !handlePacket(session, packet_)) {
+            return false;
+        }
+    }
+}
+
+bool LoopbackBroker::handlePacket(Session &session, const Packet &packet) {
+    PacketWriter writer(session.out);
+    switch (packet.type) {
+        case PacketType::Connect: {
+            Properties properties;
+            if (topicAliasMaximum_ != 0) {
+                properties.topicAliasMaximum = topicAliasMaximum_;
+            }
+            if (receiveMaximum_ != 0) {
+                properties.receiveMaximum = receiveMaximum_;
+            }
+            if (maximumPacketSize_ != 0) {
+                properties.maximumPacketSize = maximumPacketSize_;
+            }
+            writer.connack(false, connackReasonCode_, &properties);
+            return true;
+        }
+        case PacketType::Subscribe: {
+            subscribePackets_++;
+            std::vector<uint8_t> reasonCodes;
+            for (const auto &filter : packet.topicFilters) {
+                if (filter.filter.compare(0, 7, "reject/") == 0) {
+                    reasonCodes.push_back(REASON_NOT_AUTHORIZED);
+                    continue;
+                }
+                auto existing = std::find_if(session.filters.begin(), session.filters.end(),
+                                             [&](const auto &entry) { return entry.first == filter.filter; });
+                if (existing != session.filters.end()) {
+                    existing->second = filter.qos;
+                } else {
+                    session.filters.emplace_back(std::string(filter.filter), filter.qos);
+                }
+                reasonCodes.push_back(filter.qos);
+            }
+            writer.suback(packet.packetId, reasonCodes.data(), reasonCodes.size());
+            return true;
+        }
+        case PacketType::Unsubscribe: {
+            std::vector<uint8_t> reasonCodes;
+            for (const auto &filter : packet.topicFilters) {
+                auto existing = std::find_if(session.filters.begin(), session.filters.end(),
+                                             [&](const auto &entry) { return entry.first == filter.filter; });
+                // 0x11: no subscription existed.
+                reasonCodes.push_back(existing != session.filters.end() ? 0x00 : 0x11);
+                if (existing != session.filters.end()) {
+                    session.filters.erase(existing);
+                }
+            }
+            writer.unsuback(packet.packetId, reasonCodes.data(), reasonCodes.size());
+            return true;
+        }
+        case PacketType::Publish: {
+            publishPackets_++;
+            PublishPacket received;
+            received.topic = packet.topic;
+            received.payloadSize = packet.payloadSize;
+            received.qos = packet.qos;
+            received.topicAlias = packet.properties.topicAlias.value_or(0);
+            if (maximumPacketSize_ != 0 && PacketWriter::publishSize(received) > maximumPacketSize_) {
+                violations_++;
+                writer.disconnect(REASON_PACKET_TOO_LARGE);
+                writeSession(session);
+                return false;
+            }
+            if (packet.topic.compare(0, 7, "reject/") == 0) {
+                writer.disconnect(REASON_TOPIC_NAME_INVALID);
+                writeSession(session);
+                return false;
+            }
+            if (packet.qos > 0 && receiveMaximum_ != 0 && session.withheldAcks.size() >= receiveMaximum_) {
+                violations_++;
+                writer.disconnect(REASON_RECEIVE_MAXIMUM_EXCEEDED);
+                writeSession(session);
+                return false;
+            }
+            std::string_view topic = packet.topic;
+            if (packet.properties.topicAlias) {
+                uint16_t alias = *packet.properties.topicAlias;
+                if (alias == 0 || alias > topicAliasMaximum_) {
+                    return false;
+                }
+                if (!topic.empty()) {
+                    session.topicAliases[alias] = std::string(topic);
+                } else {
+                    auto known = session.topicAliases.find(alias);
+                    if (known == session.topicAliases.end()) {
+                        return false;
+                    }
+                    topic = known->second;
+                }
+            }
+            if (packet.qos > 0) {
+                PacketType ack = packet.qos == 1 ? PacketType::Puback : PacketType::Pubrec;
+                if (acknowledging_) {
+                    writer.ack(ack, packet.packetId);
+                } else {
+                    session.withheldAcks.emplace_back(ack, packet.packetId);
+                }
+            }
+            route(packet, topic);
+            return true;
+        }
+        case PacketType::Pubrel:
+            writer.ack(PacketType::Pubcomp, packet.packetId);
+            return true;
+        case PacketType::Pubrec:
+            writer.ack(PacketType::Pubrel, packet.packetId);
+            return true;
+        case PacketType::Puback:
+            pubackPackets_++;
+            return true;
+        case PacketType::Pubcomp:
+            return true;
+        case PacketType::Pingreq:
+            writer.pingresp();
+            return true;
+        case PacketType::Disconnect:
+            return false;
+        default:
+            return false;
+    }
+}
+
+void LoopbackBroker::route(const Packet &packet, std::string_view topic) {
+    for (auto &session : sessions_) {
+        int grantedQos = -1;
+        for (const auto &filter : session->filters) {
+            if (topicMatchesFilter(topic, effectiveTopicFilter(filter.first))) {
+                grantedQos = std::max(grantedQos, static_cast<int>(filter.second));
+            }
+        }
+        if (grantedQos < 0) {
+            continue;
+        }
+        PublishPacket publish;
+        publish.topic = topic;
+        publish.payload = packet.payload;
+        publish.payloadSize = packet.payloadSize;
+        publish.qos = static_cast<uint8_t>(std::min<int>(packet.qos, grantedQos));
+        if (publish.qos > 0) {
+            if (++session->packetId == 0) {
+                session->packetId = 1;
+            }
+            publish.packetId = session->packetId;
+        }
+        PacketWriter(session->out).publish(publish);
+    }
+}
+
+bool LoopbackBroker::writeSession(Session &session) {
+    while (session.outOffset < session.out.size()) {
+        ssize_t sent = send(session.fd, session.out.data() + session.outOffset, session.out.size() - session.outOffset,
+                            SEND_FLAGS);
+        if (sent > 0) {
+            session.outOffset += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+    session.out.clear();
+    session.outOffset = 0;
+    return true;
+}
+
+void LoopbackBroker::closeSession(size_t index) {
+    ::close(sessions_[index]->fd);
+    sessions_.erase(sessions_.begin() + static_cast<long>(index));
+}
+
+}
+}
@@ -0,0 +1,137 @@
+//
+//  LoopbackBroker.h
+//  d11-mqtt
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "MqttCodec.h"
+
+namespace mqtt {
+namespace test {
+
+/**
+ * Minimal in-process MQTT 5 broker on 127.0.0.1 for tests and benchmarks of the native engine. Built on the
+ * same codec, it accepts every CONNECT, grants every SUBSCRIBE (except filters starting with "reject/", a PUBLISH to
+ * which is answered with a DISCONNECT 0x90 like a broker's topic rules would), routes
+ * PUBLISH to matching sessions at min(publish QoS, subscription QoS) and completes the QoS 1/2 handshakes. Topic
+ * aliases of incoming PUBLISH packets are resolved when setTopicAliasMaximum allowed them. There is no session state,
+ * retained messages or authentication.
+ */
+class LoopbackBroker {
+public:
+    LoopbackBroker();
+    ~LoopbackBroker();
+
+    int port() const { return port_; }
+
+    /**
+     * Closes every client connection without a DISCONNECT, like a lost network. Returns once they are closed.
+     */
+    void dropClients();
+
+    /**
+     * Reason code sent in CONNACK from now on; 0 accepts connections.
+     */
+    void setConnackReasonCode(uint8_t reasonCode);
+
+    /**
+     * Topic Alias Maximum announced in CONNACK from now on; 0, the default, leaves it out and takes no aliases.
+     */
+    void setTopicAliasMaximum(uint16_t maximum);
+
+    /**
+     * Stops reading from clients until resumed, like a stalled broker whose socket buffers fill up.
+     */
+    void setReading(bool reading);
+
+    /**
+     * Receive Maximum and Maximum Packet Size announced in CONNACK from now on and enforced like a broker does: a
+     * client going past them is disconnected (0x93, 0x95) and counted in violationCount(). 0 leaves them out.
+     */
+    void setReceiveMaximum(uint16_t maximum);
+    void setMaximumPacketSize(uint32_t maximum);
+
+    /**
+     * Withholds the PUBACK/PUBREC of received QoS 1/2 publishes until resumed, when the withheld ones are sent.
+     */
+    void setAcknowledging(bool acknowledging);
+
+    size_t violationCount();
+
+    size_t sessionCount();
+
+    /**
+     * SUBSCRIBE packets received since the broker started, over all sessions.
+     */
+    size_t subscribePacketCount();
+
+    /**
+     * PUBACK packets received since the broker started, i.e. QoS 1 deliveries the clients acknowledged.
+     */
+    size_t pubackPacketCount();
+
+    /**
+     * PUBLISH packets and bytes (of every packet type) received from clients since the broker started.
+     */
+    size_t publishPacketCount();
+    size_t receivedByteCount();
+
+private:
+    struct Session {
+        int fd = -1;
+        PacketReader reader;
+        std::vector<uint8_t> out;
+        size_t outOffset = 0;
+        std::vector<std::pair<std::string, uint8_t>> filters;
+        uint16_t packetId = 0;
+        std::unordered_map<uint16_t, std::string> topicAliases;
+        std::vector<std::pair<PacketType, uint16_t>> withheldAcks;
+    };
+
+    void run();
+    void runOnBroker(std::function<void()> command);
+    void accept();
+    bool readSession(Session &session);
+    bool handlePacket(Session &session, const Packet &packet);
+    void route(const Packet &packet, std::string_view topic);
+    bool writeSession(Session &session);
+    void closeSession(size_t index);
+
+    int listenFd_ = -1;
+    int wakePipe_[2] = {-1, -1};
+    int port_ = 0;
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+
+    std::mutex commandsMutex_;
+    std::vector<std::function<void()>> commands_;
+
+    // Broker thread only.
+    std::vector<std::unique_ptr<Session>> sessions_;
+    uint8_t connackReasonCode_ = 0;
+    size_t subscribePackets_ = 0;
+    size_t pubackPackets_ = 0;
+    uint16_t topicAliasMaximum_ = 0;
+    bool reading_ = true;
+    uint16_t receiveMaximum_ = 0;
+    uint32_t maximumPacketSize_ = 0;
+    bool acknowledging_ = true;
+    size_t violations_ = 0;
+    size_t publishPackets_ = 0;
+    size_t receivedBytes_ = 0;
+    Packet packet_;
+};
+
+}
+}
@@ -0,0 +1,94 @@
+//
+//  MessageBatchTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MqttMessageBatch.h"
+#include "MqttMessageRing.h"
+
+using namespace mqtt;
+
+namespace {
+
+MqttMessage message(int index) {
+    MqttMessage message;
+    message.topic = "score";
+    message.payload = std::to_string(index);
+    return message;
+}
+
+}
+
+TEST(MessageRingTests, PopsInPushOrderUntilEmpty) {
+    MessageRing<int> ring(4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(ring.tryPush(int(i)));
+    }
+    EXPECT_FALSE(ring.tryPush(4));
+
+    int value;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(ring.tryPop(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(ring.tryPop(value));
+}
+
+TEST(MessageBatchTests, ReportsFirstAndFullPushes) {
+    MessageBatch batch(3, std::chrono::milliseconds(16));
+    EXPECT_EQ(batch.push(message(0)), MessageBatch::PushResult::First);
+    EXPECT_EQ(batch.push(message(1)), MessageBatch::PushResult::Queued);
+    EXPECT_EQ(batch.push(message(2)), MessageBatch::PushResult::Full);
+
+    bool hasRemaining = true;
+    auto messages = batch.drain(hasRemaining);
+    EXPECT_FALSE(hasRemaining);
+    ASSERT_EQ(messages.size(), 3u);
+    EXPECT_EQ(messages[2].payload, "2");
+    EXPECT_EQ(batch.push(message(3)), MessageBatch::PushResult::First);
+}
+
+TEST(MessageBatchTests, KeepsOrderWhenRingOverflows) {
+    MessageBatch batch(1, std::chrono::milliseconds(16));
+    const int count = 1000;
+    for (int i = 0; i < count; i++) {
+        batch.push(message(i));
+    }
+
+    bool hasRemaining = false;
+    auto messages = batch.drain(hasRemaining);
+    ASSERT_EQ(messages.size(), size_t(count));
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(messages[i].payload, std::to_string(i));
+    }
+}
+
+TEST(MessageBatchTests, DeliversEveryMessageFromConcurrentProducers) {
+    MessageBatch batch(16, std::chrono::milliseconds(16));
+    const int producers = 4;
+    const int perProducer = 5000;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&batch, p] {
+            for (int i = 0; i < perProducer; i++) {
+                batch.push(message(p * perProducer + i));
+            }
+        });
+    }
+
+    size_t received = 0;
+    bool hasRemaining = false;
+    while (received < size_t(producers * perProducer)) {
+        received += batch.drain(hasRemaining).size();
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(received + batch.drain(hasRemaining).size(), size_t(producers * perProducer));
+}
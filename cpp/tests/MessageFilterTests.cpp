@@ -0,0 +1,192 @@
+//
+//  MessageFilterTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttJson.h"
+#include "MqttMessageFilter.h"
+
+using namespace mqtt;
+using mqtt::test::FakeBroker;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+std::shared_ptr<MessageFilter> compile(EventValue::Array conditions) {
+    std::string error;
+    auto filter = MessageFilter::compile(EventValue(std::move(conditions)), error);
+    EXPECT_NE(filter, nullptr) << error;
+    return filter;
+}
+
+std::string compileError(EventValue spec) {
+    std::string error;
+    EXPECT_EQ(MessageFilter::compile(spec, error), nullptr);
+    return error;
+}
+
+bool matches(MessageFilter &filter, const std::string &topic, const std::string &payload = "",
+             const MessageProperties &userProperties = {}) {
+    FilterSubject subject(topic, payload, userProperties);
+    return filter.matches(subject);
+}
+
+}
+
+TEST(MessageFilterTests, TestsTopicLevels) {
+    auto filter = compile({
+        EventValue::Map{{"topicSegment", 1}, {"in", EventValue::Array{"ind", "aus"}}},
+        EventValue::Map{{"topicSegment", -1}, {"ne", "commentary"}},
+    });
+    EXPECT_TRUE(matches(*filter, "match/ind/score"));
+    EXPECT_TRUE(matches(*filter, "match/aus"));
+    EXPECT_FALSE(matches(*filter, "match/eng/score"));
+    EXPECT_FALSE(matches(*filter, "match/ind/commentary"));
+    EXPECT_FALSE(matches(*filter, "match"));
+
+    auto numeric = compile({EventValue::Map{{"topicSegment", 2}, {"gte", 100}}});
+    EXPECT_TRUE(matches(*numeric, "match/ind/120"));
+    EXPECT_FALSE(matches(*numeric, "match/ind/99"));
+    EXPECT_FALSE(matches(*numeric, "match/ind/latest"));
+}
+
+TEST(MessageFilterTests, TestsUserProperties) {
+    auto filter = compile({
+        EventValue::Map{{"userProperty", "region"}, {"eq", "IN"}},
+        EventValue::Map{{"userProperty", "version"}, {"gt", 2}},
+        EventValue::Map{{"userProperty", "test"}, {"exists", false}},
+    });
+    EXPECT_TRUE(filter->usesUserProperties());
+    EXPECT_TRUE(matches(*filter, "t", "", {{"region", "IN"}, {"version", "3"}}));
+    EXPECT_FALSE(matches(*filter, "t", "", {{"region", "IN"}, {"version", "2"}}));
+    EXPECT_FALSE(matches(*filter, "t", "", {{"region", "US"}, {"version", "3"}}));
+    EXPECT_FALSE(matches(*filter, "t", "", {{"region", "IN"}, {"version", "3"}, {"test", "1"}}));
+    EXPECT_FALSE(matches(*filter, "t", "", {{"version", "3"}}));
+    EXPECT_FALSE(compile({EventValue::Map{{"topicSegment", 0}, {"eq", "t"}}})->usesUserProperties());
+}
+
+TEST(MessageFilterTests, TestsTopLevelJsonFields) {
+    auto filter = compile({
+        EventValue::Map{{"jsonField", "teamId"}, {"in", EventValue::Array{7, 9}}},
+        EventValue::Map{{"jsonField", "live"}, {"eq", true}},
+        EventValue::Map{{"jsonField", "odds"}, {"exists", true}},
+        EventValue::Map{{"jsonField", "status"}, {"notIn", EventValue::Array{"abandoned", EventValue()}}},
+    });
+    EXPECT_TRUE(matches(*filter, "t", R"({"teamId": 7, "live": true, "odds": {"home": 1.5}, "status": "live"})"));
+    EXPECT_TRUE(matches(*filter, "t", R"({"teamId": 9, "live": true, "odds": [1.5]})"));
+    EXPECT_FALSE(matches(*filter, "t", R"({"teamId": 8, "live": true, "odds": 1})"));
+    EXPECT_FALSE(matches(*filter, "t", R"({"teamId": 7, "live": false, "odds": 1})"));
+    EXPECT_FALSE(matches(*filter, "t", R"({"teamId": 7, "live": true})"));
+    EXPECT_FALSE(matches(*filter, "t", R"({"teamId": 7, "live": true, "odds": 1, "status": null})"));
+    EXPECT_FALSE(matches(*filter, "t", R"({"teamId": "7", "live": true, "odds": 1})"));
+    EXPECT_FALSE(matches(*filter, "t", R"([{"teamId": 7}])"));
+    EXPECT_FALSE(matches(*filter, "t", "not json"));
+}
+
+TEST(MessageFilterTests, HandsTheParsedPayloadOn) {
+    auto filter = compile({EventValue::Map{{"jsonField", "version"}, {"exists", true}}});
+    MessageProperties none;
+    FilterSubject subject("t", R"({"version": 2})", none);
+    EXPECT_EQ(subject.parsedJson(), nullptr);
+    ASSERT_TRUE(filter->matches(subject));
+    ASSERT_NE(subject.parsedJson(), nullptr);
+    EXPECT_EQ(subject.parsedJson()->number(subject.parsedJson()->find(JsonDocument::ROOT, "version")), 2);
+
+    // Payloads are only parsed for JSON conditions.
+    FilterSubject topicOnly("a/b", R"({"version": 2})", none);
+    EXPECT_TRUE(compile({EventValue::Map{{"topicSegment", 0}, {"eq", "a"}}})->matches(topicOnly));
+    EXPECT_EQ(topicOnly.parsedJson(), nullptr);
+}
+
+TEST(MessageFilterTests, PassesIncreasingValuesPerTopic) {
+    auto filter = compile({
+        EventValue::Map{{"jsonField", "version"}, {"increases", true}},
+        EventValue::Map{{"jsonField", "final"}, {"ne", true}},
+    });
+    EXPECT_TRUE(matches(*filter, "match/1", R"({"version": 1})"));
+    EXPECT_TRUE(matches(*filter, "match/1", R"({"version": 2})"));
+    EXPECT_FALSE(matches(*filter, "match/1", R"({"version": 2})"));
+    EXPECT_FALSE(matches(*filter, "match/1", R"({"version": 1})"));
+    // Topics are tracked apart.
+    EXPECT_TRUE(matches(*filter, "match/2", R"({"version": 1})"));
+    // A message another condition drops does not move the last value.
+    EXPECT_FALSE(matches(*filter, "match/1", R"({"version": 9, "final": true})"));
+    EXPECT_TRUE(matches(*filter, "match/1", R"({"version": 3})"));
+    EXPECT_FALSE(matches(*filter, "match/1", R"({"version": "4"})"));
+    EXPECT_FALSE(matches(*filter, "match/1", R"({"revision": 4})"));
+}
+
+TEST(MessageFilterTests, CountsPassedAndDroppedMessages) {
+    auto filter = compile({EventValue::Map{{"topicSegment", 0}, {"eq", "keep"}}});
+    matches(*filter, "keep/1");
+    matches(*filter, "drop/1");
+    matches(*filter, "drop/2");
+    EXPECT_EQ(filter->passedCount(), 1u);
+    EXPECT_EQ(filter->droppedCount(), 2u);
+}
+
+TEST(MessageFilterTests, RejectsMalformedFilters) {
+    EXPECT_EQ(compileError(EventValue::Map{{"topicSegment", 0}}), "filter must be an array of conditions");
+    EXPECT_EQ(compileError(EventValue::Array{"topic"}), "filter conditions must be objects");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"eq", 1}}}),
+              "a condition must name a topicSegment, userProperty or jsonField");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}, {"userProperty", "b"}, {"eq", 1}}}),
+              "a condition names more than one of topicSegment, userProperty and jsonField");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"topicSegment", 1.5}, {"eq", 1}}}),
+              "topicSegment must be an integer");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}}}),
+              "a condition must have an operator");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}, {"like", "x%"}}}),
+              "unknown filter operator like");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}, {"gt", "1"}}}),
+              "gt must be a number");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}, {"in", "x"}}}),
+              "in must be an array of strings, numbers, booleans or null");
+    EXPECT_EQ(compileError(EventValue::Array{EventValue::Map{{"jsonField", "a"}, {"increases", true}},
+                                             EventValue::Map{{"jsonField", "b"}, {"increases", true}}}),
+              "only one condition of a filter may use increases");
+}
+
+TEST(MessageFilterTests, ClientDropsFilteredMessagesBeforeTheSink) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    client.setFlowControl(FlowControl{16, DropPolicy::DropOldest});
+    client.connect(ConnectOptions());
+
+    client.subscribe("all", "score/#", 0);
+    client.subscribe("india", "score/#", 0, false,
+                     compile({EventValue::Map{{"userProperty", "team"}, {"eq", "IND"}},
+                              EventValue::Map{{"jsonField", "runs"}, {"gte", 100}}}));
+    client.onMessage("score/1", R"({"runs": 120})", 0, 0, 0, {{"team", "IND"}});
+    client.onMessage("score/2", R"({"runs": 120})", 0, 0, 0, {{"team", "AUS"}});
+    client.onMessage("score/3", R"({"runs": 80})", 0, 0, 0, {{"team", "IND"}});
+
+    ASSERT_EQ(sink->messages.size(), 4u);
+    std::vector<std::string> india;
+    for (const auto &message : sink->messages) {
+        if (message.first == "india") {
+            india.push_back(message.second.topic);
+            // Parsed once, by the filter.
+            EXPECT_NE(message.second.json, nullptr);
+        }
+    }
+    EXPECT_EQ(india, std::vector<std::string>{"score/1"});
+    auto filter = client.messageFilter("india");
+    ASSERT_NE(filter, nullptr);
+    EXPECT_EQ(filter->passedCount(), 1u);
+    EXPECT_EQ(filter->droppedCount(), 2u);
+
+    client.unsubscribe("india", "score/#");
+    EXPECT_EQ(client.messageFilter("india"), nullptr);
+    EXPECT_EQ(client.messageFilter("all"), nullptr);
+}
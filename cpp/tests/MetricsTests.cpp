@@ -0,0 +1,161 @@
+//
+//  MetricsTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttMetrics.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::FakeBroker;
+using mqtt::test::field;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+double number(const EventValue &value, const std::string &key) {
+    const EventValue *found = field(value, key);
+    return found ? found->getNumber() : -1;
+}
+
+}
+
+TEST(LatencyHistogramTests, BucketsAreExactBelowSixteenAndWithinOneSixteenthAbove) {
+    for (uint64_t value = 0; value < 16; value++) {
+        EXPECT_EQ(LatencyHistogram::bucketHighestValue(LatencyHistogram::bucketIndex(value)), value);
+    }
+    for (uint64_t value : std::vector<uint64_t>{16, 17, 100, 1000, 123456, 987654321, UINT64_MAX}) {
+        uint64_t highest = LatencyHistogram::bucketHighestValue(LatencyHistogram::bucketIndex(value));
+        EXPECT_GE(highest, value);
+        EXPECT_LE(highest - value, value / 16);
+    }
+    EXPECT_LT(LatencyHistogram::bucketIndex(1000), LatencyHistogram::bucketIndex(1100));
+}
+
+TEST(LatencyHistogramTests, ReportsPercentilesOfRecordedValues) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.valueAtQuantile(0.5), 0u);
+    for (uint64_t value = 1; value <= 1000; value++) {
+        histogram.record(value);
+    }
+    EXPECT_EQ(histogram.count(), 1000u);
+    EXPECT_NEAR(static_cast<double>(histogram.valueAtQuantile(0.5)), 500, 500 / 16.0);
+    EXPECT_NEAR(static_cast<double>(histogram.valueAtQuantile(0.99)), 990, 990 / 16.0);
+    EXPECT_EQ(histogram.valueAtQuantile(1), 1000u);
+
+    EventValue snapshot = histogram.snapshot();
+    EXPECT_EQ(number(snapshot, "count"), 1000);
+    EXPECT_EQ(number(snapshot, "min"), 1);
+    EXPECT_EQ(number(snapshot, "max"), 1000);
+    EXPECT_DOUBLE_EQ(number(snapshot, "mean"), 500.5);
+    EXPECT_NE(field(snapshot, "p999"), nullptr);
+}
+
+TEST(LatencyHistogramTests, CountsRecordsFromConcurrentThreads) {
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&histogram, t] {
+            for (uint64_t value = 0; value < 10000; value++) {
+                histogram.record(value * (t + 1));
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    EventValue snapshot = histogram.snapshot();
+    EXPECT_EQ(number(snapshot, "count"), 40000);
+    EXPECT_EQ(number(snapshot, "min"), 0);
+    EXPECT_EQ(number(snapshot, "max"), 9999 * 4);
+}
+
+TEST(ClientMetricsTests, CapsTrackedTopics) {
+    ClientMetrics metrics;
+    for (size_t i = 0; i < ClientMetrics::MAX_TRACKED_TOPICS + 10; i++) {
+        metrics.recordReceived("topic/" + std::to_string(i), 4);
+    }
+    metrics.recordReceived("topic/0", 4);
+
+    EventValue snapshot = metrics.snapshot();
+    EXPECT_EQ(number(snapshot, "messagesIn"), ClientMetrics::MAX_TRACKED_TOPICS + 11);
+    EXPECT_EQ(number(snapshot, "bytesIn"), (ClientMetrics::MAX_TRACKED_TOPICS + 11) * 4);
+    const EventValue *topics = field(snapshot, "topics");
+    ASSERT_NE(topics, nullptr);
+    EXPECT_EQ(topics->getMap().size(), ClientMetrics::MAX_TRACKED_TOPICS);
+    EXPECT_EQ(number(*field(*topics, "topic/0"), "messages"), 2);
+    EXPECT_EQ(number(*field(snapshot, "otherTopics"), "messages"), 10);
+}
+
+TEST(ClientMetricsTests, TopicRateCoversTimeSincePreviousSnapshot) {
+    ClientMetrics metrics;
+    metrics.recordReceived("score", 1);
+    metrics.snapshot();
+    for (int i = 0; i < 5; i++) {
+        metrics.recordReceived("score", 1);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EventValue snapshot = metrics.snapshot();
+    const EventValue *score = field(*field(snapshot, "topics"), "score");
+    ASSERT_NE(score, nullptr);
+    EXPECT_EQ(number(*score, "messages"), 6);
+    double rate = number(*score, "messagesPerSecond");
+    EXPECT_GT(rate, 0);
+    EXPECT_LE(rate, 500);
+}
+
+TEST(ClientMetricsTests, ClientCountsTrafficAndStampsReceivedMessages) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    client.connect(ConnectOptions());
+    client.subscribe("a", "score/#", 0);
+
+    int64_t before = monotonicNanos();
+    std::string payload = "goal";
+    client.publish("score/1", reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 0, false);
+    client.onMessage("score/2", "stamped", 0, 42);
+
+    ASSERT_EQ(sink->messages.size(), 2u);
+    EXPECT_GE(sink->messages[0].second.receivedAt, before);
+    EXPECT_EQ(sink->messages[1].second.receivedAt, 42);
+
+    EventValue snapshot = client.metrics().snapshot();
+    EXPECT_EQ(number(snapshot, "messagesOut"), 1);
+    EXPECT_EQ(number(snapshot, "bytesOut"), 4);
+    EXPECT_EQ(number(snapshot, "messagesIn"), 2);
+    EXPECT_EQ(number(snapshot, "bytesIn"), 11);
+}
+
+TEST(ClientMetricsTests, ClientRecordsReconnectDuration) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<BlockingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    ReconnectPolicy policy;
+    policy.enabled = true;
+    policy.maxRetries = 2;
+    client.setReconnectPolicy(policy);
+    client.connect(ConnectOptions());
+    EXPECT_EQ(number(client.metrics().snapshot(), "reconnects"), 0);
+
+    broker->dropConnection("network lost");
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+
+    EventValue snapshot = client.metrics().snapshot();
+    EXPECT_EQ(number(snapshot, "reconnects"), 1);
+    EXPECT_EQ(number(*field(snapshot, "reconnectDurationMs"), "count"), 1);
+}
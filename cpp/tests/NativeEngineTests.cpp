@@ -0,0 +1,92 @@
+//
+//  NativeEngineTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "LoopbackBroker.h"
+#include "MqttConstants.h"
+#include "MqttNativeEngine.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::LoopbackBroker;
+
+namespace {
+
+class NativeEngineTests : public ::testing::Test {
+protected:
+    void TearDown() override { registry.clear(); }
+
+    NativeClientOptions options() {
+        NativeClientOptions options;
+        options.host = "127.0.0.1";
+        options.port = broker.port();
+        return options;
+    }
+
+    std::string initializationError() {
+        auto errors = sink->events(std::string("client") + events::MQTT_ERROR);
+        if (errors.empty()) {
+            return "<none>";
+        }
+        const EventValue *clientInit = mqtt::test::field(errors[0].second, "clientInit");
+        EXPECT_TRUE(clientInit != nullptr && !clientInit->getBool());
+        const EventValue *message = mqtt::test::field(errors[0].second, "errorMessage");
+        return message ? message->getString() : std::string();
+    }
+
+    LoopbackBroker broker;
+    ClientRegistry registry;
+    std::shared_ptr<BlockingEventSink> sink = std::make_shared<BlockingEventSink>();
+};
+
+}
+
+TEST_F(NativeEngineTests, CreatesAClientThatConnects) {
+    std::string error;
+    auto client = createNativeClient(registry, "client", options(), sink, error);
+    ASSERT_NE(client, nullptr);
+    EXPECT_TRUE(error.empty());
+    EXPECT_EQ(registry.find("client"), client);
+    client->connect(ConnectOptions());
+    EXPECT_TRUE(sink->waitFor("clientconnected"));
+}
+
+TEST_F(NativeEngineTests, TlsClientsCannotConnect) {
+    NativeClientOptions tls = options();
+    tls.enableSsl = true;
+    std::string error;
+    EXPECT_EQ(createNativeClient(registry, "client", tls, sink, error), nullptr);
+    EXPECT_EQ(initializationError(), "TLS is not supported by the native engine, use engine: 'platform'");
+
+    // Nothing is registered for connectMqtt to find, so nothing reaches the broker in the clear.
+    EXPECT_EQ(registry.find("client"), nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(broker.sessionCount(), 0u);
+
+    tls.shareConnection = true;
+    EXPECT_EQ(createNativeClient(registry, "client", tls, sink, error), nullptr);
+    EXPECT_EQ(registry.find("client"), nullptr);
+}
+
+TEST_F(NativeEngineTests, RejectsPersistenceOnASharedConnection) {
+    NativeClientOptions shared = options();
+    shared.shareConnection = true;
+    shared.storeCapacity = 64 * 1024;
+    std::string error;
+    EXPECT_EQ(createNativeClient(registry, "client", shared, sink, error), nullptr);
+    EXPECT_EQ(initializationError(), "persistence is not supported together with shareConnection");
+    EXPECT_EQ(registry.find("client"), nullptr);
+
+    shared.storeCapacity = 0;
+    EXPECT_NE(createNativeClient(registry, "client", shared, sink, error), nullptr);
+}
@@ -0,0 +1,203 @@
+//
+//  OutboundStoreTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "MqttOutboundStore.h"
+
+using namespace mqtt;
+
+namespace {
+
+struct Stored {
+    uint64_t sequence;
+    std::string topic;
+    std::string payload;
+    uint8_t qos;
+    bool retain;
+    uint16_t packetId;
+    bool released;
+};
+
+class OutboundStoreTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "outbound-" + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        std::remove(path.c_str());
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+        std::remove((path + ".compact").c_str());
+    }
+
+    std::unique_ptr<OutboundStore> open(size_t capacity = 64 * 1024) {
+        std::string error;
+        auto store = OutboundStore::open(path, capacity, error);
+        EXPECT_NE(store, nullptr) << error;
+        return store;
+    }
+
+    static uint64_t append(OutboundStore &store, const std::string &topic, const std::string &payload, uint8_t qos = 1,
+                           uint16_t packetId = 0) {
+        return store.append(topic, reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), qos, false,
+                            packetId);
+    }
+
+    static std::vector<Stored> contents(const OutboundStore &store) {
+        std::vector<Stored> result;
+        store.forEach([&result](const OutboundStore::Entry &entry) {
+            result.push_back(Stored{entry.sequence, std::string(entry.topic),
+                                    std::string(reinterpret_cast<const char *>(entry.payload), entry.payloadSize),
+                                    entry.qos, entry.retain, entry.packetId, entry.released});
+        });
+        return result;
+    }
+
+    off_t fileSize() const {
+        struct stat info {};
+        stat(path.c_str(), &info);
+        return info.st_size;
+    }
+
+    std::string path;
+};
+
+}
+
+TEST_F(OutboundStoreTests, RecoversPendingMessagesAfterReopen) {
+    {
+        auto store = open();
+        uint64_t first = append(*store, "orders/1", "buy", 1, 7);
+        uint64_t second = append(*store, "orders/2", "sell", 2);
+        uint64_t third = append(*store, "orders/3", "hold", 2);
+        ASSERT_NE(first, 0u);
+        store->complete(first);
+        store->assignPacketId(second, 9);
+        store->release(second);
+        store->assignPacketId(third, 10);
+        ASSERT_EQ(store->size(), 2u);
+    }
+    auto store = open();
+    auto messages = contents(*store);
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0].topic, "orders/2");
+    EXPECT_EQ(messages[0].payload, "sell");
+    EXPECT_EQ(messages[0].qos, 2);
+    EXPECT_EQ(messages[0].packetId, 9);
+    EXPECT_TRUE(messages[0].released);
+    EXPECT_EQ(messages[1].payload, "hold");
+    EXPECT_EQ(messages[1].packetId, 10);
+    EXPECT_FALSE(messages[1].released);
+
+    // Sequence numbers keep increasing across reopens.
+    EXPECT_GT(append(*store, "orders/4", "new"), messages[1].sequence);
+}
+
+TEST_F(OutboundStoreTests, DropsTornRecordAtTheEnd) {
+    size_t used = 0;
+    {
+        auto store = open();
+        append(*store, "orders/1", "kept");
+        used = store->usedBytes();
+        append(*store, "orders/2", "torn by a crash");
+    }
+    // Corrupt the payload of the last record, as a write interrupted by the process being killed would.
+    int fd = ::open(path.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pwrite(fd, "X", 1, static_cast<off_t>(used + 24 + 10)), 1);
+    ::close(fd);
+
+    auto store = open();
+    auto messages = contents(*store);
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].payload, "kept");
+    EXPECT_EQ(store->usedBytes(), used);
+
+    // The torn record is overwritten by the next append.
+    append(*store, "orders/3", "after recovery");
+    store.reset();
+    store = open();
+    ASSERT_EQ(store->size(), 2u);
+    EXPECT_EQ(contents(*store)[1].payload, "after recovery");
+}
+
+TEST_F(OutboundStoreTests, CompactsWhenTheLogIsFull) {
+    const size_t capacity = 16 * 1024;
+    auto store = open(capacity);
+    const std::string payload(200, 'p');
+    uint64_t pending = append(*store, "orders/pending", "still pending");
+    for (int i = 0; i < 1000; i++) {
+        uint64_t sequence = append(*store, "orders/" + std::to_string(i), payload);
+        ASSERT_NE(sequence, 0u) << i;
+        store->complete(sequence);
+    }
+    EXPECT_EQ(fileSize(), static_cast<off_t>(capacity));
+    EXPECT_LT(store->usedBytes(), capacity);
+
+    store.reset();
+    store = open(capacity);
+    auto messages = contents(*store);
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].sequence, pending);
+    EXPECT_EQ(messages[0].payload, "still pending");
+}
+
+TEST_F(OutboundStoreTests, RefusesMessagesBeyondCapacity) {
+    const size_t capacity = 8 * 1024;
+    auto store = open(capacity);
+    const std::string payload(1000, 'p');
+    std::vector<uint64_t> sequences;
+    for (;;) {
+        uint64_t sequence = append(*store, "orders", payload);
+        if (sequence == 0) {
+            break;
+        }
+        sequences.push_back(sequence);
+    }
+    ASSERT_GT(sequences.size(), 3u);
+    EXPECT_EQ(fileSize(), static_cast<off_t>(capacity));
+
+    // Every pending message can still record its remaining state changes.
+    for (uint64_t sequence : sequences) {
+        store->assignPacketId(sequence, 1);
+        store->release(sequence);
+    }
+    store->complete(sequences[0]);
+    EXPECT_NE(append(*store, "orders", payload), 0u);
+
+    store.reset();
+    store = open(capacity);
+    EXPECT_EQ(store->size(), sequences.size());
+}
+
+TEST_F(OutboundStoreTests, ShrinksFileWrittenWithLargerCapacity) {
+    {
+        auto store = open(64 * 1024);
+        append(*store, "orders/1", "kept");
+    }
+    auto store = open(16 * 1024);
+    EXPECT_EQ(fileSize(), 16 * 1024);
+    ASSERT_EQ(store->size(), 1u);
+    EXPECT_EQ(contents(*store)[0].payload, "kept");
+}
+
+TEST_F(OutboundStoreTests, StartsOverOnUnreadableFile) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, "not a store", 11), 11);
+    ::close(fd);
+
+    auto store = open();
+    EXPECT_TRUE(store->empty());
+    EXPECT_NE(append(*store, "orders", "first"), 0u);
+}
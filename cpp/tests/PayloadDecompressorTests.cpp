@@ -0,0 +1,177 @@
+//
+//  PayloadDecompressorTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <zlib.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttPayloadDecompressor.h"
+
+using namespace mqtt;
+using mqtt::test::FakeBroker;
+using mqtt::test::field;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+constexpr int ZLIB_WINDOW_BITS = 15;
+constexpr int GZIP_WINDOW_BITS = 15 + 16;
+
+std::string compress(const std::string &input, int windowBits = ZLIB_WINDOW_BITS, const std::string &dictionary = "") {
+    z_stream stream{};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    if (!dictionary.empty()) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()),
+                             static_cast<uInt>(dictionary.size()));
+    }
+    std::string output(deflateBound(&stream, input.size()) + 32, '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef *>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+    deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return output;
+}
+
+std::string scorecard(int overs) {
+    std::string json = "{\"matchId\":42,\"innings\":[";
+    for (int over = 0; over < overs; over++) {
+        json += (over ? "," : "");
+        json += "{\"over\":" + std::to_string(over) + ",\"runs\":" + std::to_string(over % 7) +
+                ",\"wickets\":0,\"bowler\":\"player-" + std::to_string(over % 5) + "\"}";
+    }
+    return json + "]}";
+}
+
+const std::string DICTIONARY = "{\"over\":,\"runs\":,\"wickets\":0,\"bowler\":\"player-\"}\"matchId\":\"innings\":";
+
+}
+
+TEST(PayloadDecompressorTests, InflatesZlibAndGzipPayloads) {
+    PayloadDecompressor decompressor;
+    std::string original = scorecard(20);
+    std::string error;
+
+    std::string payload = compress(original);
+    ASSERT_LT(payload.size(), original.size());
+    ASSERT_TRUE(decompressor.decompress("deflate", payload, error)) << error;
+    EXPECT_EQ(payload, original);
+
+    payload = compress(original, GZIP_WINDOW_BITS);
+    ASSERT_TRUE(decompressor.decompress("GZIP", payload, error)) << error;
+    EXPECT_EQ(payload, original);
+}
+
+TEST(PayloadDecompressorTests, UsesTheRegisteredDictionaryTheStreamNames) {
+    PayloadDecompressor decompressor;
+    std::string original = scorecard(3);
+    std::string compressed = compress(original, ZLIB_WINDOW_BITS, DICTIONARY);
+    EXPECT_LT(compressed.size(), compress(original).size());
+
+    std::string payload = compressed;
+    std::string error;
+    EXPECT_FALSE(decompressor.decompress("deflate", payload, error));
+    EXPECT_NE(error.find("dictionary"), std::string::npos);
+    EXPECT_EQ(payload, compressed);
+
+    decompressor.addDictionary("unrelated");
+    decompressor.addDictionary(DICTIONARY);
+    decompressor.addDictionary(DICTIONARY);
+    EXPECT_EQ(decompressor.dictionaryCount(), 2u);
+    error.clear();
+    ASSERT_TRUE(decompressor.decompress("deflate", payload, error)) << error;
+    EXPECT_EQ(payload, original);
+}
+
+TEST(PayloadDecompressorTests, RejectsUnsupportedCorruptAndTruncatedPayloads) {
+    PayloadDecompressor decompressor;
+    std::string compressed = compress(scorecard(20));
+    std::string error;
+
+    std::string payload = compressed;
+    EXPECT_FALSE(decompressor.decompress("zstd", payload, error));
+    EXPECT_EQ(payload, compressed);
+
+    payload = "not compressed";
+    error.clear();
+    EXPECT_FALSE(decompressor.decompress("deflate", payload, error));
+    EXPECT_FALSE(error.empty());
+
+    payload = compressed.substr(0, compressed.size() / 2);
+    error.clear();
+    EXPECT_FALSE(decompressor.decompress("deflate", payload, error));
+    EXPECT_FALSE(error.empty());
+
+    // The inflater is reusable after a failure.
+    payload = compressed;
+    error.clear();
+    EXPECT_TRUE(decompressor.decompress("deflate", payload, error)) << error;
+}
+
+TEST(PayloadDecompressorTests, StopsAtTheDecompressedSizeLimit) {
+    PayloadDecompressor decompressor;
+    std::string payload = compress(std::string(MAXIMUM_DECOMPRESSED_SIZE + 1, 'a'));
+    std::string error;
+    EXPECT_FALSE(decompressor.decompress("deflate", payload, error));
+    EXPECT_NE(error.find("limit"), std::string::npos);
+}
+
+TEST(PayloadDecompressorTests, DecompressesFromSeveralThreads) {
+    PayloadDecompressor decompressor;
+    decompressor.addDictionary(DICTIONARY);
+    std::string original = scorecard(50);
+    std::string compressed = compress(original, ZLIB_WINDOW_BITS, DICTIONARY);
+    std::vector<std::thread> threads;
+    std::vector<int> failures(8, 0);
+    for (size_t t = 0; t < failures.size(); t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 200; i++) {
+                std::string payload = compressed;
+                std::string error;
+                failures[t] += !decompressor.decompress("deflate", payload, error) || payload != original;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (int failed : failures) {
+        EXPECT_EQ(failed, 0);
+    }
+}
+
+TEST(PayloadDecompressorTests, ClientDeliversDecompressedPayloadsAndReportsFailures) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+    client.connect(ConnectOptions());
+    client.subscribe("a", "score/#", 0);
+    client.addCompressionDictionary(DICTIONARY);
+
+    std::string original = scorecard(4);
+    UserProperties deflate{{CONTENT_ENCODING_PROPERTY, "deflate"}};
+    client.onMessage("score/1", compress(original, ZLIB_WINDOW_BITS, DICTIONARY), 0, 0, 0, deflate);
+    client.onMessage("score/2", "garbage", 0, 0, 0, deflate);
+    client.onMessage("score/3", "plain", 0);
+
+    ASSERT_EQ(sink->messages.size(), 2u);
+    EXPECT_EQ(sink->messages[0].second.payload, original);
+    EXPECT_EQ(sink->messages[1].second.payload, "plain");
+    ASSERT_EQ(sink->count("clientmqtt_error"), 1u);
+    const EventValue &error = sink->events.back().second;
+    EXPECT_EQ(field(error, "errorType")->getString(), "DECOMPRESSION");
+    EXPECT_EQ(field(error, "topic")->getString(), "score/2");
+    EXPECT_EQ(field(error, "reasonCode")->getNumber(), DECOMPRESSION_ERROR);
+}
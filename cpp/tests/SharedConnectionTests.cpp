@@ -0,0 +1,272 @@
+//
+//  SharedConnectionTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "LoopbackBroker.h"
+#include "MqttClient.h"
+#include "MqttEventLoop.h"
+#include "MqttSharedConnection.h"
+#include "MqttSocketTransport.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::FakeBroker;
+using mqtt::test::LoopbackBroker;
+
+namespace {
+
+/**
+ * FakeBroker that also records the acknowledgements of received messages.
+ */
+class AcknowledgingBroker : public FakeBroker {
+public:
+    void acknowledge(uint64_t acknowledgement) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        acknowledged.push_back(acknowledgement);
+    }
+
+    std::vector<uint64_t> acknowledgements() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return acknowledged;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<uint64_t> acknowledged;
+};
+
+class SharedConnectionTests : public ::testing::Test {
+protected:
+    void TearDown() override {
+        for (auto &client : clients) {
+            client->close();
+        }
+    }
+
+    /**
+     * A client in sharing mode whose connections are made of FakeBrokers, one per physical connection.
+     */
+    std::shared_ptr<Client> makeClient(const std::string &clientId) {
+        auto channel = std::make_shared<SharedChannel>(
+            clientId, "broker", 1883,
+            [this](const std::string &, const std::string &, int, std::weak_ptr<TransportListener> listener) {
+                auto broker = std::make_shared<AcknowledgingBroker>();
+                broker->attach(listener.lock().get());
+                brokers.push_back(broker);
+                return broker;
+            },
+            pool);
+        auto client = std::make_shared<Client>(clientId, channel, sink);
+        channel->attach(client);
+        clients.push_back(client);
+        return client;
+    }
+
+    static ConnectOptions credentials(const std::string &username) {
+        ConnectOptions options;
+        options.username = username;
+        return options;
+    }
+
+    void publish(const std::shared_ptr<Client> &client, const std::string &topic, const std::string &payload) {
+        client->publish(topic, reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 1, false);
+    }
+
+    std::vector<std::string> payloadsOf(const std::string &eventId) {
+        std::vector<std::string> payloads;
+        for (const auto &message : sink->messages()) {
+            if (message.first == eventId) {
+                payloads.push_back(message.second.payload);
+            }
+        }
+        return payloads;
+    }
+
+    SharedConnectionPool pool;
+    std::vector<std::shared_ptr<AcknowledgingBroker>> brokers;
+    std::shared_ptr<BlockingEventSink> sink = std::make_shared<BlockingEventSink>();
+    std::vector<std::shared_ptr<Client>> clients;
+};
+
+}
+
+TEST_F(SharedConnectionTests, SharesOneConnectionPerHostAndCredentials) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    auto admin = makeClient("admin");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+    admin->connect(credentials("admin"));
+
+    ASSERT_EQ(brokers.size(), 2u);
+    EXPECT_EQ(pool.size(), 2u);
+    EXPECT_EQ(brokers[0]->connects.size(), 1u);
+    EXPECT_EQ(sink->count("scoresconnected"), 1u);
+    EXPECT_EQ(sink->count("chatconnected"), 1u);
+    EXPECT_EQ(sink->count("adminconnected"), 1u);
+    EXPECT_EQ(chat->connectionState(), Client::ConnectionState::Connected);
+}
+
+TEST_F(SharedConnectionTests, RoutesMessagesToTheClientsWithMatchingFilters) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+    scores->subscribe("s", "score/#", 1);
+    scores->subscribe("s-news", "news", 0);
+    chat->subscribe("c", "chat/+", 1);
+    chat->subscribe("c-news", "news", 1);
+    ASSERT_EQ(sink->count("ssubscribe_success"), 1u);
+    ASSERT_EQ(sink->count("csubscribe_success"), 1u);
+
+    publish(scores, "score/1", "goal");
+    publish(chat, "chat/1", "hi");
+    publish(chat, "news", "kickoff");
+
+    EXPECT_EQ(payloadsOf("s"), (std::vector<std::string>{"goal"}));
+    EXPECT_EQ(payloadsOf("c"), (std::vector<std::string>{"hi"}));
+    EXPECT_EQ(payloadsOf("s-news"), (std::vector<std::string>{"kickoff"}));
+    EXPECT_EQ(payloadsOf("c-news"), (std::vector<std::string>{"kickoff"}));
+    // The broker got "news" at the higher of the two QoS.
+    EXPECT_EQ(brokers[0]->subscribes.back(), (std::pair<std::string, int>{"news", 1}));
+}
+
+TEST_F(SharedConnectionTests, UnsubscribesOnlyWhenTheLastClientLetsGo) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+    scores->subscribe("s", "news", 0);
+    chat->subscribe("c", "news", 0);
+
+    scores->unsubscribe("s", "news");
+    EXPECT_TRUE(brokers[0]->unsubscribes.empty());
+    chat->unsubscribe("c", "news");
+    EXPECT_EQ(brokers[0]->unsubscribes, (std::vector<std::string>{"news"}));
+}
+
+TEST_F(SharedConnectionTests, DisconnectsOnlyWhenNoClientWantsTheConnection) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+    scores->subscribe("s", "score/#", 0);
+
+    scores->disconnect();
+    EXPECT_EQ(brokers[0]->disconnects, 0);
+    EXPECT_EQ(brokers[0]->unsubscribes, (std::vector<std::string>{"score/#"}));
+    EXPECT_EQ(scores->connectionState(), Client::ConnectionState::Disconnected);
+    EXPECT_EQ(chat->connectionState(), Client::ConnectionState::Connected);
+
+    chat->disconnect();
+    EXPECT_EQ(brokers[0]->disconnects, 1);
+    EXPECT_EQ(chat->connectionState(), Client::ConnectionState::Disconnected);
+    EXPECT_EQ(sink->count("chatdisconnected"), 1u);
+}
+
+TEST_F(SharedConnectionTests, ConnectionLossReachesEveryClientAndClosingReleasesIt) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+
+    brokers[0]->dropConnection("network lost");
+    EXPECT_EQ(sink->count("scoresdisconnected"), 1u);
+    EXPECT_EQ(sink->count("chatdisconnected"), 1u);
+
+    scores->close();
+    EXPECT_FALSE(brokers[0]->closed);
+    chat->close();
+    EXPECT_TRUE(brokers[0]->closed);
+    EXPECT_EQ(pool.size(), 0u);
+}
+
+TEST_F(SharedConnectionTests, AcknowledgesOnceEveryClientGotTheMessage) {
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(credentials("user"));
+    chat->connect(credentials("user"));
+    scores->subscribe("s", "news", 1);
+    chat->subscribe("c", "news", 1);
+    // Only scores holds its acknowledgements back until JS got the messages.
+    scores->setFlowControl(FlowControl{2, DropPolicy::DropOldest});
+
+    auto connection = pool.acquire("scores", "broker", 1883, credentials("user"), nullptr);
+    connection->onMessage("news", "kickoff", 1, 0, 42);
+    ASSERT_TRUE(sink->waitForMessages(2));
+    EXPECT_TRUE(brokers[0]->acknowledgements().empty());
+
+    sink->clearMessages();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (brokers[0]->acknowledgements().empty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(brokers[0]->acknowledgements(), (std::vector<uint64_t>{42}));
+}
+
+TEST(SharedConnectionSocketTests, ClientsShareOneBrokerSession) {
+    EventLoop loop;
+    LoopbackBroker broker;
+    SharedConnectionPool pool;
+    auto sink = std::make_shared<BlockingEventSink>();
+    auto makeClient = [&](const std::string &clientId) {
+        auto channel = std::make_shared<SharedChannel>(
+            clientId, "127.0.0.1", broker.port(),
+            [&loop](const std::string &connectionId, const std::string &host, int port,
+                    std::weak_ptr<TransportListener> listener) {
+                auto transport = std::make_shared<SocketTransport>(connectionId, host, port, loop);
+                transport->attach(std::move(listener));
+                return transport;
+            },
+            pool);
+        auto client = std::make_shared<Client>(clientId, channel, sink);
+        channel->attach(client);
+        return client;
+    };
+    auto scores = makeClient("scores");
+    auto chat = makeClient("chat");
+    scores->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("scoresconnected"));
+    chat->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("chatconnected"));
+    scores->subscribe("s", "score/#", 1);
+    chat->subscribe("c", "chat/#", 1);
+    ASSERT_TRUE(sink->waitFor("ssubscribe_success"));
+    ASSERT_TRUE(sink->waitFor("csubscribe_success"));
+
+    std::string payload = "hello";
+    chat->publish("chat/1", reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), 1, false);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(broker.sessionCount(), 1u);
+    auto messages = sink->messages();
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].first, "c");
+    ASSERT_TRUE([&] {
+        // The QoS 1 delivery is acknowledged once, on the shared session.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (broker.pubackPacketCount() < 1 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return broker.pubackPacketCount() == 1;
+    }());
+
+    scores->close();
+    chat->close();
+    // Lets the posted close run before the loop goes away.
+    std::promise<void> drained;
+    loop.post([&drained] { drained.set_value(); });
+    drained.get_future().wait();
+}
@@ -0,0 +1,452 @@
+//
+//  SocketTransportTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "BlockingEventSink.h"
+#include "FakeBroker.h"
+#include "LoopbackBroker.h"
+#include "MqttClient.h"
+#include "MqttConstants.h"
+#include "MqttEventLoop.h"
+#include "MqttSocketTransport.h"
+
+using namespace mqtt;
+using mqtt::test::BlockingEventSink;
+using mqtt::test::LoopbackBroker;
+
+namespace {
+
+class SocketTransportTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        sink = std::make_shared<BlockingEventSink>();
+        client = makeClient(broker.port());
+    }
+
+    void TearDown() override {
+        client->close();
+        // Lets the posted close run before the loop goes away.
+        std::promise<void> drained;
+        loop.post([&drained] { drained.set_value(); });
+        drained.get_future().wait();
+    }
+
+    std::shared_ptr<Client> makeClient(int port) {
+        transport = std::make_shared<SocketTransport>("client", "127.0.0.1", port, loop);
+        auto created = std::make_shared<Client>("client", transport, sink);
+        transport->attach(created);
+        return created;
+    }
+
+    void publish(const std::string &topic, const std::string &payload, int qos) {
+        client->publish(topic, reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), qos, false);
+    }
+
+    void connect() {
+        client->connect(ConnectOptions());
+        ASSERT_TRUE(sink->waitFor("clientconnected"));
+    }
+
+    EventLoop loop;
+    LoopbackBroker broker;
+    std::shared_ptr<BlockingEventSink> sink;
+    std::shared_ptr<SocketTransport> transport;
+    std::shared_ptr<Client> client;
+};
+
+}
+
+TEST_F(SocketTransportTests, ReceivesOwnPublishesForEveryQos) {
+    connect();
+    client->subscribe("a", "score/+", 2);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    publish("score/0", "zero", 0);
+    publish("score/1", "one", 1);
+    publish("score/2", "two", 2);
+    ASSERT_TRUE(sink->waitForMessages(3));
+
+    auto messages = sink->messages();
+    EXPECT_EQ(messages[0].second.payload, "zero");
+    EXPECT_EQ(messages[1].second.payload, "one");
+    EXPECT_EQ(messages[1].second.qos, 1);
+    EXPECT_EQ(messages[2].second.topic, "score/2");
+    EXPECT_EQ(messages[2].second.qos, 2);
+}
+
+TEST_F(SocketTransportTests, DeliversLargePayloadsAndBursts) {
+    connect();
+    client->subscribe("a", "bulk", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    const std::string large(512 * 1024, 'x');
+    publish("bulk", large, 1);
+    for (int i = 0; i < 1000; i++) {
+        publish("bulk", std::to_string(i), 0);
+    }
+    ASSERT_TRUE(sink->waitForMessages(1001));
+
+    auto messages = sink->messages();
+    EXPECT_EQ(messages[0].second.payload, large);
+    EXPECT_EQ(messages[1000].second.payload, "999");
+}
+
+TEST_F(SocketTransportTests, AcknowledgesOnlyWhatWasDeliveredWithFlowControl) {
+    client->setFlowControl(FlowControl{2, DropPolicy::DropOldest});
+    ConnectOptions options;
+    options.receiveMaximum = 10;
+    client->connect(options);
+    ASSERT_TRUE(sink->waitFor("clientconnected"));
+    client->subscribe("a", "score/+", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    publish("score/1", "one", 1);
+    publish("score/2", "two", 1);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    // The window is one message; the second waits in the pipeline, and neither was acknowledged.
+    EXPECT_EQ(sink->messages().size(), 1u);
+    EXPECT_EQ(broker.pubackPacketCount(), 0u);
+
+    sink->clearMessages();
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(sink->messages()[0].second.payload, "two");
+    sink->clearMessages();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (broker.pubackPacketCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(broker.pubackPacketCount(), 2u);
+}
+
+TEST_F(SocketTransportTests, ResubscribesAfterConnectionLoss) {
+    connect();
+    client->subscribe("a", "score/1", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    broker.dropClients();
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+
+    client->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+    ASSERT_TRUE(sink->waitFor("asubscribe_success", 2));
+    publish("score/1", "after reconnect", 0);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(sink->messages()[0].second.payload, "after reconnect");
+}
+
+TEST_F(SocketTransportTests, RestoresSubscriptionsInOneSubscribe) {
+    client->subscribe("a", "score/1", 0);
+    client->subscribe("b", "score/+", 1);
+    client->subscribe("c", "reject/score", 2);
+    connect();
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+    ASSERT_TRUE(sink->waitFor("bsubscribe_success"));
+    ASSERT_TRUE(sink->waitFor("csubscribe_failed"));
+    EXPECT_EQ(broker.subscribePacketCount(), 1u);
+}
+
+TEST_F(SocketTransportTests, ReconnectsByItselfAfterConnectionLoss) {
+    ReconnectPolicy policy;
+    policy.enabled = true;
+    policy.backoff = std::chrono::milliseconds(1);
+    policy.jitter = std::chrono::milliseconds(0);
+    client->setReconnectPolicy(policy);
+    connect();
+    client->subscribe("a", "score/1", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    broker.dropClients();
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+    ASSERT_TRUE(sink->waitFor("asubscribe_success", 2));
+    publish("score/1", "after reconnect", 0);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(sink->messages()[0].second.payload, "after reconnect");
+}
+
+TEST_F(SocketTransportTests, ReportsRejectedSubscription) {
+    connect();
+    client->subscribe("a", "reject/score", 0);
+    ASSERT_TRUE(sink->waitFor("asubscribe_failed"));
+    EXPECT_EQ(sink->count("asubscribe_success"), 0u);
+}
+
+TEST_F(SocketTransportTests, ReportsRefusedConnection) {
+    broker.setConnackReasonCode(0x87);
+    client->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    auto disconnected = sink->events("clientdisconnected");
+    EXPECT_EQ(test::field(disconnected[0].second, "reasonCode")->getNumber(), 0x87);
+}
+
+TEST_F(SocketTransportTests, ReportsUnreachableBroker) {
+    int port;
+    {
+        LoopbackBroker closed;
+        port = closed.port();
+    }
+    client->close();
+    client = makeClient(port);
+    client->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+}
+
+TEST_F(SocketTransportTests, DisconnectClosesSession) {
+    connect();
+    client->disconnect();
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    EXPECT_STREQ(client->connectionStatus(), status::DISCONNECTED);
+}
+
+TEST_F(SocketTransportTests, PublishWhileDisconnectedReportsError) {
+    publish("score", "lost", 0);
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+}
+
+TEST_F(SocketTransportTests, ReplaysStoredPublishesAfterRestart) {
+    const std::string path = ::testing::TempDir() + "socket-transport-outbox";
+    std::remove(path.c_str());
+    std::string error;
+    transport->setOutboundStore(OutboundStore::open(path, OutboundStore::DEFAULT_CAPACITY, error));
+
+    // Accepted while disconnected; the client is then removed, as if the app was killed before it connected.
+    publish("orders/1", "first", 1);
+    publish("orders/2", "second", 2);
+    publish("orders/0", "not stored", 0);
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+    EXPECT_EQ(sink->count("clientmqtt_error"), 1u);
+    client->close();
+
+    auto subscriberSink = std::make_shared<BlockingEventSink>();
+    auto subscriberTransport = std::make_shared<SocketTransport>("subscriber", "127.0.0.1", broker.port(), loop);
+    auto subscriber = std::make_shared<Client>("subscriber", subscriberTransport, subscriberSink);
+    subscriberTransport->attach(subscriber);
+    subscriber->connect(ConnectOptions());
+    ASSERT_TRUE(subscriberSink->waitFor("subscriberconnected"));
+    subscriber->subscribe("a", "orders/+", 2);
+    ASSERT_TRUE(subscriberSink->waitFor("asubscribe_success"));
+
+    client = makeClient(broker.port());
+    transport->setOutboundStore(OutboundStore::open(path, OutboundStore::DEFAULT_CAPACITY, error));
+    connect();
+    ASSERT_TRUE(subscriberSink->waitForMessages(2));
+    auto messages = subscriberSink->messages();
+    EXPECT_EQ(messages[0].second.payload, "first");
+    EXPECT_EQ(messages[1].second.payload, "second");
+    EXPECT_EQ(messages[1].second.qos, 2);
+
+    // Acknowledged messages leave the store: a second restart replays nothing.
+    publish("orders/3", "third", 1);
+    ASSERT_TRUE(subscriberSink->waitForMessages(3));
+    // The broker answers in order: once the second SUBACK is in, the PUBREL sent for the first PUBREC was completed.
+    client->subscribe("b", "sync/1", 0);
+    ASSERT_TRUE(sink->waitFor("bsubscribe_success"));
+    client->subscribe("c", "sync/2", 0);
+    ASSERT_TRUE(sink->waitFor("csubscribe_success"));
+    client->disconnect();
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    client->close();
+    std::promise<void> drained;
+    loop.post([&drained] { drained.set_value(); });
+    drained.get_future().wait();
+    auto reopened = OutboundStore::open(path, OutboundStore::DEFAULT_CAPACITY, error);
+    ASSERT_NE(reopened, nullptr);
+    EXPECT_TRUE(reopened->empty());
+
+    subscriber->close();
+    std::remove(path.c_str());
+}
+
+TEST_F(SocketTransportTests, DropsStoredPublishesTheBrokerRefuses) {
+    const std::string path = ::testing::TempDir() + "socket-transport-refused";
+    std::remove(path.c_str());
+    std::string error;
+    transport->setOutboundStore(OutboundStore::open(path, OutboundStore::DEFAULT_CAPACITY, error));
+
+    // Never stored: the broker would disconnect for them on every replay.
+    publish("orders/+", "wildcard", 1);
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+    publish("reject/1", "refused", 1);
+    publish("orders/1", "accepted", 1);
+
+    auto subscriberSink = std::make_shared<BlockingEventSink>();
+    auto subscriberTransport = std::make_shared<SocketTransport>("subscriber", "127.0.0.1", broker.port(), loop);
+    auto subscriber = std::make_shared<Client>("subscriber", subscriberTransport, subscriberSink);
+    subscriberTransport->attach(subscriber);
+    subscriber->connect(ConnectOptions());
+    ASSERT_TRUE(subscriberSink->waitFor("subscriberconnected"));
+    subscriber->subscribe("a", "orders/+", 1);
+    ASSERT_TRUE(subscriberSink->waitFor("asubscribe_success"));
+
+    // The broker refuses the first replayed publish; it is reported and dropped, the next connect sends the rest.
+    connect();
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error", 2));
+    auto errors = sink->events("clientmqtt_error");
+    EXPECT_EQ(test::field(errors[1].second, "topic")->getString(), "reject/1");
+    client->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+    ASSERT_TRUE(subscriberSink->waitForMessages(1));
+    EXPECT_EQ(subscriberSink->messages()[0].second.payload, "accepted");
+    EXPECT_EQ(sink->count("clientdisconnected"), 1u);
+
+    subscriber->close();
+    std::remove(path.c_str());
+}
+
+TEST_F(SocketTransportTests, AliasesRepeatedTopicsUpToTheBrokerMaximum) {
+    broker.setTopicAliasMaximum(2);
+    connect();
+    client->subscribe("a", "telemetry/#", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    const char *topics[] = {"telemetry/speed", "telemetry/speed", "telemetry/heading", "telemetry/altitude",
+                            "telemetry/heading", "telemetry/altitude", "telemetry/speed"};
+    for (int i = 0; i < 7; i++) {
+        publish(topics[i], std::to_string(i), i % 2);
+    }
+    ASSERT_TRUE(sink->waitForMessages(7));
+    auto messages = sink->messages();
+    for (int i = 0; i < 7; i++) {
+        EXPECT_EQ(messages[i].second.topic, topics[i]);
+        EXPECT_EQ(messages[i].second.payload, std::to_string(i));
+    }
+    // The third topic found the alias space taken and goes out by name.
+    EXPECT_EQ(transport->topicAliasCount(), 2u);
+}
+
+TEST_F(SocketTransportTests, StartsAliasesOverOnEveryConnection) {
+    broker.setTopicAliasMaximum(8);
+    connect();
+    client->subscribe("a", "telemetry/#", 0);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+    publish("telemetry/speed", "before", 0);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(transport->topicAliasCount(), 1u);
+
+    // The new connection's broker session does not know the alias, so the topic must be sent by name again.
+    broker.dropClients();
+    ASSERT_TRUE(sink->waitFor("clientdisconnected"));
+    client->connect(ConnectOptions());
+    ASSERT_TRUE(sink->waitFor("clientconnected", 2));
+    ASSERT_TRUE(sink->waitFor("asubscribe_success", 2));
+    EXPECT_EQ(transport->topicAliasCount(), 0u);
+    publish("telemetry/speed", "after", 0);
+    publish("telemetry/speed", "again", 0);
+    ASSERT_TRUE(sink->waitForMessages(3));
+    auto messages = sink->messages();
+    EXPECT_EQ(messages[1].second.topic, "telemetry/speed");
+    EXPECT_EQ(messages[2].second.payload, "again");
+}
+
+TEST_F(SocketTransportTests, SendsShorterPublishesWithAliases) {
+    size_t connections = 0;
+    auto publishedBytes = [this, &connections](uint16_t topicAliasMaximum) {
+        broker.setTopicAliasMaximum(topicAliasMaximum);
+        client->close();
+        client = makeClient(broker.port());
+        client->connect(ConnectOptions());
+        EXPECT_TRUE(sink->waitFor("clientconnected", ++connections));
+        size_t before = broker.receivedByteCount();
+        size_t packets = broker.publishPacketCount();
+        for (int i = 0; i < 100; i++) {
+            publish("match/12345/score/live", "1", 0);
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (broker.publishPacketCount() < packets + 100 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return broker.receivedByteCount() - before;
+    };
+    size_t plain = publishedBytes(0);
+    size_t aliased = publishedBytes(4);
+    // 28 bytes per PUBLISH by name; with an alias 31 for the first and 9 for every repeat.
+    EXPECT_EQ(plain, 100u * 28);
+    EXPECT_EQ(aliased, 31u + 99 * 9);
+}
+
+TEST_F(SocketTransportTests, BoundsTheOutboxWhileTheBrokerStalls) {
+    connect();
+    client->subscribe("a", "bulk", 0);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+    broker.setReading(false);
+
+    // Far more than the socket buffers and the outbox together take.
+    const std::string payload(256 * 1024, 'x');
+    size_t accepted = 0;
+    for (int i = 0; i < 256 && sink->count("clientmqtt_error") == 0; i++) {
+        publish("bulk", payload, 0);
+        accepted++;
+    }
+    ASSERT_EQ(sink->count("clientmqtt_error"), 1u);
+    accepted--;
+    auto errors = sink->events("clientmqtt_error");
+    EXPECT_NE(test::field(errors[0].second, "errorMessage")->getString().find("outbound queue full"),
+              std::string::npos);
+
+    // Once the broker reads again, everything accepted arrives and publishing works again.
+    broker.setReading(true);
+    ASSERT_TRUE(sink->waitForMessages(accepted, std::chrono::seconds(20)));
+    publish("bulk", "after", 0);
+    ASSERT_TRUE(sink->waitForMessages(accepted + 1));
+    EXPECT_EQ(sink->messages().back().second.payload, "after");
+    EXPECT_EQ(sink->count("clientmqtt_error"), 1u);
+}
+
+TEST_F(SocketTransportTests, KeepsToTheBrokersReceiveMaximum) {
+    broker.setReceiveMaximum(2);
+    broker.setAcknowledging(false);
+    connect();
+    for (int i = 0; i < 5; i++) {
+        publish("out/" + std::to_string(i), "payload", 1);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (broker.publishPacketCount() < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(broker.publishPacketCount(), 2u);
+
+    // Each acknowledgement lets a held publish through.
+    broker.setAcknowledging(true);
+    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (broker.publishPacketCount() < 5 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(broker.publishPacketCount(), 5u);
+    EXPECT_EQ(broker.violationCount(), 0u);
+    EXPECT_EQ(sink->count("clientdisconnected"), 0u);
+    EXPECT_EQ(sink->count("clientmqtt_error"), 0u);
+}
+
+TEST_F(SocketTransportTests, FailsPublishesLargerThanTheBrokersMaximumPacketSize) {
+    broker.setMaximumPacketSize(1024);
+    connect();
+    client->subscribe("a", "out/#", 1);
+    ASSERT_TRUE(sink->waitFor("asubscribe_success"));
+
+    publish("out/large", std::string(2048, 'x'), 1);
+    ASSERT_TRUE(sink->waitFor("clientmqtt_error"));
+    auto errors = sink->events("clientmqtt_error");
+    EXPECT_NE(test::field(errors[0].second, "errorMessage")->getString().find("maximum packet size"),
+              std::string::npos);
+
+    publish("out/small", "fits", 1);
+    ASSERT_TRUE(sink->waitForMessages(1));
+    EXPECT_EQ(sink->messages()[0].second.topic, "out/small");
+    EXPECT_EQ(broker.violationCount(), 0u);
+    EXPECT_EQ(sink->count("clientdisconnected"), 0u);
+}
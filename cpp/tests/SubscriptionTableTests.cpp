@@ -0,0 +1,94 @@
+//
+//  SubscriptionTableTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "MqttSubscriptionTable.h"
+
+using mqtt::SubscriptionTable;
+
+TEST(SubscriptionTableTests, AddRequiresSubscribeOnlyWhenQosRises) {
+    SubscriptionTable table;
+    EXPECT_TRUE(table.add("a", "score/1", 0));
+    EXPECT_FALSE(table.add("b", "score/1", 0));
+    EXPECT_TRUE(table.add("c", "score/1", 1));
+    EXPECT_FALSE(table.add("d", "score/1", 1));
+    EXPECT_EQ(table.maxQos("score/1"), 1);
+    EXPECT_EQ(table.size(), 1u);
+}
+
+TEST(SubscriptionTableTests, RemoveRequiresUnsubscribeForLastSubscriber) {
+    SubscriptionTable table;
+    table.add("a", "score/1", 0);
+    table.add("b", "score/1", 1);
+    EXPECT_FALSE(table.remove("b", "score/1"));
+    EXPECT_EQ(table.maxQos("score/1"), 0);
+    EXPECT_FALSE(table.remove("unknown", "score/1"));
+    EXPECT_TRUE(table.remove("a", "score/1"));
+    EXPECT_FALSE(table.contains("score/1"));
+    EXPECT_TRUE(table.empty());
+}
+
+TEST(SubscriptionTableTests, PendingAcksAreTakenOnce) {
+    SubscriptionTable table;
+    table.add("a", "score/1", 0);
+    table.add("b", "score/1", 0);
+    EXPECT_TRUE(table.hasPendingAck("score/1"));
+
+    auto acks = table.takePendingAcks("score/1");
+    std::sort(acks.begin(), acks.end());
+    EXPECT_EQ(acks, (std::vector<std::string>{"a", "b"}));
+    EXPECT_TRUE(table.takePendingAcks("score/1").empty());
+    EXPECT_FALSE(table.hasPendingAck("score/1"));
+
+    table.markAllPending();
+    EXPECT_EQ(table.takePendingAcks("score/1").size(), 2u);
+}
+
+TEST(SubscriptionTableTests, CollectsEverySubscriberOfMatchingFilters) {
+    SubscriptionTable table;
+    table.add("exact", "score/1", 0);
+    table.add("wildcard", "score/+", 0);
+    table.add("all", "#", 0);
+    table.add("shared", "$share/group/score/#", 0);
+    table.add("other", "news/+", 0);
+
+    std::vector<std::string> eventIds;
+    table.collectMatches("score/1", eventIds);
+    std::sort(eventIds.begin(), eventIds.end());
+    EXPECT_EQ(eventIds, (std::vector<std::string>{"all", "exact", "shared", "wildcard"}));
+}
+
+TEST(SubscriptionTableTests, FiltersReportMaximumQos) {
+    SubscriptionTable table;
+    table.add("a", "score/1", 0);
+    table.add("b", "score/1", 2);
+    table.add("c", "news/+", 1);
+
+    auto filters = table.filters();
+    std::sort(filters.begin(), filters.end());
+    EXPECT_EQ(filters, (std::vector<std::pair<std::string, int>>{{"news/+", 1}, {"score/1", 2}}));
+}
+
+TEST(SubscriptionTableTests, RemovedFiltersStopMatching) {
+    SubscriptionTable table;
+    table.add("a", "score/+", 0);
+    table.add("b", "score/+", 0);
+    table.add("c", "score/#", 0);
+
+    table.remove("a", "score/+");
+    std::vector<std::string> eventIds;
+    table.collectMatches("score/1", eventIds);
+    std::sort(eventIds.begin(), eventIds.end());
+    EXPECT_EQ(eventIds, (std::vector<std::string>{"b", "c"}));
+
+    table.remove("b", "score/+");
+    table.remove("c", "score/#");
+    eventIds.clear();
+    table.collectMatches("score/1", eventIds);
+    EXPECT_TRUE(eventIds.empty());
+}
@@ -0,0 +1,60 @@
+//
+//  TopicTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+#include "MqttTopic.h"
+
+using mqtt::effectiveTopicFilter;
+using mqtt::invalidTopicName;
+using mqtt::topicMatchesFilter;
+
+TEST(TopicTests, MatchesExactTopics) {
+    EXPECT_TRUE(topicMatchesFilter("score/match/1", "score/match/1"));
+    EXPECT_FALSE(topicMatchesFilter("score/match/1", "score/match/2"));
+    EXPECT_FALSE(topicMatchesFilter("score/match", "score/match/1"));
+    EXPECT_FALSE(topicMatchesFilter("score/match/1", "score/match"));
+}
+
+TEST(TopicTests, SingleLevelWildcardMatchesOneLevel) {
+    EXPECT_TRUE(topicMatchesFilter("score/match/1", "score/+/1"));
+    EXPECT_TRUE(topicMatchesFilter("score/match/1", "+/+/+"));
+    EXPECT_TRUE(topicMatchesFilter("score//1", "score/+/1"));
+    EXPECT_FALSE(topicMatchesFilter("score/match/1/2", "score/+/1"));
+    EXPECT_FALSE(topicMatchesFilter("score/match", "score/match/+"));
+}
+
+TEST(TopicTests, MultiLevelWildcardMatchesParentAndChildren) {
+    EXPECT_TRUE(topicMatchesFilter("score", "score/#"));
+    EXPECT_TRUE(topicMatchesFilter("score/match/1", "score/#"));
+    EXPECT_TRUE(topicMatchesFilter("score/match/1", "#"));
+    EXPECT_FALSE(topicMatchesFilter("scores/match", "score/#"));
+}
+
+TEST(TopicTests, WildcardsAtFirstLevelSkipDollarTopics) {
+    EXPECT_FALSE(topicMatchesFilter("$SYS/broker/load", "#"));
+    EXPECT_FALSE(topicMatchesFilter("$SYS/broker/load", "+/broker/load"));
+    EXPECT_TRUE(topicMatchesFilter("$SYS/broker/load", "$SYS/#"));
+}
+
+TEST(TopicTests, ValidatesTopicNames) {
+    EXPECT_EQ(invalidTopicName("score/match/1"), nullptr);
+    EXPECT_EQ(invalidTopicName("/"), nullptr);
+    EXPECT_EQ(invalidTopicName(std::string(65535, 't')), nullptr);
+    EXPECT_STREQ(invalidTopicName(""), "empty topic");
+    EXPECT_STREQ(invalidTopicName(std::string(65536, 't')), "topic longer than 65535 bytes");
+    EXPECT_STREQ(invalidTopicName("score/+"), "wildcard or null character in topic");
+    EXPECT_STREQ(invalidTopicName("score/#"), "wildcard or null character in topic");
+    EXPECT_STREQ(invalidTopicName(std::string_view("score\0/1", 8)), "wildcard or null character in topic");
+}
+
+TEST(TopicTests, StripsSharedSubscriptionPrefix) {
+    EXPECT_EQ(effectiveTopicFilter("$share/group/score/+"), "score/+");
+    EXPECT_EQ(effectiveTopicFilter("score/+"), "score/+");
+    EXPECT_TRUE(topicMatchesFilter("score/1", effectiveTopicFilter("$share/group/score/+")));
+}
@@ -0,0 +1,125 @@
+//
+//  TopicTrieTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "MqttTopic.h"
+#include "MqttTopicTrie.h"
+
+using mqtt::TopicTrie;
+
+namespace {
+
+std::vector<std::string> matches(const TopicTrie<std::string> &trie, const std::string &topic) {
+    std::vector<std::string> values;
+    trie.forEachMatch(topic, [&values](const std::string &value) { values.push_back(value); });
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+}
+
+TEST(TopicTrieTests, MatchesExactAndWildcardFilters) {
+    TopicTrie<std::string> trie;
+    for (const char *filter : {"score/1", "score/+", "score/#", "#", "+/1", "+/+/1", "news/+", "score/1/+"}) {
+        trie.insert(filter, filter);
+    }
+    EXPECT_EQ(matches(trie, "score/1"), (std::vector<std::string>{"#", "+/1", "score/#", "score/+", "score/1"}));
+    EXPECT_EQ(matches(trie, "score"), (std::vector<std::string>{"#", "score/#"}));
+    EXPECT_EQ(matches(trie, "score/2/1"), (std::vector<std::string>{"#", "+/+/1", "score/#"}));
+    EXPECT_EQ(matches(trie, "weather"), (std::vector<std::string>{"#"}));
+}
+
+TEST(TopicTrieTests, HandlesEmptyLevels) {
+    TopicTrie<std::string> trie;
+    for (const char *filter : {"score//1", "score/+/1", "/+", "score/+"}) {
+        trie.insert(filter, filter);
+    }
+    EXPECT_EQ(matches(trie, "score//1"), (std::vector<std::string>{"score/+/1", "score//1"}));
+    EXPECT_EQ(matches(trie, "score/"), (std::vector<std::string>{"score/+"}));
+    EXPECT_EQ(matches(trie, "/news"), (std::vector<std::string>{"/+"}));
+}
+
+TEST(TopicTrieTests, FirstLevelWildcardsSkipSystemTopics) {
+    TopicTrie<std::string> trie;
+    for (const char *filter : {"#", "+/broker/load", "$SYS/#", "$SYS/+/load"}) {
+        trie.insert(filter, filter);
+    }
+    EXPECT_EQ(matches(trie, "$SYS/broker/load"), (std::vector<std::string>{"$SYS/#", "$SYS/+/load"}));
+    EXPECT_EQ(matches(trie, "SYS/broker/load"), (std::vector<std::string>{"#", "+/broker/load"}));
+}
+
+TEST(TopicTrieTests, IndexesSharedSubscriptionsByEffectiveFilter) {
+    TopicTrie<std::string> trie;
+    trie.insert("$share/group/score/+", "shared");
+    trie.insert("score/+", "plain");
+    EXPECT_EQ(matches(trie, "score/1"), (std::vector<std::string>{"plain", "shared"}));
+
+    EXPECT_TRUE(trie.erase("$share/group/score/+", "shared"));
+    EXPECT_EQ(matches(trie, "score/1"), (std::vector<std::string>{"plain"}));
+}
+
+TEST(TopicTrieTests, EraseRemovesOnlyTheGivenValue) {
+    TopicTrie<std::string> trie;
+    trie.insert("score/+", "a");
+    trie.insert("score/+", "b");
+    trie.insert("score/1/#", "c");
+    EXPECT_EQ(trie.size(), 3u);
+
+    EXPECT_FALSE(trie.erase("score/+", "unknown"));
+    EXPECT_FALSE(trie.erase("score/2", "a"));
+    EXPECT_TRUE(trie.erase("score/+", "a"));
+    EXPECT_EQ(matches(trie, "score/1"), (std::vector<std::string>{"b", "c"}));
+
+    EXPECT_TRUE(trie.erase("score/+", "b"));
+    EXPECT_TRUE(trie.erase("score/1/#", "c"));
+    EXPECT_FALSE(trie.erase("score/1/#", "c"));
+    EXPECT_TRUE(trie.empty());
+    EXPECT_TRUE(matches(trie, "score/1").empty());
+}
+
+TEST(TopicTrieTests, AgreesWithTopicMatchesFilter) {
+    const std::vector<std::string> levels = {"a", "b", "", "$x", "+", "#"};
+    std::mt19937 random(7);
+    auto randomPath = [&](bool wildcards) {
+        std::string path;
+        size_t depth = 1 + random() % 4;
+        for (size_t i = 0; i < depth; i++) {
+            std::string level = levels[random() % levels.size()];
+            if (!wildcards && (level == "+" || level == "#")) {
+                level = "c";
+            }
+            if (level == "#" && i + 1 < depth) {
+                level = "+";
+            }
+            path += (i == 0 ? "" : "/") + level;
+        }
+        return path;
+    };
+
+    TopicTrie<std::string> trie;
+    std::vector<std::string> filters;
+    for (int i = 0; i < 200; i++) {
+        std::string filter = randomPath(true);
+        filters.push_back(filter);
+        trie.insert(filter, filter);
+    }
+    for (int i = 0; i < 500; i++) {
+        std::string topic = randomPath(false);
+        std::vector<std::string> expected;
+        for (const auto &filter : filters) {
+            if (mqtt::topicMatchesFilter(topic, filter)) {
+                expected.push_back(filter);
+            }
+        }
+        std::sort(expected.begin(), expected.end());
+        EXPECT_EQ(matches(trie, topic), expected) << topic;
+    }
+}
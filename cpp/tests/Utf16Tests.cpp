@@ -0,0 +1,51 @@
+//
+//  Utf16Tests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "MqttUtf16.h"
+
+using mqtt::utf16ToUtf8;
+using mqtt::utf8ToUtf16;
+
+namespace {
+
+std::string toUtf8(const std::u16string &utf16) {
+    return utf16ToUtf8(utf16.data(), utf16.size());
+}
+
+}
+
+TEST(Utf16Tests, EncodesEveryPlaneAsStandardUtf8) {
+    EXPECT_EQ(toUtf8(u"score/1"), "score/1");
+    EXPECT_EQ(toUtf8(u"café/€"), "caf\xc3\xa9/\xe2\x82\xac");
+    // A supplementary character is one 4 byte sequence, not two 3 byte surrogates as in modified UTF-8.
+    EXPECT_EQ(toUtf8(u"goal/\U0001F600"), "goal/\xf0\x9f\x98\x80");
+    // U+0000 stays one zero byte instead of 0xC0 0x80.
+    EXPECT_EQ(toUtf8(std::u16string(u"a\0b", 3)), std::string("a\0b", 3));
+}
+
+TEST(Utf16Tests, ReplacesUnpairedSurrogates) {
+    EXPECT_EQ(toUtf8(std::u16string{u'a', char16_t(0xD83D)}), "a\xef\xbf\xbd");
+    EXPECT_EQ(toUtf8(std::u16string{char16_t(0xDE00), u'a'}), "\xef\xbf\xbd" "a");
+}
+
+TEST(Utf16Tests, DecodesUtf8) {
+    EXPECT_EQ(utf8ToUtf16("caf\xc3\xa9/\xe2\x82\xac"), u"café/€");
+    EXPECT_EQ(utf8ToUtf16("goal/\xf0\x9f\x98\x80"), u"goal/\U0001F600");
+    EXPECT_EQ(utf8ToUtf16(std::string("a\0b", 3)), std::u16string(u"a\0b", 3));
+    std::string roundTrip = "mixed \xc3\xa9 \xf0\x9f\x8f\x8f end";
+    EXPECT_EQ(toUtf8(utf8ToUtf16(roundTrip)), roundTrip);
+}
+
+TEST(Utf16Tests, ReplacesInvalidUtf8) {
+    EXPECT_EQ(utf8ToUtf16("a\xff" "b"), u"a�b");
+    // Truncated sequence, overlong encoding and an encoded surrogate.
+    EXPECT_EQ(utf8ToUtf16("\xe2\x82"), u"��");
+    EXPECT_EQ(utf8ToUtf16("\xc0\x80"), u"��");
+    EXPECT_EQ(utf8ToUtf16("\xed\xa0\x80"), u"���");
+}
@@ -0,0 +1,275 @@
+//
+//  WarmStartTests.cpp
+//  d11-mqtt
+//
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "FakeBroker.h"
+#include "MqttClient.h"
+#include "MqttClientRegistry.h"
+#include "MqttMetrics.h"
+#include "MqttWarmStart.h"
+
+using namespace mqtt;
+using mqtt::test::FakeBroker;
+using mqtt::test::field;
+using mqtt::test::RecordingEventSink;
+
+namespace {
+
+WarmStartSession makeSession(const std::string &clientId) {
+    WarmStartSession session;
+    session.clientId = clientId;
+    session.host = "broker.local";
+    session.port = 8883;
+    session.options.keepAlive = 30;
+    session.options.cleanSession = false;
+    session.options.username = "user";
+    session.options.password = std::string("pa\0ss", 5);
+    session.options.receiveMaximum = 16;
+    session.storeCapacity = 65536;
+    session.filters = {{"score/+/live", 1}, {"match/#", 0}};
+    return session;
+}
+
+class WarmStartTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        char directory[] = "/tmp/mqtt-warmstart-XXXXXX";
+        ASSERT_NE(mkdtemp(directory), nullptr);
+        directory_ = directory;
+    }
+
+    void TearDown() override {
+        std::string command = "rm -rf '" + directory_ + "'";
+        ASSERT_EQ(std::system(command.c_str()), 0);
+    }
+
+    std::string directory_;
+};
+
+}
+
+TEST_F(WarmStartTests, EncodesAndDecodesASession) {
+    WarmStartSession session = makeSession("client/1");
+    WarmStartSession decoded;
+    ASSERT_TRUE(WarmStartStore::decode(WarmStartStore::encode(session), decoded));
+    EXPECT_EQ(decoded.clientId, session.clientId);
+    EXPECT_EQ(decoded.host, session.host);
+    EXPECT_EQ(decoded.port, session.port);
+    EXPECT_EQ(decoded.options.keepAlive, 30);
+    EXPECT_FALSE(decoded.options.cleanSession);
+    EXPECT_TRUE(decoded.requiresCredentials);
+    EXPECT_EQ(decoded.options.username, "");
+    EXPECT_EQ(decoded.options.password, "");
+    EXPECT_EQ(decoded.options.receiveMaximum, 16);
+    EXPECT_EQ(decoded.storeCapacity, 65536u);
+    EXPECT_EQ(decoded.filters, session.filters);
+}
+
+TEST_F(WarmStartTests, LeavesTheCredentialsOut) {
+    WarmStartSession session = makeSession("client");
+    session.options.password = "s3cret-password";
+    std::string data = WarmStartStore::encode(session);
+    EXPECT_EQ(data.find("s3cret-password"), std::string::npos);
+    EXPECT_EQ(data.find("user"), std::string::npos);
+
+    session.options.username.clear();
+    session.options.password.clear();
+    WarmStartSession decoded;
+    ASSERT_TRUE(WarmStartStore::decode(WarmStartStore::encode(session), decoded));
+    EXPECT_FALSE(decoded.requiresCredentials);
+}
+
+TEST_F(WarmStartTests, RejectsCorruptAndTruncatedData) {
+    std::string data = WarmStartStore::encode(makeSession("client"));
+    WarmStartSession decoded;
+
+    std::string flipped = data;
+    flipped[flipped.size() - 3] ^= 0x20;
+    EXPECT_FALSE(WarmStartStore::decode(flipped, decoded));
+    EXPECT_FALSE(WarmStartStore::decode(data.substr(0, data.size() - 1), decoded));
+    EXPECT_FALSE(WarmStartStore::decode(data.substr(0, 6), decoded));
+    EXPECT_FALSE(WarmStartStore::decode("", decoded));
+}
+
+TEST_F(WarmStartTests, StoreSavesReplacesAndRemovesSessions) {
+    WarmStartStore store(directory_);
+    std::string error;
+    WarmStartSession first = makeSession("first");
+    ASSERT_TRUE(store.save(first, error)) << error;
+    first.filters = {{"other", 2}};
+    ASSERT_TRUE(store.save(first, error)) << error;
+    ASSERT_TRUE(store.save(makeSession("second/client"), error)) << error;
+    // Not a session file, and a session file that is garbage.
+    std::ofstream(directory_ + "/first.outbox") << "outbound";
+    std::ofstream(directory_ + "/broken.warmstart") << "garbage";
+
+    auto sessions = store.load();
+    ASSERT_EQ(sessions.size(), 2u);
+    EXPECT_FALSE(std::ifstream(directory_ + "/broken.warmstart").good());
+    EXPECT_TRUE(std::ifstream(directory_ + "/first.outbox").good());
+    for (const auto &session : sessions) {
+        if (session.clientId == "first") {
+            EXPECT_EQ(session.filters, first.filters);
+        } else {
+            EXPECT_EQ(session.clientId, "second/client");
+        }
+    }
+
+    store.remove("first");
+    sessions = store.load();
+    ASSERT_EQ(sessions.size(), 1u);
+    EXPECT_EQ(sessions[0].clientId, "second/client");
+}
+
+TEST_F(WarmStartTests, HoldsMessagesUntilJsSubscribes) {
+    auto broker = std::make_shared<FakeBroker>();
+    auto sink = std::make_shared<RecordingEventSink>();
+    Client client("client", broker, sink);
+    broker->attach(&client);
+
+    client.warmStart(ConnectOptions(), {{"score/#", 1}, {"news/#", 0}}, 2);
+    ASSERT_STREQ(client.connectionStatus(), status::CONNECTED);
+    EXPECT_EQ(broker->filters.size(), 2u);
+    client.onMessage("score/1", "a", 1);
+    client.onMessage("score/2", "b", 1);
+    client.onMessage("score/3", "c", 1);
+    client.onMessage("news/1", "n", 0);
+    EXPECT_TRUE(sink->messages.empty());
+
+    // JS takes over: no second CONNECT, but a connected event for the listeners that now exist.
+    size_t connectedEvents = sink->count("clientconnected");
+    client.connect(ConnectOptions());
+    EXPECT_EQ(broker->connects.size(), 1u);
+    EXPECT_EQ(sink->count("clientconnected"), connectedEvents + 1);
+
+    client.subscribe("js", "score/#", 1);
+    // Bounded to the last two held messages; the topic matching another warm filter stays held.
+    ASSERT_EQ(sink->messages.size(), 1u);
+    EXPECT_EQ(sink->messages[0].second.payload, "c");
+    EXPECT_EQ(sink->messages[0].first, "js");
+
+    client.onMessage("score/4", "d", 1);
+    ASSERT_EQ(sink->messages.size(), 2u);
+    EXPECT_EQ(sink->messages[1].second.payload, "d");
+
+    client.subscribe("js-news", "news/#", 0);
+    ASSERT_EQ(sink->messages.size(), 3u);
+    EXPECT_EQ(sink->messages[2].first, "js-news");
+    EXPECT_EQ(sink->messages[2].second.payload, "n");
+    EXPECT_TRUE(broker->unsubscribes.empty());
+}
+
+TEST_F(WarmStartTests, RecordsTheSessionOnceTheWarmFiltersAreClaimed) {
+    auto broker = std::make_shared<FakeBroker>();
+    Client client("client", broker, std::make_shared<RecordingEventSink>());
+    broker->attach(&client);
+    std::vector<std::vector<std::pair<std::string, int>>> recorded;
+    client.setSessionObserver(
+        [&recorded](const ConnectOptions &, const std::vector<std::pair<std::string, int>> &filters) {
+            recorded.push_back(filters);
+        });
+
+    client.warmStart(ConnectOptions(), {{"b", 0}, {"a", 1}});
+    client.connect(ConnectOptions());
+    client.subscribe("js", "a", 1);
+    EXPECT_TRUE(recorded.empty());
+    client.subscribe("js", "b", 0);
+    ASSERT_EQ(recorded.size(), 1u);
+    EXPECT_EQ(recorded[0], (std::vector<std::pair<std::string, int>>{{"a", 1}, {"b", 0}}));
+
+    // Same filters again: nothing new to record.
+    client.subscribe("other", "a", 1);
+    EXPECT_EQ(recorded.size(), 1u);
+    client.subscribe("js", "c", 2);
+    ASSERT_EQ(recorded.size(), 2u);
+    EXPECT_EQ(recorded[1].back(), std::make_pair(std::string("c"), 2));
+}
+
+TEST_F(WarmStartTests, StartsRecordedClientsAndHandsThemToJs) {
+    WarmStartStore store(directory_);
+    std::string error;
+    ASSERT_TRUE(store.save(makeSession("kept"), error)) << error;
+    ASSERT_TRUE(store.save(makeSession("moved"), error)) << error;
+
+    ClientRegistry registry;
+    auto sink = std::make_shared<RecordingEventSink>();
+    std::vector<std::shared_ptr<FakeBroker>> brokers;
+    WarmStart warmStart;
+    auto createClient = [&](const WarmStartSession &session) {
+        auto broker = std::make_shared<FakeBroker>();
+        auto client = registry.create(session.clientId, broker, sink);
+        broker->attach(client.get());
+        brokers.push_back(broker);
+        return client;
+    };
+    // The sessions connected with credentials: without them nothing is started.
+    EXPECT_EQ(warmStart.start(store, createClient), 0u);
+    EXPECT_EQ(warmStart.start(store, createClient, [](const std::string &, std::string &, std::string &) {
+        return false;
+    }), 0u);
+    EXPECT_TRUE(brokers.empty());
+    EXPECT_EQ(registry.find("kept"), nullptr);
+
+    std::vector<std::string> asked;
+    size_t started = warmStart.start(store, createClient,
+                                     [&](const std::string &clientId, std::string &username, std::string &password) {
+                                         asked.push_back(clientId);
+                                         username = "user";
+                                         password = "from-keychain";
+                                         return true;
+                                     });
+    ASSERT_EQ(started, 2u);
+    EXPECT_EQ(asked.size(), 2u);
+    EXPECT_EQ(warmStart.pendingCount(), 2u);
+    for (const auto &broker : brokers) {
+        ASSERT_EQ(broker->connects.size(), 1u);
+        EXPECT_EQ(broker->connects[0].username, "user");
+        EXPECT_EQ(broker->connects[0].password, "from-keychain");
+        EXPECT_EQ(broker->filters.size(), 2u);
+    }
+
+    auto kept = warmStart.adopt("kept", "broker.local", 8883, registry);
+    ASSERT_NE(kept, nullptr);
+    EXPECT_EQ(kept, registry.find("kept"));
+    EXPECT_EQ(warmStart.adopt("moved", "broker.local", 1883, registry), nullptr);
+    EXPECT_EQ(registry.find("moved"), nullptr);
+    EXPECT_EQ(warmStart.adopt("kept", "broker.local", 8883, registry), nullptr);
+    EXPECT_EQ(warmStart.pendingCount(), 0u);
+}
+
+TEST_F(WarmStartTests, ReportsStartupMilestones) {
+    auto broker = std::make_shared<FakeBroker>();
+    Client client("client", broker, std::make_shared<RecordingEventSink>());
+    broker->attach(&client);
+    client.warmStart(ConnectOptions(), {{"score/#", 0}});
+    client.onMessage("score/1", "a", 0);
+
+    EventValue snapshot = client.metrics().snapshot();
+    const EventValue *startup = field(snapshot, "startup");
+    ASSERT_NE(startup, nullptr);
+    EXPECT_TRUE(field(*startup, "warmStart")->getBool());
+    ASSERT_NE(field(*startup, "connectedMs"), nullptr);
+    ASSERT_NE(field(*startup, "firstMessageMs"), nullptr);
+    EXPECT_EQ(field(*startup, "jsAttachedMs"), nullptr);
+    EXPECT_GE(field(*startup, "firstMessageMs")->getNumber(), field(*startup, "connectedMs")->getNumber());
+    EXPECT_GE(field(*startup, "connectedMs")->getNumber(), 0);
+
+    client.onInitialized();
+    client.onMessage("score/2", "b", 0);
+    snapshot = client.metrics().snapshot();
+    startup = field(snapshot, "startup");
+    ASSERT_NE(field(*startup, "jsAttachedMs"), nullptr);
+    EXPECT_GE(field(*startup, "jsAttachedMs")->getNumber(), field(*startup, "firstMessageMs")->getNumber());
+}
@@ -0,0 +1,53 @@
+//
+//  MqttCoreBridge.h
+//  d11-mqtt
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Network operations the shared C++ core (cpp/MqttClient.h) asks the platform client to perform.
+ * Implemented in Swift by MqttHelper on top of CocoaMQTT5.
+ */
+@protocol MqttNativeTransport <NSObject>
+
+/** receiveMaximum 0 keeps the platform default. */
+- (void)connectWithKeepAlive:(NSInteger)keepAlive cleanSession:(BOOL)cleanSession username:(NSString *)username password:(NSString *)password receiveMaximum:(NSInteger)receiveMaximum;
+- (void)disconnect;
+- (void)subscribe:(NSString *)topic qos:(NSInteger)qos;
+/** One SUBSCRIBE with every filter; qos[i] applies to topics[i]. */
+- (void)subscribeTopics:(NSArray<NSString *> *)topics qos:(NSArray<NSNumber *> *)qos;
+- (void)unsubscribe:(NSString *)topic;
+/** payload is only valid during the call (it may point into JS memory); copy it before returning. */
+- (void)publish:(NSString *)topic payload:(const uint8_t *_Nullable)payload length:(NSUInteger)length qos:(NSInteger)qos retain:(BOOL)retain;
+- (void)close;
+
+@end
+
+/**
+ * Swift facing entry points of the shared C++ core: registers transports and forwards their outcomes to the client
+ * registered under the same clientId. Connection state, subscriptions and events are owned by the core.
+ */
+@interface MqttCoreBridge : NSObject
+
++ (BOOL)registerClient:(NSString *)clientId transport:(id<MqttNativeTransport>)transport;
+
++ (void)clientInitialized:(NSString *)clientId success:(BOOL)success errorMessage:(NSString *)errorMessage;
++ (void)clientConnected:(NSString *)clientId reasonCode:(NSInteger)reasonCode;
++ (void)clientConnectionFailed:(NSString *)clientId reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage errorCause:(NSString *)errorCause;
++ (void)clientDisconnected:(NSString *)clientId reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage;
++ (void)clientSubscribed:(NSString *)clientId topic:(NSString *)topic qos:(NSInteger)qos message:(NSString *)message;
++ (void)clientSubscribeFailed:(NSString *)clientId topic:(NSString *)topic reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage;
++ (void)clientPublishFailed:(NSString *)clientId topic:(NSString *)topic errorMessage:(NSString *)errorMessage;
+/**
+ * receivedAt is clock_gettime_nsec_np(CLOCK_UPTIME_RAW) when CocoaMQTT delivered the message; the time until the core
+ * has it is recorded as its conversion time. userProperties are the MQTT 5 user properties of the message as
+ * alternating names and values, like on Android: a name may repeat, so they are not a dictionary. nil when it has none.
+ */
++ (void)clientReceivedMessage:(NSString *)clientId topic:(NSString *)topic payload:(NSData *)payload qos:(NSInteger)qos receivedAt:(int64_t)receivedAt userProperties:(nullable NSArray<NSString *> *)userProperties;
+
+@end
+
+NS_ASSUME_NONNULL_END
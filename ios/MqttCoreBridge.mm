@@ -0,0 +1,158 @@
+//
+//  MqttCoreBridge.mm
+//  d11-mqtt
+//
+
+#import "MqttCoreBridge.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MqttClientRegistry.h"
+#include "MqttJSIModule.h"
+#include "MqttMetrics.h"
+#include "MqttTrace.h"
+
+namespace {
+
+std::string toStdString(NSString *value) {
+    return value == nil ? std::string() : std::string([value UTF8String]);
+}
+
+NSString *toNSString(const std::string &value) {
+    return [[NSString alloc] initWithBytes:value.data() length:value.size() encoding:NSUTF8StringEncoding] ?: @"";
+}
+
+/**
+ * mqtt::Transport backed by the Swift MqttHelper, which runs every call on its own queue.
+ */
+class ObjCTransport : public mqtt::Transport {
+public:
+    explicit ObjCTransport(id<MqttNativeTransport> transport) : transport_(transport) {}
+
+    void connect(const mqtt::ConnectOptions &options) override {
+        [transport_ connectWithKeepAlive:options.keepAlive
+                            cleanSession:options.cleanSession
+                                username:toNSString(options.username)
+                                password:toNSString(options.password)
+                          receiveMaximum:options.receiveMaximum];
+    }
+
+    void disconnect() override {
+        [transport_ disconnect];
+    }
+
+    void subscribe(const std::string &topic, int qos) override {
+        [transport_ subscribe:toNSString(topic) qos:qos];
+    }
+
+    void subscribeMany(const std::vector<std::pair<std::string, int>> &filters) override {
+        NSMutableArray<NSString *> *topics = [NSMutableArray arrayWithCapacity:filters.size()];
+        NSMutableArray<NSNumber *> *qos = [NSMutableArray arrayWithCapacity:filters.size()];
+        for (const auto &filter : filters) {
+            [topics addObject:toNSString(filter.first)];
+            [qos addObject:@(filter.second)];
+        }
+        [transport_ subscribeTopics:topics qos:qos];
+    }
+
+    void unsubscribe(const std::string &topic) override {
+        [transport_ unsubscribe:toNSString(topic)];
+    }
+
+    void publish(const std::string &topic, const uint8_t *payload, size_t size, int qos, bool retain) override {
+        MQTT_TRACE_SECTION("mqtt::ObjCTransport::publish");
+        // No copy here: MqttHelper copies the bytes once, straight into the buffer CocoaMQTT sends.
+        [transport_ publish:toNSString(topic) payload:payload length:size qos:qos retain:retain];
+    }
+
+    void close() override {
+        [transport_ close];
+    }
+
+private:
+    id<MqttNativeTransport> transport_;
+};
+
+std::shared_ptr<mqtt::Client> findClient(NSString *clientId) {
+    return mqtt::ClientRegistry::shared().find(toStdString(clientId));
+}
+
+}
+
+@implementation MqttCoreBridge
+
++ (BOOL)registerClient:(NSString *)clientId transport:(id<MqttNativeTransport>)transport {
+    auto client = mqtt::ClientRegistry::shared().create(toStdString(clientId), std::make_shared<ObjCTransport>(transport),
+                                                        mqtt::dispatcherEventSink());
+    return client != nullptr;
+}
+
++ (void)clientInitialized:(NSString *)clientId success:(BOOL)success errorMessage:(NSString *)errorMessage {
+    if (auto client = findClient(clientId)) {
+        if (success) {
+            client->onInitialized();
+        } else {
+            client->onInitializationFailed(toStdString(errorMessage));
+        }
+    }
+}
+
++ (void)clientConnected:(NSString *)clientId reasonCode:(NSInteger)reasonCode {
+    if (auto client = findClient(clientId)) {
+        client->onConnected((int)reasonCode);
+    }
+}
+
++ (void)clientConnectionFailed:(NSString *)clientId reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage errorCause:(NSString *)errorCause {
+    if (auto client = findClient(clientId)) {
+        client->onConnectionFailed((int)reasonCode, toStdString(errorMessage), toStdString(errorCause));
+    }
+}
+
++ (void)clientDisconnected:(NSString *)clientId reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage {
+    if (auto client = findClient(clientId)) {
+        client->onDisconnected((int)reasonCode, toStdString(errorMessage));
+    }
+}
+
++ (void)clientSubscribed:(NSString *)clientId topic:(NSString *)topic qos:(NSInteger)qos message:(NSString *)message {
+    if (auto client = findClient(clientId)) {
+        client->onSubscribed(toStdString(topic), (int)qos, toStdString(message));
+    }
+}
+
++ (void)clientSubscribeFailed:(NSString *)clientId topic:(NSString *)topic reasonCode:(NSInteger)reasonCode errorMessage:(NSString *)errorMessage {
+    if (auto client = findClient(clientId)) {
+        client->onSubscribeFailed(toStdString(topic), (int)reasonCode, toStdString(errorMessage));
+    }
+}
+
++ (void)clientPublishFailed:(NSString *)clientId topic:(NSString *)topic errorMessage:(NSString *)errorMessage {
+    if (auto client = findClient(clientId)) {
+        client->onPublishFailed(toStdString(topic), toStdString(errorMessage));
+    }
+}
+
++ (void)clientReceivedMessage:(NSString *)clientId topic:(NSString *)topic payload:(NSData *)payload qos:(NSInteger)qos receivedAt:(int64_t)receivedAt userProperties:(nullable NSArray<NSString *> *)userProperties {
+    MQTT_TRACE_SECTION("mqtt::clientReceivedMessage");
+    if (auto client = findClient(clientId)) {
+        std::string topicStr = toStdString(topic);
+        std::string payloadStr(static_cast<const char *>(payload.bytes), payload.length);
+        client->metrics().recordConversion(mqtt::monotonicNanos() - receivedAt);
+        std::vector<std::string> propertyStrings;
+        propertyStrings.reserve(userProperties.count);
+        for (NSString *property in userProperties) {
+            propertyStrings.push_back(toStdString(property));
+        }
+        mqtt::UserProperties properties;
+        for (size_t i = 0; i + 1 < propertyStrings.size(); i += 2) {
+            properties.emplace_back(propertyStrings[i], propertyStrings[i + 1]);
+        }
+        client->onMessage(topicStr, std::move(payloadStr), (int)qos, receivedAt, 0, properties);
+    }
+}
+
+@end
@@ -8,12 +8,29 @@
 
 
 #import <React/RCTBridgeModule.h>
-#import <React/RCTEventEmitter.h>
 
-@interface MqttModule : RCTEventEmitter <RCTBridgeModule>
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Supplies the credentials of a recorded client whose connect had a username or password, e.g. from the Keychain;
+ * nil leaves the client to JS. Called on a background queue.
+ */
+typedef NSURLCredential *_Nullable (^MqttWarmStartCredentialsProvider)(NSString *clientId);
+
+// A plain module: events reach JS through the JSI dispatcher (cpp/MqttEventDispatcher.h), not an RCTEventEmitter.
+@interface MqttModule : NSObject <RCTBridgeModule>
 
 @property (nonatomic, assign) BOOL setBridgeOnMainQueue;
 
-- (void)sendEventToJs:(NSString * _Nonnull)eventName param:(NSDictionary<NSString *,id> *_Nullable)params;
+/**
+ * Warm start of the native engine: call from application:didFinishLaunchingWithOptions:. The clients JS created with
+ * warmStart: true at the last launch connect and subscribe again while the JS bundle loads, and hold what they
+ * receive until JS creates them; see cpp/MqttWarmStart.h. Sessions do not record credentials, so clients that
+ * connected with them are only started by warmStartWithCredentials:.
+ */
++ (void)warmStart;
++ (void)warmStartWithCredentials:(nullable MqttWarmStartCredentialsProvider)credentials;
 
 @end
+
+NS_ASSUME_NONNULL_END
@@ -7,20 +7,39 @@
 
 
 #import "MqttModule.h"
-#import "MqttJSIUtils.h"
 
 #import <React/RCTBridge+Private.h>
+#import <ReactCommon/RCTTurboModule.h>
+#import <ReactCommon/CallInvoker.h>
 #import <d11_mqtt/d11_mqtt-Swift.h>
 
+#include "MqttJSIModule.h"
+
+#if __has_include(<hermes/hermes.h>)
+#include <hermes/hermes.h>
+#define MQTT_HERMES 1
+#endif
+
 
 
 using namespace facebook::jsi;
 using namespace std;
 
-@interface MqttModule()
+@interface MqttModule() <RCTInvalidating>
 
 @end
 
+// The native engine keeps its outbound stores and warm start sessions in Application Support, which is private and
+// not purged.
+static std::string engineStorageDirectory() {
+    NSURL *supportDirectory = [[NSFileManager defaultManager] URLForDirectory:NSApplicationSupportDirectory
+                                                                     inDomain:NSUserDomainMask
+                                                            appropriateForURL:nil
+                                                                       create:YES
+                                                                        error:nil];
+    return supportDirectory.path != nil ? std::string(supportDirectory.path.UTF8String) : "";
+}
+
 @implementation MqttModule
 
 @synthesize bridge = _bridge;
@@ -32,83 +51,40 @@ RCT_EXPORT_MODULE(MqttModule)
     return YES;
 }
 
-- (NSArray<NSString *> *)supportedEvents {
-    return @[@"CUSTOM_EVENT"];
-}
-
-- (void)sendEventToJs:(NSString * _Nonnull)eventName param:(NSDictionary<NSString *,id> *_Nullable)params {
-     [self sendEventWithName:eventName body: params];
-}
-
-RCT_EXPORT_METHOD(createMqtt:(NSString *)clientId host:(NSString *)host port:(NSInteger)port enableSsl:(BOOL)enableSsl) {
-    [[Mqtt shared] createMqtt:clientId host:host port:port enableSslConfig:enableSsl];
-}
-
-static Value removeMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-
-    [[Mqtt shared] removeMqtt:clientId];
-    return Value();
-}
-
-static Value connectMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-    NSDictionary *options = mqtt::convertJSIObjectToNSDictionary(runtime, arguments[1].getObject(runtime));
-
-    [[Mqtt shared] connectMqtt:clientId options:options];
-    printf("connect mqtt called");
-    return Value();
-}
-
-static Value disconnectMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-
-    [[Mqtt shared] disconnectMqtt:clientId];
-    return Value();
-}
-
-static Value subscribeMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *eventId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[1].getString(runtime));
-    NSString *topic = mqtt::convertJSIStringToNSString(runtime, arguments[2].getString(runtime));
-    NSNumber *qosString = mqtt::convertJSIValueToObjCObject(runtime, arguments[3]);
-    NSInteger qos = [qosString intValue];
-
-    [[Mqtt shared] subscribeMqtt:eventId clientId:clientId topic:topic qos:qos];
-    return Value();
++ (void)warmStart {
+    [self warmStartWithCredentials:nil];
 }
 
-static Value unsubscribeMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *eventId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[1].getString(runtime));
-    NSString *topic = mqtt::convertJSIStringToNSString(runtime, arguments[2].getString(runtime));
-
-    [[Mqtt shared] unsubscribeMqtt:eventId clientId:clientId topic:topic];
-    return Value();
++ (void)warmStartWithCredentials:(MqttWarmStartCredentialsProvider)credentials {
+    mqtt::WarmStart::CredentialsProvider provider;
+    if (credentials != nil) {
+        provider = [credentials](const std::string &clientId, std::string &username, std::string &password) {
+            NSURLCredential *credential = credentials([NSString stringWithUTF8String:clientId.c_str()]);
+            if (credential == nil) {
+                return false;
+            }
+            username = credential.user != nil ? std::string(credential.user.UTF8String) : "";
+            password = credential.password != nil ? std::string(credential.password.UTF8String) : "";
+            return true;
+        };
+    }
+    // Reading the recorded sessions stays off the main thread, so it does not delay the launch.
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        mqtt::warmStartClients(engineStorageDirectory(), provider);
+    });
 }
 
-static Value getConnectionStatusMqtt(Runtime &runtime, const Value &thisValue, const Value *arguments, size_t count) {
-    NSString *clientId = mqtt::convertJSIStringToNSString(runtime, arguments[0].getString(runtime));
-
-    NSString *state = [[Mqtt shared] getConnectionStatusMqtt:clientId];
-    auto jsiValue = mqtt::convertNSStringToJSIString(runtime, state);
-    return jsiValue;
+// Resolves once the core has the client, so JS calls made after awaiting it (setLastValueCache, ...) find it.
+RCT_EXPORT_METHOD(createMqtt:(NSString *)clientId host:(NSString *)host port:(NSInteger)port enableSsl:(BOOL)enableSsl
+                  resolve:(RCTPromiseResolveBlock)resolve reject:(RCTPromiseRejectBlock)reject) {
+    [[Mqtt shared] createMqtt:clientId host:host port:port enableSslConfig:enableSsl onRegistered:^{
+        resolve(nil);
+    }];
 }
 
-
-static void installJSIModule(Runtime &jsiRuntime) {
-    // Create a proxy object that will hold all our functions
-    Object module = Object(jsiRuntime);
-    
-    // Callable properties
-    mqtt::registerCxxFunction(jsiRuntime, module, "removeMqtt", 1, removeMqtt);
-    mqtt::registerCxxFunction(jsiRuntime, module, "connectMqtt", 2, connectMqtt);
-    mqtt::registerCxxFunction(jsiRuntime, module, "disconnectMqtt", 1, disconnectMqtt);
-    mqtt::registerCxxFunction(jsiRuntime, module, "subscribeMqtt", 4, subscribeMqtt);
-    mqtt::registerCxxFunction(jsiRuntime, module, "unsubscribeMqtt", 3, unsubscribeMqtt);
-    mqtt::registerCxxFunction(jsiRuntime, module, "getConnectionStatusMqtt", 1, getConnectionStatusMqtt);
-    
-    jsiRuntime.global().setProperty(jsiRuntime, "__MqttModuleProxy", std::move(module));
+// The bridge is being torn down (reload or teardown) while its runtime still exists: release the JS listeners.
+- (void)invalidate {
+    mqtt::releaseJSIModule();
 }
 
 RCT_EXPORT_BLOCKING_SYNCHRONOUS_METHOD(installJSIModule) {
@@ -117,11 +93,26 @@ RCT_EXPORT_BLOCKING_SYNCHRONOUS_METHOD(installJSIModule) {
     if (cxxBridge == nil) {
         return @false;
     }
-    auto jsiRuntime = (jsi::Runtime*) cxxBridge.runtime;
+    auto jsiRuntime = (facebook::jsi::Runtime *)cxxBridge.runtime;
     if (jsiRuntime == nil) {
         return @false;
     }
-    installJSIModule(*(facebook::jsi::Runtime *)jsiRuntime);
+    auto jsCallInvoker = bridge.jsCallInvoker;
+    if (jsCallInvoker == nullptr) {
+        return @false;
+    }
+    std::string storageDirectory = engineStorageDirectory();
+    // Native events are delivered to JS listeners through the CallInvoker instead of sendEventWithName
+    // Background subscription handlers run on a Hermes runtime of their own, see cpp/MqttBackgroundRuntime.h
+    mqtt::BackgroundRuntime::RuntimeFactory createBackgroundRuntime;
+#if MQTT_HERMES
+    createBackgroundRuntime = []() -> std::unique_ptr<facebook::jsi::Runtime> {
+        return facebook::hermes::makeHermesRuntime();
+    };
+#endif
+    mqtt::installJSIModule(*(facebook::jsi::Runtime *)jsiRuntime, [jsCallInvoker](std::function<void()> &&task) {
+        jsCallInvoker->invokeAsync(std::move(task));
+    }, storageDirectory, std::move(createBackgroundRuntime));
     return @true;
 }
 
@@ -9,107 +9,142 @@
 
 import Foundation
 import CocoaMQTT
-
-class MqttHelper {
-    private let emitJsiEvent: (_ event: String, _ params: [String : Any]?) -> Void
+import os.signpost
+
+/**
+ * CocoaMQTT5 backed transport of one client. The shared C++ core (cpp/MqttClient.h) decides what to connect,
+ * subscribe and publish through MqttNativeTransport; every outcome is reported back through MqttCoreBridge.
+ * Connection state, subscription bookkeeping and event payloads live in the core.
+ */
+class MqttHelper: NSObject, MqttNativeTransport {
     private let mqtt: CocoaMQTT5
     private let clientId: String
-    private var subscriptionMap = [String: [String: Subscription]]()
-    
-    private let CONNECTED_EVENT = "connected"
-    private let CLIENT_INITIALIZE_EVENT = "client_initialize"
-    private let DISCONNECTED_EVENT = "disconnected"
-    private let SUBSCRIBE_SUCCESS = "subscribe_success"
-    private let SUBSCRIBE_FAILED = "subscribe_failed"
-    private let ERROR_EVENT = "mqtt_error"
-
-    private let CONNECTED = "connected"
-    private let CONNECTING = "connecting"
-    private let DISCONNECTED = "disconnected"
-
-    // Error Reason Codes
-    private let DEFAULT_ERROR = -1
-    private let CONNECTION_ERROR = -2
+    private let host: String
+    private let port: Int
+    private let executer: DispatchQueue
+
+    // Error Reason Codes, see ErrorCode in cpp/MqttConstants.h
     private let DISCONNECTION_ERROR = -3
     private let SUBSCRIPTION_ERROR = -4
-    private let UNSUBSCRIPTION_ERROR = -5
-    private let INITIALIZATION_ERROR = -6
-    private let RX_CHAIN_ERROR = -7
 
-    init(_ clientId: String, host: String, port: Int, enableSslConfig: Bool, emitJsiEvent: @escaping (_ event: String, _ params: [String : Any]?) -> Void) {
-        self.emitJsiEvent = emitJsiEvent
+    // Same log as the core's trace sections (cpp/MqttTrace.cpp), so Instruments shows both in one track.
+    private static let signpostLog = OSLog(subsystem: "com.d11.mqtt", category: "PointsOfInterest")
+
+    /**
+     * Runs body inside an os_signpost interval, on iOS 12 and later.
+     */
+    private static func traceInterval(_ name: StaticString, _ body: () -> Void) {
+        guard #available(iOS 12.0, *), signpostLog.signpostsEnabled else {
+            body()
+            return
+        }
+        let signpostId = OSSignpostID(log: signpostLog)
+        os_signpost(.begin, log: signpostLog, name: name, signpostID: signpostId)
+        body()
+        os_signpost(.end, log: signpostLog, name: name, signpostID: signpostId)
+    }
+
+    init(_ clientId: String, host: String, port: Int, enableSslConfig: Bool, executer: DispatchQueue) {
         self.clientId = clientId
+        self.host = host
+        self.port = port
+        self.executer = executer
         mqtt = CocoaMQTT5(clientID: clientId, host: host, port: UInt16(port))
-        mqtt.delegate = self
         mqtt.enableSSL = enableSslConfig
+        if enableSslConfig {
+            // A stable peer ID lets Secure Transport resume the TLS session of the previous connection on reconnect
+            // instead of doing a full handshake.
+            mqtt.sslSettings = ["GCDAsyncSocketSSLPeerID": "\(clientId)@\(host):\(port)".data(using: .utf8)! as NSData]
+        }
+        super.init()
+        mqtt.delegate = self
+    }
 
+    /**
+     * Reports the initialization result. Called after the client is registered with the core so the event has a
+     * receiver.
+     */
+    func initialize() {
         if mqtt.clientID == clientId && mqtt.host == host && mqtt.port == UInt16(port) {
-            emitJsiEvent(clientId + CLIENT_INITIALIZE_EVENT, ["clientInit": true])
+            MqttCoreBridge.clientInitialized(clientId, success: true, errorMessage: "")
         } else {
-            emitJsiEvent(clientId + ERROR_EVENT, [
-                "clientInit": false,
-                "errorMessage": "Failed to initialize MQTT client",
-                "errorType": "INITIALIZATION",
-                "reasonCode": INITIALIZATION_ERROR
-            ])
+            MqttCoreBridge.clientInitialized(clientId, success: false, errorMessage: "Failed to initialize MQTT client")
         }
     }
 
-    func connectMqtt(_ clientId: String, options: MqttHelperOptions) {
-        let connectProperties = MqttConnectProperties()
-        connectProperties.topicAliasMaximum = 0
-        connectProperties.sessionExpiryInterval = 0
-        connectProperties.receiveMaximum = 100
-        connectProperties.maximumPacketSize = 1024*1024
-        mqtt.connectProperties = connectProperties
+    func connect(withKeepAlive keepAlive: Int, cleanSession: Bool, username: String, password: String,
+                 receiveMaximum: Int) {
+        executer.async {
+            let connectProperties = MqttConnectProperties()
+            connectProperties.topicAliasMaximum = 0
+            connectProperties.sessionExpiryInterval = 0
+            // CocoaMQTT acknowledges on receipt, so this only bounds the broker's unacknowledged QoS 1/2 messages.
+            connectProperties.receiveMaximum = receiveMaximum > 0 ? UInt16(min(receiveMaximum, 65535)) : 100
+            connectProperties.maximumPacketSize = 1024*1024
+            self.mqtt.connectProperties = connectProperties
 
-        mqtt.username = options.username
-        mqtt.password = options.password
-        mqtt.keepAlive = options.keepAlive
-        mqtt.cleanSession = options.cleanSession
+            self.mqtt.username = username
+            self.mqtt.password = password
+            self.mqtt.keepAlive = UInt16(keepAlive)
+            self.mqtt.cleanSession = cleanSession
 
-        _ = mqtt.connect()
+            _ = self.mqtt.connect()
+        }
     }
 
-    func disconnectMqtt() {
-        mqtt.disconnect()
+    func disconnect() {
+        executer.async {
+            self.mqtt.disconnect()
+        }
     }
 
-    func subscribeMqtt(_ eventId: String, clientId: String, topic: String, qos: Int) {
-        let subscription = Subscription(qos: qos)
-        if subscriptionMap[topic] != nil {
-            subscriptionMap[topic]?[eventId] = subscription
-        } else {
-            subscriptionMap[topic] = [eventId:subscription]
-        }
-        if mqtt.connState == .connected {
+    func subscribe(_ topic: String, qos: Int) {
+        executer.async {
             let qosEnum = CocoaMQTTQoS(rawValue: UInt8(qos)) ?? .qos0
             let mqttSubscribe = MqttSubscription(topic: topic, qos: qosEnum)
             mqttSubscribe.retainHandling = CocoaRetainHandlingOption.sendOnSubscribe
-            mqtt.subscribe([mqttSubscribe])
+            self.mqtt.subscribe([mqttSubscribe])
         }
     }
 
-    func unsubscribeMqtt(_ eventId: String, clientId: String, topic: String) {
-        if subscriptionMap[topic] == nil {
-            return
+    func subscribeTopics(_ topics: [String], qos: [NSNumber]) {
+        executer.async {
+            let subscriptions = zip(topics, qos).map { topic, qos -> MqttSubscription in
+                let subscription = MqttSubscription(topic: topic, qos: CocoaMQTTQoS(rawValue: qos.uint8Value) ?? .qos0)
+                subscription.retainHandling = CocoaRetainHandlingOption.sendOnSubscribe
+                return subscription
+            }
+            self.mqtt.subscribe(subscriptions)
         }
-        if let length = subscriptionMap[topic]?.count, length > 1 {
-            subscriptionMap[topic]?.removeValue(forKey: eventId)
-        } else {
-            mqtt.unsubscribe(topic)
-            subscriptionMap.removeValue(forKey: topic)
+    }
+
+    func unsubscribe(_ topic: String) {
+        executer.async {
+            self.mqtt.unsubscribe(topic)
         }
     }
 
-    func getConnectionStatusMqtt() -> String {
-        switch(mqtt.connState) {
-            case .disconnected:
-                return DISCONNECTED
-            case .connecting:
-                return CONNECTING
-            case .connected:
-                return CONNECTED
+    func publish(_ topic: String, payload: UnsafePointer<UInt8>?, length: Int, qos: Int, retain: Bool) {
+        // The only copy on the publish path: payload may reference JS memory, so it is read before returning.
+        let bytes = [UInt8](UnsafeBufferPointer(start: payload, count: length))
+        executer.async {
+            MqttHelper.traceInterval("MqttHelper.publish") {
+                let qosEnum = CocoaMQTTQoS(rawValue: UInt8(qos)) ?? .qos0
+                let message = CocoaMQTT5Message(topic: topic, payload: bytes, qos: qosEnum, retained: retain)
+                let messageId = self.mqtt.publish(message, DUP: false, retained: retain, properties: MqttPublishProperties())
+                if messageId < 0 {
+                    MqttCoreBridge.clientPublishFailed(self.clientId, topic: topic, errorMessage: "Failed to publish message on topic: \(topic)")
+                }
+            }
+        }
+    }
+
+    func close() {
+        executer.async {
+            self.mqtt.delegate = nil
+            if self.mqtt.connState != .disconnected {
+                self.mqtt.disconnect()
+            }
         }
     }
 }
@@ -117,20 +152,11 @@ class MqttHelper {
 extension MqttHelper: CocoaMQTT5Delegate {
     func mqtt5(_ mqtt5: CocoaMQTT5, didConnectAck ack: CocoaMQTTCONNACKReasonCode, connAckData: MqttDecodeConnAck?) {
         if (ack != .success) {
-            emitJsiEvent(clientId + DISCONNECTED_EVENT, ["reasonCode": ack.rawValue])
+            MqttCoreBridge.clientConnectionFailed(clientId, reasonCode: Int(ack.rawValue), errorMessage: "Connection refused: \(ack)", errorCause: "")
             return
         }
-
-        emitJsiEvent(clientId + CONNECTED_EVENT, ["reasonCode": ack.rawValue])
-
-        for (topic, idSubscriptionMap) in subscriptionMap {
-            if let maxQos = idSubscriptionMap.values.max(by: { $0.qos < $1.qos })?.qos {
-                let qosEnum = CocoaMQTTQoS(rawValue: UInt8(maxQos)) ?? .qos0
-                let mqttSubscribe = MqttSubscription(topic: topic, qos: qosEnum)
-                mqttSubscribe.retainHandling = CocoaRetainHandlingOption.sendOnSubscribe
-                mqtt5.subscribe([mqttSubscribe])
-            }
-        }
+        // Subscriptions are resent by the core on connect.
+        MqttCoreBridge.clientConnected(clientId, reasonCode: Int(ack.rawValue))
     }
 
     func mqtt5(_ mqtt5: CocoaMQTT5, didPublishMessage message: CocoaMQTT5Message, id: UInt16) {
@@ -143,35 +169,30 @@ extension MqttHelper: CocoaMQTT5Delegate {
     }
 
     func mqtt5(_ mqtt5: CocoaMQTT5, didReceiveMessage message: CocoaMQTT5Message, id: UInt16, publishData: MqttDecodePublish?) {
-        if let allSubscriptionsForTopic = subscriptionMap[message.topic] {
-            for eventId in allSubscriptionsForTopic.keys {
-                emitJsiEvent(eventId, ["payload": message.string ?? "", "topic": message.topic, "qos": message.qos.rawValue])
-                print("message ", message.string ?? "")
-            }
+        // Stamped before the payload is copied, on the clock of the core's monotonicNanos().
+        let receivedAt = Int64(clock_gettime_nsec_np(CLOCK_UPTIME_RAW))
+        // The core decompresses the payload (content-encoding) and runs the subscription filters with them. They are
+        // passed as name/value pairs so the bridge keeps repeated names; CocoaMQTT 2.1.5 itself only exposes a
+        // [String: String], which already holds the last value of a repeated name.
+        let userProperties = publishData?.userProperty.map { properties in
+            properties.flatMap { [$0.key, $0.value] }
+        }
+        MqttHelper.traceInterval("MqttHelper.didReceiveMessage") {
+            MqttCoreBridge.clientReceivedMessage(clientId, topic: message.topic, payload: Data(message.payload), qos: Int(message.qos.rawValue), receivedAt: receivedAt, userProperties: userProperties)
         }
     }
 
     func mqtt5(_ mqtt5: CocoaMQTT5, didSubscribeTopics success: NSDictionary, failed: [String], subAckData: MqttDecodeSubAck?) {
         // Handle successful subscriptions
         for (topic, qos) in success {
-            if let topic = topic as? String, let qosValue = qos as? NSNumber, let allSubscriptionsForTopic = subscriptionMap[topic] {
-              for eventId in allSubscriptionsForTopic.keys {
-                emitJsiEvent(eventId + SUBSCRIBE_SUCCESS, ["message": "", "qos": qosValue.intValue, "topic": topic]) // TODO: get actual error message
-              }
+            if let topic = topic as? String, let qosValue = qos as? NSNumber {
+                MqttCoreBridge.clientSubscribed(clientId, topic: topic, qos: qosValue.intValue, message: "") // TODO: get actual error message
             }
         }
-    
+
         // Handle failed subscriptions
         for topic in failed {
-            if let allSubscriptionsForTopic = subscriptionMap[topic] {
-                for eventId in allSubscriptionsForTopic.keys {
-                    emitJsiEvent(eventId + SUBSCRIBE_FAILED, [
-                        "errorMessage": "Failed to subscribe to topic: \(topic)",
-                        "topic": topic,
-                        "reasonCode": SUBSCRIPTION_ERROR
-                    ])
-                }
-            }
+            MqttCoreBridge.clientSubscribeFailed(clientId, topic: topic, reasonCode: SUBSCRIPTION_ERROR, errorMessage: "Failed to subscribe to topic: \(topic)")
         }
     }
 
@@ -191,21 +212,12 @@ extension MqttHelper: CocoaMQTT5Delegate {
     }
 
     func mqtt5DidDisconnect(_ mqtt5: CocoaMQTT5, withError err: Error?) {
-        let reasonCode = DISCONNECTION_ERROR
         var errorMessage = ""
-      
+
         if let error = err {
             errorMessage = error.localizedDescription
         }
-        
-        let params: [String: Any] = [
-            "reasonCode": reasonCode,
-            "errorMessage": errorMessage
-        ]
-        emitJsiEvent(clientId + DISCONNECTED_EVENT, params)
-    }
-}
 
-struct Subscription {
-    var qos: Int
+        MqttCoreBridge.clientDisconnected(clientId, reasonCode: DISCONNECTION_ERROR, errorMessage: errorMessage)
+    }
 }
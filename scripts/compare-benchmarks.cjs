@@ -0,0 +1,107 @@
+/**
+ * Compares Google Benchmark JSON results of the native core against a baseline run.
+ *
+ * Usage: node scripts/compare-benchmarks.cjs <baseline-dir> <current-dir> [threshold]
+ *
+ * Every *.json file of current-dir is matched with the file of the same name in baseline-dir. Prints a markdown
+ * table of the changes in time and in the latency counters (p50_us, p99_us), also appended to the job summary on
+ * GitHub Actions, and emits a warning annotation for every benchmark that got slower by more than threshold (0.15
+ * by default). Shared CI runners are too noisy to fail the build on, so the exit code is always 0.
+ */
+const fs = require('fs');
+const path = require('path');
+
+const LATENCY_COUNTERS = ['p50_us', 'p99_us'];
+
+function readResults(file) {
+  const results = new Map();
+  if (!fs.existsSync(file)) {
+    return results;
+  }
+  const { benchmarks = [] } = JSON.parse(fs.readFileSync(file, 'utf8'));
+  // With --benchmark_repetitions, the median of the repetitions stands for the benchmark.
+  for (const benchmark of benchmarks) {
+    const name = benchmark.run_name ?? benchmark.name;
+    if (benchmark.run_type === 'aggregate') {
+      if (benchmark.aggregate_name === 'median') {
+        results.set(name, benchmark);
+      }
+    } else if (!results.has(name)) {
+      results.set(name, benchmark);
+    }
+  }
+  return results;
+}
+
+function formatValue(value) {
+  return value === undefined ? '-' : Number(value.toPrecision(4)).toString();
+}
+
+function formatChange(before, after) {
+  if (!before) {
+    return 'new';
+  }
+  const change = (after - before) / before;
+  return `${change >= 0 ? '+' : ''}${(change * 100).toFixed(1)}%`;
+}
+
+function main() {
+  const [baselineDir, currentDir, thresholdArg] = process.argv.slice(2);
+  if (!baselineDir || !currentDir) {
+    console.error(
+      'Usage: compare-benchmarks.cjs <baseline-dir> <current-dir> [threshold]'
+    );
+    process.exit(1);
+  }
+  const threshold = Number(thresholdArg ?? 0.15);
+  const rows = [];
+  const regressions = [];
+
+  const files = fs
+    .readdirSync(currentDir)
+    .filter((file) => file.endsWith('.json'))
+    .sort();
+  for (const file of files) {
+    const baseline = readResults(path.join(baselineDir, file));
+    const current = readResults(path.join(currentDir, file));
+    for (const [name, result] of current) {
+      const before = baseline.get(name);
+      const metrics = [['real_time', result.time_unit]];
+      for (const counter of LATENCY_COUNTERS) {
+        if (counter in result) {
+          metrics.push([counter, 'us']);
+        }
+      }
+      for (const [metric, unit] of metrics) {
+        const after = result[metric];
+        const previous = before?.[metric];
+        const change = formatChange(previous, after);
+        rows.push(
+          `| ${name} | ${metric} | ${formatValue(previous)} | ` +
+            `${formatValue(after)} ${unit} | ${change} |`
+        );
+        if (previous && (after - previous) / previous > threshold) {
+          regressions.push(
+            `${name} ${metric}: ${formatValue(previous)} -> ` +
+              `${formatValue(after)} ${unit} (${change})`
+          );
+        }
+      }
+    }
+  }
+
+  const table = [
+    '| Benchmark | Metric | Baseline | Current | Change |',
+    '| --- | --- | --- | --- | --- |',
+    ...rows,
+  ].join('\n');
+  if (process.env.GITHUB_STEP_SUMMARY) {
+    fs.appendFileSync(process.env.GITHUB_STEP_SUMMARY, `${table}\n`);
+  }
+  console.log(table);
+  for (const regression of regressions) {
+    console.log(`::warning title=Benchmark regression::${regression}`);
+  }
+}
+
+main();
@@ -1,10 +1,30 @@
 import { NativeModules, type NativeModule } from 'react-native';
+import type {
+  MqttConnectionState,
+  MqttDeliveryState,
+  MqttFilterCondition,
+  MqttFilterStats,
+  MqttLastValue,
+  MqttMetrics,
+  MqttReconnectPolicy,
+  PublishMqtt,
+} from '../Mqtt/MqttClient.interface';
 
 export const MqttModule: NativeModule & {
   installJSIModule: () => boolean;
 } = NativeModules.MqttModule;
 
 export interface MqttModuleProxy {
+  createNativeMqtt: (
+    clientId: string,
+    host: string,
+    port: number,
+    enableSsl: boolean,
+    outboundStoreMaxBytes: number,
+    shareConnection: boolean,
+    warmStart: boolean
+  ) => void;
+
   removeMqtt: (clientId: string) => void;
   connectMqtt: (
     clientId: string,
@@ -13,21 +33,95 @@ export interface MqttModuleProxy {
       cleanSession: boolean;
       username: string;
       password: string;
+      receiveMaximum?: number;
     }
   ) => void;
 
+  setReconnectPolicy?: (clientId: string, policy: MqttReconnectPolicy) => void;
+
+  setFlowControl?: (
+    clientId: string,
+    flowControl: { highWaterMark: number; dropPolicy: 'oldest' | 'newest' }
+  ) => void;
+
+  getDeliveryState?: (clientId: string) => MqttDeliveryState | undefined;
+
+  addCompressionDictionary?: (
+    clientId: string,
+    dictionary: string | ArrayBuffer
+  ) => void;
+
+  setLastValueCache?: (
+    clientId: string,
+    options: { maxBytes: number; ttlMs: number }
+  ) => void;
+
+  getLastValue?: (
+    clientId: string,
+    topic: string,
+    format: 'string' | 'arraybuffer' | 'json'
+  ) => MqttLastValue<unknown> | undefined;
+
   disconnectMqtt: (clientId: string) => void;
 
   subscribeMqtt: (
     eventId: string,
     clientId: string,
     topic: string,
-    qos: 0 | 1 | 2
+    qos: 0 | 1 | 2,
+    replayLastValue?: boolean,
+    filter?: MqttFilterCondition[]
   ) => void;
 
+  getFilterStats?: (
+    clientId: string,
+    eventId: string
+  ) => MqttFilterStats | undefined;
+
   unsubscribeMqtt: (eventId: string, clientId: string, topic: string) => void;
 
   getConnectionStatusMqtt: (clientId: string) => string;
+
+  getConnectionStateMqtt?: (clientId: string) => MqttConnectionState | undefined;
+
+  publishMqtt: (
+    clientId: string,
+    topic: string,
+    payload: string | ArrayBuffer,
+    qos: 0 | 1 | 2,
+    retain: boolean
+  ) => void;
+
+  publishManyMqtt?: (clientId: string, messages: PublishMqtt[]) => void;
+
+  getMetrics?: (clientId: string) => MqttMetrics | undefined;
+
+  addEventListener: (eventId: string, listener: (event: any) => void) => void;
+
+  removeEventListener: (eventId: string) => void;
+
+  setEventBatching: (
+    eventId: string,
+    maxBatchSize: number,
+    maxDelayMs: number
+  ) => void;
+
+  setPayloadFormat: (
+    eventId: string,
+    format: 'string' | 'arraybuffer' | 'json'
+  ) => void;
+
+  setConflation: (eventId: string, enabled: boolean) => void;
+
+  getDroppedMessageCount: (eventId: string) => number;
+
+  setBackgroundHandler?: (
+    eventId: string,
+    handlerSource: string,
+    format: 'string' | 'arraybuffer' | 'json'
+  ) => boolean;
+
+  removeBackgroundHandler?: (eventId: string) => void;
 }
 
 declare global {
@@ -1,5 +1,53 @@
 import { NativeEventEmitter } from 'react-native';
-import { MqttModule } from '../Modules/mqttModule';
+import { MqttJSIModule, MqttModule } from '../Modules/mqttModule';
+
+type Listener = (event: any) => void;
+
+/**
+ * Event emitter backed by the native JSI dispatcher.
+ * Native code invokes one registered function per event id directly on the JS thread, so events skip the
+ * bridge queue and WritableMap/NSDictionary serialization. Multiple JS listeners for the same event id are
+ * fanned out here, and the native registration is dropped once the last listener is removed.
+ */
+export class JSIEventEmitter {
+  private listeners = new Map<string, Set<Listener>>();
+
+  addListener<T>(eventType: string, listener: (event: T) => void) {
+    let eventListeners = this.listeners.get(eventType);
+    if (!eventListeners) {
+      const registered = new Set<Listener>();
+      eventListeners = registered;
+      this.listeners.set(eventType, registered);
+      MqttJSIModule.addEventListener(eventType, (event: T) => {
+        Array.from(registered).forEach((callback) => callback(event));
+      });
+    }
+    eventListeners.add(listener);
+    return {
+      remove: () => this.removeListener(eventType, listener),
+    };
+  }
+
+  removeAllListeners(eventType: string) {
+    if (this.listeners.delete(eventType)) {
+      MqttJSIModule.removeEventListener(eventType);
+    }
+  }
+
+  listenerCount(eventType: string) {
+    return this.listeners.get(eventType)?.size ?? 0;
+  }
+
+  private removeListener(eventType: string, listener: Listener) {
+    const eventListeners = this.listeners.get(eventType);
+    if (!eventListeners?.delete(listener)) {
+      return;
+    }
+    if (eventListeners.size === 0) {
+      this.removeAllListeners(eventType);
+    }
+  }
+}
 
 /**
  * This function encapsulates the creation and management of a singleton event emitter instance.
@@ -9,7 +57,10 @@ import { MqttModule } from '../Modules/mqttModule';
 export const EventEmitter = (function () {
   var instance: EventEmitter;
 
-  function createInstance() {
+  function createInstance(): EventEmitter {
+    if (typeof MqttJSIModule?.addEventListener === 'function') {
+      return new JSIEventEmitter();
+    }
     return new NativeEventEmitter(MqttModule);
   }
 
@@ -17,6 +68,7 @@ export const EventEmitter = (function () {
     /**
      * Method to get the singleton instance of the event emitter.
      * If the instance doesn't exist yet, it creates a new one using createInstance().
+     * The JSI backed emitter is used when the native dispatcher is installed, otherwise NativeEventEmitter.
      * @returns The singleton instance of the event emitter.
      */
     getInstance: function () {
@@ -30,20 +82,24 @@ export const EventEmitter = (function () {
 
 /**
  * This type definition represents a custom event emitter.
- * It extends the functionality of the NativeEventEmitter class by omitting the 'addListener' method
- * and replacing it with a modified version to match specific requirements.
+ * It is implemented either by the JSI backed emitter or by NativeEventEmitter.
  */
-export type EventEmitter = Omit<NativeEventEmitter, 'addListener'> & {
+export type EventEmitter = {
   /**
    * The 'addListener' method is overridden with a modified signature.
    * @param eventType The type of event to listen for.
    * @param listener A callback function to be invoked when the event occurs.
    * @param context An optional context for the listener.
-   * @returns An EmitterSubscription representing the subscription to the event.
+   * @returns A subscription with a remove method to stop listening to the event.
    */
   addListener: <T>(
     eventType: string,
     listener: (event: T) => void,
     context?: NonNullable<unknown>
-  ) => ReturnType<NativeEventEmitter['addListener']>;
+  ) => { remove: () => void };
+  /**
+   * Removes every listener registered for the given event type.
+   * @param eventType The type of event to stop listening to.
+   */
+  removeAllListeners: (eventType: string) => void;
 };
@@ -12,6 +12,10 @@ export enum MQTT_EVENTS {
   SUBSCRIPTION_FAILED_EVENT = 'subscribe_failed',
   CLIENT_INITIALIZE_EVENT = 'client_initialize',
   ERROR_EVENT = 'mqtt_error',
+  CONNECTION_STATE_EVENT = 'connection_state',
+  CREDENTIALS_REQUIRED_EVENT = 'credentials_required',
+  BACKGROUND_RESULT_EVENT = 'background_result',
+  BACKGROUND_ERROR_EVENT = 'background_error',
 }
 
 // This is not exclusive yet. Add all reasonCodes if you have patience
@@ -27,6 +31,28 @@ export enum Mqtt5ReasonCode {
   UNSUBSCRIPTION_ERROR = -5,
   INITIALIZATION_ERROR = -6,
   RX_CHAIN_ERROR = -7,
+  PUBLISH_ERROR = -8,
+  DECOMPRESSION_ERROR = -9,
+}
+
+/**
+ * Backend that speaks MQTT on the device. PLATFORM uses HiveMQ (Android) / CocoaMQTT (iOS), NATIVE the C++
+ * engine shared by both platforms (plain TCP only, no TLS).
+ */
+export enum MqttEngine {
+  PLATFORM = 'platform',
+  NATIVE = 'native',
+}
+
+/**
+ * How received payloads reach JS. STRING decodes them as UTF-8, ARRAY_BUFFER hands over the received bytes as is,
+ * for binary formats such as protobuf or CBOR. JSON parses them natively, off the JS thread, into a read-only
+ * object whose fields are converted on access; payloads that are not valid JSON arrive as strings.
+ */
+export enum MqttPayloadFormat {
+  STRING = 'string',
+  ARRAY_BUFFER = 'arraybuffer',
+  JSON = 'json',
 }
 
 export enum MqttQos {
@@ -41,5 +67,15 @@ export enum MqttErrorType {
   SUBSCRIPTION = 'SUBSCRIPTION',
   UNSUBSCRIPTION = 'UNSUBSCRIPTION',
   DISCONNECTION = 'DISCONNECTION',
+  PUBLISH = 'PUBLISH',
+  DECOMPRESSION = 'DECOMPRESSION',
   GENERAL = 'GENERAL',
 }
+
+export const DEFAULT_MAX_BATCH_SIZE = 100;
+
+export const DEFAULT_MAX_BATCH_DELAY_MS = 16;
+
+export const DEFAULT_OUTBOUND_STORE_MAX_BYTES = 4 * 1024 * 1024;
+
+export const DEFAULT_LAST_VALUE_CACHE_MAX_BYTES = 1024 * 1024;
@@ -1,7 +1,10 @@
 import {
+  CONNECTION_STATE,
   Mqtt5ReasonCode,
   MQTT_EVENTS,
+  MqttEngine,
   MqttErrorType,
+  MqttPayloadFormat,
   MqttQos,
 } from './MqttClient.constants';
 
@@ -14,6 +17,76 @@ export type MqttConnect = {
   backoffTime?: number;
   jitter?: number;
   enableSslConfig?: boolean;
+  engine?: MqttEngine;
+  /*
+   * persistence, shareConnection and warmStart are options of the native engine, which has no TLS: they are ignored
+   * (with a warning) by the platform engine, so they cannot apply to a client with enableSslConfig.
+   */
+  /** Native engine only: keep outgoing QoS 1/2 messages on disk until acknowledged. */
+  persistence?: MqttPersistenceOptions;
+  /**
+   * Native engine only: clients created with it share one connection per host, port and credentials, with their
+   * subscriptions and events kept apart.
+   */
+  shareConnection?: boolean;
+  /**
+   * Native engine only: record the last successful connect and subscriptions, so that at the next launch the client
+   * connects natively before the JS bundle has loaded and holds what it receives until JS subscribes. The app starts
+   * the recorded clients with MqttWarmStart.start (Android) or [MqttModule warmStart] (iOS). The username and
+   * password are not recorded: the app passes them to the warm start, or the client is left to JS.
+   */
+  warmStart?: boolean;
+  /** Bounds the received messages waiting for JS, see MqttFlowControlOptions. */
+  flowControl?: MqttFlowControlOptions;
+  /** Keep the last received payload of every topic on disk, see MqttLastValueCacheOptions. */
+  lastValueCache?: MqttLastValueCacheOptions;
+};
+
+export type MqttPersistenceOptions = {
+  /** Disk space of the outbound store, 4 MiB by default. */
+  maxBytes?: number;
+};
+
+/**
+ * Disk-backed cache of the last payload received on every topic, read with MqttClient.getLastValue or replayed into
+ * a new subscription with replayLastValue, so a screen can render before the broker sends anything. It outlives the
+ * app process. Least recently used topics are evicted beyond maxBytes.
+ */
+export type MqttLastValueCacheOptions = {
+  /** Disk space of the cache, 1 MiB by default. */
+  maxBytes?: number;
+  /** Values older than this are not served; 0 (the default) keeps them until evicted. */
+  ttlMs?: number;
+};
+
+/**
+ * Backpressure of received messages. Once highWaterMark messages wait for JS, QoS 0 messages are dropped as
+ * dropPolicy says; QoS 1/2 messages are kept and acknowledged only once delivered, so the broker stops sending
+ * after receiveMaximum unacknowledged ones.
+ */
+export type MqttFlowControlOptions = {
+  /** Received messages that may wait for JS; 0 (the default) disables flow control. */
+  highWaterMark?: number;
+  /** 'oldest' (default) replaces the oldest waiting QoS 0 message, 'newest' drops the received one. */
+  dropPolicy?: 'oldest' | 'newest';
+  /** Receive Maximum announced to the broker, between 1 and 65535. */
+  receiveMaximum?: number;
+};
+
+/**
+ * State of the flow control of one client, see MqttClient.getDeliveryState.
+ */
+export type MqttDeliveryState = {
+  highWaterMark: number;
+  dropPolicy: 'oldest' | 'newest';
+  /** Received messages waiting in the native core. */
+  queued: number;
+  /** Messages handed to the JS thread and not yet delivered to every listener. */
+  inFlight: number;
+  /** QoS 1/2 messages of both whose acknowledgement is held back. */
+  unacknowledged: number;
+  /** QoS 0 messages dropped since the client was created. */
+  dropped: number;
 };
 
 export type MqttReconnect = {
@@ -23,6 +96,18 @@ export type MqttReconnect = {
 
 export type MqttOptions = MqttConnect & MqttReconnect;
 
+/**
+ * Automatic reconnect run by the native core, see setReconnectPolicy.
+ */
+export type MqttReconnectPolicy = {
+  enabled: boolean;
+  maxRetries: number;
+  backoffMs: number;
+  maxBackoffMs: number;
+  jitterMs: number;
+  refreshCredentials: boolean;
+};
+
 export type MqttConfig = {
   clientId: string;
   host: string;
@@ -69,14 +154,120 @@ export interface MqttEventsInterface {
     clientUnsubscribed: boolean;
     errorType: MqttErrorType;
   };
+  [MQTT_EVENTS.CONNECTION_STATE_EVENT]: MqttConnectionState;
+  [MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT]: {
+    reasonCode: Mqtt5ReasonCode;
+    retryCount: number;
+  };
+  [MQTT_EVENTS.BACKGROUND_RESULT_EVENT]: unknown;
+  [MQTT_EVENTS.BACKGROUND_ERROR_EVENT]: {
+    errorMessage: string;
+  };
 }
 
-export type SubscribeMqtt = {
+/**
+ * Connection state kept by the native core. The object returned by getConnectionState() is live: every property
+ * read returns the current value.
+ */
+export type MqttConnectionState = {
+  readonly state: CONNECTION_STATE;
+  /** Reason code of the last connect, connection failure or disconnect. */
+  readonly lastReasonCode: Mqtt5ReasonCode | number;
+  /** Failed connection attempts since the last successful connect. */
+  readonly retryCount: number;
+  /** Milliseconds since the Unix epoch of the last successful connect, 0 if never connected. */
+  readonly lastConnectedAt: number;
+};
+
+/**
+ * Distribution of a latency or size, from a log-linear histogram: percentiles are within 1/16 of the recorded values.
+ */
+export type MqttHistogram = {
+  count: number;
+  min: number;
+  max: number;
+  mean: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  p999: number;
+};
+
+export type MqttTopicMetrics = {
+  messages: number;
+  bytes: number;
+  /** Rate over the time since the previous getMetrics() call. */
+  messagesPerSecond: number;
+};
+
+/**
+ * Snapshot of the native counters of one client, see MqttClient.getMetrics.
+ */
+export type MqttMetrics = {
+  messagesIn: number;
+  bytesIn: number;
+  messagesOut: number;
+  bytesOut: number;
+  reconnects: number;
+  /** Handover of a received message from the platform client to the native core. */
+  conversionTimeNs: MqttHistogram;
+  /** From an unexpected connection loss to the next successful connect. */
+  reconnectDurationMs: MqttHistogram;
+  /** Received messages per exact topic, for the first 256 topics. */
+  topics: Record<string, MqttTopicMetrics>;
+  /** Received messages of the topics beyond the first 256. */
+  otherTopics: MqttTopicMetrics;
+  /** Milliseconds from the native library being loaded, see MqttOptions.warmStart. */
+  startup: {
+    /** Whether the client was started natively at launch. */
+    warmStart: boolean;
+    /** JS created the client. */
+    jsAttachedMs?: number;
+    /** First successful connect. */
+    connectedMs?: number;
+    /** First received message. */
+    firstMessageMs?: number;
+  };
+  /** Delivery to JS, shared by all clients. */
+  dispatcher?: {
+    /** From a message being received to its listener being called. */
+    dispatchLatencyUs: MqttHistogram;
+    /** Messages delivered per pass of the JS thread. */
+    queueDepth: MqttHistogram;
+    flushDurationUs: MqttHistogram;
+  };
+};
+
+/**
+ * A received message. The payload is an ArrayBuffer when subscribed with payloadFormat ARRAY_BUFFER and the parsed
+ * value with payloadFormat JSON.
+ */
+export type MqttMessage<Payload = string> = Omit<
+  MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_EVENT],
+  'payload'
+> & {
+  payload: Payload;
+};
+
+export type MqttBatchOptions = {
+  maxBatchSize?: number;
+  maxDelayMs?: number;
+};
+
+export type SubscribeMqtt<Payload = string> = {
   topic: string;
   qos?: MqttQos;
-  onEvent: (
-    payload: MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_EVENT]
-  ) => void;
+  /** ARRAY_BUFFER delivers payloads as ArrayBuffer (SubscribeMqtt<ArrayBuffer>), JSON as parsed values. */
+  payloadFormat?: MqttPayloadFormat;
+  onEvent: (payload: MqttMessage<Payload>) => void;
+  batch?: MqttBatchOptions;
+  onBatch?: (messages: MqttMessage<Payload>[]) => void;
+  /** Keep only the latest undelivered message per topic while the JS thread is busy. */
+  conflate?: boolean;
+  /** Deliver the cached last values of the matching topics right away, see MqttConnect.lastValueCache. */
+  replayLastValue?: boolean;
+  /** Conditions evaluated natively that every delivered message must meet, see MqttFilterCondition. */
+  filter?: MqttFilterCondition[];
   onSuccess?: (
     ack: MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_SUCCESS_EVENT]
   ) => void;
@@ -85,6 +276,87 @@ export type SubscribeMqtt = {
   ) => void;
 };
 
+/**
+ * A value a filter condition compares with.
+ */
+export type MqttFilterOperand = string | number | boolean | null;
+
+/**
+ * One condition of a subscription filter. It names a value of the message, a topic level (negative indexes count
+ * from the last level), an MQTT 5 user property or a member of a JSON object payload, and tests it with every
+ * operator it sets. Topic levels and user properties compare with numbers as the number they spell. ne and notIn
+ * hold for a missing value; increases holds for a number greater than that of the last delivered message of the
+ * same topic.
+ */
+export type MqttFilterCondition = (
+  | { topicSegment: number }
+  | { userProperty: string }
+  | { jsonField: string }
+) & {
+  exists?: boolean;
+  eq?: MqttFilterOperand;
+  ne?: MqttFilterOperand;
+  in?: MqttFilterOperand[];
+  notIn?: MqttFilterOperand[];
+  lt?: number;
+  lte?: number;
+  gt?: number;
+  gte?: number;
+  increases?: boolean;
+};
+
+/**
+ * Counters of a subscription filter, see the getFilterStats method of a subscription.
+ */
+export type MqttFilterStats = {
+  /** Messages delivered to the subscription. */
+  passed: number;
+  /** Messages dropped natively, before reaching JS. */
+  dropped: number;
+};
+
+/**
+ * A subscription handled on the library's background JS runtime, see MqttClient.subscribeInBackground.
+ */
+export type SubscribeInBackgroundMqtt<Result = unknown> = {
+  topic: string;
+  qos?: MqttQos;
+  /** Format of message.payload in the handler. */
+  payloadFormat?: MqttPayloadFormat;
+  /**
+   * Source of a function `(message, post) => result`, evaluated on the background runtime. It cannot capture
+   * anything from the UI runtime.
+   */
+  handler: string;
+  /** Called on the UI JS thread with what the handler returned (unless undefined) or passed to post. */
+  onResult: (result: Result) => void;
+  /** The handler failed to evaluate or threw, or there is no background runtime (JSC). */
+  onError?: (
+    error: MqttEventsInterface[MQTT_EVENTS.BACKGROUND_ERROR_EVENT]
+  ) => void;
+  onSuccess?: (
+    ack: MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_SUCCESS_EVENT]
+  ) => void;
+  onSubscribeError?: (
+    error: MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_FAILED_EVENT]
+  ) => void;
+};
+
+/**
+ * A value of the last value cache, see MqttClient.getLastValue.
+ */
+export type MqttLastValue<Payload = string> = MqttMessage<Payload> & {
+  /** Milliseconds since the Unix epoch when the value was received. */
+  receivedAt: number;
+};
+
+export type PublishMqtt = {
+  topic: string;
+  payload: string | ArrayBuffer;
+  qos?: MqttQos;
+  retain?: boolean;
+};
+
 export type DisconnectCallback = {
   mqtt5ReasonCode: Mqtt5ReasonCode;
   options: MqttConnect & {
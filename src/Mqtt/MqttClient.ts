@@ -1,14 +1,31 @@
 import {
   CONNECTION_STATE,
+  DEFAULT_MAX_BATCH_DELAY_MS,
+  DEFAULT_LAST_VALUE_CACHE_MAX_BYTES,
+  DEFAULT_MAX_BATCH_SIZE,
+  DEFAULT_OUTBOUND_STORE_MAX_BYTES,
   MQTT_EVENTS,
   Mqtt5ReasonCode,
+  MqttEngine,
+  MqttPayloadFormat,
   MqttQos,
 } from './MqttClient.constants';
 import type {
   DisconnectCallback,
+  MqttBatchOptions,
   MqttConnect,
+  MqttConnectionState,
+  MqttDeliveryState,
   MqttEventsInterface,
+  MqttFilterStats,
+  MqttLastValue,
+  MqttLastValueCacheOptions,
+  MqttMessage,
+  MqttMetrics,
   MqttOptions,
+  MqttPersistenceOptions,
+  PublishMqtt,
+  SubscribeInBackgroundMqtt,
   SubscribeMqtt,
 } from './MqttClient.interface';
 import { EventEmitter } from './EventEmitter';
@@ -34,6 +51,10 @@ export class MqttClient {
 
   private connectionStatus = CONNECTION_STATE.DISCONNECTED;
 
+  private nativeConnectionState?: MqttConnectionState;
+
+  private nativeReconnect = false;
+
   private onReconnectIntercepter?: (
     mqtt5ReasonCode?: Mqtt5ReasonCode
   ) => Promise<MqttConnect | undefined>;
@@ -56,7 +77,17 @@ export class MqttClient {
       return;
     }
 
-    this.createClient(clientId, host, port, options?.enableSslConfig ?? false);
+    this.createClient(
+      clientId,
+      host,
+      port,
+      options?.enableSslConfig ?? false,
+      options?.engine ?? MqttEngine.PLATFORM,
+      options?.persistence,
+      options?.shareConnection ?? false,
+      options?.warmStart ?? false,
+      options?.lastValueCache
+    );
 
     this.setOnConnectCallback(
       (ack: MqttEventsInterface[MQTT_EVENTS.CONNECTED_EVENT]) => {
@@ -78,9 +109,34 @@ export class MqttClient {
      *          checks the current connection status, and attempts to reconnect if previously connected.
      *          retrieves new connection options (like a new authentication token) using the onReconnectIntercepter callback,
      *          and calls the connect method with the updated options. Finally, it updates the disconnect reason code.
+     *          When the native module supports it, the native core runs the reconnects instead (see connection()).
      */
 
-    if (options?.autoReconnect) {
+    this.nativeReconnect =
+      !!options?.autoReconnect &&
+      typeof MqttJSIModule.setReconnectPolicy === 'function';
+
+    if (this.nativeReconnect) {
+      /**
+       * The native core reconnects by itself with backoff and jitter; JS is only asked for new credentials once the
+       * broker rejected the current ones.
+       */
+      this.eventEmitter.addListener(
+        this.clientId + MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT,
+        async (
+          ack: MqttEventsInterface[MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT]
+        ) => {
+          try {
+            const newOptions = await this.onReconnectIntercepter?.(
+              ack.reasonCode
+            );
+            this.connect(newOptions);
+          } catch (reconnectError) {
+            console.log('Error during credentials refresh:', reconnectError);
+          }
+        }
+      );
+    } else if (options?.autoReconnect) {
       this.onDisconnectInterceptor(async (ack) => {
         console.log(
           `::MQTT Client: disconnected due to reasonCode: ${ack.reasonCode}, where previous disconnected reasonCode: ${this.mqtt5DisconnectReasonCode}. Response: ${ack}`
@@ -112,15 +168,56 @@ export class MqttClient {
    * @param port The port number of the MQTT broker.
    * @param enableSslConfig A boolean indicating whether SSL/TLS configuration should be enabled (default: false).
    *                        If true, the client uses SSL/TLS for secure communication with the MQTT broker.
+   * @param engine The backend speaking MQTT: the platform client (default) or the native C++ engine.
+   * @param persistence Optional outbound store options of the native engine. When set, QoS 1/2 publishes are kept
+   *                    on disk until acknowledged, accepted while disconnected and replayed after reconnecting,
+   *                    including after the app was killed.
+   * @param shareConnection Native engine only: share one connection with the other clients created with it for the
+   *                        same host, port and credentials.
+   * @param warmStart Native engine only: record the session to connect natively at the next launch, and take over
+   *                  the client started natively at this one.
+   * @param lastValueCache Optional last value cache options. When set, the last payload received on every topic is
+   *                       kept on disk for getLastValue and replayLastValue subscriptions.
    */
   async createClient(
     clientId: any,
     host: any,
     port: any,
-    enableSslConfig: any
+    enableSslConfig: any,
+    engine: MqttEngine = MqttEngine.PLATFORM,
+    persistence?: MqttPersistenceOptions,
+    shareConnection: boolean = false,
+    warmStart: boolean = false,
+    lastValueCache?: MqttLastValueCacheOptions
   ) {
     try {
-      await MqttModule.createMqtt(clientId, host, port, enableSslConfig);
+      if (engine === MqttEngine.NATIVE) {
+        MqttJSIModule.createNativeMqtt(
+          clientId,
+          host,
+          port,
+          enableSslConfig,
+          persistence
+            ? persistence.maxBytes ?? DEFAULT_OUTBOUND_STORE_MAX_BYTES
+            : 0,
+          shareConnection,
+          warmStart
+        );
+      } else {
+        if (persistence || shareConnection || warmStart) {
+          console.warn(
+            'persistence, shareConnection and warmStart need engine: native and are ignored by the platform engine'
+          );
+        }
+        await MqttModule.createMqtt(clientId, host, port, enableSslConfig);
+      }
+      if (lastValueCache) {
+        MqttJSIModule.setLastValueCache?.(clientId, {
+          maxBytes:
+            lastValueCache.maxBytes ?? DEFAULT_LAST_VALUE_CACHE_MAX_BYTES,
+          ttlMs: lastValueCache.ttlMs ?? 0,
+        });
+      }
       console.log('MQTT client created successfully');
     } catch (error) {
       console.error('Failed to create MQTT client', error);
@@ -135,6 +232,23 @@ export class MqttClient {
     if (this.connectionStatus !== CONNECTION_STATE.CONNECTING) {
       return;
     }
+    if (this.nativeReconnect) {
+      MqttJSIModule.setReconnectPolicy?.(this.clientId, {
+        enabled: true,
+        maxRetries: this.options?.retryCount || 0,
+        backoffMs: this.options?.backoffTime ?? 2000,
+        maxBackoffMs: (this.options?.maxBackoffTime ?? 60) * 1000,
+        jitterMs: this.options?.jitter ?? 1,
+        refreshCredentials: true,
+      });
+    }
+    const flowControl = this.options?.flowControl;
+    if (flowControl) {
+      MqttJSIModule.setFlowControl?.(this.clientId, {
+        highWaterMark: flowControl.highWaterMark ?? 0,
+        dropPolicy: flowControl.dropPolicy ?? 'oldest',
+      });
+    }
     /**
      * Function call to initiate a connection to the MQTT broker using the native module.
      * It provides connection parameters such as client ID, keep-alive interval, username, password, and clean session flag.
@@ -146,17 +260,22 @@ export class MqttClient {
      *                - password: The password for authenticating with the MQTT broker (default: '').
      *                - cleanSession: A boolean indicating whether to start a clean session (default: true).
      *                                If true, the broker discards any previous session state.
+     *                - receiveMaximum: The Receive Maximum announced to the broker, from flowControl (optional).
      */
     MqttJSIModule.connectMqtt(this.clientId, {
       keepAlive: this.options?.keepAlive || 60,
       username: this.options?.username || '',
       password: this.options?.password || '',
-      cleanSession: this.options?.cleanSession || true,
+      cleanSession: this.options?.cleanSession ?? true,
+      ...(flowControl?.receiveMaximum !== undefined && {
+        receiveMaximum: flowControl.receiveMaximum,
+      }),
     });
 
     clearTimeout(this.retryTimer);
 
     const shouldRetry =
+      !this.nativeReconnect &&
       this?.options?.autoReconnect &&
       this.currentRetryCount < (this.options?.retryCount || 0);
 
@@ -221,6 +340,17 @@ export class MqttClient {
       remove: listener.remove,
     };
   }
+  /**
+   * Whether automatic reconnect gave up. The native core counts failed attempts and stops once they exceed
+   * retryCount; the JS fallback stops after retryCount scheduled retries.
+   */
+  private hasReachedMaxRetries() {
+    if (this.nativeReconnect) {
+      return this.getCurrentRetryCount() > (this.options?.retryCount || 0);
+    }
+    return this.currentRetryCount === this.options?.retryCount;
+  }
+
   /**
    * Private method to reset connection-related variables when initiating a connection attempt.
    * It sets the current retry count to zero and updates the connection status to 'connecting'.
@@ -290,26 +420,72 @@ export class MqttClient {
 
   /**
    * Method to subscribe to an MQTT topic with the specified Quality of Service (QoS).
+   * When batch options are passed, the native layer buffers received messages and delivers them in one JS call
+   * once maxBatchSize messages are pending or maxDelayMs passed since the first one, whichever comes first.
    * @param topic The MQTT topic to subscribe to.
    * @param qos The Quality of Service level for the subscription (default is QoS 1).
+   * @param payloadFormat Optional format of received payloads: 'string' (default, UTF-8 decoded), 'arraybuffer'
+   *                      (the received bytes, without any transcoding) or 'json' (parsed natively off the JS thread,
+   *                      fields converted on access).
    * @param onEvent Callback function to handle incoming messages for the subscribed topic.
+   * @param batch Optional batching options, maxBatchSize (default 100) and maxDelayMs (default 16).
+   * @param onBatch Optional callback receiving each batch as an array; without it onEvent is called per message.
+   * @param conflate Optional last-value mode: while the JS thread is busy, the native layer keeps only the latest
+   *                 message per exact topic and drops the older ones instead of queueing them.
+   * @param replayLastValue Optional, delivers the cached last values of the matching topics right away.
+   * @param filter Optional conditions every delivered message must meet, evaluated natively so that the messages
+   *               they drop never reach JS. Throws when they are malformed.
    * @param onSuccess Optional callback function to handle subscription success event.
    * @param onError Optional callback function to handle subscription failure event.
-   * @returns An object with a remove method to unsubscribe from the topic.
+   * @returns An object with a remove method to unsubscribe from the topic, getDroppedMessageCount, the number of
+   *          messages dropped by conflation so far, and getFilterStats, the messages the filter passed and dropped.
    */
-  subscribe({
+  subscribe<Payload = string>({
     topic,
     qos = 1,
+    payloadFormat,
     onEvent,
+    batch,
+    onBatch,
+    conflate = false,
+    replayLastValue = false,
+    filter,
     onSuccess = () => {},
     onError = () => {},
-  }: SubscribeMqtt) {
+  }: SubscribeMqtt<Payload>) {
     const eventId = this.getMqttSubscribeEventId(topic, qos);
-    MqttJSIModule.subscribeMqtt(eventId, this.clientId, topic, qos);
 
-    const listener = this.eventEmitter.addListener<
-      MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_EVENT]
-    >(eventId, onEvent);
+    if (payloadFormat && payloadFormat !== MqttPayloadFormat.STRING) {
+      // Set before the listener exists so no message is delivered as a string.
+      MqttJSIModule.setPayloadFormat?.(eventId, payloadFormat);
+    }
+
+    if (conflate) {
+      MqttJSIModule.setConflation?.(eventId, true);
+    }
+
+    const listener = batch
+      ? this.addBatchListener(
+          eventId,
+          batch,
+          onBatch ?? ((messages) => messages.forEach(onEvent))
+        )
+      : this.eventEmitter.addListener<MqttMessage<Payload>>(eventId, onEvent);
+
+    try {
+      MqttJSIModule.subscribeMqtt(
+        eventId,
+        this.clientId,
+        topic,
+        qos,
+        replayLastValue,
+        filter
+      );
+    } catch (error) {
+      // A malformed filter; nothing was subscribed.
+      listener.remove();
+      throw error;
+    }
 
     const success = this.eventEmitter.addListener<
       MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_SUCCESS_EVENT]
@@ -326,9 +502,147 @@ export class MqttClient {
         failed.remove();
         MqttJSIModule.unsubscribeMqtt(eventId, this.clientId, topic);
       },
+      getDroppedMessageCount: (): number =>
+        MqttJSIModule.getDroppedMessageCount?.(eventId) ?? 0,
+      getFilterStats: (): MqttFilterStats | undefined =>
+        MqttJSIModule.getFilterStats?.(this.clientId, eventId),
+    };
+  }
+
+  /**
+   * Method to subscribe to an MQTT topic with a handler that runs on the library's background JS runtime (a Hermes
+   * runtime on a native thread of its own) instead of the UI JS thread. The handler parses, filters or aggregates
+   * the messages there and only what it returns or posts reaches onResult, so heavy topics do not cost frames.
+   * Inside it, global.__MqttModuleProxy offers the same client functions as on the UI runtime, and setTimeout and
+   * clearTimeout are available for aggregating over time.
+   * @param topic The MQTT topic to subscribe to.
+   * @param qos The Quality of Service level for the subscription (default is QoS 1).
+   * @param payloadFormat Optional format of message.payload in the handler, as for subscribe.
+   * @param handler Source of a function `(message, post) => result`, e.g. a template literal. It is evaluated on the
+   *                background runtime, so it cannot use variables of the UI runtime.
+   * @param onResult Callback receiving each result: what the handler returned, unless undefined, or passed to post.
+   * @param onError Optional callback for a handler that failed to evaluate or threw, and for apps without Hermes,
+   *                which have no background runtime; no messages are delivered then.
+   * @param onSuccess Optional callback function to handle subscription success event.
+   * @param onSubscribeError Optional callback function to handle subscription failure event.
+   * @returns An object with a remove method to unsubscribe from the topic.
+   */
+  subscribeInBackground<Result = unknown>({
+    topic,
+    qos = 1,
+    payloadFormat = MqttPayloadFormat.STRING,
+    handler,
+    onResult,
+    onError = () => {},
+    onSuccess = () => {},
+    onSubscribeError = () => {},
+  }: SubscribeInBackgroundMqtt<Result>) {
+    const eventId = this.getMqttSubscribeEventId(topic, qos);
+
+    const result = this.eventEmitter.addListener<Result>(
+      eventId + MQTT_EVENTS.BACKGROUND_RESULT_EVENT,
+      onResult
+    );
+    const error = this.eventEmitter.addListener<
+      MqttEventsInterface[MQTT_EVENTS.BACKGROUND_ERROR_EVENT]
+    >(eventId + MQTT_EVENTS.BACKGROUND_ERROR_EVENT, onError);
+
+    // Registered before subscribing so no message of the subscription goes to the UI runtime.
+    if (
+      !MqttJSIModule.setBackgroundHandler?.(eventId, handler, payloadFormat)
+    ) {
+      result.remove();
+      error.remove();
+      onError({ errorMessage: 'No background JS runtime available' });
+      return { remove: () => {} };
+    }
+
+    MqttJSIModule.subscribeMqtt(eventId, this.clientId, topic, qos);
+
+    const success = this.eventEmitter.addListener<
+      MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_SUCCESS_EVENT]
+    >(eventId + MQTT_EVENTS.SUBSCRIPTION_SUCCESS_EVENT, onSuccess);
+
+    const failed = this.eventEmitter.addListener<
+      MqttEventsInterface[MQTT_EVENTS.SUBSCRIPTION_FAILED_EVENT]
+    >(eventId + MQTT_EVENTS.SUBSCRIPTION_FAILED_EVENT, onSubscribeError);
+
+    return {
+      remove: () => {
+        MqttJSIModule.unsubscribeMqtt(eventId, this.clientId, topic);
+        MqttJSIModule.removeBackgroundHandler?.(eventId);
+        result.remove();
+        error.remove();
+        success.remove();
+        failed.remove();
+      },
     };
   }
 
+  /**
+   * Registers a listener that receives batched messages for a subscription.
+   * Batching is configured natively before the subscription is made so no message is delivered unbatched.
+   * When the JSI dispatcher is not available, each message is delivered as a batch of one.
+   * @param eventId The subscription event identifier.
+   * @param batch Batching options.
+   * @param onBatch Callback receiving the batched messages.
+   */
+  private addBatchListener<Payload>(
+    eventId: string,
+    batch: MqttBatchOptions,
+    onBatch: (messages: MqttMessage<Payload>[]) => void
+  ) {
+    if (typeof MqttJSIModule.setEventBatching !== 'function') {
+      return this.eventEmitter.addListener<MqttMessage<Payload>>(
+        eventId,
+        (message) => onBatch([message])
+      );
+    }
+    const listener = this.eventEmitter.addListener<MqttMessage<Payload>[]>(
+      eventId,
+      onBatch
+    );
+    MqttJSIModule.setEventBatching(
+      eventId,
+      batch.maxBatchSize ?? DEFAULT_MAX_BATCH_SIZE,
+      batch.maxDelayMs ?? DEFAULT_MAX_BATCH_DELAY_MS
+    );
+    return listener;
+  }
+
+  /**
+   * Method to publish a message on an MQTT topic.
+   * ArrayBuffer payloads are handed to the native client as raw bytes, without any string conversion.
+   * Publish failures are reported through the error callback with errorType 'PUBLISH'.
+   * @param topic The MQTT topic to publish to.
+   * @param payload The message payload, either a string (sent as UTF-8) or an ArrayBuffer.
+   * @param qos The Quality of Service level for the message (default is QoS 0).
+   * @param retain Whether the broker should retain the message (default is false).
+   */
+  publish({
+    topic,
+    payload,
+    qos = MqttQos.AT_MOST_ONCE,
+    retain = false,
+  }: PublishMqtt) {
+    MqttJSIModule.publishMqtt(this.clientId, topic, payload, qos, retain);
+  }
+
+  /**
+   * Method to publish several messages with a single call into native code, for high rate telemetry.
+   * Like publish, it returns without waiting for the network; failures are reported through the error callback.
+   * The native engine writes the whole batch to the socket at once and, when the broker allows topic aliases,
+   * replaces topics it has already sent on the connection with a 2 byte alias.
+   * @param messages The messages to publish, with the same fields as for publish.
+   */
+  publishMany(messages: PublishMqtt[]) {
+    if (MqttJSIModule.publishManyMqtt) {
+      MqttJSIModule.publishManyMqtt(this.clientId, messages);
+      return;
+    }
+    messages.forEach((message) => this.publish(message));
+  }
+
   /**
    * Method to disconnect the MQTT client from the broker.
    * It updates the connection status to 'disconnected' and triggers disconnection using the native module.
@@ -360,6 +674,16 @@ export class MqttClient {
     this.eventEmitter.removeAllListeners(
       this.clientId + MQTT_EVENTS.ERROR_EVENT
     );
+
+    this.eventEmitter.removeAllListeners(
+      this.clientId + MQTT_EVENTS.CONNECTION_STATE_EVENT
+    );
+    if (this.nativeReconnect) {
+      this.eventEmitter.removeAllListeners(
+        this.clientId + MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT
+      );
+    }
+    this.nativeConnectionState = undefined;
   }
 
   /**
@@ -410,13 +734,12 @@ export class MqttClient {
       if (this.getConnectionStatus() !== CONNECTION_STATE.CONNECTING) {
         callback(ack, {
           ...this.options,
-          disconnectType:
-            this.currentRetryCount === this.options?.retryCount
-              ? 'maxRetriesReached'
-              : this.connectionStatus !== CONNECTION_STATE.CONNECTING
-              ? 'forceDisconnected'
-              : 'retrying',
-          retryCount: this.currentRetryCount,
+          disconnectType: this.hasReachedMaxRetries()
+            ? 'maxRetriesReached'
+            : this.connectionStatus !== CONNECTION_STATE.CONNECTING
+            ? 'forceDisconnected'
+            : 'retrying',
+          retryCount: this.getCurrentRetryCount(),
         });
       }
     });
@@ -483,16 +806,102 @@ export class MqttClient {
    *          - 'disconnected': Indicates that the client is not currently connected to the MQTT broker.
    */
   getConnectionStatus() {
-    return MqttJSIModule.getConnectionStatusMqtt(this.clientId);
+    return (
+      this.getConnectionState()?.state ??
+      MqttJSIModule.getConnectionStatusMqtt(this.clientId)
+    );
+  }
+
+  /**
+   * Method to retrieve the live connection state kept by the native core.
+   * The returned object is backed by native atomics: reading its properties returns the current values without a
+   * call into the platform, so it can be kept and polled cheaply.
+   * @returns The connection state (state, lastReasonCode, retryCount, lastConnectedAt), or undefined when the
+   *          native client does not exist yet.
+   */
+  getConnectionState(): MqttConnectionState | undefined {
+    if (!this.nativeConnectionState) {
+      this.nativeConnectionState = MqttJSIModule.getConnectionStateMqtt?.(
+        this.clientId
+      );
+    }
+    return this.nativeConnectionState;
+  }
+
+  /**
+   * Method to set a callback for connection state transitions (connecting, connected, disconnected).
+   * @param callback Callback function receiving a snapshot of the connection state after each transition.
+   * @returns An object with a remove method to remove the listener.
+   */
+  setOnConnectionStateChange(
+    callback: (
+      state: MqttEventsInterface[MQTT_EVENTS.CONNECTION_STATE_EVENT]
+    ) => void
+  ) {
+    const eventName = this.clientId + MQTT_EVENTS.CONNECTION_STATE_EVENT;
+    const listener = this.eventEmitter.addListener(eventName, callback);
+    return {
+      remove: listener.remove,
+    };
+  }
+
+  /**
+   * Method to retrieve a snapshot of the native metrics of this client: message and byte counters, per-topic rates,
+   * reconnect durations and the latency from receiving a message to its listener being called.
+   * @returns The metrics, or undefined when the native module or client does not provide them.
+   */
+  getMetrics(): MqttMetrics | undefined {
+    return MqttJSIModule.getMetrics?.(this.clientId);
+  }
+
+  /**
+   * Method to retrieve the state of the flow control of received messages: the messages waiting in the native core
+   * and on the JS thread, the QoS 1/2 messages not yet acknowledged and the QoS 0 messages dropped.
+   * @returns The state, or undefined when the native module does not provide it.
+   */
+  getDeliveryState(): MqttDeliveryState | undefined {
+    return MqttJSIModule.getDeliveryState?.(this.clientId);
+  }
+
+  /**
+   * Method to read the last payload received on a topic from the last value cache (see the lastValueCache option),
+   * including one received in an earlier run of the app, to render a screen before the broker sends anything.
+   * @param topic The topic, without wildcards.
+   * @param payloadFormat The format of the returned payload, STRING by default.
+   * @returns The value, or undefined when there is no cache, no unexpired value of the topic or no native support.
+   */
+  getLastValue<Payload = string>(
+    topic: string,
+    payloadFormat: MqttPayloadFormat = MqttPayloadFormat.STRING
+  ): MqttLastValue<Payload> | undefined {
+    return MqttJSIModule.getLastValue?.(
+      this.clientId,
+      topic,
+      payloadFormat
+    ) as MqttLastValue<Payload> | undefined;
+  }
+
+  /**
+   * Method to register a preset dictionary for compressed payloads. Messages published with the user property
+   * `content-encoding: deflate` (or `gzip`) are decompressed natively before they reach the listeners; deflate
+   * payloads compressed with a dictionary need that dictionary registered here first.
+   * @param dictionary The dictionary the publisher compresses with, as a string or its bytes.
+   */
+  addCompressionDictionary(dictionary: string | ArrayBuffer) {
+    MqttJSIModule.addCompressionDictionary?.(this.clientId, dictionary);
   }
 
   /**
    * Retrieves the current retry count for MQTT connection attempts.
-   * This method returns the number of times the client has attempted to reconnect to the MQTT broker.
+   * This method returns the number of times the client has attempted to reconnect to the MQTT broker. When the native
+   * core reconnects, this is its count of failed attempts since the last successful connect.
    * @returns The current retry count as a number.
    */
 
   getCurrentRetryCount() {
+    if (this.nativeReconnect) {
+      return this.getConnectionState()?.retryCount ?? this.currentRetryCount;
+    }
     return this.currentRetryCount;
   }
 }
@@ -22,3 +22,50 @@ describe('EventEmitter', () => {
     expect(secondInstance).toBe(firstInstance);
   });
 });
+
+describe('JSIEventEmitter', () => {
+  const addEventListener = jest.fn();
+  const removeEventListener = jest.fn();
+
+  beforeEach(() => {
+    jest.clearAllMocks();
+    jest.doMock('../Modules/mqttModule', () => ({
+      MqttModule: {},
+      MqttJSIModule: { addEventListener, removeEventListener },
+    }));
+  });
+
+  it('should use the JSI dispatcher when it is installed', () => {
+    const { EventEmitter: JSIBackedEmitter, JSIEventEmitter } =
+      require('../Mqtt/EventEmitter');
+    expect(JSIBackedEmitter.getInstance()).toBeInstanceOf(JSIEventEmitter);
+  });
+
+  it('should register one native listener per event and fan out to all JS listeners', () => {
+    const { JSIEventEmitter } = require('../Mqtt/EventEmitter');
+    const emitter = new JSIEventEmitter();
+    const first = jest.fn();
+    const second = jest.fn();
+    emitter.addListener('event', first);
+    emitter.addListener('event', second);
+    expect(addEventListener).toHaveBeenCalledTimes(1);
+
+    const nativeCallback = addEventListener.mock.calls[0][1];
+    nativeCallback({ payload: 'data' });
+    expect(first).toHaveBeenCalledWith({ payload: 'data' });
+    expect(second).toHaveBeenCalledWith({ payload: 'data' });
+  });
+
+  it('should drop the native listener once the last JS listener is removed', () => {
+    const { JSIEventEmitter } = require('../Mqtt/EventEmitter');
+    const emitter = new JSIEventEmitter();
+    const first = emitter.addListener('event', jest.fn());
+    const second = emitter.addListener('event', jest.fn());
+
+    first.remove();
+    expect(removeEventListener).not.toHaveBeenCalled();
+    second.remove();
+    expect(removeEventListener).toHaveBeenCalledWith('event');
+    expect(emitter.listenerCount('event')).toBe(0);
+  });
+});
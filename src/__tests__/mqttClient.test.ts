@@ -1,7 +1,12 @@
 import { MqttClient } from '../Mqtt/MqttClient';
 import { MqttJSIModule } from '../Modules/mqttModule';
 import { EventEmitter } from '../Mqtt/EventEmitter';
-import { CONNECTION_STATE, MQTT_EVENTS } from '../Mqtt/MqttClient.constants';
+import {
+  CONNECTION_STATE,
+  MQTT_EVENTS,
+  MqttEngine,
+  MqttPayloadFormat,
+} from '../Mqtt/MqttClient.constants';
 import { NativeModules } from 'react-native';
 const { MqttModule } = NativeModules;
 
@@ -60,6 +65,100 @@ describe('MqttClient', () => {
     );
   });
 
+  it('should create the client on the native engine when selected', () => {
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+    });
+    expect(MqttJSIModule.createNativeMqtt).toHaveBeenCalledWith(
+      clientId,
+      host,
+      port,
+      false,
+      0,
+      false,
+      false
+    );
+    expect(MqttModule.createMqtt).toBeCalledTimes(0);
+  });
+
+  it('should ask the native engine to share the connection', () => {
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+      shareConnection: true,
+    });
+    expect(MqttJSIModule.createNativeMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      host,
+      port,
+      false,
+      0,
+      true,
+      false
+    );
+  });
+
+  it('should ask the native engine to warm start the client', () => {
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+      warmStart: true,
+    });
+    expect(MqttJSIModule.createNativeMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      host,
+      port,
+      false,
+      0,
+      false,
+      true
+    );
+  });
+
+  it('should warn that native engine options are ignored by the platform engine', () => {
+    const warn = jest.spyOn(console, 'warn').mockImplementation(() => {});
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      enableSslConfig: true,
+      shareConnection: true,
+    });
+    expect(warn).toHaveBeenCalledTimes(1);
+    expect(MqttJSIModule.createNativeMqtt).toBeCalledTimes(0);
+    warn.mockRestore();
+  });
+
+  it('should open an outbound store when persistence is enabled', () => {
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+      persistence: {},
+    });
+    expect(MqttJSIModule.createNativeMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      host,
+      port,
+      false,
+      4 * 1024 * 1024,
+      false,
+      false
+    );
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+      persistence: { maxBytes: 65536 },
+    });
+    expect(MqttJSIModule.createNativeMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      host,
+      port,
+      false,
+      65536,
+      false,
+      false
+    );
+  });
+
   it('should connect to MQTT client', () => {
     let client;
     client = new MqttClient(clientId, host, port, clientConfig);
@@ -72,6 +171,20 @@ describe('MqttClient', () => {
     });
   });
 
+  it('should connect without a clean session when asked to', () => {
+    const client = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      cleanSession: false,
+    });
+    client.connect();
+    expect(MqttJSIModule.connectMqtt).toHaveBeenLastCalledWith(clientId, {
+      cleanSession: false,
+      keepAlive: 60,
+      password: '',
+      username: '',
+    });
+  });
+
   it('should reset MQTT client options', () => {
     let client;
     client = new MqttClient(clientId, host, port, clientConfig);
@@ -145,6 +258,76 @@ describe('MqttClient', () => {
     });
   });
 
+  describe('Native reconnect', () => {
+    beforeEach(() => {
+      jest.useFakeTimers();
+      MqttJSIModule.setReconnectPolicy = jest.fn();
+    });
+    afterEach(() => {
+      jest.clearAllTimers();
+      delete (MqttJSIModule as Partial<typeof MqttJSIModule>)
+        .setReconnectPolicy;
+    });
+
+    test('Should hand backoff and retries to the native layer', () => {
+      const client = new MqttClient(clientId, host, port, {
+        ...clientConfig,
+        autoReconnect: true,
+        retryCount: 3,
+      });
+      client.connect();
+
+      expect(MqttJSIModule.setReconnectPolicy).toHaveBeenLastCalledWith(
+        clientId,
+        {
+          enabled: true,
+          maxRetries: 3,
+          backoffMs: 100,
+          maxBackoffMs: 100000,
+          jitterMs: 1,
+          refreshCredentials: true,
+        }
+      );
+      expect(MqttJSIModule.connectMqtt).toHaveBeenLastCalledWith(clientId, {
+        cleanSession: true,
+        keepAlive: 60,
+        password: '',
+        username: '',
+      });
+      expect(jest.getTimerCount()).toBe(0);
+    });
+
+    test('Should ask the reconnect interceptor only for credentials', async () => {
+      const addListener = EventEmitter.getInstance().addListener as jest.Mock;
+      addListener.mockClear();
+      const client = new MqttClient(clientId, host, port, {
+        ...clientConfig,
+        autoReconnect: true,
+      });
+      const events = addListener.mock.calls.map((call) => call[0]);
+      expect(events).toContain(
+        clientId + MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT
+      );
+      expect(events).not.toContain(clientId + MQTT_EVENTS.DISCONNECTED_EVENT);
+
+      const interceptor = jest.fn(async () => ({ password: 'fresh token' }));
+      client.setOnReconnectIntercepter(interceptor);
+      const onCredentialsRequired = addListener.mock.calls.find(
+        (call) =>
+          call[0] === clientId + MQTT_EVENTS.CREDENTIALS_REQUIRED_EVENT
+      )[1];
+      await onCredentialsRequired({ reasonCode: 135, retryCount: 1 });
+
+      expect(interceptor).toHaveBeenCalledWith(135);
+      expect(MqttJSIModule.connectMqtt).toHaveBeenLastCalledWith(clientId, {
+        cleanSession: true,
+        keepAlive: 60,
+        password: 'fresh token',
+        username: '',
+      });
+    });
+  });
+
   describe('MqttClient disconnect and remove', () => {
     let client;
 
@@ -163,7 +346,7 @@ describe('MqttClient', () => {
       expect(MqttJSIModule.removeMqtt).toHaveBeenCalledWith('client1');
       expect(
         EventEmitter.getInstance().removeAllListeners
-      ).toHaveBeenCalledTimes(4);
+      ).toHaveBeenCalledTimes(5);
     });
   });
 
@@ -179,18 +362,444 @@ describe('MqttClient', () => {
       expect.any(String),
       clientId,
       topic,
-      qos
+      qos,
+      false,
+      undefined
     );
     expect(EventEmitter.getInstance().addListener).toHaveBeenCalledTimes(4);
     expect(subscription.remove).toBeDefined();
   });
 
+  it('should configure native batching before subscribing with batch options', () => {
+    const setEventBatching = jest.fn();
+    MqttJSIModule.setEventBatching = setEventBatching;
+    const onBatch = jest.fn();
+
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.subscribe({
+      topic: 'test-topic',
+      onEvent: jest.fn(),
+      batch: { maxDelayMs: 50 },
+      onBatch,
+    });
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    expect(setEventBatching).toHaveBeenCalledWith(
+      subscribeMqtt.mock.calls[0][0],
+      100,
+      50
+    );
+    expect(setEventBatching.mock.invocationCallOrder[0]).toBeLessThan(
+      subscribeMqtt.mock.invocationCallOrder[0]
+    );
+    delete (MqttJSIModule as Partial<typeof MqttJSIModule>).setEventBatching;
+  });
+
+  it('should select the ArrayBuffer payload format before subscribing', () => {
+    const setPayloadFormat = jest.fn();
+    MqttJSIModule.setPayloadFormat = setPayloadFormat;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.subscribe<ArrayBuffer>({
+      topic: 'binary/#',
+      payloadFormat: MqttPayloadFormat.ARRAY_BUFFER,
+      onEvent: jest.fn(),
+    });
+
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    const last = subscribeMqtt.mock.calls.length - 1;
+    expect(setPayloadFormat).toHaveBeenCalledWith(
+      subscribeMqtt.mock.calls[last][0],
+      'arraybuffer'
+    );
+    expect(setPayloadFormat.mock.invocationCallOrder[0]).toBeLessThan(
+      subscribeMqtt.mock.invocationCallOrder[last]
+    );
+    delete (MqttJSIModule as Partial<typeof MqttJSIModule>).setPayloadFormat;
+  });
+
+  it('should parse JSON payloads natively when selected', () => {
+    const setPayloadFormat = jest.fn();
+    MqttJSIModule.setPayloadFormat = setPayloadFormat;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.subscribe<{ runs: number }>({
+      topic: 'scores/#',
+      payloadFormat: MqttPayloadFormat.JSON,
+      onEvent: jest.fn(),
+    });
+    mqttClient.subscribe({
+      topic: 'text/#',
+      payloadFormat: MqttPayloadFormat.STRING,
+      onEvent: jest.fn(),
+    });
+
+    expect(setPayloadFormat).toHaveBeenCalledTimes(1);
+    expect(setPayloadFormat).toHaveBeenCalledWith(
+      expect.stringContaining('scores/#'),
+      'json'
+    );
+    delete (MqttJSIModule as Partial<typeof MqttJSIModule>).setPayloadFormat;
+  });
+
+  it('should enable conflation natively and report dropped messages', () => {
+    const setConflation = jest.fn();
+    const getDroppedMessageCount = jest.fn(() => 7);
+    MqttJSIModule.setConflation = setConflation;
+    MqttJSIModule.getDroppedMessageCount = getDroppedMessageCount;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const subscription = mqttClient.subscribe({
+      topic: 'odds/#',
+      conflate: true,
+      onEvent: jest.fn(),
+    });
+    mqttClient.subscribe({ topic: 'chat/#', onEvent: jest.fn() });
+
+    expect(setConflation).toHaveBeenCalledTimes(1);
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    const conflated = subscribeMqtt.mock.calls.length - 2;
+    expect(setConflation).toHaveBeenCalledWith(
+      subscribeMqtt.mock.calls[conflated][0],
+      true
+    );
+    expect(setConflation.mock.invocationCallOrder[0]).toBeLessThan(
+      subscribeMqtt.mock.invocationCallOrder[conflated]
+    );
+    expect(subscription.getDroppedMessageCount()).toBe(7);
+    delete (MqttJSIModule as Partial<typeof MqttJSIModule>).setConflation;
+    delete (MqttJSIModule as Partial<typeof MqttJSIModule>)
+      .getDroppedMessageCount;
+  });
+
+  it('should read metrics from the native core', () => {
+    const metrics = { messagesIn: 3, bytesIn: 12 };
+    const getMetrics = jest.fn().mockReturnValue(metrics);
+    MqttJSIModule.getMetrics = getMetrics;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+
+    expect(mqttClient.getMetrics()).toBe(metrics);
+    expect(getMetrics).toHaveBeenCalledWith(clientId);
+    delete MqttJSIModule.getMetrics;
+    expect(mqttClient.getMetrics()).toBeUndefined();
+  });
+
+  it('should configure flow control before connecting', () => {
+    const setFlowControl = jest.fn();
+    const state = { queued: 2, dropped: 1 };
+    MqttJSIModule.setFlowControl = setFlowControl;
+    MqttJSIModule.getDeliveryState = jest.fn().mockReturnValue(state);
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      flowControl: { highWaterMark: 64, receiveMaximum: 16 },
+    });
+    mqttClient.connect();
+
+    const connectMqtt = MqttJSIModule.connectMqtt as jest.Mock;
+    expect(setFlowControl).toHaveBeenCalledWith(clientId, {
+      highWaterMark: 64,
+      dropPolicy: 'oldest',
+    });
+    expect(setFlowControl.mock.invocationCallOrder[0]).toBeLessThan(
+      connectMqtt.mock.invocationCallOrder[
+        connectMqtt.mock.invocationCallOrder.length - 1
+      ]
+    );
+    expect(MqttJSIModule.connectMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      expect.objectContaining({ receiveMaximum: 16 })
+    );
+    expect(mqttClient.getDeliveryState()).toBe(state);
+    delete MqttJSIModule.setFlowControl;
+    delete MqttJSIModule.getDeliveryState;
+  });
+
+  it('should register compression dictionaries with the native client', () => {
+    const addCompressionDictionary = jest.fn();
+    MqttJSIModule.addCompressionDictionary = addCompressionDictionary;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const bytes = new ArrayBuffer(4);
+    mqttClient.addCompressionDictionary('{"score":');
+    mqttClient.addCompressionDictionary(bytes);
+
+    expect(addCompressionDictionary).toHaveBeenNthCalledWith(
+      1,
+      clientId,
+      '{"score":'
+    );
+    expect(addCompressionDictionary).toHaveBeenNthCalledWith(
+      2,
+      clientId,
+      bytes
+    );
+    delete MqttJSIModule.addCompressionDictionary;
+  });
+
+  it('should open the last value cache and read from it', () => {
+    const setLastValueCache = jest.fn();
+    const value = { topic: 'score/1', payload: { home: 2 }, qos: 1 };
+    const getLastValue = jest.fn().mockReturnValue(value);
+    MqttJSIModule.setLastValueCache = setLastValueCache;
+    MqttJSIModule.getLastValue = getLastValue;
+    mqttClient = new MqttClient(clientId, host, port, {
+      ...clientConfig,
+      engine: MqttEngine.NATIVE,
+      lastValueCache: { ttlMs: 60000 },
+    });
+
+    expect(setLastValueCache).toHaveBeenCalledWith(clientId, {
+      maxBytes: 1024 * 1024,
+      ttlMs: 60000,
+    });
+    expect(mqttClient.getLastValue('score/1', MqttPayloadFormat.JSON)).toBe(
+      value
+    );
+    expect(getLastValue).toHaveBeenCalledWith(clientId, 'score/1', 'json');
+    mqttClient.subscribe({
+      topic: 'score/+',
+      onEvent: jest.fn(),
+      replayLastValue: true,
+    });
+    expect(MqttJSIModule.subscribeMqtt).toHaveBeenLastCalledWith(
+      expect.stringContaining('#subscribe_mqtt#score/+#1#'),
+      clientId,
+      'score/+',
+      1,
+      true,
+      undefined
+    );
+    delete MqttJSIModule.setLastValueCache;
+    delete MqttJSIModule.getLastValue;
+    expect(mqttClient.getLastValue('score/1')).toBeUndefined();
+  });
+
+  it('should pass subscription filters to the native layer', () => {
+    const getFilterStats = jest.fn(() => ({ passed: 3, dropped: 5 }));
+    MqttJSIModule.getFilterStats = getFilterStats;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const filter = [
+      { topicSegment: 1, in: ['ind', 'aus'] },
+      { jsonField: 'version', increases: true },
+    ];
+    const subscription = mqttClient.subscribe({
+      topic: 'score/#',
+      onEvent: jest.fn(),
+      filter,
+    });
+
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    const [eventId] =
+      subscribeMqtt.mock.calls[subscribeMqtt.mock.calls.length - 1];
+    expect(subscribeMqtt).toHaveBeenLastCalledWith(
+      eventId,
+      clientId,
+      'score/#',
+      1,
+      false,
+      filter
+    );
+    expect(subscription.getFilterStats()).toEqual({ passed: 3, dropped: 5 });
+    expect(getFilterStats).toHaveBeenCalledWith(clientId, eventId);
+    delete MqttJSIModule.getFilterStats;
+    expect(subscription.getFilterStats()).toBeUndefined();
+  });
+
+  it('should not listen for a subscription with a malformed filter', () => {
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    subscribeMqtt.mockImplementationOnce(() => {
+      throw new Error(
+        'subscribeMqtt: invalid filter: a condition must have an operator'
+      );
+    });
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const addListener = EventEmitter.getInstance().addListener as jest.Mock;
+    const { remove } = addListener.mock.results[0].value;
+    const removed = remove.mock.calls.length;
+
+    expect(() =>
+      mqttClient.subscribe({
+        topic: 'score/#',
+        onEvent: jest.fn(),
+        filter: [{ jsonField: 'team' }],
+      })
+    ).toThrow('a condition must have an operator');
+    expect(remove.mock.calls.length).toBeGreaterThan(removed);
+  });
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const addListener = EventEmitter.getInstance().addListener as jest.Mock;
+    const listeners = addListener.mock.results.length;
+
+    expect(() =>
+      mqttClient.subscribe({
+        topic: 'score/#',
+        onEvent: jest.fn(),
+        filter: [{ jsonField: 'team', like: 'IN%' } as never],
+      })
+    ).toThrow('unknown filter operator like');
+    const subscribed = addListener.mock.results
+      .slice(listeners)
+      .find((result) => result.value?.remove);
+    expect(subscribed?.value.remove).toHaveBeenCalled();
+  });
+
+  it('should run background subscriptions through the native handler', () => {
+    const setBackgroundHandler = jest.fn().mockReturnValue(true);
+    const removeBackgroundHandler = jest.fn();
+    MqttJSIModule.setBackgroundHandler = setBackgroundHandler;
+    MqttJSIModule.removeBackgroundHandler = removeBackgroundHandler;
+    const handler = '(message) => message.payload.length';
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const subscription = mqttClient.subscribeInBackground({
+      topic: 'score/#',
+      payloadFormat: MqttPayloadFormat.JSON,
+      handler,
+      onResult: jest.fn(),
+    });
+
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    const [eventId] = setBackgroundHandler.mock.calls[0];
+    expect(setBackgroundHandler).toHaveBeenCalledWith(
+      expect.stringContaining('#subscribe_mqtt#score/##1#'),
+      handler,
+      'json'
+    );
+    expect(subscribeMqtt).toHaveBeenLastCalledWith(
+      eventId,
+      clientId,
+      'score/#',
+      1
+    );
+    expect(setBackgroundHandler.mock.invocationCallOrder[0]).toBeLessThan(
+      subscribeMqtt.mock.invocationCallOrder[
+        subscribeMqtt.mock.invocationCallOrder.length - 1
+      ]
+    );
+    subscription.remove();
+    expect(removeBackgroundHandler).toHaveBeenCalledWith(eventId);
+    expect(MqttJSIModule.unsubscribeMqtt).toHaveBeenLastCalledWith(
+      eventId,
+      clientId,
+      'score/#'
+    );
+    delete MqttJSIModule.setBackgroundHandler;
+    delete MqttJSIModule.removeBackgroundHandler;
+  });
+
+  it('should report background subscriptions without a background runtime', () => {
+    const onError = jest.fn();
+    const subscribeMqtt = MqttJSIModule.subscribeMqtt as jest.Mock;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const calls = subscribeMqtt.mock.calls.length;
+    mqttClient.subscribeInBackground({
+      topic: 'score/#',
+      handler: '(message) => message',
+      onResult: jest.fn(),
+      onError,
+    });
+    expect(onError).toHaveBeenLastCalledWith({
+      errorMessage: 'No background JS runtime available',
+    });
+    expect(subscribeMqtt.mock.calls.length).toBe(calls);
+  });
+
+  it('should deliver batches of one when native batching is unavailable', () => {
+    const onBatch = jest.fn();
+
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.subscribe({
+      topic: 'test-topic',
+      onEvent: jest.fn(),
+      batch: {},
+      onBatch,
+    });
+    expect(onBatch).toHaveBeenCalledWith([{ reasonCode: 100 }]);
+  });
+
+  it('should publish a string payload with default qos and retain', () => {
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.publish({ topic: 'test-topic', payload: 'hello' });
+    expect(MqttJSIModule.publishMqtt).toHaveBeenCalledWith(
+      clientId,
+      'test-topic',
+      'hello',
+      0,
+      false
+    );
+  });
+
+  it('should publish an ArrayBuffer payload as is', () => {
+    const payload = new Uint8Array([0, 255, 16]).buffer;
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.publish({ topic: 'test-topic', payload, qos: 1, retain: true });
+    expect(MqttJSIModule.publishMqtt).toHaveBeenCalledWith(
+      clientId,
+      'test-topic',
+      payload,
+      1,
+      true
+    );
+  });
+
+  it('should publish a batch of messages in one native call', () => {
+    const messages = [
+      { topic: 'telemetry/speed', payload: '42' },
+      { topic: 'telemetry/heading', payload: '270', qos: 1 },
+    ];
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.publishMany(messages);
+    expect(MqttJSIModule.publishManyMqtt).toHaveBeenCalledWith(
+      clientId,
+      messages
+    );
+  });
+
+  it('should publish a batch one by one without native batching', () => {
+    const publishManyMqtt = MqttJSIModule.publishManyMqtt;
+    delete MqttJSIModule.publishManyMqtt;
+    (MqttJSIModule.publishMqtt as jest.Mock).mockClear();
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    mqttClient.publishMany([
+      { topic: 'telemetry/speed', payload: '42' },
+      { topic: 'telemetry/heading', payload: '270', qos: 1, retain: true },
+    ]);
+    expect(MqttJSIModule.publishMqtt).toHaveBeenCalledTimes(2);
+    expect(MqttJSIModule.publishMqtt).toHaveBeenLastCalledWith(
+      clientId,
+      'telemetry/heading',
+      '270',
+      1,
+      true
+    );
+    MqttJSIModule.publishManyMqtt = publishManyMqtt;
+  });
+
   it('should get connection status', () => {
     mqttClient = new MqttClient(clientId, host, port, clientConfig);
     const status = mqttClient.getConnectionStatus();
     expect(status).toBe(CONNECTION_STATE.CONNECTED);
   });
 
+  it('should read the connection status from the native state object', () => {
+    const connectionState = {
+      state: CONNECTION_STATE.CONNECTING,
+      lastReasonCode: 0,
+      retryCount: 2,
+      lastConnectedAt: 0,
+    };
+    (MqttJSIModule.getConnectionStateMqtt as jest.Mock).mockReturnValueOnce(
+      connectionState
+    );
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    expect(mqttClient.getConnectionStatus()).toBe(CONNECTION_STATE.CONNECTING);
+    expect(mqttClient.getConnectionState()).toBe(connectionState);
+  });
+
+  it('should listen to connection state changes', () => {
+    mqttClient = new MqttClient(clientId, host, port, clientConfig);
+    const callback = jest.fn();
+    mqttClient.setOnConnectionStateChange(callback);
+    expect(EventEmitter.getInstance().addListener).toHaveBeenCalledWith(
+      clientId + MQTT_EVENTS.CONNECTION_STATE_EVENT,
+      callback
+    );
+  });
+
   it('should get retry count', () => {
     mqttClient = new MqttClient(clientId, host, port, clientConfig);
     const status = mqttClient.getCurrentRetryCount();